@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "benchmark.h"
+
+#include <turbomath/turbomath.h>
+
+namespace rosflight_firmware
+{
+
+// The kernels, named after their test/benchmarks.cpp counterparts (within the 10 characters of a named value)
+enum : uint8_t
+{
+  KERNEL_PID,         // BM_ControllerPID/0
+  KERNEL_PID_LPF,     // BM_ControllerPID/100
+  KERNEL_MIXER,       // BM_MixerMixOutput
+  KERNEL_STREAM,      // BM_MavlinkStream
+  KERNEL_BIQUAD,      // BM_BiquadApply
+  KERNEL_SIN_TABLE,   // BM_Sin<...>
+  KERNEL_SIN_FINE,
+  KERNEL_SIN_POLY,
+  KERNEL_ASIN_TABLE,  // BM_Asin<...>
+  KERNEL_ASIN_FINE,
+  KERNEL_ASIN_POLY,
+  KERNEL_ATAN2_TABLE, // BM_Atan2<...>
+  KERNEL_ATAN2_FINE,
+  KERNEL_ATAN2_POLY,
+  KERNEL_INV_SQRT,    // BM_InvSqrt
+  KERNEL_COUNT
+};
+
+static const char *const kernel_names[KERNEL_COUNT] = {
+  "pid", "pid_lpf", "mixer", "ml_stream", "biquad",
+  "sin_tab", "sin_fine", "sin_poly", "asin_tab", "asin_fine", "asin_poly", "atan2_tab", "atan2_fine", "atan2_poly",
+  "inv_sqrt"
+};
+
+// Inputs spread over [-scale, scale], the same as the host benchmarks use
+static float input(uint16_t i, float scale)
+{
+  return scale*(static_cast<float>((i*37u) % 256u)/128.0f - 1.0f);
+}
+
+Benchmark::Benchmark(ROSflight& rf) :
+  RF_(rf)
+{}
+
+void Benchmark::init()
+{
+  const float kp[3] = {0.3f, 0.3f, 0.2f};
+  const float ki[3] = {0.1f, 0.1f, 0.05f};
+  const float kd[3] = {0.05f, 0.05f, 0.0f};
+  const float kff[3] = {0.0f, 0.0f, 0.0f};
+  pid_.init(kp, ki, kd, kff, 1.0f, 0.05f, 0.0f);
+  pid_lpf_.init(kp, ki, kd, kff, 1.0f, 0.05f, 0.0f);
+  pid_lpf_.set_dterm_lowpass(1000.0f, 100.0f);
+  biquad_.set_lowpass(1000.0f, 100.0f);
+
+  next_run_ms_ = RF_.board_.clock_millis();
+  next_kernel_ = 0;
+}
+
+void Benchmark::run()
+{
+  uint32_t now_ms = RF_.board_.clock_millis();
+  if (now_ms < next_run_ms_)
+    return;
+  next_run_ms_ = now_ms + PERIOD_MS;
+
+  uint32_t cycles = time_kernel(next_kernel_);
+  RF_.mavlink_.send_named_value_int(kernel_names[next_kernel_], static_cast<int32_t>(cycles));
+  next_kernel_ = static_cast<uint8_t>((next_kernel_ + 1) % KERNEL_COUNT);
+}
+
+uint32_t Benchmark::time_kernel(uint8_t kernel)
+{
+  static const bool active[3] = {true, true, true};
+  static const float x_c[3] = {0.1f, -0.1f, 0.0f};
+  volatile float sink = 0.0f;
+
+  uint32_t start = RF_.board_.clock_cycles();
+  for (uint16_t i = 0; i < ITERATIONS; i++)
+  {
+    switch (kernel)
+    {
+    case KERNEL_PID:
+    case KERNEL_PID_LPF:
+    {
+      const float x[3] = {input(i, 0.2f), input(i + 1, 0.2f), input(i + 2, 0.2f)};
+      float u[3];
+      (kernel == KERNEL_PID ? pid_ : pid_lpf_).run(0.001f, x, x_c, active, true, u);
+      sink = u[0];
+      break;
+    }
+    case KERNEL_MIXER:
+      RF_.mixer_.mix_output();
+      break;
+    case KERNEL_STREAM:
+      RF_.mavlink_.stream();
+      break;
+    case KERNEL_BIQUAD:
+      sink = biquad_.apply(turbomath::Vector(input(i, 1.0f), input(i + 1, 1.0f), input(i + 2, 1.0f))).x;
+      break;
+    case KERNEL_SIN_TABLE:
+      sink = turbomath::sin<turbomath::PRECISION_TABLE>(input(i, 3.14159265f));
+      break;
+    case KERNEL_SIN_FINE:
+      sink = turbomath::sin<turbomath::PRECISION_FINE_TABLE>(input(i, 3.14159265f));
+      break;
+    case KERNEL_SIN_POLY:
+      sink = turbomath::sin<turbomath::PRECISION_POLYNOMIAL>(input(i, 3.14159265f));
+      break;
+    case KERNEL_ASIN_TABLE:
+      sink = turbomath::asin<turbomath::PRECISION_TABLE>(input(i, 0.99f));
+      break;
+    case KERNEL_ASIN_FINE:
+      sink = turbomath::asin<turbomath::PRECISION_FINE_TABLE>(input(i, 0.99f));
+      break;
+    case KERNEL_ASIN_POLY:
+      sink = turbomath::asin<turbomath::PRECISION_POLYNOMIAL>(input(i, 0.99f));
+      break;
+    case KERNEL_ATAN2_TABLE:
+      sink = turbomath::atan2<turbomath::PRECISION_TABLE>(input(i, 1.0f), input(i + 17, 1.0f));
+      break;
+    case KERNEL_ATAN2_FINE:
+      sink = turbomath::atan2<turbomath::PRECISION_FINE_TABLE>(input(i, 1.0f), input(i + 17, 1.0f));
+      break;
+    case KERNEL_ATAN2_POLY:
+      sink = turbomath::atan2<turbomath::PRECISION_POLYNOMIAL>(input(i, 1.0f), input(i + 17, 1.0f));
+      break;
+    case KERNEL_INV_SQRT:
+    default:
+      sink = turbomath::inv_sqrt(1.5f + input(i, 1.0f));
+      break;
+    }
+  }
+  (void) sink;
+
+  // the switch and the input generation are included, which is a few cycles on every kernel
+  return (RF_.board_.clock_cycles() - start)/ITERATIONS;
+}
+
+} // namespace rosflight_firmware
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_NAZE_BENCHMARK_H
+#define ROSFLIGHT_FIRMWARE_NAZE_BENCHMARK_H
+
+#include <stdint.h>
+
+#include "controller.h"
+#include "filter.h"
+#include "rosflight.h"
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief On-target counterpart of test/benchmarks.cpp, built with make BENCHMARK=1
+ *
+ * Times the hot path kernels with the board's cycle counter (DWT CYCCNT) and sends the cycles per call of
+ * each as a MAVLink named value. One kernel is timed per call of run() that is due, so that the main loop
+ * is never held up for more than a few ms.
+ */
+class Benchmark
+{
+public:
+  static constexpr uint32_t PERIOD_MS = 100;
+  static constexpr uint16_t ITERATIONS = 200;
+
+  Benchmark(ROSflight& rf);
+
+  void init();
+  void run();
+
+private:
+  ROSflight& RF_;
+  uint32_t next_run_ms_;
+  uint8_t next_kernel_;
+
+  Controller::PID pid_;
+  Controller::PID pid_lpf_;
+  Biquad biquad_;
+
+  uint32_t time_kernel(uint8_t kernel);
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_NAZE_BENCHMARK_H
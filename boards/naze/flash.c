@@ -40,47 +40,55 @@ void initEEPROM(void)
   // ct_assert(sizeof(_params) < CONFIG_SIZE);
 }
 
-static uint8_t compute_checksum(const void * addr, size_t len)
+static uint32_t sector_address(uint8_t sector, uint32_t offset)
 {
-  const uint8_t *p;
-  uint8_t chk = 0;
-
-  for (p = (const uint8_t *)addr; p < ((const uint8_t *)addr + len); p++)
-    chk ^= *p;
-
-  return chk;
+  return FLASH_WRITE_ADDR + sector * FLASH_SECTOR_SIZE + offset;
 }
 
-bool readEEPROM(void * dest, size_t len)
+bool eraseEEPROMSector(uint8_t sector)
 {
-  memcpy(dest, (char *)FLASH_WRITE_ADDR, len);
-  return true;
-}
+  FLASH_Status status = FLASH_COMPLETE;
 
-bool writeEEPROM(const void * src, size_t len)
-{
-  FLASH_Status status;
+  if (sector >= NUM_SECTORS)
+    return false;
 
-  // write it
   FLASH_Unlock();
   for (unsigned int tries = 3; tries; tries--)
   {
     FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
 
-    for(int i = 0; i < NUM_PAGES; i++)
-      status = FLASH_ErasePage(FLASH_WRITE_ADDR + i * FLASH_PAGE_SIZE);
-
-    for (unsigned int i = 0; i < len && status == FLASH_COMPLETE; i += 4)
-      status = FLASH_ProgramWord(FLASH_WRITE_ADDR + i, *(uint32_t *)((char *)src + i));
+    status = FLASH_COMPLETE;
+    for (int i = 0; i < PAGES_PER_SECTOR && status == FLASH_COMPLETE; i++)
+      status = FLASH_ErasePage(sector_address(sector, i * FLASH_PAGE_SIZE));
 
-    if(status == FLASH_COMPLETE)
+    if (status == FLASH_COMPLETE)
       break;
   }
   FLASH_Lock();
 
-  // Flash write failed - just die now
-  if (status != FLASH_COMPLETE || compute_checksum(src, len) != compute_checksum((uint32_t*)FLASH_WRITE_ADDR, len))
+  return status == FLASH_COMPLETE;
+}
+
+uint32_t readEEPROMWord(uint8_t sector, uint32_t offset)
+{
+  if (sector >= NUM_SECTORS || offset + 4 > FLASH_SECTOR_SIZE)
+    return 0xFFFFFFFF;
+
+  return *(volatile uint32_t *)sector_address(sector, offset);
+}
+
+bool writeEEPROMWord(uint8_t sector, uint32_t offset, uint32_t word)
+{
+  FLASH_Status status;
+
+  if (sector >= NUM_SECTORS || offset + 4 > FLASH_SECTOR_SIZE)
     return false;
 
-  return true;
+  // a word can only be programmed once after an erase, so a failed write is not retried here
+  FLASH_Unlock();
+  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+  status = FLASH_ProgramWord(sector_address(sector, offset), word);
+  FLASH_Lock();
+
+  return status == FLASH_COMPLETE && readEEPROMWord(sector, offset) == word;
 }
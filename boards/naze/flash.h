@@ -46,11 +46,22 @@
 #endif
 
 #define FLASH_PAGE_SIZE                 ((uint16_t)0x400)
-#define NUM_PAGES                       3
-// if sizeof(_params) is over this number, compile-time error will occur. so, need to add another page to config data.
-// TODO compile time check is currently disabled
+// the config area is split into two sectors, so one can be erased while the other still holds the params
+#define NUM_SECTORS                     2
+#define PAGES_PER_SECTOR                2
+#define FLASH_SECTOR_SIZE               (FLASH_PAGE_SIZE * PAGES_PER_SECTOR)
+#define NUM_PAGES                       (NUM_SECTORS * PAGES_PER_SECTOR)
 #define CONFIG_SIZE                     (FLASH_PAGE_SIZE * NUM_PAGES)
 
+// The Makefile passes the number of pages the linker keeps the program image out of (config_area.ld), which
+// has to match the config area, or a config save could erase the end of the firmware
+#ifndef CONFIG_PAGES
+#define CONFIG_PAGES 4
+#endif
+#if NUM_PAGES != CONFIG_PAGES
+#error "the config area doesn't match the CONFIG_PAGES reserved by the linker"
+#endif
+
 // static const uint8_t EEPROM_CONF_VERSION = 76;
 //static uint32_t enabledSensors = 0;
 //static void resetConf(void);
@@ -63,17 +74,26 @@ static const uint32_t FLASH_WRITE_ADDR = 0x08000000 + (FLASH_PAGE_SIZE * (FLASH_
 void initEEPROM(void);
 
 /**
- * @brief Read data from Flash
- * @param dest The memory address to copy the data to
- * @param len The number of bytes to copy
- * @returns true if the read was successful, false otherwise
+ * @brief Erase a sector of the config area to all ones
+ * @details This stalls the CPU for the tens of milliseconds the erase takes
+ * @param sector The sector to erase
+ * @returns true if the erase was successful, false otherwise
+ */
+bool eraseEEPROMSector(uint8_t sector);
+
+/**
+ * @brief Read a word from a sector of the config area
+ * @param sector The sector to read from
+ * @param offset The byte offset of the word in the sector, a multiple of 4
+ * @returns The word, or all ones if the address is out of range
  */
-bool readEEPROM(void * dest, size_t len);
+uint32_t readEEPROMWord(uint8_t sector, uint32_t offset);
 
 /**
- * @brief Write data to Flash
- * @param src The memory address to copy data from
- * @param len The number of bytes to copy
- * @returns true if the write was successful, false otherwise
+ * @brief Program a word in an erased part of a sector of the config area
+ * @param sector The sector to write to
+ * @param offset The byte offset of the word in the sector, a multiple of 4
+ * @param word The value to write
+ * @returns true if the word reads back correctly, false otherwise
  */
-bool writeEEPROM(const void * src, size_t len);
+bool writeEEPROMWord(uint8_t sector, uint32_t offset, uint32_t word);
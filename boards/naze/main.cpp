@@ -33,6 +33,10 @@
 #include "rosflight.h"
 //#include "mavlink.h"
 
+#ifdef ROSFLIGHT_BENCHMARK
+#include "benchmark.h"
+#endif
+
 int main(void)
 {
   rosflight_firmware::Naze32 board;
@@ -40,9 +44,17 @@ int main(void)
 
   firmware.init();
 
+#ifdef ROSFLIGHT_BENCHMARK
+  rosflight_firmware::Benchmark benchmark(firmware);
+  benchmark.init();
+#endif
+
   while(1)
   {
     firmware.run();
+#ifdef ROSFLIGHT_BENCHMARK
+    benchmark.run();
+#endif
   }
   return 0;
 }
@@ -32,6 +32,8 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wold-style-cast"
 
+#include <string.h>
+
 extern "C"
 {
 
@@ -46,6 +48,42 @@ extern void SetSysClock(bool overclock);
 
 namespace rosflight_firmware {
 
+// The MPU6050 driver takes a plain C callback, so keep track of which board to hand the samples to
+static Naze32 *imu_board = NULL;
+
+static void imu_data_ready_cb(void)
+{
+  if (imu_board != NULL)
+    imu_board->imu_push_sample();
+}
+
+// Likewise for the UART the SBUS receiver is on
+static Naze32 *rc_board = NULL;
+
+static void sbus_rx_cb(uint16_t data)
+{
+  if (rc_board != NULL)
+    rc_board->rc_push_byte(static_cast<uint8_t>(data & 0xFF));
+}
+
+// Cortex-M3 debug registers. The cycle counter needs trace enabled in DEMCR before DWT will count.
+static volatile uint32_t *const DEMCR = reinterpret_cast<volatile uint32_t *>(0xE000EDFC);
+static volatile uint32_t *const DWT_CTRL = reinterpret_cast<volatile uint32_t *>(0xE0001000);
+static volatile uint32_t *const DWT_CYCCNT = reinterpret_cast<volatile uint32_t *>(0xE0001004);
+static const uint32_t DEMCR_TRCENA = 1u << 24;
+static const uint32_t DWT_CTRL_CYCCNTENA = 1u;
+
+// Commands of the M25P16 (and compatible) SPI flash that rev5 boards carry on SPI2, used for the log storage
+static const uint8_t LOG_FLASH_WRITE_ENABLE = 0x06;
+static const uint8_t LOG_FLASH_READ_STATUS = 0x05;
+static const uint8_t LOG_FLASH_READ = 0x03;
+static const uint8_t LOG_FLASH_PAGE_PROGRAM = 0x02;
+static const uint8_t LOG_FLASH_SECTOR_ERASE = 0xD8;
+static const uint8_t LOG_FLASH_READ_ID = 0x9F;
+static const uint8_t LOG_FLASH_STATUS_BUSY = 0x01; // write in progress
+static const uint32_t LOG_FLASH_PAGE_SIZE = 256;
+static const uint32_t LOG_FLASH_SECTOR_SIZE = 65536;
+
 Naze32::Naze32(){}
 
 void Naze32::init_board(void)
@@ -54,6 +92,13 @@ void Naze32::init_board(void)
   SetSysClock(0);
   systemInit();
   _board_revision = 2;
+
+  // Start the cycle counter
+  *DEMCR |= DEMCR_TRCENA;
+  *DWT_CYCCNT = 0;
+  *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+
+  log_flash_init();
 }
 
 void Naze32::board_reset(bool bootloader)
@@ -78,11 +123,22 @@ void Naze32::clock_delay(uint32_t milliseconds)
   delay(milliseconds);
 }
 
+uint32_t Naze32::clock_cycles()
+{
+  return *DWT_CYCCNT;
+}
+
+uint32_t Naze32::clock_cycles_per_us()
+{
+  return SystemCoreClock/1000000;
+}
+
 // serial
 
 void Naze32::serial_init(uint32_t baud_rate)
 {
   Serial1 = uartOpen(USART1, NULL, baud_rate, MODE_RXTX);
+  _serial_rx_dma_pos = reinterpret_cast<uartPort_t *>(Serial1)->rxDMAPos; // nothing received yet
 }
 
 void Naze32::serial_write(const uint8_t *src, size_t len)
@@ -93,14 +149,70 @@ void Naze32::serial_write(const uint8_t *src, size_t len)
   }
 }
 
+uint16_t Naze32::serial_tx_bytes_free(void)
+{
+  // The UART driver sends its TX buffer out by DMA, so anything that fits in the
+  // buffer is written without waiting on the line
+  uint32_t head = Serial1->txBufferHead;
+  uint32_t tail = Serial1->txBufferTail;
+  uint32_t used = (head >= tail) ? head - tail : Serial1->txBufferSize - tail + head;
+  return Serial1->txBufferSize - used - 1;
+}
+
 uint16_t Naze32::serial_bytes_available(void)
 {
   return serialTotalBytesWaiting(Serial1);
 }
 
-uint8_t Naze32::serial_read(void)
+size_t Naze32::serial_read(uint8_t *dst, size_t max)
+{
+  // USART1 receives by DMA into a circular buffer, so the bytes are copied straight out of it rather than
+  // through a serialRead call each. rxDMAPos counts down from the buffer size to the next byte to read, as
+  // the DMA's CNDTR does to the next byte it will write.
+  uartPort_t *port = reinterpret_cast<uartPort_t *>(Serial1);
+  if (!port->rxDMAChannel)
+  {
+    size_t len = 0;
+    while (len < max && serialTotalBytesWaiting(Serial1))
+      dst[len++] = serialRead(Serial1);
+    return len;
+  }
+
+  uint32_t size = port->port.rxBufferSize;
+  uint32_t dma_pos = port->rxDMAChannel->CNDTR;
+  // The DMA doesn't stop at unread bytes, so the buffer overran if more was received since the last call
+  // than there was room for behind what was still unread then. The bytes left are a mix of old and new,
+  // so they're dropped. (A lap of exactly the whole buffer between calls looks like nothing was received.)
+  uint32_t unread = (port->rxDMAPos - _serial_rx_dma_pos + size) % size;
+  uint32_t received = (_serial_rx_dma_pos - dma_pos + size) % size;
+  _serial_rx_dma_pos = dma_pos;
+  if (unread + received >= size)
+  {
+    _serial_rx_overflows++;
+    port->rxDMAPos = dma_pos;
+    return 0;
+  }
+  uint32_t waiting = unread + received;
+
+  size_t len = (waiting < max) ? waiting : max;
+  for (size_t copied = 0; copied < len;)
+  {
+    uint32_t tail = size - port->rxDMAPos;
+    size_t chunk = size - tail; // up to the end of the buffer
+    if (chunk > len - copied)
+      chunk = len - copied;
+    memcpy(dst + copied, const_cast<const uint8_t *>(port->port.rxBuffer) + tail, chunk);
+    copied += chunk;
+    port->rxDMAPos -= chunk;
+    if (port->rxDMAPos == 0)
+      port->rxDMAPos = size;
+  }
+  return len;
+}
+
+uint32_t Naze32::serial_rx_overflows(void)
 {
-  return serialRead(Serial1);
+  return _serial_rx_overflows;
 }
 
 // sensors
@@ -123,6 +235,10 @@ void Naze32::sensors_init()
   uint16_t acc1G;
   mpu6050_init(true, &acc1G, &_gyro_scale, _board_revision);
   _accel_scale = 9.80665f/acc1G;
+
+  // Queue every sample as soon as the driver has read it out, instead of waiting for the main loop to poll
+  imu_board = this;
+  mpu6050_register_interrupt_cb(&imu_data_ready_cb);
 }
 
 uint16_t Naze32::num_sensor_errors(void)
@@ -130,32 +246,44 @@ uint16_t Naze32::num_sensor_errors(void)
   return i2cGetErrorCounter();
 }
 
-bool Naze32::new_imu_data()
+void Naze32::imu_push_sample()
 {
-  return mpu6050_new_data();
-}
+  if (!mpu6050_new_data())
+    return;
 
-bool Naze32::imu_read(float accel[3], float* temperature, float gyro[3], uint64_t* time_us)
-{
   volatile int16_t gyro_raw[3], accel_raw[3];
   volatile int16_t raw_temp;
-  mpu6050_async_read_all(accel_raw, &raw_temp, gyro_raw, time_us);
+  uint64_t time_us;
+  mpu6050_async_read_all(accel_raw, &raw_temp, gyro_raw, &time_us);
 
-  accel[0] = accel_raw[0] * _accel_scale;
-  accel[1] = -accel_raw[1] * _accel_scale;
-  accel[2] = -accel_raw[2] * _accel_scale;
+  // an all-zero accelerometer reading means the read failed
+  if (accel_raw[0] == 0 && accel_raw[1] == 0 && accel_raw[2] == 0)
+    return;
 
-  gyro[0] = gyro_raw[0] * _gyro_scale;
-  gyro[1] = -gyro_raw[1] * _gyro_scale;
-  gyro[2] = -gyro_raw[2] * _gyro_scale;
+  imu_sample_t sample;
+  sample.accel[0] = accel_raw[0] * _accel_scale;
+  sample.accel[1] = -accel_raw[1] * _accel_scale;
+  sample.accel[2] = -accel_raw[2] * _accel_scale;
 
-  (*temperature) = (float)raw_temp/340.0f + 36.53f;
+  sample.gyro[0] = gyro_raw[0] * _gyro_scale;
+  sample.gyro[1] = -gyro_raw[1] * _gyro_scale;
+  sample.gyro[2] = -gyro_raw[2] * _gyro_scale;
 
-  if (accel[0] == 0 && accel[1] == 0 && accel[2] == 0)
-  {
-    return false;
-  }
-  else return true;
+  sample.temperature = (float)raw_temp/340.0f + 36.53f;
+  sample.time_us = time_us;
+
+  // if the main loop has fallen this far behind, the newest sample is dropped
+  _imu_fifo.push(sample);
+}
+
+uint16_t Naze32::imu_samples_available()
+{
+  return _imu_fifo.size();
+}
+
+bool Naze32::imu_read(imu_sample_t *sample)
+{
+  return _imu_fifo.pop(sample);
 }
 
 void Naze32::imu_not_responding_error(void)
@@ -166,122 +294,551 @@ void Naze32::imu_not_responding_error(void)
   sensors_init();
 }
 
-void Naze32::mag_read(float mag[3])
+void Naze32::sensor_set_callback(sensor_callback_t callback, void *context)
 {
-  // Convert to NED
-  int16_t raw_mag[3];
-  //  hmc5883l_update();
-  hmc5883l_request_async_update();
-  hmc5883l_async_read(raw_mag);
-  mag[0] = (float)raw_mag[0];
-  mag[1] = (float)raw_mag[1];
-  mag[2] = (float)raw_mag[2];
+  _sensor_callback = callback;
+  _sensor_context = context;
 }
 
-bool Naze32::mag_check(void)
+bool Naze32::sensor_request(sensor_id_t sensor)
 {
-  return hmc5883l_present();
+  if (sensor >= SENSOR_COUNT || _sensor_pending[sensor])
+    return false;
+
+  // The drivers' async updates only queue their I2C jobs, which the I2C interrupt works through in the
+  // background. Each driver keeps its latest completed measurement, which sensor_poll() hands on.
+  switch (sensor)
+  {
+  case SENSOR_BARO:
+    ms5611_async_update();
+    break;
+  case SENSOR_DIFF_PRESSURE:
+    ms4525_async_update();
+    break;
+  case SENSOR_SONAR:
+    if (sonar_type != SONAR_PWM)
+      mb1242_async_update();
+    break;
+  case SENSOR_MAG:
+    hmc5883l_request_async_update();
+    break;
+  default:
+    break;
+  }
+  _sensor_pending[sensor] = true;
+  return true;
 }
 
-void Naze32::baro_read(float *pressure, float *temperature)
+void Naze32::sensor_poll(void)
 {
-  ms5611_async_update();
-  ms5611_async_read(pressure, temperature);
+  for (int i = 0; i < SENSOR_COUNT; i++)
+  {
+    if (!_sensor_pending[i])
+      continue;
+    _sensor_pending[i] = false;
+
+    sensor_result_t result = {};
+    result.sensor = static_cast<sensor_id_t>(i);
+    switch (result.sensor)
+    {
+    case SENSOR_BARO:
+      result.present = ms5611_present();
+      ms5611_async_read(&result.value[0], &result.temperature);
+      break;
+    case SENSOR_DIFF_PRESSURE:
+      result.present = ms4525_present();
+      ms4525_async_read(&result.value[0], &result.temperature);
+      break;
+    case SENSOR_SONAR:
+      if (sonar_type == SONAR_NONE)
+      {
+        if (mb1242_present())
+          sonar_type = SONAR_I2C;
+        else if (sonarPresent())
+          sonar_type = SONAR_PWM;
+      }
+      result.present = (sonar_type != SONAR_NONE);
+      if (sonar_type == SONAR_I2C)
+        result.value[0] = mb1242_async_read();
+      else if (sonar_type == SONAR_PWM)
+        result.value[0] = sonarRead(6);
+      break;
+    case SENSOR_MAG:
+    {
+      int16_t raw_mag[3];
+      result.present = hmc5883l_present();
+      hmc5883l_async_read(raw_mag);
+      for (int j = 0; j < 3; j++)
+        result.value[j] = static_cast<float>(raw_mag[j]);
+      break;
+    }
+    default:
+      break;
+    }
+
+    if (_sensor_callback)
+      _sensor_callback(_sensor_context, result);
+  }
 }
 
-bool Naze32::baro_check()
+uint16_t num_sensor_errors(void)
 {
-  ms5611_async_update();
-  return ms5611_present();
+  return i2cGetErrorCounter();
 }
 
-bool Naze32::diff_pressure_check(void)
+// PWM
+
+// Outputs 1-2 are on TIM1 and outputs 3-6 on TIM4
+static const uint8_t TIM1_OUTPUTS = 0x03;
+static const uint8_t TIM4_OUTPUTS = 0x3C;
+
+void Naze32::pwm_init(bool cppm, uint32_t refresh_rate, uint16_t idle_pwm)
 {
-  ms4525_async_update();
-  return ms4525_present();
+  pwmInit(cppm, false, false, refresh_rate, idle_pwm);
+  _motor_protocol = MOTOR_PROTOCOL_PWM;
+  _motor_mask = 0;
+  TIM_DMACmd(TIM1, TIM_DMA_CC1, DISABLE);
+  TIM_DMACmd(TIM4, TIM_DMA_Update, DISABLE);
+
+  // Buffer the compare registers of the output timers, so that pwm_write_multi can latch them together
+  TIM_OC1PreloadConfig(TIM1, TIM_OCPreload_Enable);
+  TIM_OC4PreloadConfig(TIM1, TIM_OCPreload_Enable);
+  TIM_OC1PreloadConfig(TIM4, TIM_OCPreload_Enable);
+  TIM_OC2PreloadConfig(TIM4, TIM_OCPreload_Enable);
+  TIM_OC3PreloadConfig(TIM4, TIM_OCPreload_Enable);
+  TIM_OC4PreloadConfig(TIM4, TIM_OCPreload_Enable);
 }
 
-void Naze32::diff_pressure_read(float *diff_pressure, float *temperature)
+uint16_t Naze32::pwm_read(uint8_t channel)
 {
-  ms4525_async_update();
-  ms4525_async_read(diff_pressure, temperature);
+  return pwmRead(channel);
 }
 
-bool Naze32::sonar_check(void)
+void Naze32::pwm_write(uint8_t channel, uint16_t value)
 {
-  mb1242_async_update();
-  if (mb1242_present())
+  pwmWriteMotor(channel, value);
+}
+
+void Naze32::pwm_write_multi(const float *value, uint8_t num_channels)
+{
+  // Hold off the update events of the PWM output timers while writing, so that none of them starts a period
+  // with only some of its new compare values. Timers running DShot are left alone, their DMA needs the updates.
+  bool hold_tim1 = !(_motor_mask & TIM1_OUTPUTS);
+  bool hold_tim4 = !(_motor_mask & TIM4_OUTPUTS);
+  if (hold_tim1)
+    TIM1->CR1 |= TIM_CR1_UDIS;
+  if (hold_tim4)
+    TIM4->CR1 |= TIM_CR1_UDIS;
+
+  for (uint8_t i = 0; i < num_channels; i++)
+  {
+    if (value[i] >= 0.0f)
+      pwmWriteMotor(i, static_cast<uint16_t>(value[i]));
+  }
+
+  if (hold_tim1)
+    TIM1->CR1 &= ~TIM_CR1_UDIS;
+  if (hold_tim4)
+    TIM4->CR1 &= ~TIM_CR1_UDIS;
+}
+
+bool Naze32::pwm_lost()
+{
+  return ((millis() - pwmLastUpdate()) > 40);
+}
+
+// RC
+
+// uartOpen only does 8N1, SBUS is 8E2
+static void sbus_uart_init(void)
+{
+  USART_InitTypeDef init;
+  USART_StructInit(&init);
+  init.USART_BaudRate = 100000;
+  init.USART_WordLength = USART_WordLength_9b; // 8 data bits and the parity bit
+  init.USART_StopBits = USART_StopBits_2;
+  init.USART_Parity = USART_Parity_Even;
+  init.USART_Mode = USART_Mode_Rx;
+  init.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+  USART_Cmd(USART2, DISABLE);
+  USART_Init(USART2, &init);
+  USART_Cmd(USART2, ENABLE);
+}
+
+bool Naze32::rc_init(rc_protocol_t protocol)
+{
+  _rc_protocol = protocol;
+  rc_frame_t stale;
+  while (_rc_fifo.pop(&stale)) {}
+
+  switch (protocol)
   {
-    sonar_type = SONAR_I2C;
+  case RC_PROTOCOL_CPPM:
+    // breezystm32 owns the capture interrupt and decodes the pulse train itself, so rc_read picks up each
+    // frame on the first call after its sync pulse instead of having it queued from the interrupt
+    _cppm_last_update = pwmLastUpdate();
     return true;
+  case RC_PROTOCOL_SBUS:
+    // SBUS is on the RC3/RC4 UART (which pwm_init leaves free in CPPM mode). It is sent inverted, and the
+    // F1 UARTs can't invert their input, so it needs an inverter in front of the RX pin.
+    _sbus.reset();
+    rc_board = this;
+    if (_sbus_port == NULL)
+      _sbus_port = uartOpen(USART2, &sbus_rx_cb, 100000, MODE_RX);
+    sbus_uart_init();
+    return true;
+  default:
+    return false;
   }
-  else if (sonarPresent())
+}
+
+void Naze32::rc_push_byte(uint8_t byte)
+{
+  rc_frame_t frame;
+  if (_rc_protocol == RC_PROTOCOL_SBUS && _sbus.parse(byte, micros(), &frame))
+    _rc_fifo.push(frame);
+}
+
+bool Naze32::rc_read(rc_frame_t *frame)
+{
+  if (_rc_protocol == RC_PROTOCOL_CPPM)
   {
-    sonar_type = SONAR_PWM;
+    uint32_t last_update = pwmLastUpdate();
+    if (last_update == _cppm_last_update)
+      return false;
+    _cppm_last_update = last_update;
+
+    for (uint8_t i = 0; i < 8; i++)
+      frame->channels[i] = pwmRead(i);
+    frame->num_channels = 8;
+    frame->failsafe = false;
+    frame->time_us = micros();
     return true;
   }
-  else
+  return _rc_fifo.pop(frame);
+}
+
+// motors
+
+// Output i is on channel motor_channels[i].channel of motor_channels[i].timer, both timers count at 72 MHz
+static const struct
+{
+  TIM_TypeDef *timer;
+  uint8_t channel;
+} motor_channels[] = {{TIM1, 0}, {TIM1, 3}, {TIM4, 0}, {TIM4, 1}, {TIM4, 2}, {TIM4, 3}};
+
+static const uint32_t MOTOR_TIMER_HZ = 72000000;
+
+static void set_compare(TIM_TypeDef *timer, uint8_t channel, uint16_t value)
+{
+  switch (channel)
   {
-    sonar_type = SONAR_NONE;
+  case 0: TIM_SetCompare1(timer, value); break;
+  case 1: TIM_SetCompare2(timer, value); break;
+  case 2: TIM_SetCompare3(timer, value); break;
+  default: TIM_SetCompare4(timer, value); break;
+  }
+}
+
+// Restarts a timer that pwmInit already set up for PWM output with a new prescaler and period
+static void motor_timer_init(TIM_TypeDef *timer, uint16_t prescaler, uint16_t period)
+{
+  TIM_Cmd(timer, DISABLE);
+  TIM_TimeBaseInitTypeDef base;
+  TIM_TimeBaseStructInit(&base);
+  base.TIM_Prescaler = prescaler;
+  base.TIM_Period = period;
+  base.TIM_CounterMode = TIM_CounterMode_Up;
+  TIM_TimeBaseInit(timer, &base);
+
+  // compare values written in motor_write only take effect on the next update, so a timer's channels latch together
+  TIM_ARRPreloadConfig(timer, ENABLE);
+  TIM_OC1PreloadConfig(timer, TIM_OCPreload_Enable);
+  TIM_OC2PreloadConfig(timer, TIM_OCPreload_Enable);
+  TIM_OC3PreloadConfig(timer, TIM_OCPreload_Enable);
+  TIM_OC4PreloadConfig(timer, TIM_OCPreload_Enable);
+  for (uint8_t channel = 0; channel < 4; channel++)
+    set_compare(timer, channel, 0);
+
+  TIM_Cmd(timer, ENABLE);
+}
+
+// Each DMA request writes one bit period of CCR1-CCR4 through the timer's DMA burst register
+static void dshot_dma_init(TIM_TypeDef *timer, DMA_Channel_TypeDef *dma, uint16_t request, uint16_t *buffer,
+                           uint16_t length)
+{
+  RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+  DMA_DeInit(dma);
+  DMA_InitTypeDef init;
+  DMA_StructInit(&init);
+  init.DMA_PeripheralBaseAddr = (uint32_t) &timer->DMAR;
+  init.DMA_MemoryBaseAddr = (uint32_t) buffer;
+  init.DMA_DIR = DMA_DIR_PeripheralDST;
+  init.DMA_BufferSize = length;
+  init.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+  init.DMA_MemoryInc = DMA_MemoryInc_Enable;
+  init.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+  init.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+  init.DMA_Mode = DMA_Mode_Normal;
+  init.DMA_Priority = DMA_Priority_High;
+  init.DMA_M2M = DMA_M2M_Disable;
+  DMA_Init(dma, &init);
+
+  TIM_DMAConfig(timer, TIM_DMABase_CCR1, TIM_DMABurstLength_4Transfers);
+  TIM_DMACmd(timer, request, ENABLE);
+}
+
+// True while a frame is still going out, when its bit buffer must not be touched
+static bool dshot_dma_busy(DMA_Channel_TypeDef *dma)
+{
+  return DMA_GetCurrDataCounter(dma) != 0 && (dma->CCR & DMA_CCR1_EN);
+}
+
+static void dshot_dma_start(DMA_Channel_TypeDef *dma, uint16_t length)
+{
+  DMA_Cmd(dma, DISABLE);
+  DMA_SetCurrDataCounter(dma, length);
+  DMA_Cmd(dma, ENABLE);
+}
+
+// 11 bit throttle (0 is disarmed, 1-47 are commands, 48-2047 is the throttle range), telemetry bit, 4 bit CRC
+static uint16_t dshot_frame(float value)
+{
+  uint16_t throttle = 0;
+  if (value > 0.0f)
+    throttle = 48 + static_cast<uint16_t>((value > 1.0f ? 1.0f : value)*1999.0f);
+  uint16_t packet = throttle << 1;
+  uint16_t crc = (packet ^ (packet >> 4) ^ (packet >> 8)) & 0x0F;
+  return (packet << 4) | crc;
+}
+
+bool Naze32::motor_init(motor_protocol_t protocol, uint32_t refresh_rate, uint8_t motor_mask, uint8_t servo_mask)
+{
+  _motor_protocol = MOTOR_PROTOCOL_PWM;
+
+  // Only the first six outputs are on timers that can be reprogrammed, and all of a timer's channels run at
+  // the same rate, so servos can't share a timer with the motors
+  bool use_tim1 = motor_mask & TIM1_OUTPUTS;
+  bool use_tim4 = motor_mask & TIM4_OUTPUTS;
+  if (protocol == MOTOR_PROTOCOL_PWM || protocol >= MOTOR_PROTOCOL_COUNT || motor_mask == 0
+      || (motor_mask & ~(TIM1_OUTPUTS | TIM4_OUTPUTS))
+      || (use_tim1 && (servo_mask & TIM1_OUTPUTS)) || (use_tim4 && (servo_mask & TIM4_OUTPUTS)))
     return false;
+
+  if (protocol == MOTOR_PROTOCOL_ONESHOT125 || protocol == MOTOR_PROTOCOL_MULTISHOT)
+  {
+    // the period has to fit the longest pulse, and the counter has to fit the period
+    float max_pulse_us = (protocol == MOTOR_PROTOCOL_ONESHOT125) ? 250.0f : 25.0f;
+    float period_us = 1e6f/(refresh_rate > 0 ? refresh_rate : 1);
+    if (period_us < 1.05f*max_pulse_us)
+      period_us = 1.05f*max_pulse_us;
+    uint32_t period_ticks = static_cast<uint32_t>(period_us*(MOTOR_TIMER_HZ/1000000));
+    uint16_t prescaler = period_ticks/65536;
+    _motor_ticks_per_us = static_cast<float>(MOTOR_TIMER_HZ/1000000)/(prescaler + 1);
+    uint16_t period = static_cast<uint16_t>(period_us*_motor_ticks_per_us) - 1;
+    if (use_tim1)
+      motor_timer_init(TIM1, prescaler, period);
+    if (use_tim4)
+      motor_timer_init(TIM4, prescaler, period);
   }
+  else
+  {
+    uint32_t bitrate = (protocol == MOTOR_PROTOCOL_DSHOT150) ? 150000 : (protocol == MOTOR_PROTOCOL_DSHOT300) ? 300000 : 600000;
+    uint16_t bit_ticks = MOTOR_TIMER_HZ/bitrate;
+    _dshot_bit_ticks[0] = bit_ticks*3/8;
+    _dshot_bit_ticks[1] = bit_ticks*3/4;
+    memset(_dshot_tim1_buffer, 0, sizeof(_dshot_tim1_buffer));
+    memset(_dshot_tim4_buffer, 0, sizeof(_dshot_tim4_buffer));
+
+    // DMA1 channel 5 (TIM1_UP) belongs to the USART1 receive DMA, so TIM1 bursts are requested by its CC1
+    // match on channel 2, which also comes once per bit period
+    if (use_tim1)
+    {
+      motor_timer_init(TIM1, 0, bit_ticks - 1);
+      dshot_dma_init(TIM1, DMA1_Channel2, TIM_DMA_CC1, _dshot_tim1_buffer, DSHOT_FRAME_SLOTS*4);
+    }
+    if (use_tim4)
+    {
+      motor_timer_init(TIM4, 0, bit_ticks - 1);
+      dshot_dma_init(TIM4, DMA1_Channel7, TIM_DMA_Update, _dshot_tim4_buffer, DSHOT_FRAME_SLOTS*4);
+    }
+  }
+
+  if (use_tim1)
+    TIM_CtrlPWMOutputs(TIM1, ENABLE);
+  _motor_mask = motor_mask;
+  _motor_protocol = protocol;
+  return true;
 }
 
-float Naze32::sonar_read(void)
+void Naze32::motor_write(const float *values, uint8_t num_outputs)
 {
-  if (sonar_type == SONAR_I2C)
+  if (_motor_protocol == MOTOR_PROTOCOL_PWM)
+    return;
+
+  // never cut a frame short or change the bits under it (which would send a bad CRC): a timer whose last
+  // frame is still in flight drops this update, and gets the next one on the next control loop
+  bool dshot = (_motor_protocol != MOTOR_PROTOCOL_ONESHOT125 && _motor_protocol != MOTOR_PROTOCOL_MULTISHOT);
+  bool tim1_busy = dshot && (_motor_mask & TIM1_OUTPUTS) && dshot_dma_busy(DMA1_Channel2);
+  bool tim4_busy = dshot && (_motor_mask & TIM4_OUTPUTS) && dshot_dma_busy(DMA1_Channel7);
+
+  for (uint8_t i = 0; i < NUM_FAST_MOTORS && i < num_outputs; i++)
+  {
+    if (!(_motor_mask & (1 << i)))
+      continue;
+    if ((motor_channels[i].timer == TIM1) ? tim1_busy : tim4_busy)
+      continue;
+
+    float value = values[i] < 0.0f ? 0.0f : (values[i] > 1.0f ? 1.0f : values[i]);
+    if (_motor_protocol == MOTOR_PROTOCOL_ONESHOT125 || _motor_protocol == MOTOR_PROTOCOL_MULTISHOT)
+    {
+      float pulse_us = (_motor_protocol == MOTOR_PROTOCOL_ONESHOT125) ? 125.0f + 125.0f*value : 5.0f + 20.0f*value;
+      set_compare(motor_channels[i].timer, motor_channels[i].channel, static_cast<uint16_t>(pulse_us*_motor_ticks_per_us));
+    }
+    else
+    {
+      uint16_t frame = dshot_frame(value);
+      uint16_t *buffer = (motor_channels[i].timer == TIM1) ? _dshot_tim1_buffer : _dshot_tim4_buffer;
+      for (uint8_t bit = 0; bit < 16; bit++)
+        buffer[4*bit + motor_channels[i].channel] = _dshot_bit_ticks[(frame >> (15 - bit)) & 1];
+    }
+  }
+
+  if (_motor_protocol == MOTOR_PROTOCOL_ONESHOT125 || _motor_protocol == MOTOR_PROTOCOL_MULTISHOT)
   {
-    mb1242_async_update();
-    return mb1242_async_read();
+    // start the new pulses right away on both timers, rather than at the end of whatever period they are in
+    if (_motor_mask & TIM1_OUTPUTS)
+      TIM_GenerateEvent(TIM1, TIM_EventSource_Update);
+    if (_motor_mask & TIM4_OUTPUTS)
+      TIM_GenerateEvent(TIM4, TIM_EventSource_Update);
   }
-  else if (sonar_type == SONAR_PWM)
-    return sonarRead(6);
   else
-    return 0.0f;
+  {
+    if ((_motor_mask & TIM1_OUTPUTS) && !tim1_busy)
+      dshot_dma_start(DMA1_Channel2, DSHOT_FRAME_SLOTS*4);
+    if ((_motor_mask & TIM4_OUTPUTS) && !tim4_busy)
+      dshot_dma_start(DMA1_Channel7, DSHOT_FRAME_SLOTS*4);
+  }
 }
 
-uint16_t num_sensor_errors(void)
+// non-volatile memory
+
+void Naze32::memory_init(void)
 {
-  return i2cGetErrorCounter();
+  initEEPROM();
 }
 
-// PWM
+uint32_t Naze32::memory_sector_size(void)
+{
+  return FLASH_SECTOR_SIZE;
+}
 
-void Naze32::pwm_init(bool cppm, uint32_t refresh_rate, uint16_t idle_pwm)
+bool Naze32::memory_erase_sector(uint8_t sector)
 {
-  pwmInit(cppm, false, false, refresh_rate, idle_pwm);
+  return eraseEEPROMSector(sector);
 }
 
-uint16_t Naze32::pwm_read(uint8_t channel)
+uint32_t Naze32::memory_read_word(uint8_t sector, uint32_t offset)
 {
-  return pwmRead(channel);
+  return readEEPROMWord(sector, offset);
 }
 
-void Naze32::pwm_write(uint8_t channel, uint16_t value)
+bool Naze32::memory_write_word(uint8_t sector, uint32_t offset, uint32_t word)
 {
-  pwmWriteMotor(channel, value);
+  return writeEEPROMWord(sector, offset, word);
 }
 
-bool Naze32::pwm_lost()
+// log storage
+
+void Naze32::log_flash_init(void)
 {
-  return ((millis() - pwmLastUpdate()) > 40);
+  spiInit();
+
+  // the last byte of the JEDEC ID is log2 of the capacity, boards without the flash read back all ones
+  uint8_t id[3];
+  spiSelect(true);
+  spiTransferByte(LOG_FLASH_READ_ID);
+  spiTransfer(id, NULL, 3);
+  spiSelect(false);
+  _log_size = (id[0] != 0x00 && id[0] != 0xFF && id[2] >= 16 && id[2] <= 24) ? (1u << id[2]) : 0;
 }
 
-// non-volatile memory
+void Naze32::log_flash_command(uint8_t command, uint32_t address)
+{
+  // leaves the flash selected for the data that follows
+  spiSelect(true);
+  spiTransferByte(command);
+  spiTransferByte(static_cast<uint8_t>(address >> 16));
+  spiTransferByte(static_cast<uint8_t>(address >> 8));
+  spiTransferByte(static_cast<uint8_t>(address));
+}
 
-void Naze32::memory_init(void)
+uint32_t Naze32::log_size(void)
 {
-  initEEPROM();
+  return _log_size;
 }
 
-bool Naze32::memory_read(void * dest, size_t len)
+uint32_t Naze32::log_page_size(void)
 {
-  return readEEPROM(dest, len);
+  return LOG_FLASH_PAGE_SIZE;
 }
 
-bool Naze32::memory_write(const void * src, size_t len)
+uint32_t Naze32::log_erase_size(void)
 {
-  return writeEEPROM(src, len);
+  return LOG_FLASH_SECTOR_SIZE;
+}
+
+bool Naze32::log_busy(void)
+{
+  if (_log_size == 0)
+    return false;
+
+  spiSelect(true);
+  spiTransferByte(LOG_FLASH_READ_STATUS);
+  uint8_t status = spiTransferByte(0xFF);
+  spiSelect(false);
+  return status & LOG_FLASH_STATUS_BUSY;
+}
+
+bool Naze32::log_erase(uint32_t address)
+{
+  if (address >= _log_size || address % LOG_FLASH_SECTOR_SIZE != 0 || log_busy())
+    return false;
+
+  // the flash erases the sector on its own (up to a few seconds) once deselected
+  spiSelect(true);
+  spiTransferByte(LOG_FLASH_WRITE_ENABLE);
+  spiSelect(false);
+  log_flash_command(LOG_FLASH_SECTOR_ERASE, address);
+  spiSelect(false);
+  return true;
+}
+
+bool Naze32::log_write(uint32_t address, const uint8_t *data, size_t len)
+{
+  if (len == 0 || address + len > _log_size
+      || address/LOG_FLASH_PAGE_SIZE != (address + len - 1)/LOG_FLASH_PAGE_SIZE || log_busy())
+    return false;
+
+  // clocking the page out takes about 120 us, programming it (under a millisecond) carries on in the background
+  spiSelect(true);
+  spiTransferByte(LOG_FLASH_WRITE_ENABLE);
+  spiSelect(false);
+  log_flash_command(LOG_FLASH_PAGE_PROGRAM, address);
+  spiTransfer(NULL, const_cast<uint8_t *>(data), static_cast<int>(len));
+  spiSelect(false);
+  return true;
+}
+
+bool Naze32::log_read(uint32_t address, uint8_t *data, size_t len)
+{
+  if (address + len > _log_size || log_busy())
+    return false;
+
+  log_flash_command(LOG_FLASH_READ, address);
+  spiTransfer(data, NULL, static_cast<int>(len));
+  spiSelect(false);
+  return true;
 }
 
 // LED
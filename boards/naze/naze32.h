@@ -39,6 +39,8 @@ extern "C"
 }
 
 #include "board.h"
+#include "ring_buffer.h"
+#include "sbus.h"
 
 namespace rosflight_firmware {
 
@@ -47,8 +49,18 @@ class Naze32 : public Board
 
 private:
   serialPort_t *Serial1;
+  uint32_t _serial_rx_overflows = 0;
+  uint32_t _serial_rx_dma_pos = 0; // the RX DMA's CNDTR at the last serial_read
 
-  std::function<void(void)> imu_callback_;
+  // Filled by the MPU6050 data-ready interrupt, drained by the main loop
+  RingBuffer<imu_sample_t, 16> _imu_fifo;
+
+  // RC receiver frames, filled by the SBUS UART interrupt or picked up from the CPPM capture
+  rc_protocol_t _rc_protocol = RC_PROTOCOL_PWM;
+  RingBuffer<rc_frame_t, 4> _rc_fifo;
+  SbusDecoder _sbus;
+  serialPort_t *_sbus_port = NULL;
+  uint32_t _cppm_last_update = 0;
 
   int _board_revision = 2;
 
@@ -63,14 +75,30 @@ private:
   };
   uint8_t sonar_type = SONAR_NONE;
 
+  sensor_callback_t _sensor_callback = NULL;
+  void *_sensor_context = NULL;
+  bool _sensor_pending[SENSOR_COUNT] = {};
+
+  // Motor outputs 0-5 (TIM1 CH1 and CH4, TIM4 CH1-4) when MOTOR_PROTOCOL isn't PWM
+  static constexpr uint8_t NUM_FAST_MOTORS = 6;
+  static constexpr uint8_t DSHOT_FRAME_SLOTS = 18; // 16 bits, then two low bit periods to end the frame
+  motor_protocol_t _motor_protocol = MOTOR_PROTOCOL_PWM;
+  uint8_t _motor_mask = 0;
+  float _motor_ticks_per_us = 0.0f;
+  uint16_t _dshot_bit_ticks[2] = {0, 0}; // compare values for a 0 and a 1 bit
+  uint16_t _dshot_tim1_buffer[DSHOT_FRAME_SLOTS*4] = {}; // one burst of CCR1-CCR4 per bit period
+  uint16_t _dshot_tim4_buffer[DSHOT_FRAME_SLOTS*4] = {};
+
+  // SPI flash for the log storage, 0 if the board doesn't have one
+  uint32_t _log_size = 0;
+  void log_flash_init(void);
+  void log_flash_command(uint8_t command, uint32_t address);
+
 
 
 public:
   Naze32();
 
-  bool new_imu_data_;
-  uint64_t imu_time_us_;
-
   // setup
   void init_board(void);
   void board_reset(bool bootloader);
@@ -79,32 +107,29 @@ public:
   uint32_t clock_millis();
   uint64_t clock_micros();
   void clock_delay(uint32_t milliseconds);
+  uint32_t clock_cycles();
+  uint32_t clock_cycles_per_us();
 
   // serial
   void serial_init(uint32_t baud_rate);
   void serial_write(const uint8_t *src, size_t len);
+  uint16_t serial_tx_bytes_free(void);
   uint16_t serial_bytes_available(void);
-  uint8_t serial_read(void);
+  size_t serial_read(uint8_t *dst, size_t max);
+  uint32_t serial_rx_overflows(void);
 
   // sensors
   void sensors_init();
   uint16_t num_sensor_errors(void);
 
-  bool new_imu_data();
-  bool imu_read(float accel[3], float* temperature, float gyro[3], uint64_t* time_us);
+  uint16_t imu_samples_available();
+  bool imu_read(imu_sample_t *sample);
   void imu_not_responding_error();
+  void imu_push_sample(); // called from interrupt context
 
-  bool mag_check(void);
-  void mag_read(float mag[3]);
-
-  bool baro_check();
-  void baro_read(float *pressure, float *temperature);
-
-  bool diff_pressure_check(void);
-  void diff_pressure_read(float *diff_pressure, float *temperature);
-
-  bool sonar_check(void);
-  float sonar_read(void);
+  void sensor_set_callback(sensor_callback_t callback, void *context);
+  bool sensor_request(sensor_id_t sensor);
+  void sensor_poll(void);
 
   // PWM
   // TODO make these deal in normalized (-1 to 1 or 0 to 1) values (not pwm-specific)
@@ -112,11 +137,32 @@ public:
   bool pwm_lost();
   uint16_t pwm_read(uint8_t channel);
   void pwm_write(uint8_t channel, uint16_t value);
+  void pwm_write_multi(const float *value, uint8_t num_channels);
+
+  // RC
+  bool rc_init(rc_protocol_t protocol);
+  bool rc_read(rc_frame_t *frame);
+  void rc_push_byte(uint8_t byte); // called from interrupt context
+
+  // motors
+  bool motor_init(motor_protocol_t protocol, uint32_t refresh_rate, uint8_t motor_mask, uint8_t servo_mask);
+  void motor_write(const float *values, uint8_t num_outputs);
 
   // non-volatile memory
   void memory_init(void);
-  bool memory_read(void * dest, size_t len);
-  bool memory_write(const void * src, size_t len);
+  uint32_t memory_sector_size(void);
+  bool memory_erase_sector(uint8_t sector);
+  uint32_t memory_read_word(uint8_t sector, uint32_t offset);
+  bool memory_write_word(uint8_t sector, uint32_t offset, uint32_t word);
+
+  // log storage
+  uint32_t log_size(void);
+  uint32_t log_page_size(void);
+  uint32_t log_erase_size(void);
+  bool log_busy(void);
+  bool log_erase(uint32_t address);
+  bool log_write(uint32_t address, const uint8_t *data, size_t len);
+  bool log_read(uint32_t address, uint8_t *data, size_t len);
 
   // LEDs
   void led0_on(void);
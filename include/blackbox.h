@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_BLACKBOX_H
+#define ROSFLIGHT_FIRMWARE_BLACKBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rosflight_firmware
+{
+
+class ROSflight;
+
+/**
+ * @brief Flight data logger, writing compact frames to the board's log storage while armed
+ *
+ * log_frame() is called by the control loop after the mixer and encodes a frame into one of two page-sized
+ * buffers, without touching the flash. run(), a scheduler task, programs a full buffer into the flash once
+ * the flash has finished with the previous one, while the control loop fills the other. When both buffers
+ * are full the frame is dropped rather than waited for, and the next one is a keyframe.
+ *
+ * The log is a sequence of pages, each holding whole frames, with the rest of the page left erased (0xFF).
+ * Every session, from arming to disarming, starts on a new page with a header. Logging resumes after the last
+ * written page at boot, and stops when the storage is full until it is erased (while disarmed, see erase()).
+ *
+ * Frame formats (little endian):
+ *   FRAME_HEADER:    uint8 FORMAT_VERSION, uint8 NUM_FIELDS, uint16 IMU_RATE (Hz), uint16 BLACKBOX_DIV
+ *   FRAME_KEYFRAME:  varint time (us), then the zigzag varint of each field
+ *   FRAME_DELTA:     varint time since the previous frame (us), then the zigzag varint of each field minus
+ *                    its value in the previous frame
+ * The fields are fixed point, in the order and units of the Field enum.
+ */
+class Blackbox
+{
+public:
+  static constexpr uint8_t FORMAT_VERSION = 1;
+  static constexpr uint16_t PAGE_SIZE = 256;
+  static constexpr uint8_t KEYFRAME_INTERVAL = 32; // frames between keyframes, to limit what a bad page loses
+
+  static constexpr uint8_t FRAME_HEADER = 'H';
+  static constexpr uint8_t FRAME_KEYFRAME = 'I';
+  static constexpr uint8_t FRAME_DELTA = 'P';
+
+  enum : uint8_t
+  {
+    FIELD_GYRO_X,       // mrad/s
+    FIELD_GYRO_Y,
+    FIELD_GYRO_Z,
+    FIELD_ACCEL_X,      // cm/s^2
+    FIELD_ACCEL_Y,
+    FIELD_ACCEL_Z,
+    FIELD_SETPOINT_X,   // combined command, 1e-4 of its unit
+    FIELD_SETPOINT_Y,
+    FIELD_SETPOINT_Z,
+    FIELD_SETPOINT_F,
+    FIELD_P_X,          // PID terms (Controller::pid_terms), 1e-4
+    FIELD_P_Y,
+    FIELD_P_Z,
+    FIELD_I_X,
+    FIELD_I_Y,
+    FIELD_I_Z,
+    FIELD_D_X,
+    FIELD_D_Y,
+    FIELD_D_Z,
+    FIELD_OUTPUT_0,     // mixer outputs, 1e-4
+    NUM_FIELDS = FIELD_OUTPUT_0 + 8
+  };
+
+  static constexpr float GYRO_SCALE = 1000.0f;
+  static constexpr float ACCEL_SCALE = 100.0f;
+  static constexpr float COMMAND_SCALE = 10000.0f;
+
+  // A frame type byte, a 64-bit varint and a 32-bit varint per field
+  static constexpr uint16_t MAX_FRAME_SIZE = 1 + 10 + 5*NUM_FIELDS;
+
+  Blackbox(ROSflight& rf);
+
+  /**
+   * @brief Find the end of the log already in the storage
+   */
+  void init();
+
+  /**
+   * @brief Log the control update that just finished, called after the mixer on every update (never blocks)
+   */
+  void log_frame();
+
+  /**
+   * @brief Write out a full buffer, or continue an erase, if the storage is ready
+   */
+  void run();
+
+  /**
+   * @brief Start erasing the log, carried on by run() (only while disarmed)
+   * @return False if armed, or there is no log storage
+   */
+  bool erase();
+
+  /**
+   * @brief Read back part of the log
+   * @return False if the range is beyond the log, or the storage is busy (try again later)
+   */
+  bool read(uint32_t offset, uint8_t *data, size_t len);
+
+  inline bool available() const { return storage_size_ > 0; }
+  inline bool logging() const { return logging_; }
+  inline bool erasing() const { return erasing_; }
+  inline bool full() const { return full_; }
+  inline uint32_t size() const { return end_; } // bytes of log written to the storage, in whole pages
+  inline uint32_t capacity() const { return storage_size_; }
+  inline uint32_t frames_logged() const { return frames_logged_; }
+  inline uint32_t frames_dropped() const { return frames_dropped_; }
+
+private:
+  ROSflight& RF_;
+
+  uint32_t storage_size_;  // 0 if there is no usable log storage
+  uint32_t erase_size_;
+  uint32_t end_;           // where the next page goes in the storage
+  uint32_t erase_address_; // next block to erase
+  bool erasing_;
+  bool logging_;
+  bool full_;
+  bool failed_;
+
+  bool enabled_;
+  uint16_t rate_div_;
+  uint16_t updates_since_frame_;
+
+  // The buffer being filled and the next one to write alternate, so pages are written in the order they were filled
+  uint8_t buffer_[2][PAGE_SIZE];
+  uint16_t length_[2];
+  uint32_t address_[2];   // where each buffer goes in the storage
+  bool pending_[2];       // full, waiting to be written
+  uint8_t fill_;
+  uint8_t flush_;
+  uint32_t next_address_; // where the buffer after the one being filled goes
+
+  int32_t previous_[NUM_FIELDS];
+  uint64_t previous_time_us_;
+  uint8_t frames_since_keyframe_;
+  bool need_keyframe_;
+
+  uint32_t frames_logged_;
+  uint32_t frames_dropped_;
+
+  void param_change_callback(uint16_t param_id);
+  void reset_buffers();
+  uint32_t find_end();
+  bool start_session();
+  void end_session();
+  bool append(const uint8_t *data, uint16_t len);
+  void sample(int32_t fields[NUM_FIELDS]) const;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_BLACKBOX_H
@@ -40,6 +40,65 @@
 namespace rosflight_firmware
 {
 
+typedef struct
+{
+  float accel[3];     // m/s^2, body frame (NED)
+  float gyro[3];      // rad/s, body frame (NED)
+  float temperature;  // deg C
+  uint64_t time_us;   // time the sample was taken
+} imu_sample_t;
+
+// ESC protocols for the motor outputs, indexed by the MOTOR_PROTOCOL param
+typedef enum
+{
+  MOTOR_PROTOCOL_PWM,         // 1000-2000 us pulses through pwm_write
+  MOTOR_PROTOCOL_ONESHOT125,  // 125-250 us pulses
+  MOTOR_PROTOCOL_MULTISHOT,   // 5-25 us pulses
+  MOTOR_PROTOCOL_DSHOT150,    // digital frames at 150, 300 or 600 kbit/s
+  MOTOR_PROTOCOL_DSHOT300,
+  MOTOR_PROTOCOL_DSHOT600,
+  MOTOR_PROTOCOL_COUNT
+} motor_protocol_t;
+
+// RC receiver protocols, indexed by the RC_TYPE param
+typedef enum
+{
+  RC_PROTOCOL_PWM,   // one pulse per channel on parallel inputs, polled through pwm_read
+  RC_PROTOCOL_CPPM,  // all channels as a pulse train on one input
+  RC_PROTOCOL_SBUS,  // 100 kbaud, 8E2 serial frames of 16 11-bit channels
+  RC_PROTOCOL_COUNT
+} rc_protocol_t;
+
+// The low-priority sensors, which share a slow bus
+typedef enum
+{
+  SENSOR_BARO,
+  SENSOR_DIFF_PRESSURE,
+  SENSOR_SONAR,
+  SENSOR_MAG,
+  SENSOR_COUNT
+} sensor_id_t;
+
+typedef struct
+{
+  sensor_id_t sensor;
+  bool present;       // false if the sensor didn't answer
+  float value[3];     // baro and diff pressure: [0] Pa, sonar: [0] m, mag: the field (raw units)
+  float temperature;  // deg C, baro and diff pressure only
+} sensor_result_t;
+
+typedef void (*sensor_callback_t)(void *context, const sensor_result_t &result);
+
+static constexpr uint8_t RC_MAX_CHANNELS = 16;
+
+typedef struct
+{
+  uint16_t channels[RC_MAX_CHANNELS]; // us, digital protocols are scaled to the same 1000-2000 range
+  uint8_t num_channels;
+  bool failsafe;                      // the receiver reports it has lost the transmitter
+  uint64_t time_us;                   // time the end of the frame was received
+} rc_frame_t;
+
 class Board
 {
 
@@ -52,32 +111,34 @@ public:
   virtual uint32_t clock_millis() = 0;
   virtual uint64_t clock_micros() = 0;
   virtual void clock_delay(uint32_t milliseconds) = 0;
+  // Free-running cycle counter (wraps), for timing code that takes less than a few microseconds
+  virtual uint32_t clock_cycles() = 0;
+  virtual uint32_t clock_cycles_per_us() = 0;
 
 // serial
   virtual void serial_init(uint32_t baud_rate) = 0;
-  virtual void serial_write(const uint8_t *src, size_t len) = 0;
+  virtual void serial_write(const uint8_t *src, size_t len) = 0; // must not block if len <= serial_tx_bytes_free()
+  virtual uint16_t serial_tx_bytes_free(void) = 0;
   virtual uint16_t serial_bytes_available(void) = 0;
-  virtual uint8_t serial_read(void) = 0;
+  virtual size_t serial_read(uint8_t *dst, size_t max) = 0; // copies up to max received bytes, returns how many
+  virtual uint32_t serial_rx_overflows(void) = 0; // times received bytes were lost to a full RX buffer
 
 // sensors
   virtual void sensors_init() = 0;
   virtual uint16_t num_sensor_errors(void)  = 0;
 
-  virtual bool new_imu_data() = 0;
-  virtual bool imu_read(float accel[3], float *temperature, float gyro[3], uint64_t* time) = 0;
+  // IMU samples are queued by the board (typically from the data-ready interrupt) and read out in order
+  virtual uint16_t imu_samples_available() = 0;
+  virtual bool imu_read(imu_sample_t *sample) = 0; // pops the oldest sample, returns false if there are none
   virtual void imu_not_responding_error(void) = 0;
 
-  virtual bool mag_check(void) = 0;
-  virtual void mag_read(float mag[3]) = 0;
-
-  virtual bool baro_check(void) = 0;
-  virtual void baro_read(float *pressure, float *temperature) = 0;
-
-  virtual bool diff_pressure_check(void) = 0;
-  virtual void diff_pressure_read(float *diff_pressure, float *temperature) = 0;
-
-  virtual bool sonar_check(void) = 0;
-  virtual float sonar_read(void) = 0;
+  // Reads of the low-priority sensors are asynchronous, so that a slow bus never holds up the caller:
+  // sensor_request() queues the bus transactions of a read, which also probes a sensor that isn't known to be
+  // there, and returns at once. The board works through the queue in the background and hands each result to
+  // the callback during a later sensor_poll(), from the main loop rather than an interrupt.
+  virtual void sensor_set_callback(sensor_callback_t callback, void *context) = 0;
+  virtual bool sensor_request(sensor_id_t sensor) = 0; // false if a request for the sensor is already pending
+  virtual void sensor_poll(void) = 0;
 
 // PWM
 // TODO make these deal in normalized (-1 to 1 or 0 to 1) values (not pwm-specific)
@@ -85,11 +146,42 @@ public:
   virtual bool pwm_lost() = 0;
   virtual uint16_t pwm_read(uint8_t channel) = 0;
   virtual void pwm_write(uint8_t channel, uint16_t value) = 0;
-
-// non-volatile memory
+  // Sets the pulse widths (us) of the first num_channels outputs together, so that each output timer picks them
+  // all up on the same period. Channels with a negative value are left alone.
+  virtual void pwm_write_multi(const float *value, uint8_t num_channels) = 0;
+
+// RC
+  // Starts decoding complete frames of a frame-based receiver protocol (typically from the capture or UART
+  // interrupt), after pwm_init. Returns false if the board can't, in which case RC polls pwm_read instead.
+  virtual bool rc_init(rc_protocol_t protocol) = 0;
+  virtual bool rc_read(rc_frame_t *frame) = 0; // pops the oldest frame, returns false if there are none
+
+// motors
+  // Switches the outputs in motor_mask (bit i for output i) to a protocol other than MOTOR_PROTOCOL_PWM, after
+  // pwm_init, without disturbing the servos in servo_mask. Returns false if the board can't do that, in which
+  // case every output is left on pwm_write.
+  virtual bool motor_init(motor_protocol_t protocol, uint32_t refresh_rate, uint8_t motor_mask, uint8_t servo_mask) = 0;
+  // Sends the normalized (0 to 1, 0 stops the motor) values of the motor outputs in a single batch, so that
+  // they all update on the same frame. values has one entry per output, the other outputs are ignored.
+  virtual void motor_write(const float *values, uint8_t num_outputs) = 0;
+
+// non-volatile memory: two sectors that erase to all ones and are written a 32-bit word at a time
   virtual void memory_init(void) = 0;
-  virtual bool memory_read(void *dest, size_t len) = 0;
-  virtual bool memory_write(const void *src, size_t len) = 0;
+  virtual uint32_t memory_sector_size(void) = 0;
+  virtual bool memory_erase_sector(uint8_t sector) = 0;
+  virtual uint32_t memory_read_word(uint8_t sector, uint32_t offset) = 0;
+  virtual bool memory_write_word(uint8_t sector, uint32_t offset, uint32_t word) = 0;
+
+// log storage: a separate, larger flash for the blackbox, which erases to all ones a block of log_erase_size()
+// bytes at a time and is programmed up to a page of log_page_size() bytes at a time. Erases and writes only
+// start the operation, which carries on in the background while log_busy() is true, and fail if it is.
+  virtual uint32_t log_size(void) = 0; // 0 if the board has no log storage
+  virtual uint32_t log_page_size(void) = 0;
+  virtual uint32_t log_erase_size(void) = 0;
+  virtual bool log_busy(void) = 0;
+  virtual bool log_erase(uint32_t address) = 0; // the block starting at address
+  virtual bool log_write(uint32_t address, const uint8_t *data, size_t len) = 0; // must not cross a page
+  virtual bool log_read(uint32_t address, uint8_t *data, size_t len) = 0;
 
 // LEDs
   virtual void led0_on(void) = 0;
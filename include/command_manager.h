@@ -69,6 +69,10 @@ typedef struct
 class CommandManager
 {
 
+public:
+  // Number of recent offboard commands the latency percentiles are computed over
+  static constexpr uint8_t OFFBOARD_LATENCY_SAMPLES = 32;
+
 private:
 
   typedef struct
@@ -157,8 +161,18 @@ private:
 
   ROSflight& RF_;
 
-  bool new_command_;
+  bool new_command_; // an input changed since the last mux
   bool rc_override_;
+  bool in_failsafe_;
+  uint32_t next_mux_time_ms_; // when a timeout changes the mux without a new input
+  uint32_t mux_count_;
+
+  // Offboard commands waiting for the fast path, and the latency of the last few that were applied
+  bool offboard_pending_;
+  uint64_t offboard_stamp_us_;
+  uint32_t offboard_latency_us_[OFFBOARD_LATENCY_SAMPLES];
+  uint8_t offboard_latency_count_;
+  uint8_t offboard_latency_index_;
 
   control_t& failsafe_command_;
 
@@ -171,6 +185,8 @@ private:
 
   void interpret_rc(void);
   bool stick_deviated(MuxChannel channel);
+  void do_muxing(void);
+  void schedule_next_mux(void);
 
 public:
 
@@ -179,10 +195,38 @@ public:
   bool run();
   bool rc_override_active();
   bool offboard_control_active();
-  void set_new_offboard_command(control_t new_offboard_command);
+
+  /**
+   * @brief Take a new offboard command, to be applied at the start of the next control update
+   * @param new_offboard_command The command, stamp_ms is the local time used for the offboard timeout
+   * @param stamp_us When the command was sent, on the local clock (us), 0 for the time it is handed over
+   */
+  void set_new_offboard_command(control_t new_offboard_command, uint64_t stamp_us = 0);
+
+  /**
+   * @brief Mux a pending offboard command into the combined command, called right before the controller
+   * so a new offboard command is used on the next control update rather than after the next RC frame
+   */
+  void apply_offboard_command();
+
+  /**
+   * @brief Get a percentile of the latency of the recent offboard commands, from when they were sent to
+   * when they reached the controller
+   * @param percent The percentile, from 0 to 100
+   * @return The latency (us), 0 if no offboard command was applied yet
+   */
+  uint32_t offboard_latency_percentile_us(uint8_t percent) const;
+
+  /**
+   * @brief Get the time since the last applied offboard command was sent
+   * @return The age (us), 0 if no offboard command was applied yet
+   */
+  uint32_t offboard_command_age_us() const;
   void set_new_rc_command(control_t new_rc_command);
   void override_combined_command_with_rc();
   inline const control_t& combined_control() const { return combined_command_; }
+  // Number of times the combined command was recomputed, which only happens when an input changes
+  inline uint32_t mux_count() const { return mux_count_; }
   inline const control_t& rc_control() const { return rc_command_; }
 };
 
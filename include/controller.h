@@ -39,6 +39,7 @@
 
 #include "command_manager.h"
 #include "estimator.h"
+#include "filter.h"
 
 namespace rosflight_firmware
 {
@@ -56,9 +57,40 @@ public:
     float z;
   };
 
+  // Statistics of the time between control updates
+  struct Timing
+  {
+    float period_us;        // filtered period, what the gains are discretized for
+    float jitter_us;        // filtered absolute deviation of the period from period_us
+    uint32_t min_period_us;
+    uint32_t max_period_us;
+    uint32_t overruns;      // updates later than the budget set by CTRL_DT_TOL
+  };
+
+  // The contributions to the output of each axis of the PID loop in charge of it, before saturation, from
+  // the last update. p includes the feed-forward term, and all three are zero on an axis under passthrough.
+  struct PIDTerms
+  {
+    float p[3];
+    float i[3];
+    float d[3];
+  };
+
+  // Weight of each new period in the filtered period and jitter
+  static constexpr float PERIOD_FILTER_GAIN = 0.01f;
+  // The gains are discretized again when the filtered period drifts this far (as a fraction) from the one in use
+  static constexpr float PERIOD_REDISCRETIZE_TOLERANCE = 0.01f;
+  // Minimum time between two warnings about late control updates
+  static constexpr uint32_t OVERRUN_LOG_INTERVAL_US = 1000000;
+  // The control period until IMU_RATE gives a valid one
+  static constexpr float DEFAULT_PERIOD_US = 1000.0f;
+
   Controller(ROSflight& rf);
 
   inline const Output& output() const { return output_; }
+  inline const Timing& timing() const { return timing_; }
+  inline const PIDTerms& pid_terms() const { return pid_terms_; }
+  void reset_timing();
 
   void init();
   void run();
@@ -66,42 +98,117 @@ public:
   void calculate_equilbrium_torque_from_rc();
   void param_change_callback(uint16_t param_id);
 
-private:
+  /**
+   * @brief A PID controller evaluating the roll, pitch and yaw axes together
+   * @details The gains and states are laid out as one array per quantity with an entry per axis, and
+   * every axis runs the same straight-line code, so there is no per-axis dispatch and nothing is
+   * allocated. An axis that is not active still tracks its derivative, so switching it on doesn't kick
+   * the D term, but its integrator is frozen and its output is zero.
+   */
   class PID
   {
   public:
+    static constexpr uint8_t NUM_AXES = 3;
+
     PID();
-    void init(float kp, float ki, float kd, float max, float min, float tau);
-    float run(float dt, float x, float x_c, bool update_integrator);
-    float run(float dt, float x, float x_c, bool update_integrator, float xdot);
+
+    /**
+     * @brief Set the gains and limits, keeping the controller state
+     * @param kp, ki, kd, kff Per-axis gains, kff multiplies the setpoint (feed-forward)
+     * @param max Symmetric limit on the output
+     * @param tau Time constant of the dirty derivative (s)
+     * @param antiwindup_tau Time constant (s) with which the integrator is pulled back while the output
+     * saturates (back-calculation), the saturation is removed within one step if it is not longer than dt
+     */
+    void init(const float kp[NUM_AXES], const float ki[NUM_AXES], const float kd[NUM_AXES],
+              const float kff[NUM_AXES], float max, float tau, float antiwindup_tau);
+
+    /**
+     * @brief Configure the low-pass filter on the derivative
+     * @param sample_rate_hz The rate at which run() is called (Hz)
+     * @param cutoff_hz The cutoff frequency (Hz), 0 disables the filter
+     */
+    void set_dterm_lowpass(float sample_rate_hz, float cutoff_hz);
+
+    void reset();
+
+    /**
+     * @brief Run one step, differentiating the measurement with the dirty derivative
+     * @param dt Time since the last step (s), the derivative is zero if it is not positive
+     * @param x The measurement on each axis
+     * @param x_c The setpoint on each axis
+     * @param active Which axes are controlled, the others output zero
+     * @param update_integrators Whether to include and update the integrators
+     * @param u The output on each axis
+     */
+    void run(float dt, const float x[NUM_AXES], const float x_c[NUM_AXES], const bool active[NUM_AXES],
+             bool update_integrators, float u[NUM_AXES]);
+
+    /**
+     * @brief Run one step with a measured derivative
+     * @param xdot The derivative of the measurement on each axis
+     */
+    void run(float dt, const float x[NUM_AXES], const float x_c[NUM_AXES], const float xdot[NUM_AXES],
+             const bool active[NUM_AXES], bool update_integrators, float u[NUM_AXES]);
+
+    // The terms of the last run(), zero on the axes that weren't active
+    inline const PIDTerms& terms() const { return terms_; }
 
   private:
-    float kp_;
-    float ki_;
-    float kd_;
+    float kp_[NUM_AXES];
+    float ki_[NUM_AXES];
+    float kd_[NUM_AXES];
+    float kff_[NUM_AXES];
+    float antiwindup_gain_[NUM_AXES];
 
     float max_;
-    float min_;
-
-    float integrator_;
-    float differentiator_;
-    float prev_x_;
     float tau_;
+    float antiwindup_tau_;
+
+    // coefficients discretized for the time step dt_, recomputed only when the time step changes
+    void discretize(float dt);
+    float dt_;
+    float derivative_a_;
+    float derivative_b_;
+    float ki_dt_[NUM_AXES];
+    float antiwindup_k_;
+
+    float integrator_[NUM_AXES]; // in units of the output, i.e. already multiplied by ki
+    float differentiator_[NUM_AXES];
+    float prev_x_[NUM_AXES];
+    Biquad dterm_lpf_;
+    PIDTerms terms_;
   };
 
+private:
   ROSflight& RF_;
 
-  turbomath::Vector run_pid_loops(uint32_t dt, const Estimator::State& state, const control_t& command, bool update_integrators);
+  // Parameters used on every loop besides the PID gains, refreshed by param_change_callback
+  struct Config
+  {
+    turbomath::Vector eq_torque; // feedforward equilibrium torques
+    float nominal_period_us;     // 1/IMU_RATE, as the controller runs once per IMU sample
+    uint32_t max_period_us;      // updates later than this are out of budget
+  };
+  Config config_;
+
+  void init_pids();
+  void update_config();
+  void discretize_pids();
+  bool update_timing(uint32_t dt_us, uint64_t now_us);
+  turbomath::Vector run_pid_loops(float dt, const Estimator::State& state, const control_t& command, bool update_integrators);
 
   Output output_;
+  PIDTerms pid_terms_;
 
-  PID roll_;
-  PID roll_rate_;
-  PID pitch_;
-  PID pitch_rate_;
-  PID yaw_rate_;
+  PID rate_pid_;  // roll, pitch and yaw rates, measured by the gyro
+  PID angle_pid_; // roll and pitch angles, with the gyro as their derivative
 
   uint64_t prev_time_us_;
+
+  Timing timing_;
+  float control_period_us_; // the period the PIDs are discretized for
+  uint64_t next_overrun_log_us_;
 };
 
 } // namespace rosflight_firmware
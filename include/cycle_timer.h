@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_CYCLE_TIMER_H
+#define ROSFLIGHT_FIRMWARE_CYCLE_TIMER_H
+
+#include <stdint.h>
+
+#include "board.h"
+#include "profiler.h"
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Records the clock cycles between its construction and destruction as a sample of a profiler stage
+ *
+ * Meant for kernels too short for the microsecond clock. Use it through ROSFLIGHT_TIME_SCOPE, which compiles
+ * away unless the build defines ROSFLIGHT_CYCLE_TIMERS, so that the timing costs nothing in normal builds.
+ */
+class CycleTimer
+{
+public:
+  inline CycleTimer(Board& board, Profiler& profiler, uint8_t stage) :
+    board_(board),
+    profiler_(profiler),
+    stage_(stage),
+    start_(board.clock_cycles())
+  {}
+
+  inline ~CycleTimer()
+  {
+    profiler_.record_cycles(stage_, board_.clock_cycles() - start_);
+  }
+
+private:
+  Board& board_;
+  Profiler& profiler_;
+  uint8_t stage_;
+  uint32_t start_;
+};
+
+} // namespace rosflight_firmware
+
+// Times the rest of the enclosing scope into the cycle statistics of a profiler stage, e.g.
+// ROSFLIGHT_TIME_SCOPE(RF_, Profiler::STAGE_ESTIMATOR_LPF);
+#ifdef ROSFLIGHT_CYCLE_TIMERS
+#define ROSFLIGHT_CYCLE_TIMER_NAME_(line) cycle_timer_##line
+#define ROSFLIGHT_CYCLE_TIMER_NAME(line) ROSFLIGHT_CYCLE_TIMER_NAME_(line)
+#define ROSFLIGHT_TIME_SCOPE(rf, stage) \
+  rosflight_firmware::CycleTimer ROSFLIGHT_CYCLE_TIMER_NAME(__LINE__)((rf).board_, (rf).profiler_, (stage))
+#else
+#define ROSFLIGHT_TIME_SCOPE(rf, stage) do {} while (0)
+#endif
+
+#endif // ROSFLIGHT_FIRMWARE_CYCLE_TIMER_H
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_DELTA_BATCH_H
+#define ROSFLIGHT_FIRMWARE_DELTA_BATCH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "varint.h"
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Encode one sample of fixed-point fields as varints of its change from a previous one
+ * @param time_us The varint time field, the time since the previous sample or an absolute time
+ * @param fields The quantized fields
+ * @param previous The fields of the previous sample, or nullptr to encode the fields as they are
+ * @param out Where to write the sample, with room for VARINT_MAX_SIZE_64 + VARINT_MAX_SIZE_32*NUM_FIELDS bytes
+ * @return The number of bytes written
+ */
+template <uint8_t NUM_FIELDS>
+inline uint16_t delta_encode(uint64_t time_us, const int32_t fields[NUM_FIELDS], const int32_t *previous,
+                             uint8_t *out)
+{
+  uint16_t len = varint_encode(time_us, out);
+  for (uint8_t i = 0; i < NUM_FIELDS; i++)
+  {
+    // wraps for the (unquantizable) extremes, which the decoder's int32 sums undo
+    uint32_t base = previous ? static_cast<uint32_t>(previous[i]) : 0u;
+    int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(fields[i]) - base);
+    len = static_cast<uint16_t>(len + varint_encode(zigzag_encode(delta), out + len));
+  }
+  return len;
+}
+
+/**
+ * @brief Packs a batch of fixed-point samples for a high-rate stream, each as varints of its change from the
+ * previous sample
+ *
+ * Each sample is encoded as the varint time since the previous sample (us), then the zigzag varint of the
+ * difference of each field from the previous sample. The first sample of a batch is encoded against zeros
+ * (time 0 and the fields as they are), so every batch decodes on its own and a lost frame costs nothing more.
+ * At the rates these streams run the fields barely change between samples, so most take one or two bytes.
+ */
+template <uint8_t NUM_FIELDS, uint16_t CAPACITY>
+class DeltaBatch
+{
+public:
+  static constexpr uint16_t MAX_SAMPLE_SIZE = VARINT_MAX_SIZE_32*(NUM_FIELDS + 1);
+  static_assert(MAX_SAMPLE_SIZE <= CAPACITY, "DeltaBatch must have room for at least one sample");
+
+  DeltaBatch() : buffer_(), size_(0), count_(0), start_time_us_(0), previous_time_us_(0), previous_() {}
+
+  void clear()
+  {
+    size_ = 0;
+    count_ = 0;
+  }
+
+  /**
+   * @brief Append a sample
+   * @param time_us Time of the sample, not before the previous one
+   * @param fields The fields, converted with quantize()
+   * @return False if the sample doesn't fit, in which case the batch is left as it was
+   */
+  bool add(uint64_t time_us, const int32_t fields[NUM_FIELDS])
+  {
+    if (count_ == UINT8_MAX)
+      return false;
+
+    uint8_t sample[MAX_SAMPLE_SIZE];
+    uint16_t len;
+    if (count_ == 0)
+    {
+      len = delta_encode<NUM_FIELDS>(0, fields, nullptr, sample);
+    }
+    else
+    {
+      // a gap the 32-bit varint can't describe ends the batch, the sample starts the next one
+      uint64_t dt_us = time_us - previous_time_us_;
+      if (dt_us > UINT32_MAX)
+        return false;
+      len = delta_encode<NUM_FIELDS>(dt_us, fields, previous_, sample);
+    }
+
+    if (size_ + len > CAPACITY)
+      return false;
+
+    memcpy(buffer_ + size_, sample, len);
+    size_ = static_cast<uint16_t>(size_ + len);
+    if (count_ == 0)
+      start_time_us_ = time_us;
+    count_++;
+    previous_time_us_ = time_us;
+    memcpy(previous_, fields, sizeof(previous_));
+    return true;
+  }
+
+  inline const uint8_t *data() const { return buffer_; }
+  inline uint16_t size() const { return size_; }
+  inline uint8_t count() const { return count_; }
+  inline uint64_t start_time_us() const { return start_time_us_; } // time of the first sample
+  inline uint64_t end_time_us() const { return previous_time_us_; } // time of the last sample
+
+private:
+  uint8_t buffer_[CAPACITY];
+  uint16_t size_;
+  uint8_t count_;
+  uint64_t start_time_us_;
+  uint64_t previous_time_us_;
+  int32_t previous_[NUM_FIELDS];
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_DELTA_BATCH_H
@@ -51,10 +51,29 @@ public:
   {
     turbomath::Vector angular_velocity;
     turbomath::Quaternion attitude;
-    float roll;
-    float pitch;
-    float yaw;
     uint64_t timestamp_us;
+
+    // Euler angles, extracted from the attitude on first use after it changes, since only angle mode
+    // control needs them
+    inline float roll() const { update_RPY(); return rpy_.x; }
+    inline float pitch() const { update_RPY(); return rpy_.y; }
+    inline float yaw() const { update_RPY(); return rpy_.z; }
+
+    // Call after changing the attitude
+    inline void attitude_changed() { rpy_valid_ = false; }
+
+  private:
+    inline void update_RPY() const
+    {
+      if (!rpy_valid_)
+      {
+        attitude.get_RPY(&rpy_.x, &rpy_.y, &rpy_.z);
+        rpy_valid_ = true;
+      }
+    }
+
+    mutable turbomath::Vector rpy_;
+    mutable bool rpy_valid_ = false;
   };
 
   Estimator(ROSflight& _rf);
@@ -65,12 +84,45 @@ public:
   void run();
   void reset_state();
   void reset_adaptive_bias();
+  void param_change_callback(uint16_t param_id);
+
+  // Above this squared half angle (0.2 rad) the matrix exponential falls back from its series to turbomath trig
+  static constexpr float MAT_EXP_SERIES_MAX_SQRD = 0.04f;
+
+  /**
+   * @brief Compute the matrix exponential coefficients for propagating the attitude quaternion
+   * @param sqrd_norm_w The squared norm of the angular rate (rad^2/s^2)
+   * @param dt The time step (s)
+   * @param t1 Set to cos(|w|dt/2)
+   * @param t2 Set to sin(|w|dt/2)/|w|
+   */
+  static void mat_exp_coefficients(float sqrd_norm_w, float dt, float *t1, float *t2);
 
 private:
+  // Parameters used on every sample, refreshed by param_change_callback
+  struct Config
+  {
+    float acc_alpha;
+    float acc_one_minus_alpha;
+    float gyro_alpha;
+    float gyro_one_minus_alpha;
+    float kp;
+    float ki;
+    float kp_init;      // gains used for the first FILTER_INIT_T, for quick convergence
+    float ki_init;
+    uint64_t init_time_us;
+    bool use_acc;
+    bool use_quad_int;
+    bool use_mat_exp;
+    bool check_acc_timeout; // using the accelerometer, and not a fixed wing
+    uint32_t update_period_us; // 0 runs the full update on every sample
+  };
+
   const turbomath::Vector g_ = {0.0f, 0.0f, -1.0f};
 
   ROSflight& RF_;
   State state_;
+  Config config_;
 
   uint64_t last_time_;
   uint64_t last_acc_update_us_;
@@ -85,7 +137,25 @@ private:
 
   turbomath::Vector w_acc_;
 
+  // Gyro samples pre-integrated since the last full update, when FILTER_UPD_RATE is set
+  uint64_t last_update_us_;
+  turbomath::Vector delta_angle_;
+  turbomath::Vector coning_;
+
+  // Accelerometer correction, gyro interpolation and attitude propagation, one specialization per
+  // combination of FILTER_USE_ACC, FILTER_QUAD_INT and FILTER_MAT_EXP
+  typedef void (Estimator::*PropagateFcn)(float dt, float kp, float ki, uint64_t now_us, uint64_t t);
+  PropagateFcn propagate_;
+
+  template <bool UseAcc, bool UseQuadInt, bool UseMatExp>
+  void propagate(float dt, float kp, float ki, uint64_t now_us, uint64_t t);
+
+  void update_config();
   void run_LPF();
+  turbomath::Vector accel_correction(float ki, float dt, uint64_t now_us);
+  void integrate_delta_angle(float dt);
+  void update_from_delta_angle(float kp, float ki, float dt, uint64_t now_us);
+  void reset_delta_angle();
 };
 
 } // namespace rosflight_firmware
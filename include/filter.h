@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_FILTER_H
+#define ROSFLIGHT_FIRMWARE_FILTER_H
+
+#include <stdint.h>
+#include <turbomath/turbomath.h>
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief A second order IIR section filtering all three axes of a vector
+ * @details Transposed direct form II, so the coefficients can be changed while running (e.g. a notch
+ * tracking a moving frequency) without a transient. A disabled filter passes samples through unchanged.
+ */
+class Biquad
+{
+public:
+  Biquad();
+
+  /**
+   * @brief Configure as a low-pass filter
+   * @param sample_rate_hz The rate at which apply() is called (Hz)
+   * @param cutoff_hz The -3 dB frequency (Hz), the filter is disabled if it is not in (0, sample_rate_hz/2)
+   * @param q The quality factor, 1/sqrt(2) gives a Butterworth response
+   * @return True if the filter is enabled
+   */
+  bool set_lowpass(float sample_rate_hz, float cutoff_hz, float q = BUTTERWORTH_Q);
+
+  /**
+   * @brief Configure as a notch filter, keeping the filter state
+   * @param sample_rate_hz The rate at which apply() is called (Hz)
+   * @param center_hz The notch frequency (Hz), the filter is disabled if it is not in (0, sample_rate_hz/2)
+   * @param q The quality factor, the center frequency divided by the -3 dB bandwidth
+   * @return True if the filter is enabled
+   */
+  bool set_notch(float sample_rate_hz, float center_hz, float q);
+
+  void disable();
+  void reset();
+
+  inline bool enabled() const { return enabled_; }
+
+  inline turbomath::Vector apply(const turbomath::Vector& x)
+  {
+    if (!enabled_)
+      return x;
+    return turbomath::Vector(apply_axis(x.x, s1_.x, s2_.x),
+                             apply_axis(x.y, s1_.y, s2_.y),
+                             apply_axis(x.z, s1_.z, s2_.z));
+  }
+
+  // the same for callers that keep the three axes in an array
+  inline void apply(const float x[3], float y[3])
+  {
+    if (!enabled_)
+    {
+      y[0] = x[0];
+      y[1] = x[1];
+      y[2] = x[2];
+      return;
+    }
+    y[0] = apply_axis(x[0], s1_.x, s2_.x);
+    y[1] = apply_axis(x[1], s1_.y, s2_.y);
+    y[2] = apply_axis(x[2], s1_.z, s2_.z);
+  }
+
+  static constexpr float BUTTERWORTH_Q = 0.70710678f;
+
+private:
+  inline float apply_axis(float x, float& s1, float& s2) const
+  {
+    float y = b0_*x + s1;
+    s1 = b1_*x - a1_*y + s2;
+    s2 = b2_*x - a2_*y;
+    return y;
+  }
+
+  void set_coefficients(float b0, float b1, float b2, float a0, float a1, float a2);
+
+  bool enabled_;
+  float b0_, b1_, b2_, a1_, a2_;
+  turbomath::Vector s1_;
+  turbomath::Vector s2_;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_FILTER_H
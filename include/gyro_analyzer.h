@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_GYRO_ANALYZER_H
+#define ROSFLIGHT_FIRMWARE_GYRO_ANALYZER_H
+
+#include <stdint.h>
+#include <turbomath/turbomath.h>
+
+namespace rosflight_firmware
+{
+
+class ROSflight;
+
+/**
+ * @brief Finds the strongest vibration frequencies in the gyro signal with a bank of Goertzel filters
+ * @details A window of WINDOW_SIZE consecutive gyro samples is captured from the IMU path, then analyzed
+ * a few samples at a time from a low priority scheduler task, never for longer than TIME_SLICE_US per
+ * call. Samples arriving during the analysis are skipped, so the analyzer only takes idle time and
+ * simply reports less often when there is little of it.
+ */
+class GyroAnalyzer
+{
+public:
+  static constexpr uint16_t WINDOW_SIZE = 64;
+  static constexpr uint8_t NUM_BINS = 16;
+  static constexpr uint8_t MAX_PEAKS = 3;
+  static constexpr uint32_t TIME_SLICE_US = 80;
+
+  GyroAnalyzer(ROSflight& rf);
+
+  void init();
+
+  /**
+   * @brief Capture a bias-corrected, unfiltered gyro sample, called by Sensors for every IMU sample
+   * @param gyro The gyro sample (rad/s)
+   */
+  inline void push(const turbomath::Vector& gyro)
+  {
+    if (phase_ == PHASE_COLLECTING)
+    {
+      window_[count_++] = gyro;
+      if (count_ >= WINDOW_SIZE)
+        start_analysis();
+    }
+  }
+
+  /**
+   * @brief Continue the analysis of the captured window for at most TIME_SLICE_US
+   */
+  void run();
+
+  /**
+   * @brief Get a peak from the last analyzed window
+   * @param i The rank of the peak, 0 being the strongest
+   * @return The frequency of the peak (Hz), or 0 if no peak stood out of the spectrum
+   */
+  inline float peak_hz(uint8_t i) const { return (i < MAX_PEAKS) ? peaks_hz_[i] : 0.0f; }
+  inline uint32_t windows_analyzed() const { return windows_analyzed_; }
+
+  inline float bin_hz(uint8_t bin) const { return min_hz_ + bin*bin_spacing_hz_; }
+  inline float bin_power(uint8_t bin) const { return power_[bin]; }
+
+private:
+  // A bin is only a peak if its power is this many times the median over the bins, and the vibration
+  // is at least MIN_PEAK_AMPLITUDE (rad/s)
+  static constexpr float PEAK_THRESHOLD = 4.0f;
+  static constexpr float MIN_PEAK_AMPLITUDE = 0.01f;
+  // Samples processed between checks of the time slice
+  static constexpr uint16_t CHUNK_SIZE = 8;
+  // Low-pass constant applied to the strongest peak before it drives the dynamic notch
+  static constexpr float NOTCH_TRACKING_ALPHA = 0.3f;
+
+  enum : uint8_t
+  {
+    PHASE_DISABLED,
+    PHASE_COLLECTING,
+    PHASE_MEAN,
+    PHASE_WINDOWING,
+    PHASE_FILTERING
+  };
+
+  ROSflight& RF_;
+
+  uint8_t phase_;
+  uint16_t count_;   // samples captured, windowed or filtered in the current phase
+  uint8_t bin_;      // bin being filtered
+  turbomath::Vector window_[WINDOW_SIZE];
+  float hann_[WINDOW_SIZE];
+  turbomath::Vector mean_;
+  turbomath::Vector s1_;
+  turbomath::Vector s2_;
+
+  float min_hz_;
+  float bin_spacing_hz_;
+  float coeff_[NUM_BINS];  // Goertzel coefficients, 2*cos(2*pi*f/fs)
+  float power_[NUM_BINS];  // spectrum of the last window, summed over the axes
+
+  float peaks_hz_[MAX_PEAKS];
+  uint32_t windows_analyzed_;
+  bool drive_notch_;
+  float notch_hz_;
+
+  void param_change_callback(uint16_t param_id);
+  void update_config();
+  void start_analysis();
+  void sum_window(uint16_t end);
+  void apply_window(uint16_t end);
+  void filter_bin(uint16_t end);
+  void find_peaks();
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_GYRO_ANALYZER_H
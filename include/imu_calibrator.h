@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_IMU_CALIBRATOR_H
+#define ROSFLIGHT_FIRMWARE_IMU_CALIBRATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <turbomath/turbomath.h>
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Mean and variance of a stream of vectors, per component, with Welford's algorithm
+ * @details Unlike the sum and the sum of squares, the running mean and sum of squared deviations
+ * never grow much larger than the values themselves, so single precision doesn't lose the variance
+ * of a small noise on a large offset (such as gravity on the accelerometer).
+ */
+class RunningStats
+{
+public:
+  inline void clear()
+  {
+    n_ = 0;
+    mean_ = turbomath::Vector(0.0f, 0.0f, 0.0f);
+    m2_ = turbomath::Vector(0.0f, 0.0f, 0.0f);
+  }
+
+  inline void add(const turbomath::Vector& x)
+  {
+    n_++;
+    turbomath::Vector delta = x - mean_;
+    turbomath::axpy(1.0f/static_cast<float>(n_), delta, mean_);
+    turbomath::Vector delta2 = x - mean_;
+    m2_.x += delta.x*delta2.x;
+    m2_.y += delta.y*delta2.y;
+    m2_.z += delta.z*delta2.z;
+  }
+
+  inline uint32_t count() const { return n_; }
+  inline const turbomath::Vector& mean() const { return mean_; }
+
+  // sample variance of each component, 0 until there are two samples
+  inline turbomath::Vector variance() const
+  {
+    return (n_ > 1) ? m2_ / static_cast<float>(n_ - 1) : turbomath::Vector(0.0f, 0.0f, 0.0f);
+  }
+
+private:
+  uint32_t n_ = 0;
+  turbomath::Vector mean_ = {0, 0, 0};
+  turbomath::Vector m2_ = {0, 0, 0};
+};
+
+/**
+ * @brief Learns the gyro bias as a function of temperature while the vehicle sits still
+ * @details Raw IMU samples are gathered in windows of WINDOW_SIZE. A window is still if the variance of
+ * every gyro and accel axis is below a noise threshold, the mean accel hasn't moved since the previous
+ * window, and the mean gyro is close to the bias the model already expects at that temperature. The mean gyro
+ * of each still window is then a measurement of the bias, which is averaged into one of NUM_BINS
+ * temperature bins of BIN_WIDTH degrees. Each bin keeps the running mean of its temperature and bias,
+ * with the weight capped at BIN_MAX_WEIGHT windows so that it keeps following a slowly aging sensor.
+ *
+ * The bias at a temperature is interpolated between the populated bins on either side of it, and held
+ * at the nearest one beyond the ends of the model. Until any bin is populated it is the default bias.
+ */
+class ImuCalibrator
+{
+public:
+  static constexpr uint16_t WINDOW_SIZE = 256;
+  static constexpr uint8_t NUM_BINS = 16;
+  static constexpr float MIN_TEMPERATURE = -20.0f;  // deg C, lower edge of the first bin
+  static constexpr float BIN_WIDTH = 5.0f;          // deg C
+  static constexpr uint16_t BIN_MAX_WEIGHT = 64;
+
+  // Stillness thresholds, a few times the noise of a typical MEMS IMU at 1 kHz
+  static constexpr float MAX_GYRO_VARIANCE = 4e-4f;   // (rad/s)^2
+  static constexpr float MAX_ACCEL_VARIANCE = 0.04f;  // (m/s^2)^2
+  static constexpr float MAX_ACCEL_DRIFT = 0.05f;     // m/s^2 between the means of consecutive windows
+  static constexpr float MAX_BIAS = 1.0f;            // rad/s, the largest bias accepted into an empty model
+  static constexpr float MAX_BIAS_ERROR = 0.05f;      // rad/s between the mean gyro and the expected bias
+
+  ImuCalibrator();
+
+  // forget the model and the current window
+  void reset();
+
+  /**
+   * @brief Set the bias returned until the model has any data
+   * @param bias The gyro bias (rad/s)
+   */
+  inline void set_default_gyro_bias(const turbomath::Vector& bias) { default_gyro_bias_ = bias; }
+
+  /**
+   * @brief Add a raw (uncorrected) IMU sample
+   * @return True if the sample completed a still window, which updated the model
+   */
+  bool push(const turbomath::Vector& accel, const turbomath::Vector& gyro, float temperature);
+
+  /**
+   * @brief Get the gyro bias the model expects at a temperature
+   * @param temperature The IMU temperature (deg C)
+   * @return The gyro bias (rad/s)
+   */
+  turbomath::Vector gyro_bias(float temperature) const;
+
+  inline bool has_model() const { return bins_populated_ > 0; }
+  inline uint8_t bins_populated() const { return bins_populated_; }
+  inline uint32_t windows_accepted() const { return windows_accepted_; }
+  inline uint32_t windows_rejected() const { return windows_rejected_; }
+
+private:
+  struct Bin
+  {
+    uint16_t weight;  // windows averaged into the bin, up to BIN_MAX_WEIGHT
+    float temperature;
+    turbomath::Vector gyro_bias;
+  };
+
+  bool window_is_still(const turbomath::Vector& gyro_mean, float temperature) const;
+  void update_bin(float temperature, const turbomath::Vector& gyro_mean);
+
+  turbomath::Vector default_gyro_bias_;
+
+  RunningStats gyro_stats_;
+  RunningStats accel_stats_;
+  float temperature_mean_;
+  turbomath::Vector last_accel_mean_;
+  bool have_last_accel_mean_;
+
+  Bin bins_[NUM_BINS];
+  uint8_t bins_populated_;
+  uint32_t windows_accepted_;
+  uint32_t windows_rejected_;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_IMU_CALIBRATOR_H
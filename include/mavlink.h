@@ -40,7 +40,12 @@
 #include <mavlink/v1.0/rosflight/mavlink.h>
 
 # pragma GCC diagnostic pop
+#include "delta_batch.h"
+#include "mavlink2.h"
 #include "nanoprintf.h"
+#include "param.h"
+#include "ring_buffer.h"
+#include "timesync.h"
 
 namespace rosflight_firmware {
 
@@ -64,33 +69,85 @@ private:
 
     STREAM_ID_SERVO_OUTPUT_RAW,
     STREAM_ID_RC_RAW,
+    STREAM_ID_PROFILER,
+    STREAM_ID_IMU_BATCH,
+    STREAM_ID_TELEMETRY,
+    STREAM_ID_GYRO_PEAKS,
+    STREAM_ID_TIMESYNC,
     STREAM_ID_LOW_PRIORITY,
     STREAM_COUNT
   };
 
+  // When the link is saturated, messages are dropped lowest priority first: a message is only queued if
+  // it leaves (PRIORITY_CRITICAL - priority)/8 of the TX buffer free for more important traffic
+  enum : uint8_t
+  {
+    PRIORITY_LOW,      // debugging
+    PRIORITY_MEDIUM,   // auxiliary sensors and raw I/O
+    PRIORITY_HIGH,     // attitude and IMU
+    PRIORITY_CRITICAL  // heartbeat, status, parameters, logs and command responses
+  };
+
+  static constexpr uint16_t TX_BUFFER_SIZE = 512;
+
+  // How often the adaptive stream rates are recomputed, and the slowest they get throttled to
+  static constexpr uint32_t STREAM_RATE_UPDATE_US = 1000000;
+  static constexpr uint32_t STREAM_MAX_ADAPTIVE_PERIOD_US = 1000000;
+
   uint32_t sysid_;
   uint32_t compid_;
   uint64_t offboard_control_time_;
   ROSflight& RF_;
   uint8_t send_params_index_;
+  uint8_t send_profiler_index_;
+  uint16_t encapsulated_seq_;
+  uint16_t param_dump_chunk_;
+  uint32_t param_upload_received_;
+  bool param_upload_active_;
+  uint16_t blackbox_chunk_;
+  uint16_t blackbox_chunk_count_;
   mavlink_message_t in_buf_;
   mavlink_status_t status_;
+  Mavlink2Parser parser2_;
+  bool v2_; // send MAVLink 2 frames, both versions are always received
   bool initialized_;
 
+  // Offset and skew to the companion computer clock, from the round trips of our TIMESYNC requests
+  TimeSync timesync_;
+
+  RingBuffer<uint8_t, TX_BUFFER_SIZE> tx_buffer_;
+  uint8_t tx_priority_;
+  uint32_t tx_dropped_bytes_;
+  uint32_t tx_dropped_messages_;
+  uint32_t tx_attempted_bytes_;
+  uint32_t rx_parse_errors_; // of the v1 parser
+  uint64_t next_stream_rate_update_us_;
+
   typedef  void (Mavlink::*MavlinkStreamFcn)(void);
 
   typedef struct
   {
-    uint32_t period_us;
+    uint32_t period_us;           // period actually used
     uint64_t next_time_us;
+    uint8_t priority;
     MavlinkStreamFcn send_function;
+    uint32_t requested_period_us; // period set through the STRM_* parameters
+    float avg_bytes;              // average number of bytes sent per call of send_function
+    uint16_t rate_param;          // STRM_* parameter setting the rate, PARAMS_COUNT if there is none
   } mavlink_stream_t;
 
   void handle_msg_param_request_list(void);
   void handle_msg_param_request_read(const mavlink_message_t *const msg);
   void handle_msg_param_set(const mavlink_message_t *const msg);
   void send_next_param(void);
+  void handle_msg_data_transmission_handshake(const mavlink_message_t *const msg);
+  void handle_msg_encapsulated_data(const mavlink_message_t *const msg);
+  void send_param_transfer_handshake(uint8_t type, uint16_t chunk, uint8_t result);
+  void send_next_param_chunk(void);
+  void send_blackbox_handshake(uint8_t type, uint8_t result);
+  void send_next_blackbox_chunk(void);
 
+  void parse_byte(uint8_t byte);
   void handle_mavlink_message(void);
 
   void handle_msg_rosflight_cmd(const mavlink_message_t *const msg);
@@ -103,32 +160,46 @@ private:
   void send_imu(void);
   void send_output_raw(void);
   void send_rc_raw(void);
+  void send_profiler(void);
+  void send_imu_batch(void);
+  void send_telemetry(void);
+  void send_telemetry_frame(void);
+  void send_gyro_peaks(void);
+  void send_timesync(void);
   void send_diff_pressure(void);
   void send_baro(void);
   void send_sonar(void);
   void send_mag(void);
   void send_low_priority(void);
   void send_message(const mavlink_message_t &msg);
+  inline uint32_t non_payload_bytes() const { return v2_ ? MAVLINK2_NUM_NON_PAYLOAD_BYTES : MAVLINK_NUM_NON_PAYLOAD_BYTES; }
+  void drain_tx(void);
   void send_log_message(uint8_t severity, const char *text);
   void stream_set_period(uint8_t stream_id, uint32_t period_us);
+  void update_stream_rates(void);
+  void param_change_callback(uint16_t param_id);
 
   // Debugging Utils
-  void send_named_value_int(const char *const name, int32_t value);
   //  void send_named_command_struct(const char *const name, control_t command_struct);
 
   mavlink_stream_t mavlink_streams_[STREAM_COUNT] = {
-    //  period_us    last_time_us   send_function
-    { 1000000,     0,             &rosflight_firmware::Mavlink::send_heartbeat },
-    { 1000000,     0,             &rosflight_firmware::Mavlink::send_status},
-    { 200000,      0,             &rosflight_firmware::Mavlink::send_attitude },
-    { 1000,        0,             &rosflight_firmware::Mavlink::send_imu },
-    { 200000,      0,             &rosflight_firmware::Mavlink::send_diff_pressure },
-    { 200000,      0,             &rosflight_firmware::Mavlink::send_baro },
-    { 100000,      0,             &rosflight_firmware::Mavlink::send_sonar },
-    { 6250,        0,             &rosflight_firmware::Mavlink::send_mag },
-    { 0,           0,             &rosflight_firmware::Mavlink::send_output_raw },
-    { 0,           0,             &rosflight_firmware::Mavlink::send_rc_raw },
-    { 5000,        0,             &rosflight_firmware::Mavlink::send_low_priority }
+    //  period_us    next_time_us   priority            send_function                                         requested_period_us  avg_bytes  rate_param
+    { 1000000,     0,             PRIORITY_CRITICAL,  &rosflight_firmware::Mavlink::send_heartbeat,       1000000,             0.0f,       PARAM_STREAM_HEARTBEAT_RATE },
+    { 1000000,     0,             PRIORITY_CRITICAL,  &rosflight_firmware::Mavlink::send_status,          1000000,             0.0f,       PARAM_STREAM_STATUS_RATE },
+    { 200000,      0,             PRIORITY_HIGH,      &rosflight_firmware::Mavlink::send_attitude,        200000,              0.0f,       PARAM_STREAM_ATTITUDE_RATE },
+    { 1000,        0,             PRIORITY_HIGH,      &rosflight_firmware::Mavlink::send_imu,             1000,                0.0f,       PARAM_STREAM_IMU_RATE },
+    { 200000,      0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_diff_pressure,   200000,              0.0f,       PARAM_STREAM_AIRSPEED_RATE },
+    { 200000,      0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_baro,            200000,              0.0f,       PARAM_STREAM_BARO_RATE },
+    { 100000,      0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_sonar,           100000,              0.0f,       PARAM_STREAM_SONAR_RATE },
+    { 6250,        0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_mag,             6250,                0.0f,       PARAM_STREAM_MAG_RATE },
+    { 0,           0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_output_raw,      0,                   0.0f,       PARAM_STREAM_OUTPUT_RAW_RATE },
+    { 0,           0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_rc_raw,          0,                   0.0f,       PARAM_STREAM_RC_RAW_RATE },
+    { 0,           0,             PRIORITY_LOW,       &rosflight_firmware::Mavlink::send_profiler,        0,                   0.0f,       PARAM_STREAM_PROFILER_RATE },
+    { 0,           0,             PRIORITY_MEDIUM,    &rosflight_firmware::Mavlink::send_imu_batch,       0,                   0.0f,       PARAM_STREAM_IMU_BATCH_RATE },
+    { 0,           0,             PRIORITY_HIGH,      &rosflight_firmware::Mavlink::send_telemetry,       0,                   0.0f,       PARAM_STREAM_TELEMETRY_RATE },
+    { 0,           0,             PRIORITY_LOW,       &rosflight_firmware::Mavlink::send_gyro_peaks,      0,                   0.0f,       PARAM_STREAM_GYRO_PEAKS_RATE },
+    { 0,           0,             PRIORITY_HIGH,      &rosflight_firmware::Mavlink::send_timesync,        0,                   0.0f,       PARAM_STREAM_TIMESYNC_RATE },
+    { 5000,        0,             PRIORITY_CRITICAL,  &rosflight_firmware::Mavlink::send_low_priority,    5000,                0.0f,       PARAMS_COUNT }
   };
 
 
@@ -142,6 +213,78 @@ public:
     LOG_CRITICAL = 2
   };
 
+  // Payload types, carried in the first data byte of ENCAPSULATED_DATA messages
+  enum : uint8_t
+  {
+    ENCAPSULATED_TYPE_IMU_BATCH = 1,
+    ENCAPSULATED_TYPE_PARAM_DUMP = 2,
+    ENCAPSULATED_TYPE_PARAM_UPLOAD = 3,
+    ENCAPSULATED_TYPE_BLACKBOX = 4,
+    ENCAPSULATED_TYPE_BLACKBOX_ERASE = 5,
+    ENCAPSULATED_TYPE_TELEMETRY = 6
+  };
+
+  // Bulk parameter transfer moves the Params bulk image in chunks of PARAM_CHUNK_SIZE bytes, each an
+  // ENCAPSULATED_DATA message with seqnr = chunk index and data = {type, chunk bytes}. Transfers are set up
+  // with DATA_TRANSMISSION_HANDSHAKE (type = the encapsulated type, width = chunk index):
+  //   dump:   the host requests chunks from width on; the FCU answers with a handshake giving size, packets
+  //           and payload, then streams the chunks. A dump is resumed by requesting the first missing chunk.
+  //   upload: the host starts with width = 0 and sends the chunks in any order; width != 0 only queries the
+  //           progress. The FCU answers with width = first missing chunk, and applies the image once all
+  //           chunks are in, answering with jpg_quality = PARAM_TRANSFER_APPLIED or PARAM_TRANSFER_REJECTED.
+  static constexpr uint8_t PARAM_CHUNK_SIZE = MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN - 1;
+  static constexpr uint16_t PARAM_CHUNK_COUNT = (Params::BULK_IMAGE_SIZE + PARAM_CHUNK_SIZE - 1)/PARAM_CHUNK_SIZE;
+  enum : uint8_t
+  {
+    PARAM_TRANSFER_IN_PROGRESS,
+    PARAM_TRANSFER_APPLIED,
+    PARAM_TRANSFER_REJECTED
+  };
+
+  // IMU batch frame layout (little endian):
+  //   [0] type, [1] sample count, [2..3] int16 temperature (0.01 deg C), [4..11] uint64 time of first sample (us)
+  //   then per sample: uint16 time since first sample (us), int16 accel[3], int16 gyro[3]
+  // The blackbox log (see blackbox.h) is downloaded like a parameter dump, in chunks of BLACKBOX_CHUNK_SIZE
+  // bytes with size = the length of the log, the last chunk padded with 0xFF. The handshake of a
+  // ENCAPSULATED_TYPE_BLACKBOX_ERASE transfer starts erasing the log instead, and "blackbox erased" is logged
+  // once that is done. Both are answered with PARAM_TRANSFER_REJECTED while armed.
+  static constexpr uint8_t BLACKBOX_CHUNK_SIZE = PARAM_CHUNK_SIZE;
+
+  static constexpr uint8_t IMU_BATCH_HEADER_SIZE = 12;
+  static constexpr uint8_t IMU_BATCH_SAMPLE_SIZE = 14;
+  static constexpr uint8_t IMU_BATCH_SAMPLES_PER_FRAME = 17;
+  static constexpr float IMU_BATCH_ACCEL_LSB_PER_MPS2 = 400.0f; // +/- 81.9 m/s^2
+  static constexpr float IMU_BATCH_GYRO_LSB_PER_RADPS = 900.0f; // +/- 36.4 rad/s
+
+  // Telemetry frame layout (little endian), for the IMU and attitude at rates SMALL_IMU and
+  // ATTITUDE_QUATERNION can't keep up with:
+  //   [0] type, [1] sample count, [2..9] uint64 time of first sample (us), then the samples as a TelemetryBatch
+  // with the fields in TelemetryField order. Each sample of the stream is added to the frame being built, which
+  // is sent once the next sample doesn't fit or its first sample is TELEMETRY_MAX_LATENCY_US old.
+  enum TelemetryField : uint8_t
+  {
+    TELEMETRY_ACCEL_X, TELEMETRY_ACCEL_Y, TELEMETRY_ACCEL_Z,  // IMU_BATCH_ACCEL_LSB_PER_MPS2
+    TELEMETRY_GYRO_X, TELEMETRY_GYRO_Y, TELEMETRY_GYRO_Z,     // IMU_BATCH_GYRO_LSB_PER_RADPS
+    TELEMETRY_Q_W, TELEMETRY_Q_X, TELEMETRY_Q_Y, TELEMETRY_Q_Z, // TELEMETRY_QUATERNION_LSB
+    TELEMETRY_NUM_FIELDS
+  };
+  static constexpr uint8_t TELEMETRY_HEADER_SIZE = 10;
+  static constexpr float TELEMETRY_QUATERNION_LSB = 10000.0f;
+  static constexpr uint32_t TELEMETRY_MAX_LATENCY_US = 50000;
+  typedef DeltaBatch<TELEMETRY_NUM_FIELDS, MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN - TELEMETRY_HEADER_SIZE>
+      TelemetryBatch;
+
+private:
+  TelemetryBatch telemetry_batch_;
+  uint64_t telemetry_last_time_us_; // time of the last IMU sample added, so a faster stream doesn't repeat it
+
+public:
+
+  // Received bytes are read RX_CHUNK_SIZE at a time, at most RX_BYTES_PER_PASS per call of receive(), about
+  // 2.8 ms of traffic at 921600 baud
+  static constexpr uint16_t RX_CHUNK_SIZE = 64;
+  static constexpr uint16_t RX_BYTES_PER_PASS = 256;
+
   Mavlink(ROSflight &_rf);
 
   void init();
@@ -152,7 +295,17 @@ public:
   void update_status();
   void log(uint8_t severity, const char *fmt, ...);
 
+  void send_named_value_int(const char *const name, int32_t value);
   void send_named_value_float(const char *const name, float value);
+
+  inline uint32_t tx_dropped_bytes() const { return tx_dropped_bytes_; }
+  inline uint32_t tx_dropped_messages() const { return tx_dropped_messages_; }
+  inline const TimeSync& timesync() const { return timesync_; }
+  inline const Mavlink2Parser& mavlink2_parser() const { return parser2_; }
+  // Frames dropped by either parser (bad CRC, or bytes that weren't part of a frame), and times the board's
+  // RX buffer overflowed
+  inline uint32_t rx_parse_errors() const { return rx_parse_errors_ + parser2_.frames_dropped(); }
+  uint32_t rx_overflows() const;
 };
 
 } // namespace rosflight_firmware
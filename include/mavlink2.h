@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_MAVLINK2_H
+#define ROSFLIGHT_FIRMWARE_MAVLINK2_H
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wswitch-default"
+#pragma GCC diagnostic ignored "-Wcast-align"
+
+#include <mavlink/v1.0/rosflight/mavlink.h>
+
+# pragma GCC diagnostic pop
+
+namespace rosflight_firmware
+{
+
+// MAVLink 2 framing of the messages of the (v1.0) rosflight dialect, selected with MAVLINK_VER:
+//   [0] 0xFD, [1] payload length, [2] incompat flags, [3] compat flags, [4] seq, [5] sysid, [6] compid,
+//   [7..9] msgid (24 bit), payload, [n..n+1] CRC-16/MCRF4XX over [1..n-1] and the dialect's CRC extra byte
+// The trailing zero bytes of the payload are left out (all but the first) and the receiver fills them back in.
+// Messages are never signed; a signed frame (incompat flag 0x01) is dropped, since it can't be checked.
+static constexpr uint8_t MAVLINK2_STX = 0xFD;
+static constexpr uint8_t MAVLINK2_HEADER_SIZE = 10;
+static constexpr uint8_t MAVLINK2_NUM_NON_PAYLOAD_BYTES = MAVLINK2_HEADER_SIZE + 2;
+static constexpr uint8_t MAVLINK2_INCOMPAT_FLAG_SIGNED = 0x01;
+static constexpr uint8_t MAVLINK2_SIGNATURE_SIZE = 13;
+
+/**
+ * @brief The length of the MAVLink 2 frame of a message packed by the dialect's pack functions
+ */
+uint16_t mavlink2_frame_length(const mavlink_message_t &msg);
+
+/**
+ * @brief Write the MAVLink 2 frame of a message packed by the dialect's pack functions
+ * @param buf Where to write it, with room for mavlink2_frame_length(msg) bytes
+ * @return The number of bytes written
+ */
+uint16_t mavlink2_serialize(const mavlink_message_t &msg, uint8_t *buf);
+
+/**
+ * @brief Byte-at-a-time MAVLink 2 parser, the counterpart of mavlink_parse_char
+ */
+class Mavlink2Parser
+{
+public:
+  Mavlink2Parser();
+
+  /**
+   * @brief Feed the next received byte
+   * @param msg The message being received, complete with its full-length (zero-filled) payload once this
+   * returns true, ready for the dialect's decode functions
+   * @return True if the byte completed a valid frame
+   */
+  bool parse(uint8_t byte, mavlink_message_t *msg);
+
+  inline bool idle() const { return state_ == STATE_IDLE; } // not in the middle of a frame
+  inline uint32_t frames_received() const { return frames_received_; }
+  inline uint32_t frames_dropped() const { return frames_dropped_; } // bad CRC, signed or unknown message
+
+private:
+  enum : uint8_t
+  {
+    STATE_IDLE,
+    STATE_HEADER,
+    STATE_PAYLOAD,
+    STATE_CRC,
+    STATE_SIGNATURE
+  };
+
+  uint8_t state_;
+  uint8_t header_[MAVLINK2_HEADER_SIZE];
+  uint16_t index_; // within the header, payload, CRC or signature of the current state
+  uint16_t crc_;
+  uint8_t received_crc_[2];
+  uint32_t frames_received_;
+  uint32_t frames_dropped_;
+
+  bool finish_frame(mavlink_message_t *msg);
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_MAVLINK2_H
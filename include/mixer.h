@@ -36,6 +36,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "controller.h"
+
 namespace rosflight_firmware
 {
 
@@ -59,7 +61,9 @@ public:
     X8 = 8,
     TRICOPTER = 9,
     FIXEDWING = 10,
+    CUSTOM = 11,
     NUM_MIXERS,
+    NUM_BUILT_IN_MIXERS = CUSTOM,
     INVALID_MIXER = 255
   };
 
@@ -83,138 +87,63 @@ public:
 private:
   ROSflight& RF_;
 
+  // Parameters used on every loop, refreshed by param_change_callback
+  typedef struct
+  {
+    float motor_min_pwm;
+    float motor_pwm_scale;      // MOTOR_MAX_PWM - MOTOR_MIN_PWM
+    float motor_armed_min;      // MOTOR_IDLE_THR if ARM_SPIN_MOTORS is set, otherwise zero
+    bool fixed_wing;
+    float aileron_sign;         // -1 if the channel is reversed, 1 otherwise
+    float elevator_sign;
+    float rudder_sign;
+    bool airmode;               // MIXER_AIRMODE
+    bool thrust_curve;          // MOTOR_THR_CURVE is non-zero, so motor outputs go through thrust_curve_
+    bool digital_motors;        // the motors use MOTOR_PROTOCOL through Board::motor_write instead of pwm_write
+  } config_t;
+
+  config_t config_;
+
+  // ESC command for evenly spaced normalized thrusts from 0 to 1, the inverse of MOTOR_THR_CURVE
+  static constexpr int THRUST_CURVE_POINTS = 33;
+  float thrust_curve_[THRUST_CURVE_POINTS];
+
   float raw_outputs_[8];
   float unsaturated_outputs_[8];
-
+  float pwm_outputs_[8];        // pulse widths (us) for Board::pwm_write_multi, negative for outputs it skips
+  float pwm_scale_[8];          // raw output to pulse width, refreshed whenever the mixer or the PWM params change
+  float pwm_offset_[8];
+  float motor_inv_F_[8];        // 1/F for each output with a thrust component, so mix_airmode doesn't divide
+
+  // Loaded from the MIX_* params when MIXER is CUSTOM
+  mixer_t custom_mixer_;
+
+  void update_config();
+  void update_pwm_scaling();
+  bool load_custom_mixer();
+  void update_thrust_curve(float a);
+  float thrust_to_command(float thrust) const;
+  void mix_saturating(const Controller::Output& commands);
+  void mix_airmode(const Controller::Output& commands);
   void write_motor(uint8_t index, float value);
   void write_servo(uint8_t index, float value);
 
-  const mixer_t esc_calibration_mixing =
-  {
-    {M, M, M, M, M, M, NONE, NONE},
-    { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f}, // F Mix
-    { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-  };
-
-  const mixer_t quadcopter_plus_mixing =
-  {
-    {M, M, M, M, NONE, NONE, NONE, NONE}, // output_type
-
-    { 1.0f,  1.0f,  1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
-    { 0.0f, -1.0f,  0.0f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
-    { 1.0f, -1.0f,  1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
-  };
-
-  const mixer_t quadcopter_x_mixing =
-  {
-    {M, M, M, M, NONE, NONE, NONE, NONE}, // output_type
-
-    { 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
-    {-1.0f, -1.0f, 1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 1.0f, -1.0f,-1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
-    { 1.0f, -1.0f, 1.0f,-1.0f,  0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
-  };
-
-  const mixer_t hex_plus_mixing =
-  {
-    {M, M, M, M, M, M, M, M}, // output_type
-
-    { 1.0f,  1.0f,       1.0f,      1.0f,  1.0f,      1.0f,      0.0f, 0.0f}, //  F  Mix
-    { 0.0f, -0.866025f, -0.866025f, 0.0f,  0.866025f, 0.866025f, 0.0f, 0.0f}, //  X  Mix
-    { 1.0f,  0.5f,      -0.5f,     -1.0f, -0.5f,      0.5f,      0.0f, 0.0f}, //  Y  Mix
-    { 1.0f, -1.0f,       1.0f,     -1.0f,  1.0f,     -1.0f,      0.0f, 0.0f}  //  Z  Mix
-  };
-
-  const mixer_t hex_x_mixing =
-  {
-    {M, M, M, M, M, M, M, M}, // output_type
-
-    {   1.0f,       1.0f,  1.0f,       1.0f,      1.0f,  1.0f,      0.0f,  0.0f}, //  F  Mix
-    {  -0.5f,      -1.0f, -0.5f,       0.5f,      1.0f,  0.5f,      0.0f,  0.0f}, //  X  Mix
-    {   0.866025f,  0.0f, -0.866025f, -0.866025f, 0.0f,  0.866025f, 0.0f,  0.0f}, //  Y  Mix
-    {  1.0f,       -1.0f,  1.0f,      -1.0f,      1.0f, -1.0f,      0.0f,  0.0f}  //  Z  Mix
-  };
-
-  const mixer_t octocopter_plus_mixing =
-  {
-    {M, M, M, M, M, M, M, M}, // output_type
-
-    { 1.0f,   1.0f,    1.0f,   1.0f,     1.0f,   1.0f,    1.0f,  1.0f},   //  F  Mix
-    { 0.0f,  -0.707f, -1.0f,  -0.707f,   0.0f,   0.707f,  1.0f,  0.707f}, //  X  Mix
-    { 1.0f,   0.707f,  0.0f,  -0.707f,  -1.0f,  -0.707f,  0.0f,  0.707f}, //  Y  Mix
-    { 1.0f,  -1.0f,    1.0f,  -1.0f,     1.0f,  -1.0f,    1.0f, -1.0f}     //  Z  Mix
-  };
-
-  const mixer_t octocopter_x_mixing =
-  {
-    {M, M, M, M, M, M, M, M}, // output_type
-
-    { 1.0f,    1.0f,    1.0f,    1.0f,   1.0f,    1.0f,   1.0f,   1.0f},  // F Mix
-    {-0.414f, -1.0f,   -1.0f,   -0.414f, 0.414f,  1.0f,   1.0f,   0.414}, // X Mix
-    { 1.0f,    0.414f, -0.414f, -1.0f,  -1.0f,   -0.414f, 0.414f, 1.0},   // Y Mix
-    { 1.0f,   -1.0f,    1.0f,   -1.0f,   1.0f,  -1.0f,    1.0f,  -1.0f}   // Z Mix
-  };
-
-  const mixer_t Y6_mixing =
-  {
-    {M, M, M, M, M, M, NONE, NONE}, // output_type
-
-    { 1.0f,   1.0f,    1.0f,    1.0f,    1.0f,    1.0f,   0.0f, 0.0f}, // F Mix
-    {-1.0f,  -1.0f,    0.0f,    0.0f,    1.0f,    1.0f,   0.0f, 0.0f}, // X Mix
-    { 0.667f, 0.667f, -1.333f, -1.333f,  0.667f,  0.667f, 0.0f, 0.0f}, // Y Mix
-    { 1.0f,  -1.0f,    1.0f,   -1.0f,    1.0f,   -1.0f,   0.0f, 0.0f}  // Z Mix
-  };
-
-  const mixer_t X8_mixing =
-  {
-    {M, M, M, M, M, M, M, M}, // output_type
-
-    { 1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f}, // F Mix
-    {-1.0f, -1.0f, -1.0f, -1.0f,  1.0f,  1.0f,  1.0f,  1.0f}, // X Mix
-    { 1.0f,  1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f,  1.0f}, // Y Mix
-    { 1.0f, -1.0f,  1.0f, -1.0f,  1.0f, -1.0f,  1.0f, -1.0f}  // Z Mix
-  };
-
-  const mixer_t tricopter_mixing =
-  {
-    {M, M, M, S, NONE, NONE, NONE, NONE}, // output_type
-
-    { 1.0f,   0.0f, 1.0f,    1.0f,   0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
-    {-1.0f,   0.0f, 0.0f,    1.0f,   0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 0.667f, 0.0f, 0.667f, -1.333f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
-    { 0.0f,   1.0f, 0.0f,    0.0f,   0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
-  };
-
-  const mixer_t fixedwing_mixing =
-  {
-    {S, S, M, S, S, M, NONE, NONE},
-
-    { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
-    { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
-    { 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
-    { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
-  };
-
+  // The built-in mixers are static so that they live in flash with the code, and only the custom mixer takes RAM
+  static const mixer_t esc_calibration_mixing;
+  static const mixer_t quadcopter_plus_mixing;
+  static const mixer_t quadcopter_x_mixing;
+  static const mixer_t hex_plus_mixing;
+  static const mixer_t hex_x_mixing;
+  static const mixer_t octocopter_plus_mixing;
+  static const mixer_t octocopter_x_mixing;
+  static const mixer_t Y6_mixing;
+  static const mixer_t X8_mixing;
+  static const mixer_t tricopter_mixing;
+  static const mixer_t fixedwing_mixing;
 
   const mixer_t *mixer_to_use_;
 
-  const mixer_t *array_of_mixers_[NUM_MIXERS] =
-  {
-    &esc_calibration_mixing,
-    &quadcopter_plus_mixing,
-    &quadcopter_x_mixing,
-    &hex_plus_mixing,
-    &hex_x_mixing,
-    &octocopter_plus_mixing,
-    &octocopter_x_mixing,
-    &Y6_mixing,
-    &X8_mixing,
-    &tricopter_mixing,
-    &fixedwing_mixing,
-  };
+  static const mixer_t *const array_of_mixers_[NUM_BUILT_IN_MIXERS];
 
 public:
   Mixer(ROSflight& _rf);
@@ -222,6 +151,7 @@ public:
   void init_PWM();
   void init_mixing();
   void mix_output();
+  void mix_output(const Controller::Output& commands);
   void param_change_callback(uint16_t param_id);
   inline const float* get_outputs() const {return raw_outputs_;}
 };
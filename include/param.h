@@ -34,7 +34,6 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <functional>
 
 #ifndef GIT_VERSION_HASH
 #define GIT_VERSION_HASH 0x00
@@ -59,6 +58,7 @@ enum : uint16_t
   /*** MAVLINK CONFIGURATION ***/
   /*****************************/
   PARAM_SYSTEM_ID,
+  PARAM_MAVLINK_VERSION,
   PARAM_STREAM_HEARTBEAT_RATE,
   PARAM_STREAM_STATUS_RATE,
 
@@ -71,6 +71,20 @@ enum : uint16_t
 
   PARAM_STREAM_OUTPUT_RAW_RATE,
   PARAM_STREAM_RC_RAW_RATE,
+  PARAM_STREAM_PROFILER_RATE,
+  PARAM_STREAM_IMU_BATCH_RATE,
+  PARAM_STREAM_TELEMETRY_RATE,
+  PARAM_STREAM_GYRO_PEAKS_RATE,
+  PARAM_STREAM_TIMESYNC_RATE,
+
+  PARAM_STREAM_ADAPTIVE,
+  PARAM_STREAM_BANDWIDTH_FRACTION,
+
+  /******************************/
+  /*** BLACKBOX CONFIGURATION ***/
+  /******************************/
+  PARAM_BLACKBOX,
+  PARAM_BLACKBOX_RATE_DIV,
 
   /********************************/
   /*** CONTROLLER CONFIGURATION ***/
@@ -102,6 +116,12 @@ enum : uint16_t
   PARAM_Z_EQ_TORQUE,
 
   PARAM_PID_TAU,
+  PARAM_PID_ROLL_FF,
+  PARAM_PID_PITCH_FF,
+  PARAM_PID_YAW_FF,
+  PARAM_PID_DTERM_LPF_HZ,
+  PARAM_PID_ANTIWINDUP_TAU,
+  PARAM_CONTROL_PERIOD_TOLERANCE,
 
   /*************************/
   /*** PWM CONFIGURATION ***/
@@ -112,6 +132,8 @@ enum : uint16_t
   PARAM_MOTOR_MAX_PWM,
   PARAM_MOTOR_MIN_PWM,
   PARAM_SPIN_MOTORS_WHEN_ARMED,
+  PARAM_MOTOR_THRUST_CURVE,
+  PARAM_MOTOR_PROTOCOL,
 
   /*******************************/
   /*** ESTIMATOR CONFIGURATION ***/
@@ -123,12 +145,28 @@ enum : uint16_t
   PARAM_FILTER_USE_QUAD_INT,
   PARAM_FILTER_USE_MAT_EXP,
   PARAM_FILTER_USE_ACC,
+  PARAM_FILTER_UPDATE_RATE,
 
   PARAM_CALIBRATE_GYRO_ON_ARM,
 
   PARAM_GYRO_ALPHA,
   PARAM_ACC_ALPHA,
 
+  PARAM_IMU_SAMPLE_RATE,
+  PARAM_GYRO_LPF_HZ,
+  PARAM_GYRO_LPF2_HZ,
+  PARAM_ACC_LPF_HZ,
+  PARAM_GYRO_NOTCH_HZ,
+  PARAM_GYRO_NOTCH_Q,
+  PARAM_GYRO_DYN_NOTCH,
+  PARAM_GYRO_DYN_NOTCH_Q,
+  PARAM_GYRO_DYN_NOTCH_MIN_HZ,
+
+  PARAM_GYRO_ANALYZER,
+  PARAM_GYRO_ANALYZER_MIN_HZ,
+  PARAM_GYRO_ANALYZER_MAX_HZ,
+  PARAM_GYRO_ANALYZER_NOTCH,
+
   PARAM_GYRO_X_BIAS,
   PARAM_GYRO_Y_BIAS,
   PARAM_GYRO_Z_BIAS,
@@ -138,6 +176,7 @@ enum : uint16_t
   PARAM_ACC_X_TEMP_COMP,
   PARAM_ACC_Y_TEMP_COMP,
   PARAM_ACC_Z_TEMP_COMP,
+  PARAM_IMU_ONLINE_CAL,
 
   PARAM_MAG_A11_COMP,
   PARAM_MAG_A12_COMP,
@@ -191,6 +230,47 @@ enum : uint16_t
   /*** FRAME CONFIGURATION ***/
   /***************************/
   PARAM_MIXER,
+  PARAM_MIXER_AIRMODE,
+  PARAM_MIXER_CUSTOM_TYPE_0,
+  PARAM_MIXER_CUSTOM_TYPE_1,
+  PARAM_MIXER_CUSTOM_TYPE_2,
+  PARAM_MIXER_CUSTOM_TYPE_3,
+  PARAM_MIXER_CUSTOM_TYPE_4,
+  PARAM_MIXER_CUSTOM_TYPE_5,
+  PARAM_MIXER_CUSTOM_TYPE_6,
+  PARAM_MIXER_CUSTOM_TYPE_7,
+  PARAM_MIXER_CUSTOM_F_0,
+  PARAM_MIXER_CUSTOM_F_1,
+  PARAM_MIXER_CUSTOM_F_2,
+  PARAM_MIXER_CUSTOM_F_3,
+  PARAM_MIXER_CUSTOM_F_4,
+  PARAM_MIXER_CUSTOM_F_5,
+  PARAM_MIXER_CUSTOM_F_6,
+  PARAM_MIXER_CUSTOM_F_7,
+  PARAM_MIXER_CUSTOM_X_0,
+  PARAM_MIXER_CUSTOM_X_1,
+  PARAM_MIXER_CUSTOM_X_2,
+  PARAM_MIXER_CUSTOM_X_3,
+  PARAM_MIXER_CUSTOM_X_4,
+  PARAM_MIXER_CUSTOM_X_5,
+  PARAM_MIXER_CUSTOM_X_6,
+  PARAM_MIXER_CUSTOM_X_7,
+  PARAM_MIXER_CUSTOM_Y_0,
+  PARAM_MIXER_CUSTOM_Y_1,
+  PARAM_MIXER_CUSTOM_Y_2,
+  PARAM_MIXER_CUSTOM_Y_3,
+  PARAM_MIXER_CUSTOM_Y_4,
+  PARAM_MIXER_CUSTOM_Y_5,
+  PARAM_MIXER_CUSTOM_Y_6,
+  PARAM_MIXER_CUSTOM_Y_7,
+  PARAM_MIXER_CUSTOM_Z_0,
+  PARAM_MIXER_CUSTOM_Z_1,
+  PARAM_MIXER_CUSTOM_Z_2,
+  PARAM_MIXER_CUSTOM_Z_3,
+  PARAM_MIXER_CUSTOM_Z_4,
+  PARAM_MIXER_CUSTOM_Z_5,
+  PARAM_MIXER_CUSTOM_Z_6,
+  PARAM_MIXER_CUSTOM_Z_7,
 
   PARAM_FIXED_WING,
   PARAM_ELEVATOR_REVERSE,
@@ -220,41 +300,131 @@ class Params
 public:
   static constexpr uint8_t PARAMS_NAME_LENGTH = 16;
 
-private:
+  // Bulk parameter image (little endian): uint32 version hash, uint16 param count, uint8 checksum, then
+  // the int32/float values of all params in ID order, then one type byte per param. The checksum is the
+  // XOR of every other byte in the image, so a host can patch a value and update it without the names.
+  static constexpr uint16_t BULK_HEADER_SIZE = 7;
+  static constexpr uint16_t BULK_IMAGE_SIZE = BULK_HEADER_SIZE + 5*PARAMS_COUNT;
+
+  // Param change callbacks are plain functions with a context pointer, so registering one never allocates.
+  // The pool grows with the param table, as modules subscribe to about one callback per param they add.
+  typedef void (*ParamCallback)(void *context, uint16_t param_id);
+  static constexpr uint16_t MAX_CALLBACKS = PARAMS_COUNT;
+
+  // Passed as the param ID to a callback when several of the params it is subscribed to changed in one batch
+  static constexpr uint16_t BATCH_CHANGED = PARAMS_COUNT;
+
   union param_value_t
   {
     float fvalue;
     int32_t ivalue;
+
+    param_value_t() = default;
+    constexpr param_value_t(int32_t value) : ivalue(value) {}
+    constexpr param_value_t(float value) : fvalue(value) {}
   };
 
+  // Everything about a parameter except its current value lives in a constexpr table in flash
   typedef struct
   {
-    uint32_t version;
-    uint16_t size;
-    uint8_t magic_be;                       // magic number, should be 0xBE
+    uint16_t id;
+    char name[PARAMS_NAME_LENGTH + 1];
+    param_type_t type;
+    param_value_t default_value;
+    float min;
+    float max;
+  } param_info_t;
 
-    param_value_t values[PARAMS_COUNT];
-    char names[PARAMS_COUNT][PARAMS_NAME_LENGTH];
-    param_type_t types[PARAMS_COUNT];
+private:
 
-    uint8_t magic_ef;                       // magic number, should be 0xEF
-    uint8_t chk;                            // XOR checksum
+  typedef struct
+  {
+    param_value_t values[PARAMS_COUNT];    // names and types are fixed by the version hash
   } params_t;
 
-  std::function<void(int)> callbacks[PARAMS_COUNT]; // Param change callbacks
-
   params_t params;
   ROSflight& RF_;
 
-  void init_param_int(uint16_t id, const char name[PARAMS_NAME_LENGTH], int32_t value);
-  void init_param_float(uint16_t id, const char name[PARAMS_NAME_LENGTH], float value);
-  uint8_t compute_checksum(void);
+  uint8_t bulk_staging_[BULK_IMAGE_SIZE];
+  uint8_t name_index_[PARAMS_COUNT]; // param IDs sorted by name, for lookup_param_id
+
+  // Param change callbacks: a fixed pool of subscriptions, chained into a list per param
+  static constexpr uint8_t NO_CALLBACK = 0xFF;
+  typedef struct
+  {
+    ParamCallback callback;
+    void *context;
+    uint16_t param_id;
+    uint8_t next;
+  } callback_entry_t;
+  callback_entry_t callbacks_[MAX_CALLBACKS];
+  uint8_t num_callbacks_;
+  uint8_t first_callback_[PARAMS_COUNT];
+  uint8_t dropped_callbacks_; // subscriptions that didn't fit in the pool
+
+  // Params changed since begin_batch(), notified by end_batch()
+  uint32_t batch_changed_[(PARAMS_COUNT + 31)/32];
+  uint8_t batch_depth_;
+
+  template <typename T, void (T::*Method)(uint16_t)>
+  static void member_callback(void *object, uint16_t param_id)
+  {
+    (static_cast<T *>(object)->*Method)(param_id);
+  }
+
+  inline bool batch_changed(uint16_t id) const { return batch_changed_[id/32] & (1u << (id%32)); }
+
+  // Sets a value without sending it over MAVLink, for set_defaults() and the param store replaying its records
+  friend class ParamStore;
+  void set_value(uint16_t id, param_value_t value);
+  void build_name_index(void);
+  uint8_t bulk_byte(uint16_t index) const;
+  static uint8_t bulk_checksum(const uint8_t *image);
 
 
 public:
   Params(ROSflight& _rf);
 
-  void add_callback(std::function<void(int)> callback, uint16_t param_id);
+  /**
+   * @brief Subscribe to changes of a parameter, and call the callback once right away
+   * @details Any number of callbacks can subscribe to the same parameter, up to MAX_CALLBACKS in total.
+   * Registering the same callback, context and parameter again has no effect.
+   * @param callback The function to call with the context and the ID of the changed parameter
+   * @param context Passed back to the callback, typically the subscribing object
+   * @param param_id The ID of the parameter
+   * @return True if successful, false if all MAX_CALLBACKS subscriptions are in use
+   */
+  bool add_callback(ParamCallback callback, void *context, uint16_t param_id);
+
+  /**
+   * @brief Number of add_callback calls that failed because the pool was full, reported at boot
+   * @details A lost subscription means changes to that param silently don't take effect, so this
+   * must stay zero
+   */
+  inline uint8_t dropped_callbacks() const { return dropped_callbacks_; }
+
+  /**
+   * @brief Subscribe a member function to changes of a parameter, e.g.
+   * add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MIXER)
+   */
+  template <typename T, void (T::*Method)(uint16_t)>
+  inline bool add_callback(T *object, uint16_t param_id)
+  {
+    return add_callback(&member_callback<T, Method>, object, param_id);
+  }
+
+  /**
+   * @brief Hold back change callbacks until end_batch(), e.g. while applying many parameters at once
+   * @details Batches can be nested, the callbacks run when the outermost batch ends
+   */
+  void begin_batch(void);
+
+  /**
+   * @brief End a batch and call the callbacks of every parameter that changed during it
+   * @details Each subscriber is called only once: with the param ID if only one of its parameters
+   * changed, or with BATCH_CHANGED if several did
+   */
+  void end_batch(void);
 
 
 
@@ -271,25 +441,27 @@ public:
   void set_defaults(void);
 
   /**
-   * @brief Read parameter values from non-volatile memory
-   * @return True if successful, false otherwise
+   * @brief Read parameter values from non-volatile memory, on top of the defaults
+   * @return True if stored values were found, false if the parameters were left at their defaults
    */
   bool read(void);
 
   /**
-   * @brief Write current parameter values to non-volatile memory
-   * @return True if successful, false otherwise
+   * @brief Queue the changed parameter values to be written to non-volatile memory by the param store
+   * @return True if successful, false if the memory has failed
    */
   bool write(void);
 
   /**
-   * @brief Callback for executing actions that need to be taken when a parameter value changes
+   * @brief Call the callbacks subscribed to a parameter, or mark it as changed if a batch is open, and tell
+   * the param store the value is no longer saved
    * @param id The ID of the parameter that was changed
    */
   void change_callback(uint16_t id);
 
   /**
    * @brief Gets the id of a parameter from its name
+   * @details Binary search over an index of the names sorted at boot, so about log2(PARAMS_COUNT) compares
    * @param name The name of the parameter
    * @return The ID of the parameter if the name is valid, PARAMS_COUNT otherwise (invalid ID)
    */
@@ -314,7 +486,7 @@ public:
    * @param id The ID of the parameter
    * @return The name of the parameter
    */
-  inline const char *get_param_name(uint16_t id) const { return params.names[id]; }
+  const char *get_param_name(uint16_t id) const;
 
   /**
    * @brief Get the type of a parameter
@@ -324,7 +496,28 @@ public:
    * PARAM_TYPE_INT32, PARAM_TYPE_FLOAT, or PARAM_TYPE_INVALID
    * See line 165
    */
-  inline param_type_t get_param_type(uint16_t id) const { return params.types[id]; }
+  param_type_t get_param_type(uint16_t id) const;
+
+  /**
+   * @brief Get the default value of a parameter
+   * @param id The ID of the parameter
+   * @return The default value, to be read as ivalue or fvalue according to the type of the parameter
+   */
+  param_value_t get_param_default(uint16_t id) const;
+
+  /**
+   * @brief Get the smallest sensible value of a parameter, as documented
+   * @param id The ID of the parameter
+   * @return The minimum value, as a float for both integer and floating point parameters
+   */
+  float get_param_min(uint16_t id) const;
+
+  /**
+   * @brief Get the largest sensible value of a parameter, as documented
+   * @param id The ID of the parameter
+   * @return The maximum value, as a float for both integer and floating point parameters
+   */
+  float get_param_max(uint16_t id) const;
 
   /**
    * @brief Sets the value of a parameter by ID and calls the parameter change callback
@@ -358,6 +551,31 @@ public:
    */
   bool set_param_by_name_float(const char name[PARAMS_NAME_LENGTH], float value);
 
+  /**
+   * @brief Copy part of the bulk parameter image of the current values
+   * @param offset Byte offset into the image
+   * @param buf Destination buffer
+   * @param len Number of bytes to copy, bytes past the end of the image are zero-filled
+   */
+  void bulk_read(uint16_t offset, uint8_t *buf, uint16_t len) const;
+
+  /**
+   * @brief Store part of an uploaded bulk parameter image, without applying it
+   * @param offset Byte offset into the image
+   * @param buf Source buffer
+   * @param len Number of bytes, anything past the end of the image is ignored
+   * @return True if the bytes were stored, false if the offset is outside the image
+   */
+  bool bulk_stage(uint16_t offset, const uint8_t *buf, uint16_t len);
+
+  /**
+   * @brief Validate the staged bulk image and apply it
+   * @details The version hash, parameter count, types and checksum all have to match. The new values
+   * are applied as one batch of change callbacks, and no PARAM_VALUE messages are sent.
+   * @return True if the image was applied, false (and nothing is changed) if it was invalid
+   */
+  bool bulk_commit(void);
+
 };
 
 } // namespace rosflight_firmware
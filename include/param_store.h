@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_PARAM_STORE_H
+#define ROSFLIGHT_FIRMWARE_PARAM_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "param.h"
+
+namespace rosflight_firmware
+{
+
+class ROSflight;
+
+/**
+ * @brief Log-structured parameter storage in non-volatile memory
+ *
+ * The board provides two sectors. The active sector holds a header followed by (id, value) records, each
+ * with its own CRC, and saving only appends records for the parameters that changed since they were last
+ * stored. Replaying the records over the defaults gives the stored values. When the active sector is full
+ * the other one is erased and a compacted snapshot of every non-default parameter is written into it; its
+ * header is written last, so a power loss part way through leaves the old sector in charge.
+ *
+ * Saving is asynchronous: save() only queues the changed parameters, and run() writes a few records at a
+ * time from the scheduler. Sector erases take tens of milliseconds on flash parts, so compaction waits
+ * until the vehicle is disarmed.
+ */
+class ParamStore
+{
+public:
+  static constexpr uint32_t MAGIC = 0x53504652; // "RFPS"
+  static constexpr uint32_t HEADER_SIZE = 16;   // magic, version hash, generation, CRC
+  static constexpr uint32_t RECORD_SIZE = 8;    // uint16 id and uint16 CRC, then the int32/float value
+  static constexpr uint8_t RECORDS_PER_RUN = 2; // records written per call of run()
+
+  ParamStore(ROSflight& _rf);
+
+  /**
+   * @brief Find the active sector
+   * @return True if a valid sector written by this firmware version was found
+   */
+  bool init(void);
+
+  /**
+   * @brief Replay the stored records over the current parameter values, which should be the defaults
+   * @return True if there was a valid sector to replay, false if the values were left alone
+   */
+  bool load(void);
+
+  /**
+   * @brief Note that a parameter value no longer matches the stored one
+   */
+  void value_changed(uint16_t id);
+
+  /**
+   * @brief Queue every changed parameter to be written by run()
+   * @return False if the memory has failed and nothing can be stored
+   */
+  bool save(void);
+
+  /**
+   * @brief Write the next few queued records, compacting into the other sector first if needed
+   */
+  void run(void);
+
+  /**
+   * @brief Run until everything queued has been written, e.g. before rebooting (blocking, does nothing
+   * while armed)
+   */
+  void flush(void);
+
+  inline bool busy(void) const { return state_ != STATE_IDLE || any_pending(); }
+  inline bool failed(void) const { return failed_; }
+  inline uint32_t generation(void) const { return generation_; }
+  inline uint32_t records_used(void) const { return (append_offset_ - HEADER_SIZE)/RECORD_SIZE; }
+
+private:
+  enum : uint8_t
+  {
+    STATE_IDLE,
+    STATE_SNAPSHOT
+  };
+
+  static constexpr uint8_t NO_SECTOR = 0xFF;
+  static constexpr uint32_t ERASED_WORD = 0xFFFFFFFF;
+
+  ROSflight& RF_;
+
+  uint8_t active_sector_;
+  uint32_t generation_;
+  uint32_t append_offset_;   // where the next record goes in the active sector
+
+  uint8_t state_;
+  uint8_t target_sector_;    // sector being compacted into
+  uint16_t snapshot_id_;     // next param to check for the snapshot
+  uint32_t snapshot_offset_; // where the next snapshot record goes in the target sector
+
+  bool failed_;
+
+  uint32_t unsaved_[(PARAMS_COUNT + 31)/32]; // value differs from the stored one
+  uint32_t pending_[(PARAMS_COUNT + 31)/32]; // queued by save()
+
+  static constexpr uint16_t CRC_INIT = 0xFFFF;
+  static uint16_t crc16(uint16_t crc, uint32_t word);
+  static uint16_t header_crc(uint32_t generation);
+  bool read_header(uint8_t sector, uint32_t *generation) const;
+  bool record_valid(uint8_t sector, uint32_t offset, uint16_t *id, int32_t *value) const;
+  bool write_record(uint8_t sector, uint32_t offset, uint16_t id);
+  bool any_pending(void) const;
+  uint16_t next_pending(void) const;
+  void clear_bits(uint16_t id);
+  void set_failed(void);
+  void run_append(void);
+  void run_snapshot(void);
+  void start_compaction(void);
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_PARAM_STORE_H
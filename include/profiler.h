@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_PROFILER_H
+#define ROSFLIGHT_FIRMWARE_PROFILER_H
+
+#include <stdint.h>
+
+namespace rosflight_firmware
+{
+
+class ROSflight;
+
+class Profiler
+{
+
+public:
+  enum : uint8_t
+  {
+    STAGE_SENSORS,
+    STAGE_IMU_FILTER,
+    STAGE_ESTIMATOR,
+    STAGE_ESTIMATOR_LPF,
+    STAGE_ESTIMATOR_ACC,
+    STAGE_ESTIMATOR_QUAD_INT,
+    STAGE_ESTIMATOR_PROPAGATE,
+    STAGE_CONTROLLER,
+    STAGE_MIXER,
+    STAGE_MIXER_OUTPUT,    // writing the outputs at the end of the mixer, only timed by ROSFLIGHT_TIME_SCOPE
+    STAGE_BLACKBOX_FRAME,
+    STAGE_IMU_TO_MOTOR,    // from the IMU sample time to the motor write, not an elapsed stage time
+    STAGE_CONTROL_PERIOD,  // the time between control updates, not an elapsed stage time
+    STAGE_RC_FRAME_PERIOD, // the time between RC receiver frames, not an elapsed stage time
+    STAGE_RC_LATENCY,      // from the end of an RC frame to when RC interpreted it, not an elapsed stage time
+    STAGE_MAVLINK_STREAM,
+    STAGE_MAVLINK_RECEIVE,
+    STAGE_STATE_MANAGER,
+    STAGE_RC,
+    STAGE_COMMAND_MANAGER,
+    STAGE_PARAM_STORE,
+    STAGE_GYRO_ANALYZER,
+    STAGE_BLACKBOX,
+    STAGE_COUNT
+  };
+
+  // Bin 0 holds samples of 0 us, bin i holds samples in [2^(i-1), 2^i) us, the last bin holds everything longer
+  static constexpr uint8_t HISTOGRAM_BINS = 16;
+
+  struct Stage
+  {
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t count;
+    uint64_t total_us;
+    uint16_t histogram[HISTOGRAM_BINS];
+  };
+
+  // Statistics in clock cycles, for the stages timed by ROSFLIGHT_TIME_SCOPE (see cycle_timer.h)
+  struct Cycles
+  {
+    uint32_t min;
+    uint32_t max;
+    uint32_t count;
+    uint64_t total;
+  };
+
+  Profiler(ROSflight& _rf);
+
+  void init();
+
+  /**
+   * @brief Clear the statistics of a single stage
+   * @param stage The ID of the stage
+   */
+  void reset(uint8_t stage);
+
+  /**
+   * @brief Get the current time, to be used as the start time of a stage
+   * @return The current time (us)
+   */
+  uint64_t tic();
+
+  /**
+   * @brief Record the time elapsed since start_us for a stage
+   * @param stage The ID of the stage
+   * @param start_us The start time of the stage (us)
+   * @return The current time (us), so that consecutive stages can be chained without extra clock reads
+   */
+  uint64_t toc(uint8_t stage, uint64_t start_us);
+
+  /**
+   * @brief Add a single duration sample to the statistics of a stage
+   * @param stage The ID of the stage
+   * @param elapsed_us The duration of the stage (us)
+   */
+  void record(uint8_t stage, uint32_t elapsed_us);
+
+  /**
+   * @brief Add a single duration sample, in clock cycles, to the cycle statistics of a stage
+   * @param stage The ID of the stage
+   * @param cycles The duration of the stage (cycles of Board::clock_cycles)
+   */
+  void record_cycles(uint8_t stage, uint32_t cycles);
+
+  inline const Stage& stage(uint8_t id) const { return stages_[id]; }
+  uint32_t mean_us(uint8_t id) const;
+  inline const Cycles& cycles(uint8_t id) const { return cycles_[id]; }
+  uint32_t mean_cycles(uint8_t id) const;
+
+  /**
+   * @brief Get a short name for a stage (at most 10 characters, to fit in a DEBUG_VECT message)
+   * @param id The ID of the stage
+   * @return The name of the stage
+   */
+  static const char *stage_name(uint8_t id);
+
+private:
+  ROSflight& RF_;
+  Stage stages_[STAGE_COUNT];
+  Cycles cycles_[STAGE_COUNT];
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_PROFILER_H
@@ -35,6 +35,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "board.h"
+
 namespace rosflight_firmware
 {
 
@@ -70,14 +72,27 @@ public:
     CPPM,
   } rc_type_t;
 
+  // Receivers that don't deliver frames are polled this often
+  static constexpr uint32_t POLL_PERIOD_US = 20000;
+  // A frame-based receiver is lost if no frame has arrived for this long
+  static constexpr uint32_t FRAME_TIMEOUT_US = 40000;
+
   void init();
   float stick(Stick channel);
   bool switch_on(Switch channel);
   bool switch_mapped(Switch channel);
+
+  /**
+   * @brief Interpret new RC input, called on every pass of the main loop
+   * @return True if there was a new, valid RC command
+   */
   bool run();
   bool new_command();
   void param_change_callback(uint16_t param_id);
 
+  inline bool frame_mode() const { return frame_mode_; }
+  inline uint32_t frame_count() const { return frame_count_; }
+
 private:
   ROSflight& RF_;
 
@@ -96,10 +111,14 @@ private:
 
   bool new_command_;
 
+  bool frame_mode_;        // the board delivers whole receiver frames through rc_read
+  rc_frame_t frame_;       // the newest frame
+  uint32_t frame_count_;
+  uint64_t next_poll_us_;
+
   uint32_t time_of_last_stick_deviation = 0;
   uint32_t time_sticks_have_been_in_arming_position_ms = 0;
   uint32_t prev_time_ms = 0;
-  uint32_t last_rc_receive_time = 0;
 
   rc_stick_config_t sticks[STICKS_COUNT];
   rc_switch_config_t switches[SWITCHES_COUNT];
@@ -108,9 +127,11 @@ private:
   float stick_values[STICKS_COUNT];
 
   void init_rc();
+  void init_receiver();
   void init_switches();
   void init_sticks();
-  bool check_rc_lost();
+  uint16_t read_channel(uint8_t channel);
+  bool check_rc_lost(uint64_t now_us);
   void look_for_arm_disarm_signal();
 };
 
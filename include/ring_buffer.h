@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_RING_BUFFER_H
+#define ROSFLIGHT_FIRMWARE_RING_BUFFER_H
+
+#include <stdint.h>
+#include <atomic>
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Lock-free single-producer/single-consumer FIFO
+ *
+ * The producer (e.g. an interrupt handler) only ever writes head_ and the consumer (the main loop) only ever
+ * writes tail_, so no locking is needed as long as there is exactly one of each. Both indices run freely and
+ * wrap at 2^16, which is why the capacity has to be a power of two. The fences only need to keep the compiler
+ * from reordering the data accesses around the index updates, since the producer and consumer share a core.
+ */
+template <typename T, uint16_t N>
+class RingBuffer
+{
+  static_assert(N > 1 && (N & (N - 1)) == 0, "RingBuffer capacity must be a power of two");
+  static_assert(N <= 0x8000, "RingBuffer capacity must fit in the 16-bit indices");
+
+public:
+  RingBuffer() : buffer_(), head_(0), tail_(0), overflows_(0) {}
+
+  /**
+   * @brief Add an item to the back of the buffer (producer only)
+   * @return True if successful, false (and the item is dropped) if the buffer is full
+   */
+  bool push(const T& item)
+  {
+    uint16_t head = head_;
+    if (static_cast<uint16_t>(head - tail_) >= N)
+    {
+      overflows_++;
+      return false;
+    }
+    std::atomic_signal_fence(std::memory_order_acquire);
+    buffer_[head & MASK] = item;
+    std::atomic_signal_fence(std::memory_order_release);
+    head_ = static_cast<uint16_t>(head + 1);
+    return true;
+  }
+
+  /**
+   * @brief Remove the item at the front of the buffer (consumer only)
+   * @return True if an item was removed, false if the buffer is empty
+   */
+  bool pop(T *item)
+  {
+    uint16_t tail = tail_;
+    if (head_ == tail)
+      return false;
+    std::atomic_signal_fence(std::memory_order_acquire);
+    *item = buffer_[tail & MASK];
+    std::atomic_signal_fence(std::memory_order_release);
+    tail_ = static_cast<uint16_t>(tail + 1);
+    return true;
+  }
+
+  /**
+   * @brief Copy the item at the front of the buffer without removing it (consumer only)
+   * @return True if there was an item, false if the buffer is empty
+   */
+  bool peek(T *item) const
+  {
+    if (empty())
+      return false;
+    std::atomic_signal_fence(std::memory_order_acquire);
+    *item = buffer_[tail_ & MASK];
+    return true;
+  }
+
+  /**
+   * @brief Add several items to the back of the buffer, wrapping around the end if needed (producer only)
+   * @return True if successful, false (and nothing is added) if there isn't room for all of them
+   */
+  bool push(const T *items, uint16_t count)
+  {
+    if (count > space())
+    {
+      overflows_++;
+      return false;
+    }
+    uint16_t head = head_;
+    std::atomic_signal_fence(std::memory_order_acquire);
+    for (uint16_t i = 0; i < count; i++)
+      buffer_[(head + i) & MASK] = items[i];
+    std::atomic_signal_fence(std::memory_order_release);
+    head_ = static_cast<uint16_t>(head + count);
+    return true;
+  }
+
+  // Direct access to the buffer memory, so that data can be written in and read out in place without
+  // an intermediate copy. The regions returned never wrap around the end of the buffer.
+
+  // Number of items that can be written contiguously at head_ptr() (producer only)
+  inline uint16_t contiguous_space() const
+  {
+    uint16_t to_end = static_cast<uint16_t>(N - (head_ & MASK));
+    uint16_t free_space = space();
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return (free_space < to_end) ? free_space : to_end;
+  }
+  inline T *head_ptr() { return &buffer_[head_ & MASK]; }
+
+  // Make count items written at head_ptr() visible to the consumer (producer only)
+  inline void commit(uint16_t count)
+  {
+    std::atomic_signal_fence(std::memory_order_release);
+    head_ = static_cast<uint16_t>(head_ + count);
+  }
+
+  // Number of items that can be read contiguously at tail_ptr() (consumer only)
+  inline uint16_t contiguous_size() const
+  {
+    uint16_t to_end = static_cast<uint16_t>(N - (tail_ & MASK));
+    uint16_t used = size();
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return (used < to_end) ? used : to_end;
+  }
+  inline const T *tail_ptr() const { return &buffer_[tail_ & MASK]; }
+
+  // Release count items read at tail_ptr() back to the producer (consumer only)
+  inline void consume(uint16_t count)
+  {
+    std::atomic_signal_fence(std::memory_order_release);
+    tail_ = static_cast<uint16_t>(tail_ + count);
+  }
+
+  inline uint16_t size() const { return static_cast<uint16_t>(head_ - tail_); }
+  inline uint16_t space() const { return static_cast<uint16_t>(N - size()); }
+  inline bool empty() const { return head_ == tail_; }
+  inline bool full() const { return size() >= N; }
+  static constexpr uint16_t capacity() { return N; }
+
+  // Number of items dropped by push() because the buffer was full
+  inline uint32_t overflows() const { return overflows_; }
+
+private:
+  static constexpr uint16_t MASK = N - 1;
+
+  T buffer_[N];
+  volatile uint16_t head_;
+  volatile uint16_t tail_;
+  volatile uint32_t overflows_;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_RING_BUFFER_H
@@ -32,9 +32,12 @@
 #ifndef ROSFLIGHT_FIRMWARE_ROSFLIGHT_H
 #define ROSFLIGHT_FIRMWARE_ROSFLIGHT_H
 
+#include "blackbox.h"
 #include "board.h"
 #include "param.h"
+#include "param_store.h"
 #include "sensors.h"
+#include "gyro_analyzer.h"
 #include "estimator.h"
 #include "rc.h"
 #include "controller.h"
@@ -42,6 +45,8 @@
 #include "mixer.h"
 #include "state_manager.h"
 #include "command_manager.h"
+#include "profiler.h"
+#include "scheduler.h"
 
 namespace rosflight_firmware
 {
@@ -59,6 +64,7 @@ public:
   Mavlink mavlink_;
 
   Params params_;
+  ParamStore param_store_;
 
   CommandManager command_manager_;
   Controller controller_;
@@ -66,7 +72,11 @@ public:
   Mixer mixer_;
   RC rc_;
   Sensors sensors_;
+  GyroAnalyzer gyro_analyzer_;
   StateManager state_manager_;
+  Profiler profiler_;
+  Blackbox blackbox_;
+  Scheduler scheduler_;
 
   uint32_t loop_time_us;
 
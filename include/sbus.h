@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_SBUS_H
+#define ROSFLIGHT_FIRMWARE_SBUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Byte-at-a-time decoder for SBUS receiver frames
+ *
+ * Meant to be fed from the UART receive interrupt. A frame is a 0x0F header, 22 bytes holding 16 11-bit
+ * channels LSB first, a flags byte and an end byte. The receiver leaves a gap of several ms between frames,
+ * so a gap longer than a few bytes restarts the frame, which is how the decoder syncs up.
+ */
+class SbusDecoder
+{
+public:
+  static constexpr uint8_t FRAME_SIZE = 25;
+  static constexpr uint8_t NUM_CHANNELS = 16;
+  static constexpr uint32_t FRAME_GAP_US = 2000;
+
+  SbusDecoder();
+
+  void reset();
+
+  /**
+   * @brief Add a received byte
+   * @param byte The byte
+   * @param time_us When the byte was received (us)
+   * @param frame Filled in with the decoded frame when this byte completes one
+   * @return True if the byte completed a valid frame
+   */
+  bool parse(uint8_t byte, uint64_t time_us, rc_frame_t *frame);
+
+  inline uint32_t errors() const { return errors_; }
+
+private:
+  static constexpr uint8_t HEADER = 0x0F;
+  static constexpr uint8_t FLAG_FAILSAFE = 0x08;
+
+  uint8_t buffer_[FRAME_SIZE];
+  uint8_t count_;
+  uint64_t last_byte_us_;
+  uint32_t errors_;
+
+  void decode(uint64_t time_us, rc_frame_t *frame) const;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_SBUS_H
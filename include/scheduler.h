@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ROSFLIGHT_FIRMWARE_SCHEDULER_H
+#define ROSFLIGHT_FIRMWARE_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "profiler.h"
+
+namespace rosflight_firmware
+{
+
+class ROSflight;
+
+class Scheduler
+{
+
+public:
+  enum : uint8_t
+  {
+    TASK_MAVLINK_RECEIVE,
+    TASK_RC,
+    TASK_COMMAND_MANAGER,
+    TASK_STATE_MANAGER,
+    TASK_MAVLINK_STREAM,
+    TASK_PARAM_STORE,
+    TASK_GYRO_ANALYZER,
+    TASK_BLACKBOX,
+    TASK_COUNT
+  };
+
+  // Margin kept free before the next expected IMU sample, to absorb IMU and clock jitter
+  static constexpr uint32_t IMU_GUARD_US = 50;
+  // A period-0 task that has been waiting this long is run regardless of the available slack
+  static constexpr uint32_t MAX_DEFER_US = 10000;
+  // Overruns are counted, but only logged this often, so that a burst of slow passes doesn't flood the link
+  static constexpr uint32_t OVERRUN_LOG_INTERVAL_US = 1000000;
+
+  typedef void (*TaskFcn)(ROSflight& rf);
+
+  typedef struct
+  {
+    uint32_t period_us;  // 0 runs the task on every idle pass
+    uint8_t priority;    // higher priority tasks get the slack first
+    uint32_t budget_us;  // worst case execution time the task is allowed
+    uint8_t profiler_stage;
+    TaskFcn run;
+    uint64_t next_time_us;
+    uint32_t overruns;
+    uint32_t deferrals;
+  } task_t;
+
+  Scheduler(ROSflight& _rf);
+
+  void init();
+
+  /**
+   * @brief Run the housekeeping tasks that are due and fit in the time left before the next IMU sample
+   */
+  void run();
+
+  /**
+   * @brief Tell the scheduler an IMU sample arrived, so it can predict when the next one will
+   * @param imu_time_us The timestamp of the IMU sample (us)
+   */
+  void imu_update(uint64_t imu_time_us);
+
+  inline const task_t& task(uint8_t id) const { return tasks_[id]; }
+  inline uint32_t overrun_count() const { return overrun_count_; }
+  inline uint32_t imu_period_us() const { return imu_period_us_; }
+
+private:
+  ROSflight& RF_;
+
+  uint64_t last_imu_us_;
+  uint32_t imu_period_us_;
+  uint64_t next_overrun_log_us_;
+  uint32_t overrun_count_;
+
+  uint8_t order_[TASK_COUNT]; // task ids sorted by priority
+
+  static void run_mavlink_receive(ROSflight& rf);
+  static void run_rc(ROSflight& rf);
+  static void run_command_manager(ROSflight& rf);
+  static void run_state_manager(ROSflight& rf);
+  static void run_mavlink_stream(ROSflight& rf);
+  static void run_param_store(ROSflight& rf);
+  static void run_gyro_analyzer(ROSflight& rf);
+  static void run_blackbox(ROSflight& rf);
+
+  bool fits_before_imu(uint64_t now_us, uint32_t budget_us) const;
+  void run_task(uint8_t id, uint64_t now_us);
+
+  task_t tasks_[TASK_COUNT] = {
+    //  period_us  priority  budget_us  profiler_stage                    run
+    {   0,         4,        200,       Profiler::STAGE_MAVLINK_RECEIVE,  &Scheduler::run_mavlink_receive,  0, 0, 0 },
+    {   0,         4,        100,       Profiler::STAGE_RC,               &Scheduler::run_rc,               0, 0, 0 },
+    {   0,         3,        50,        Profiler::STAGE_COMMAND_MANAGER,  &Scheduler::run_command_manager,  0, 0, 0 },
+    {   1000,      2,        50,        Profiler::STAGE_STATE_MANAGER,    &Scheduler::run_state_manager,    0, 0, 0 },
+    {   0,         1,        300,       Profiler::STAGE_MAVLINK_STREAM,   &Scheduler::run_mavlink_stream,   0, 0, 0 },
+    {   5000,      0,        400,       Profiler::STAGE_PARAM_STORE,      &Scheduler::run_param_store,      0, 0, 0 },
+    {   0,         0,        100,       Profiler::STAGE_GYRO_ANALYZER,    &Scheduler::run_gyro_analyzer,    0, 0, 0 },
+    {   0,         1,        200,       Profiler::STAGE_BLACKBOX,         &Scheduler::run_blackbox,         0, 0, 0 }
+  };
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_SCHEDULER_H
@@ -37,6 +37,11 @@
 #include <stdbool.h>
 #include <turbomath/turbomath.h>
 
+#include "board.h"
+#include "filter.h"
+#include "imu_calibrator.h"
+#include "ring_buffer.h"
+
 namespace rosflight_firmware
 {
 
@@ -82,6 +87,25 @@ public:
   void init();
   bool run();
 
+  /**
+   * @brief Read and correct the oldest buffered IMU sample
+   * @return True if there was a new sample, false if the IMU FIFO is empty
+   */
+  bool update_imu(void);
+
+  /**
+   * @brief Number of corrected IMU samples waiting to be sent in IMU batch frames
+   * @details Samples are only accumulated while the STRM_IMU_BATCH stream is enabled
+   */
+  inline uint16_t imu_batch_available(void) const { return imu_batch_.size(); }
+
+  /**
+   * @brief Pop the oldest corrected IMU sample from the batch buffer
+   * @return True if a sample was copied into sample, false if the buffer is empty
+   */
+  inline bool imu_batch_pop(imu_sample_t *sample) { return imu_batch_.pop(sample); }
+  inline bool imu_batch_peek(imu_sample_t *sample) const { return imu_batch_.peek(sample); }
+
   // Calibration Functions
   bool start_imu_calibration(void);
   bool start_gyro_calibration(void);
@@ -89,6 +113,22 @@ public:
   bool start_diff_pressure_calibration(void);
   bool gyro_calibration_complete(void);
 
+  /**
+   * @brief Set the center frequency of the dynamic gyro notch filter
+   * @details Meant to be driven by a measured vibration frequency, such as motor RPM telemetry. Has no
+   * effect unless GYRO_DNOTCH is set, and the notch is bypassed below GYRO_DNOTCH_MIN.
+   * @param center_hz The frequency to reject (Hz)
+   */
+  void set_dynamic_notch_frequency(float center_hz);
+  inline float dynamic_notch_frequency(void) const { return dyn_notch_hz_; }
+
+  /**
+   * @brief The online gyro calibration, which learns the bias over temperature while disarmed and still
+   * @details Only runs with IMU_ONLINE_CAL set. Once it has data, its bias replaces GYRO_*_BIAS.
+   */
+  inline const ImuCalibrator& imu_calibrator(void) const { return imu_calibrator_; }
+  inline const turbomath::Vector& gyro_bias(void) const { return gyro_bias_; }
+
   inline bool should_send_imu_data(void)
   {
     if (imu_data_sent_)
@@ -110,6 +150,12 @@ private:
   static const float BARO_MAX_CALIBRATION_VARIANCE;
   static const float DIFF_PRESSURE_MAX_CALIBRATION_VARIANCE;
 
+  // The temperature change (deg C) that looks the gyro bias up in the online calibration model again
+  static constexpr float GYRO_BIAS_TEMPERATURE_STEP = 0.1f;
+
+  // Enough for two full IMU batch frames, so a flush rate of 100 Hz keeps up with a 1 kHz IMU
+  static constexpr uint16_t IMU_BATCH_BUFFER_SIZE = 32;
+
   class OutlierFilter
   {
   private:
@@ -124,42 +170,49 @@ private:
     bool update(float new_val, float *val);
   };
 
-  enum LowPrioritySensors
-  {
-    BAROMETER,
-    DIFF_PRESSURE,
-    SONAR,
-    MAGNETOMETER,
-    NUM_LOW_PRIORITY_SENSORS
-  };
-
   ROSflight& rf_;
 
   Data data_;
 
-  float accel_[3] = {0, 0, 0};
-  float gyro_[3] = {0, 0, 0};
-
   bool calibrating_acc_flag_ = false;
   bool calibrating_gyro_flag_ = false;
-  LowPrioritySensors next_sensor_to_update_ = BAROMETER;
+  sensor_id_t next_sensor_to_update_ = SENSOR_BARO;
   void calibrate_accel(void);
   void calibrate_gyro(void);
   void calibrate_baro(void);
   void calibrate_diff_pressure(void);
   void correct_imu(void);
+  void param_change_callback(uint16_t param_id);
+  void update_imu_filters(void);
+  void calibration_param_callback(uint16_t param_id);
+  void update_gyro_bias(void);
+  void batch_imu(void);
   void correct_mag(void);
   void correct_baro(void);
   void correct_diff_pressure(void);
-  bool update_imu(void);
   void update_other_sensors(void);
   void look_for_disabled_sensors(void);
+  static void sensor_result_callback(void *context, const sensor_result_t &result);
+  void handle_sensor_result(const sensor_result_t &result);
   uint32_t last_time_look_for_disarmed_sensors_ = 0;
   uint32_t last_imu_update_ms_ = 0;
 
   bool new_imu_data_;
+  RingBuffer<imu_sample_t, IMU_BATCH_BUFFER_SIZE> imu_batch_;
+  bool imu_batch_enabled_ = false; // the IMU batch stream is on, cached from its rate param
   bool imu_data_sent_;
 
+  // IMU filters, applied in correct_imu() in this order: notches, then low-pass
+  Biquad gyro_notch_;
+  Biquad gyro_dyn_notch_;
+  Biquad gyro_lpf_[2];
+  Biquad acc_lpf_;
+  float imu_sample_rate_hz_ = 0.0f;
+  bool dyn_notch_enabled_ = false;
+  float dyn_notch_q_ = 0.0f;
+  float dyn_notch_min_hz_ = 0.0f;
+  float dyn_notch_hz_ = 0.0f;
+
   // IMU calibration
   uint16_t gyro_calibration_count_ = 0;
   turbomath::Vector gyro_sum_ = {0, 0, 0};
@@ -170,6 +223,15 @@ private:
   turbomath::Vector max_ = {-1000.0f, -1000.0f, -1000.0f};
   turbomath::Vector min_ = {1000.0f, 1000.0f, 1000.0f};
 
+  // IMU corrections applied in correct_imu(), cached from the params and the online calibration
+  ImuCalibrator imu_calibrator_;
+  bool online_calibration_enabled_ = false;
+  turbomath::Vector accel_bias_ = {0, 0, 0};
+  turbomath::Vector accel_temp_comp_ = {0, 0, 0};
+  turbomath::Vector gyro_bias_ = {0, 0, 0};
+  float gyro_bias_temperature_ = 0.0f;  // temperature gyro_bias_ was looked up at
+  bool gyro_bias_stale_ = true;
+
   // Baro Calibration
   bool baro_calibrated_ = false;
   float ground_pressure_ = 0.0f;
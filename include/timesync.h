@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_TIMESYNC_H
+#define ROSFLIGHT_FIRMWARE_TIMESYNC_H
+
+#include <stdint.h>
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Tracks the offset and skew between the board clock and the clock of the companion computer
+ * @details Fed with TIMESYNC round trips started by the board. Each round trip gives the host time at
+ * (about) the local midpoint of the trip; an alpha-beta filter on the host-minus-local difference
+ * estimates the offset, and its rate of change the skew. Round trips that took much longer than the
+ * quickest recent one were queued somewhere on the way and are dropped. Once synced, the conversion
+ * never falls back to board time: a host clock that was set only steps the offset.
+ */
+class TimeSync
+{
+public:
+  // Gains of the alpha-beta filter on the offset
+  static constexpr float OFFSET_GAIN = 0.1f;
+  static constexpr float SKEW_GAIN = 0.005f;
+  // Largest skew accepted, crystal oscillators are well within this
+  static constexpr float MAX_SKEW = 0.001f;
+  // A prediction error beyond this means the host clock was set, so the offset steps to the new one (us)
+  static constexpr uint32_t RESYNC_THRESHOLD_US = 10000;
+  // Round trips longer than twice the quickest recent one plus this margin are dropped (us)
+  static constexpr uint32_t ROUND_TRIP_MARGIN_US = 200;
+  // Number of round trips before the estimate is used
+  static constexpr uint8_t MIN_SAMPLES = 5;
+
+  TimeSync();
+
+  void reset();
+
+  /**
+   * @brief Add a round trip
+   * @param local_send_us When the request was sent, on the board clock (us)
+   * @param host_us When the host answered, on the host clock (us)
+   * @param local_receive_us When the answer came back, on the board clock (us)
+   * @return True if the round trip was used
+   */
+  bool add_round_trip(uint64_t local_send_us, uint64_t host_us, uint64_t local_receive_us);
+
+  /**
+   * @brief Convert a board time to host time
+   * @param local_us The time on the board clock (us)
+   * @return The time on the host clock (us), or local_us unchanged until the estimate is ready
+   */
+  uint64_t to_host_us(uint64_t local_us) const;
+
+  inline bool synced() const { return samples_ >= MIN_SAMPLES; }
+  inline int64_t offset_us() const { return offset_us_; } // host minus local at the last round trip
+  inline float skew() const { return skew_; }              // change of the offset per unit of local time
+  inline uint32_t min_round_trip_us() const { return min_round_trip_us_; }
+  inline uint32_t rejected() const { return rejected_; }
+  inline uint32_t resyncs() const { return resyncs_; }
+
+private:
+  uint8_t samples_;
+  int64_t offset_us_;
+  uint64_t reference_us_;   // local time at which offset_us_ holds
+  float skew_;
+  uint32_t min_round_trip_us_;
+  uint32_t rejected_;
+  uint32_t resyncs_;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_TIMESYNC_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_VARINT_H
+#define ROSFLIGHT_FIRMWARE_VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace rosflight_firmware
+{
+
+// Variable-length integers: 7 bits per byte, least significant group first, with the top bit set on every
+// byte but the last. Signed values are zigzag mapped first (0, -1, 1, -2, ... to 0, 1, 2, 3, ...) so that
+// small deltas of either sign take a single byte.
+
+static constexpr uint8_t VARINT_MAX_SIZE_32 = 5;
+static constexpr uint8_t VARINT_MAX_SIZE_64 = 10;
+
+// The default quantize() limit, which keeps the difference between any two values within an int32
+static constexpr int32_t QUANTIZE_LIMIT = 1000000000;
+
+/**
+ * @brief Convert a value to the fixed point integer that is encoded in the compact streams and logs
+ * @param value The value
+ * @param lsb_per_unit Counts per unit of the value
+ * @param limit The result is clamped to +/- this, NaN goes to the low end
+ * @return The value in counts, rounded to the nearest
+ */
+inline int32_t quantize(float value, float lsb_per_unit, int32_t limit = QUANTIZE_LIMIT)
+{
+  float scaled = value * lsb_per_unit;
+  if (!(scaled > static_cast<float>(-limit)))
+    return -limit;
+  if (scaled > static_cast<float>(limit))
+    return limit;
+  return static_cast<int32_t>(scaled < 0.0f ? scaled - 0.5f : scaled + 0.5f);
+}
+
+inline uint32_t zigzag_encode(int32_t value)
+{
+  uint32_t shifted = static_cast<uint32_t>(value) << 1;
+  return (value < 0) ? ~shifted : shifted;
+}
+
+inline int32_t zigzag_decode(uint32_t value)
+{
+  return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1u)));
+}
+
+/**
+ * @brief Write a varint
+ * @param out Where to write it, with room for VARINT_MAX_SIZE_64 bytes
+ * @return The number of bytes written
+ */
+inline uint8_t varint_encode(uint64_t value, uint8_t *out)
+{
+  uint8_t len = 0;
+  while (value >= 0x80)
+  {
+    out[len++] = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  out[len++] = static_cast<uint8_t>(value);
+  return len;
+}
+
+/**
+ * @brief Read a varint
+ * @param in The encoded bytes
+ * @param len The number of bytes available
+ * @param value The decoded value
+ * @return The number of bytes read, or 0 if the varint is truncated or too long
+ */
+inline uint8_t varint_decode(const uint8_t *in, size_t len, uint64_t *value)
+{
+  uint64_t result = 0;
+  for (uint8_t i = 0; i < len && i < VARINT_MAX_SIZE_64; i++)
+  {
+    result |= static_cast<uint64_t>(in[i] & 0x7F) << (7*i);
+    if (!(in[i] & 0x80))
+    {
+      *value = result;
+      return static_cast<uint8_t>(i + 1);
+    }
+  }
+  return 0;
+}
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_VARINT_H
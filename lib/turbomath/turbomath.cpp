@@ -381,12 +381,8 @@ float fsign(float y)
   return (0.0f < y) - (y < 0.0f);
 }
 
-float cos(float x)
-{
-  return sin(M_PI/2.0 - x);
-}
-
-float sin(float x)
+template <>
+float sin<PRECISION_TABLE>(float x)
 {
   // wrap down to +/x PI
   while (x > M_PI)
@@ -397,11 +393,11 @@ float sin(float x)
 
   // sin is symmetric
   if (x < 0)
-    return -1.0*sin(-x);
+    return -1.0*sin<PRECISION_TABLE>(-x);
 
   // wrap onto (0, PI)
   if (x > M_PI)
-    return -1.0*sin(x - M_PI);
+    return -1.0*sin<PRECISION_TABLE>(x - M_PI);
 
   // Now, all we have left is the range 0 to PI, use the lookup table
   float t = (x - sin_min_x)/(sin_max_x - sin_min_x) * static_cast<float>(sin_num_entries);
@@ -417,17 +413,18 @@ float sin(float x)
 }
 
 
-float atan(float x)
+template <>
+float atan<PRECISION_TABLE>(float x)
 {
   // atan is symmetric
   if (x < 0)
   {
-    return -1.0*atan(-1.0*x);
+    return -1.0*atan<PRECISION_TABLE>(-1.0*x);
   }
   // This uses a sweet identity to wrap the domain of atan onto (0,1)
   if (x > 1.0)
   {
-    return M_PI/2.0 - atan(1.0/x);
+    return M_PI/2.0 - atan<PRECISION_TABLE>(1.0/x);
   }
 
   float t = (x - atan_min_x)/(atan_max_x - atan_min_x) * static_cast<float>(atan_num_entries);
@@ -443,51 +440,12 @@ float atan(float x)
 }
 
 
-float atan2(float y, float x)
+template <>
+float asin<PRECISION_TABLE>(float x)
 {
-  // algorithm from wikipedia: https://en.wikipedia.org/wiki/Atan2
-  if (x == 0.0)
-  {
-    if (y < 0.0)
-    {
-      return - M_PI/2.0;
-    }
-    else if ( y > 0.0)
-    {
-      return M_PI/2.0;
-    }
-    else
-    {
-      return 0.0;
-    }
-  }
-
-  float arctan = atan(y/x);
-
   if (x < 0.0)
   {
-    if ( y < 0)
-    {
-      return arctan - M_PI;
-    }
-    else
-    {
-      return arctan + M_PI;
-    }
-  }
-
-  else
-  {
-      return arctan;
-  }
-}
-
-
-float asin(float x)
-{
-  if (x < 0.0)
-  {
-    return -1.0*asin(-1.0*x);
+    return -1.0*asin<PRECISION_TABLE>(-1.0*x);
   }
 
   float t = (x - asin_min_x)/(asin_max_x - asin_min_x) * static_cast<float>(asin_num_entries);
@@ -502,6 +460,288 @@ float asin(float x)
       return asin_lookup_table[index]/asin_scale_factor + delta_x * (asin_lookup_table[index] - asin_lookup_table[index - 1])/asin_scale_factor;
 }
 
+// Fine tables: 256 intervals over [0, PI/2] for sin, [0, 1] for atan and [0, 0.5] for asin, with the
+// endpoint included so the interpolation never reads past the end
+static const int16_t FINE_TABLE_SIZE = 257;
+
+static const float sin_fine_table[FINE_TABLE_SIZE] = {
+0.0f,	0.00613588465f,	0.0122715383f,	0.0184067299f,	0.0245412285f,	0.0306748032f,
+0.0368072229f,	0.0429382569f,	0.0490676743f,	0.0551952443f,	0.0613207363f,	0.0674439196f,
+0.0735645636f,	0.079682438f,	0.0857973123f,	0.0919089565f,	0.0980171403f,	0.104121634f,
+0.110222207f,	0.116318631f,	0.122410675f,	0.128498111f,	0.134580709f,	0.140658239f,
+0.146730474f,	0.152797185f,	0.158858143f,	0.16491312f,	0.170961889f,	0.17700422f,
+0.183039888f,	0.189068664f,	0.195090322f,	0.201104635f,	0.207111376f,	0.21311032f,
+0.21910124f,	0.225083911f,	0.231058108f,	0.237023606f,	0.24298018f,	0.248927606f,
+0.25486566f,	0.260794118f,	0.266712757f,	0.272621355f,	0.278519689f,	0.284407537f,
+0.290284677f,	0.296150888f,	0.302005949f,	0.30784964f,	0.31368174f,	0.319502031f,
+0.325310292f,	0.331106306f,	0.336889853f,	0.342660717f,	0.34841868f,	0.354163525f,
+0.359895037f,	0.365612998f,	0.371317194f,	0.37700741f,	0.382683432f,	0.388345047f,
+0.39399204f,	0.3996242f,	0.405241314f,	0.410843171f,	0.41642956f,	0.422000271f,
+0.427555093f,	0.433093819f,	0.438616239f,	0.444122145f,	0.44961133f,	0.455083587f,
+0.460538711f,	0.465976496f,	0.471396737f,	0.47679923f,	0.482183772f,	0.48755016f,
+0.492898192f,	0.498227667f,	0.503538384f,	0.508830143f,	0.514102744f,	0.51935599f,
+0.524589683f,	0.529803625f,	0.53499762f,	0.540171473f,	0.545324988f,	0.550457973f,
+0.555570233f,	0.560661576f,	0.565731811f,	0.570780746f,	0.575808191f,	0.580813958f,
+0.585797857f,	0.590759702f,	0.595699304f,	0.600616479f,	0.605511041f,	0.610382806f,
+0.615231591f,	0.620057212f,	0.624859488f,	0.629638239f,	0.634393284f,	0.639124445f,
+0.643831543f,	0.648514401f,	0.653172843f,	0.657806693f,	0.662415778f,	0.666999922f,
+0.671558955f,	0.676092704f,	0.680600998f,	0.685083668f,	0.689540545f,	0.693971461f,
+0.698376249f,	0.702754744f,	0.707106781f,	0.711432196f,	0.715730825f,	0.720002508f,
+0.724247083f,	0.72846439f,	0.732654272f,	0.736816569f,	0.740951125f,	0.745057785f,
+0.749136395f,	0.753186799f,	0.757208847f,	0.761202385f,	0.765167266f,	0.769103338f,
+0.773010453f,	0.776888466f,	0.780737229f,	0.784556597f,	0.788346428f,	0.792106577f,
+0.795836905f,	0.799537269f,	0.803207531f,	0.806847554f,	0.810457198f,	0.81403633f,
+0.817584813f,	0.821102515f,	0.824589303f,	0.828045045f,	0.831469612f,	0.834862875f,
+0.838224706f,	0.841554977f,	0.844853565f,	0.848120345f,	0.851355193f,	0.854557988f,
+0.85772861f,	0.860866939f,	0.863972856f,	0.867046246f,	0.870086991f,	0.873094978f,
+0.876070094f,	0.879012226f,	0.881921264f,	0.884797098f,	0.88763962f,	0.890448723f,
+0.893224301f,	0.89596625f,	0.898674466f,	0.901348847f,	0.903989293f,	0.906595705f,
+0.909167983f,	0.911706032f,	0.914209756f,	0.91667906f,	0.919113852f,	0.921514039f,
+0.923879533f,	0.926210242f,	0.92850608f,	0.930766961f,	0.932992799f,	0.93518351f,
+0.937339012f,	0.939459224f,	0.941544065f,	0.943593458f,	0.945607325f,	0.947585591f,
+0.949528181f,	0.951435021f,	0.95330604f,	0.955141168f,	0.956940336f,	0.958703475f,
+0.960430519f,	0.962121404f,	0.963776066f,	0.965394442f,	0.966976471f,	0.968522094f,
+0.970031253f,	0.971503891f,	0.972939952f,	0.974339383f,	0.97570213f,	0.977028143f,
+0.978317371f,	0.979569766f,	0.98078528f,	0.981963869f,	0.983105487f,	0.984210092f,
+0.985277642f,	0.986308097f,	0.987301418f,	0.988257568f,	0.98917651f,	0.99005821f,
+0.990902635f,	0.991709754f,	0.992479535f,	0.993211949f,	0.99390697f,	0.994564571f,
+0.995184727f,	0.995767414f,	0.996312612f,	0.996820299f,	0.997290457f,	0.997723067f,
+0.998118113f,	0.998475581f,	0.998795456f,	0.999077728f,	0.999322385f,	0.999529418f,
+0.999698819f,	0.999830582f,	0.999924702f,	0.999981175f,	1.0f,
+};
+
+static const float atan_fine_table[FINE_TABLE_SIZE] = {
+0.0f,	0.00390623013f,	0.00781234106f,	0.0117182136f,	0.0156237286f,	0.019528767f,
+0.0234332099f,	0.0273369383f,	0.0312398334f,	0.0351417768f,	0.03904265f,	0.0429423347f,
+0.0468407129f,	0.0507376669f,	0.0546330792f,	0.0585268326f,	0.06241881f,	0.0663088949f,
+0.0701969711f,	0.0740829225f,	0.0779666338f,	0.0818479898f,	0.0857268758f,	0.0896031775f,
+0.0934767812f,	0.0973475735f,	0.101215442f,	0.105080273f,	0.108941957f,	0.112800381f,
+0.116655435f,	0.12050701f,	0.124354995f,	0.128199281f,	0.132039762f,	0.135876328f,
+0.139708874f,	0.143537294f,	0.147361481f,	0.151181332f,	0.154996742f,	0.158807608f,
+0.162613829f,	0.166415301f,	0.170211925f,	0.174003601f,	0.177790229f,	0.181571711f,
+0.18534795f,	0.189118849f,	0.192884312f,	0.196644245f,	0.200398554f,	0.204147145f,
+0.207889927f,	0.211626809f,	0.2153577f,	0.219082511f,	0.222801154f,	0.226513541f,
+0.230219587f,	0.233919206f,	0.237612314f,	0.241298827f,	0.244978663f,	0.248651741f,
+0.252317981f,	0.255977303f,	0.259629629f,	0.263274883f,	0.266912988f,	0.270543868f,
+0.274167451f,	0.277783663f,	0.281392433f,	0.284993689f,	0.288587362f,	0.292173383f,
+0.295751686f,	0.299322203f,	0.302884868f,	0.306439619f,	0.309986391f,	0.313525123f,
+0.317055753f,	0.320578222f,	0.32409247f,	0.327598441f,	0.331096077f,	0.334585322f,
+0.338066123f,	0.341538425f,	0.345002177f,	0.348457327f,	0.351903825f,	0.355341622f,
+0.35877067f,	0.362190922f,	0.365602332f,	0.369004855f,	0.372398447f,	0.375783065f,
+0.379158669f,	0.382525217f,	0.385882669f,	0.389230988f,	0.392570135f,	0.395900074f,
+0.39922077f,	0.402532187f,	0.405834293f,	0.409127055f,	0.412410442f,	0.415684422f,
+0.418948967f,	0.422204048f,	0.425449637f,	0.428685708f,	0.431912235f,	0.435129194f,
+0.43833656f,	0.441534311f,	0.444722424f,	0.447900879f,	0.451069656f,	0.454228735f,
+0.457378099f,	0.460517729f,	0.463647609f,	0.466767724f,	0.469878058f,	0.472978598f,
+0.47606933f,	0.479150243f,	0.482221324f,	0.485282564f,	0.488333951f,	0.491375478f,
+0.494407135f,	0.497428916f,	0.500440813f,	0.503442821f,	0.506434934f,	0.509417149f,
+0.51238946f,	0.515351866f,	0.518304364f,	0.521246951f,	0.524179629f,	0.527102395f,
+0.530015251f,	0.532918198f,	0.535811238f,	0.538694373f,	0.541567605f,	0.54443094f,
+0.547284381f,	0.550127933f,	0.552961602f,	0.555785394f,	0.558599315f,	0.561403374f,
+0.564197577f,	0.566981934f,	0.569756453f,	0.572521145f,	0.575276018f,	0.578021084f,
+0.580756354f,	0.583481839f,	0.586197551f,	0.588903504f,	0.59159971f,	0.594286183f,
+0.596962937f,	0.599629987f,	0.602287346f,	0.604935031f,	0.607573058f,	0.610201443f,
+0.612820202f,	0.615429353f,	0.618028912f,	0.620618899f,	0.62319933f,	0.625770225f,
+0.628331602f,	0.630883482f,	0.633425883f,	0.635958826f,	0.63848233f,	0.640996418f,
+0.643501109f,	0.645996425f,	0.648482388f,	0.650959019f,	0.653426341f,	0.655884377f,
+0.658333148f,	0.660772679f,	0.663202993f,	0.665624112f,	0.668036062f,	0.670438866f,
+0.672832548f,	0.675217133f,	0.677592646f,	0.679959111f,	0.682316555f,	0.684665002f,
+0.687004478f,	0.68933501f,	0.691656622f,	0.693969341f,	0.696273194f,	0.698568208f,
+0.700854408f,	0.703131822f,	0.705400477f,	0.7076604f,	0.709911618f,	0.71215416f,
+0.714388052f,	0.716613323f,	0.71883f,	0.721038111f,	0.723237685f,	0.725428749f,
+0.727611333f,	0.729785464f,	0.731951171f,	0.734108483f,	0.736257429f,	0.738398037f,
+0.740530337f,	0.742654356f,	0.744770126f,	0.746877674f,	0.748977029f,	0.751068222f,
+0.753151281f,	0.755226236f,	0.757293116f,	0.759351951f,	0.76140277f,	0.763445603f,
+0.765480479f,	0.767507428f,	0.76952648f,	0.771537665f,	0.773541012f,	0.77553655f,
+0.77752431f,	0.779504322f,	0.781476615f,	0.783441219f,	0.785398163f,
+};
+
+static const float asin_fine_table[FINE_TABLE_SIZE] = {
+0.0f,	0.00195312624f,	0.00390625993f,	0.00585940853f,	0.00781257948f,	0.00976578023f,
+0.0117190182f,	0.013672301f,	0.0156256359f,	0.0175790304f,	0.019532492f,	0.0214860281f,
+0.0234396463f,	0.0253933539f,	0.0273471585f,	0.0293010676f,	0.0312550885f,	0.0332092288f,
+0.035163496f,	0.0371178975f,	0.0390724409f,	0.0410271337f,	0.0429819833f,	0.0449369973f,
+0.0468921831f,	0.0488475484f,	0.0508031006f,	0.0527588473f,	0.0547147959f,	0.0566709542f,
+0.0586273295f,	0.0605839295f,	0.0625407618f,	0.0644978339f,	0.0664551534f,	0.0684127279f,
+0.070370565f,	0.0723286723f,	0.0742870575f,	0.0762457282f,	0.0782046919f,	0.0801639565f,
+0.0821235295f,	0.0840834186f,	0.0860436315f,	0.0880041759f,	0.0899650594f,	0.0919262899f,
+0.0938878751f,	0.0958498227f,	0.0978121404f,	0.099774836f,	0.101737917f,	0.103701392f,
+0.105665268f,	0.107629554f,	0.109594256f,	0.111559383f,	0.113524943f,	0.115490943f,
+0.117457392f,	0.119424297f,	0.121391667f,	0.123359509f,	0.125327831f,	0.127296642f,
+0.129265948f,	0.131235759f,	0.133206082f,	0.135176926f,	0.137148298f,	0.139120206f,
+0.141092659f,	0.143065665f,	0.145039232f,	0.147013368f,	0.148988081f,	0.15096338f,
+0.152939272f,	0.154915766f,	0.156892871f,	0.158870594f,	0.160848944f,	0.162827929f,
+0.164807558f,	0.166787839f,	0.168768781f,	0.170750391f,	0.172732678f,	0.174715651f,
+0.176699319f,	0.17868369f,	0.180668772f,	0.182654574f,	0.184641104f,	0.186628372f,
+0.188616386f,	0.190605155f,	0.192594687f,	0.194584991f,	0.196576077f,	0.198567952f,
+0.200560626f,	0.202554107f,	0.204548405f,	0.206543528f,	0.208539486f,	0.210536287f,
+0.21253394f,	0.214532455f,	0.216531841f,	0.218532107f,	0.220533261f,	0.222535313f,
+0.224538273f,	0.22654215f,	0.228546953f,	0.230552691f,	0.232559373f,	0.23456701f,
+0.236575611f,	0.238585185f,	0.240595741f,	0.24260729f,	0.24461984f,	0.246633402f,
+0.248647986f,	0.2506636f,	0.252680255f,	0.254697961f,	0.256716727f,	0.258736564f,
+0.260757481f,	0.262779488f,	0.264802596f,	0.266826814f,	0.268852153f,	0.270878623f,
+0.272906234f,	0.274934996f,	0.27696492f,	0.278996016f,	0.281028294f,	0.283061765f,
+0.28509644f,	0.287132329f,	0.289169443f,	0.291207791f,	0.293247386f,	0.295288238f,
+0.297330358f,	0.299373756f,	0.301418444f,	0.303464432f,	0.305511732f,	0.307560355f,
+0.309610312f,	0.311661614f,	0.313714272f,	0.315768298f,	0.317823704f,	0.3198805f,
+0.321938699f,	0.323998312f,	0.32605935f,	0.328121825f,	0.33018575f,	0.332251135f,
+0.334317994f,	0.336386338f,	0.338456178f,	0.340527528f,	0.342600399f,	0.344674804f,
+0.346750754f,	0.348828263f,	0.350907344f,	0.352988007f,	0.355070267f,	0.357154136f,
+0.359239626f,	0.361326751f,	0.363415524f,	0.365505957f,	0.367598064f,	0.369691857f,
+0.371787351f,	0.373884559f,	0.375983494f,	0.378084169f,	0.380186598f,	0.382290795f,
+0.384396774f,	0.386504549f,	0.388614134f,	0.390725542f,	0.392838788f,	0.394953886f,
+0.39707085f,	0.399189696f,	0.401310437f,	0.403433088f,	0.405557665f,	0.407684181f,
+0.409812652f,	0.411943093f,	0.414075518f,	0.416209945f,	0.418346386f,	0.42048486f,
+0.422625379f,	0.424767962f,	0.426912623f,	0.429059378f,	0.431208244f,	0.433359236f,
+0.435512371f,	0.437667666f,	0.439825136f,	0.441984799f,	0.444146671f,	0.44631077f,
+0.448477112f,	0.450645714f,	0.452816595f,	0.45498977f,	0.457165259f,	0.459343078f,
+0.461523246f,	0.463705781f,	0.4658907f,	0.468078022f,	0.470267765f,	0.472459949f,
+0.474654591f,	0.476851711f,	0.479051327f,	0.48125346f,	0.483458128f,	0.48566535f,
+0.487875148f,	0.490087539f,	0.492302545f,	0.494520186f,	0.496740481f,	0.498963452f,
+0.50118912f,	0.503417504f,	0.505648627f,	0.507882509f,	0.510119172f,	0.512358638f,
+0.514600928f,	0.516846064f,	0.519094069f,	0.521344966f,	0.523598776f,
+};
+
+static const float PI_F = 3.14159265f;
+static const float HALF_PI_F = 1.57079633f;
+
+static inline float fine_table_lookup(const float table[FINE_TABLE_SIZE], float t)
+{
+  int16_t index = static_cast<int16_t>(t);
+  if (index >= FINE_TABLE_SIZE - 1)
+    return table[FINE_TABLE_SIZE - 1];
+  float delta_x = t - index;
+  return table[index] + delta_x*(table[index + 1] - table[index]);
+}
+
+// wraps x onto [0, PI/2], returning the sign of sin(x)
+static inline float sin_reduce(float *x)
+{
+  float sign = 1.0f;
+  while (*x > PI_F)
+    *x -= 2.0f*PI_F;
+  while (*x <= -PI_F)
+    *x += 2.0f*PI_F;
+  if (*x < 0.0f)
+  {
+    *x = -*x;
+    sign = -1.0f;
+  }
+  if (*x > HALF_PI_F)
+    *x = PI_F - *x;
+  return sign;
+}
+
+// the asin identity for x in (0.5, 1]: PI/2 - 2*asin(sqrt((1 - x)/2)), returning the new argument
+static inline float asin_reduce(float x)
+{
+  float v = 0.5f*(1.0f - x);
+  if (v <= 0.0f)
+    return 0.0f;
+  // one more Newton step, so the square root doesn't limit the accuracy
+  float r = inv_sqrt(v);
+  r *= 1.5f - 0.5f*v*r*r;
+  return v*r;
+}
+
+template <>
+float sin<PRECISION_FINE_TABLE>(float x)
+{
+  float sign = sin_reduce(&x);
+  return sign*fine_table_lookup(sin_fine_table, x*(256.0f/HALF_PI_F));
+}
+
+template <>
+float atan<PRECISION_FINE_TABLE>(float x)
+{
+  if (x < 0.0f)
+    return -atan<PRECISION_FINE_TABLE>(-x);
+  if (x > 1.0f)
+    return HALF_PI_F - atan<PRECISION_FINE_TABLE>(1.0f/x);
+  return fine_table_lookup(atan_fine_table, x*256.0f);
+}
+
+template <>
+float asin<PRECISION_FINE_TABLE>(float x)
+{
+  if (x < 0.0f)
+    return -asin<PRECISION_FINE_TABLE>(-x);
+  if (x > 0.5f)
+    return HALF_PI_F - 2.0f*fine_table_lookup(asin_fine_table, asin_reduce(x)*512.0f);
+  return fine_table_lookup(asin_fine_table, x*512.0f);
+}
+
+// Polynomial tier: odd minimax polynomials (Remez exchange, absolute error) over the same reduced
+// ranges as the fine tables
+template <>
+float sin<PRECISION_POLYNOMIAL>(float x)
+{
+  // max error 3.4e-9 on [0, PI/2], so float rounding dominates
+  float sign = sin_reduce(&x);
+  float x2 = x*x;
+  return sign*x*(0.999999977f + x2*(-0.166666476f + x2*(0.00833289982f + x2*(-0.000198008978f + x2*2.5904885e-06f))));
+}
+
+static inline float atan_polynomial(float x)
+{
+  // max error 2.5e-7 on [0, 1]
+  float x2 = x*x;
+  return x*(0.999996112f + x2*(-0.333173681f + x2*(0.198078156f + x2*(-0.132333421f
+           + x2*(0.0796236724f + x2*(-0.0336042206f + x2*0.00681179329f))))));
+}
+
+template <>
+float atan<PRECISION_POLYNOMIAL>(float x)
+{
+  if (x < 0.0f)
+    return -atan<PRECISION_POLYNOMIAL>(-x);
+  if (x > 1.0f)
+    return HALF_PI_F - atan_polynomial(1.0f/x);
+  return atan_polynomial(x);
+}
+
+static inline float asin_polynomial(float x)
+{
+  // max error 2.1e-8 on [0, 0.5]
+  float x2 = x*x;
+  return x*(1.00000046f + x2*(0.166631011f + x2*(0.0757618203f + x2*(0.0381369773f + x2*0.0533216797f))));
+}
+
+template <>
+float asin<PRECISION_POLYNOMIAL>(float x)
+{
+  if (x < 0.0f)
+    return -asin<PRECISION_POLYNOMIAL>(-x);
+  if (x > 0.5f)
+    return HALF_PI_F - 2.0f*asin_polynomial(asin_reduce(x));
+  return asin_polynomial(x);
+}
+
+float cos(float x)
+{
+  return cos<TURBOMATH_PRECISION>(x);
+}
+
+float sin(float x)
+{
+  return sin<TURBOMATH_PRECISION>(x);
+}
+
+float atan(float x)
+{
+  return atan<TURBOMATH_PRECISION>(x);
+}
+
+float atan2(float y, float x)
+{
+  return atan2<TURBOMATH_PRECISION>(y, x);
+}
+
+float asin(float x)
+{
+  return asin<TURBOMATH_PRECISION>(x);
+}
+
 float alt(float press)
 {
 
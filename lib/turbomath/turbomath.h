@@ -97,6 +97,61 @@ public:
   Quaternion& operator*= (const Quaternion& q);
 };
 
+// Precision tiers for the trig approximations, selectable at compile time, e.g. atan2<PRECISION_POLYNOMIAL>(y, x).
+// Maximum absolute errors are in radians (or unitless for sin/cos).
+enum precision_t
+{
+  PRECISION_TABLE,        // the original 125-200 entry int16 tables, ~1e-4
+  PRECISION_FINE_TABLE,   // 257 entry float tables with linear interpolation, ~5e-6
+  PRECISION_POLYNOMIAL    // minimax polynomials, ~3e-7 and no tables
+};
+
+template <precision_t P> float sin(float x);
+template <precision_t P> float asin(float x);
+template <precision_t P> float atan(float x);
+
+template <> float sin<PRECISION_TABLE>(float x);
+template <> float sin<PRECISION_FINE_TABLE>(float x);
+template <> float sin<PRECISION_POLYNOMIAL>(float x);
+template <> float asin<PRECISION_TABLE>(float x);
+template <> float asin<PRECISION_FINE_TABLE>(float x);
+template <> float asin<PRECISION_POLYNOMIAL>(float x);
+template <> float atan<PRECISION_TABLE>(float x);
+template <> float atan<PRECISION_FINE_TABLE>(float x);
+template <> float atan<PRECISION_POLYNOMIAL>(float x);
+
+template <precision_t P>
+inline float cos(float x)
+{
+  return sin<P>(1.57079633f - x);
+}
+
+template <precision_t P>
+float atan2(float y, float x)
+{
+  // algorithm from wikipedia: https://en.wikipedia.org/wiki/Atan2
+  if (x == 0.0f)
+  {
+    if (y < 0.0f)
+      return -1.57079633f;
+    else if (y > 0.0f)
+      return 1.57079633f;
+    else
+      return 0.0f;
+  }
+
+  float arctan = atan<P>(y/x);
+  if (x < 0.0f)
+    return (y < 0.0f) ? arctan - 3.14159265f : arctan + 3.14159265f;
+  else
+    return arctan;
+}
+
+// The tier used by the float-based wrappers below, which a build can override with -DTURBOMATH_PRECISION=...
+#ifndef TURBOMATH_PRECISION
+#define TURBOMATH_PRECISION PRECISION_TABLE
+#endif
+
 // float-based wrappers
 float cos(float x);
 float sin(float x);
@@ -118,6 +173,49 @@ union float_converter_t
   int32_t ivalue;
 };
 
+// Fused kernels for the compound expressions in the estimator's per-sample path. They are inline so
+// that each one compiles to a single pass over the components, without the out-of-line calls and
+// temporaries of the equivalent operator expressions.
+
+// y += a*x
+inline void axpy(float a, const Vector& x, Vector& y)
+{
+  y.x += a*x.x;
+  y.y += a*x.y;
+  y.z += a*x.z;
+}
+
+// y = a*x + b*y
+inline void axpby(float a, const Vector& x, float b, Vector& y)
+{
+  y.x = a*x.x + b*y.x;
+  y.y = a*x.y + b*y.y;
+  y.z = a*x.z + b*y.z;
+}
+
+// a*u + b*v + c*w
+inline Vector lincomb(float a, const Vector& u, float b, const Vector& v, float c, const Vector& w)
+{
+  return Vector(a*u.x + b*v.x + c*w.x,
+                a*u.y + b*v.y + c*w.y,
+                a*u.z + b*v.z + c*w.z);
+}
+
+// (Quaternion(t1, t2*w)*q).normalize(), with t2 factored out of the product and without the intermediate
+// quaternion, the attitude update of both the Euler and matrix exponential integrators
+inline Quaternion propagate_normalize(const Quaternion& q, const Vector& w, float t1, float t2)
+{
+  float qw = t1*q.w + t2*(-w.x*q.x - w.y*q.y - w.z*q.z);
+  float qx = t1*q.x + t2*( w.x*q.w + w.z*q.y - w.y*q.z);
+  float qy = t1*q.y + t2*( w.y*q.w - w.z*q.x + w.x*q.z);
+  float qz = t1*q.z + t2*( w.z*q.w + w.y*q.x - w.x*q.y);
+
+  float recip_norm = inv_sqrt(qw*qw + qx*qx + qy*qy + qz*qz);
+  if (qw < 0.0f)
+    recip_norm = -recip_norm;
+  return Quaternion(qw*recip_norm, qx*recip_norm, qy*recip_norm, qz*recip_norm);
+}
+
 } // namespace turbomath
 
 #endif // TURBOMATH_TURBOMATH_H
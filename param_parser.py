@@ -18,24 +18,19 @@ lines = re.split("\n+", text)
 params = []
 i = 0
 for line in lines:
-    # search for init_param lines
-    match = re.search("^\s*init_param", line)
+    # search for entries of the param table, e.g.
+    # PARAM_INT(PARAM_BAUD_RATE, "BAUD_RATE", 921600, 9600, 921600), // Baud rate of MAVlink communication
+    match = re.search("^\s*PARAM_(INT|FLOAT)\((.*)\),?\s*//(.*)$", line)
     if match != None:
-        name_with_quotes = re.search("\".*\"", line).group(0)
-        name = re.search("\w{1,16}", name_with_quotes).group(0)
-        if name != 'DEFAULT':
-            params.append(dict())
-            params[i]['type'] = re.split("\(", re.split("_", line)[2])[0]
-            params[i]['name'] = name
-            # Find default value
-            params[i]['default'] =  re.split("\)", re.split(",", line)[2])[0]
-            # isolate the comment portion of the line and split it on the "|" characters
-            comment = re.split("\|", re.split("//", line)[1])
-            # Isolate the Description
-            params[i]["description"] = comment[0].strip()
-            params[i]["min"] = comment[1].strip()
-            params[i]["max"] = comment[2].strip()
-            i += 1
+        args = [arg.strip() for arg in match.group(2).split(",")]
+        params.append(dict())
+        params[i]['type'] = match.group(1).lower()
+        params[i]['name'] = args[1].strip("\"")
+        params[i]['default'] = args[2]
+        params[i]["description"] = match.group(3).strip()
+        params[i]["min"] = args[3].replace("INFINITY", "inf")
+        params[i]["max"] = args[4].replace("INFINITY", "inf")
+        i += 1
 
 # Now, generate the markdown table of the parameters
 out = open('parameter-descriptions.md', 'w')
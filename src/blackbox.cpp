@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "blackbox.h"
+#include "delta_batch.h"
+#include "rosflight.h"
+#include "varint.h"
+
+namespace rosflight_firmware
+{
+
+constexpr uint8_t Blackbox::FORMAT_VERSION;
+constexpr uint16_t Blackbox::PAGE_SIZE;
+constexpr uint8_t Blackbox::KEYFRAME_INTERVAL;
+constexpr uint8_t Blackbox::FRAME_HEADER;
+constexpr uint8_t Blackbox::FRAME_KEYFRAME;
+constexpr uint8_t Blackbox::FRAME_DELTA;
+constexpr float Blackbox::GYRO_SCALE;
+constexpr float Blackbox::ACCEL_SCALE;
+constexpr float Blackbox::COMMAND_SCALE;
+
+Blackbox::Blackbox(ROSflight& rf) :
+  RF_(rf),
+  storage_size_(0),
+  erase_size_(0),
+  end_(0),
+  erase_address_(0),
+  erasing_(false),
+  logging_(false),
+  full_(false),
+  failed_(false),
+  enabled_(false),
+  rate_div_(1),
+  updates_since_frame_(0),
+  previous_time_us_(0),
+  frames_since_keyframe_(0),
+  need_keyframe_(true),
+  frames_logged_(0),
+  frames_dropped_(0)
+{
+  reset_buffers();
+}
+
+void Blackbox::init()
+{
+  // the pages written here have to fit evenly in the storage's own pages and erase blocks
+  uint32_t size = RF_.board_.log_size();
+  uint32_t page_size = RF_.board_.log_page_size();
+  erase_size_ = RF_.board_.log_erase_size();
+  bool usable = size > 0 && page_size >= PAGE_SIZE && page_size % PAGE_SIZE == 0
+                && erase_size_ >= page_size && erase_size_ % page_size == 0 && size % erase_size_ == 0;
+  storage_size_ = usable ? size : 0;
+
+  erasing_ = false;
+  logging_ = false;
+  failed_ = false;
+  frames_logged_ = 0;
+  frames_dropped_ = 0;
+  end_ = available() ? find_end() : 0;
+  reset_buffers();
+
+  RF_.params_.add_callback<Blackbox, &Blackbox::param_change_callback>(this, PARAM_BLACKBOX);
+  RF_.params_.add_callback<Blackbox, &Blackbox::param_change_callback>(this, PARAM_BLACKBOX_RATE_DIV);
+}
+
+void Blackbox::param_change_callback(uint16_t param_id)
+{
+  (void) param_id;
+  enabled_ = RF_.params_.get_param_int(PARAM_BLACKBOX);
+  rate_div_ = static_cast<uint16_t>(RF_.params_.get_param_int(PARAM_BLACKBOX_RATE_DIV));
+  if (rate_div_ == 0)
+    rate_div_ = 1;
+}
+
+void Blackbox::reset_buffers()
+{
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    length_[i] = 0;
+    pending_[i] = false;
+  }
+  fill_ = 0;
+  flush_ = 0;
+  address_[0] = end_;
+  next_address_ = end_ + PAGE_SIZE;
+  full_ = (end_ + PAGE_SIZE > storage_size_);
+}
+
+uint32_t Blackbox::find_end()
+{
+  // pages are written in order and never start with an erased byte, so a binary search for the first page
+  // that does finds the end of the log
+  uint32_t low = 0;
+  uint32_t high = storage_size_/PAGE_SIZE;
+  while (low < high)
+  {
+    uint32_t mid = low + (high - low)/2;
+    uint8_t first = 0xFF;
+    RF_.board_.log_read(mid*PAGE_SIZE, &first, 1);
+    if (first == 0xFF)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+  return low*PAGE_SIZE;
+}
+
+void Blackbox::log_frame()
+{
+  if (!RF_.state_manager_.state().armed)
+  {
+    if (logging_)
+      end_session();
+    return;
+  }
+
+  if (!logging_ && !start_session())
+    return;
+
+  if (++updates_since_frame_ < rate_div_)
+    return;
+  updates_since_frame_ = 0;
+
+  int32_t fields[NUM_FIELDS];
+  sample(fields);
+  uint64_t time_us = RF_.sensors_.data().imu_time;
+
+  bool keyframe = need_keyframe_ || frames_since_keyframe_ >= KEYFRAME_INTERVAL;
+  uint8_t frame[MAX_FRAME_SIZE];
+  uint16_t len = 0;
+  frame[len++] = keyframe ? FRAME_KEYFRAME : FRAME_DELTA;
+  len = static_cast<uint16_t>(len + delta_encode<NUM_FIELDS>(keyframe ? time_us : time_us - previous_time_us_, fields,
+                                                              keyframe ? nullptr : previous_, frame + len));
+
+  if (!append(frame, len))
+  {
+    // the next frame that makes it in can't be a delta from this one
+    if (!full_)
+      frames_dropped_++;
+    need_keyframe_ = true;
+    return;
+  }
+
+  memcpy(previous_, fields, sizeof(previous_));
+  previous_time_us_ = time_us;
+  frames_since_keyframe_ = keyframe ? 1 : static_cast<uint8_t>(frames_since_keyframe_ + 1);
+  need_keyframe_ = false;
+  frames_logged_++;
+}
+
+bool Blackbox::start_session()
+{
+  if (!enabled_ || !available() || erasing_ || full_ || failed_)
+    return false;
+
+  uint16_t rate_hz = static_cast<uint16_t>(RF_.params_.get_param_int(PARAM_IMU_SAMPLE_RATE));
+  const uint8_t header[] = { FRAME_HEADER, FORMAT_VERSION, NUM_FIELDS,
+                             static_cast<uint8_t>(rate_hz & 0xFF), static_cast<uint8_t>(rate_hz >> 8),
+                             static_cast<uint8_t>(rate_div_ & 0xFF), static_cast<uint8_t>(rate_div_ >> 8) };
+  if (!append(header, sizeof(header)))
+    return false;
+
+  logging_ = true;
+  need_keyframe_ = true;
+  updates_since_frame_ = static_cast<uint16_t>(rate_div_ - 1); // log the first update
+  return true;
+}
+
+void Blackbox::end_session()
+{
+  // write out the partly filled page, the next session starts on a new one
+  if (length_[fill_] > 0)
+    pending_[fill_] = true;
+  logging_ = false;
+}
+
+bool Blackbox::append(const uint8_t *data, uint16_t len)
+{
+  if (pending_[fill_] || length_[fill_] + len > PAGE_SIZE)
+  {
+    pending_[fill_] = true;
+
+    // both buffers are full, the storage is behind
+    uint8_t next = fill_ ^ 1;
+    if (pending_[next])
+      return false;
+
+    if (next_address_ + PAGE_SIZE > storage_size_)
+    {
+      full_ = true;
+      logging_ = false;
+      RF_.mavlink_.log(Mavlink::LOG_WARNING, "blackbox full");
+      return false;
+    }
+
+    fill_ = next;
+    length_[fill_] = 0;
+    address_[fill_] = next_address_;
+    next_address_ += PAGE_SIZE;
+  }
+
+  memcpy(buffer_[fill_] + length_[fill_], data, len);
+  length_[fill_] = static_cast<uint16_t>(length_[fill_] + len);
+  return true;
+}
+
+void Blackbox::run()
+{
+  if (!available() || RF_.board_.log_busy())
+    return;
+
+  if (pending_[flush_])
+  {
+    // only the bytes in use are programmed, the rest of the page stays erased
+    if (!RF_.board_.log_write(address_[flush_], buffer_[flush_], length_[flush_]))
+    {
+      failed_ = true;
+      logging_ = false;
+      RF_.mavlink_.log(Mavlink::LOG_ERROR, "blackbox write failed");
+    }
+    end_ = address_[flush_] + PAGE_SIZE;
+    length_[flush_] = 0;
+    pending_[flush_] = false;
+    flush_ ^= 1;
+  }
+  else if (erasing_)
+  {
+    // only the blocks the log reaches into have been written
+    if (erase_address_ < end_)
+    {
+      if (!RF_.board_.log_erase(erase_address_))
+      {
+        erasing_ = false;
+        RF_.mavlink_.log(Mavlink::LOG_ERROR, "blackbox erase failed");
+        return;
+      }
+      erase_address_ += erase_size_;
+    }
+    else
+    {
+      erasing_ = false;
+      failed_ = false;
+      end_ = 0;
+      reset_buffers();
+      RF_.mavlink_.log(Mavlink::LOG_INFO, "blackbox erased");
+    }
+  }
+}
+
+bool Blackbox::erase()
+{
+  if (!available() || RF_.state_manager_.state().armed)
+    return false;
+
+  erase_address_ = 0;
+  erasing_ = true;
+  return true;
+}
+
+bool Blackbox::read(uint32_t offset, uint8_t *data, size_t len)
+{
+  if (erasing_ || offset + len > end_ || RF_.board_.log_busy())
+    return false;
+  return RF_.board_.log_read(offset, data, len);
+}
+
+void Blackbox::sample(int32_t fields[NUM_FIELDS]) const
+{
+  const Sensors::Data& data = RF_.sensors_.data();
+  fields[FIELD_GYRO_X] = quantize(data.gyro.x, GYRO_SCALE);
+  fields[FIELD_GYRO_Y] = quantize(data.gyro.y, GYRO_SCALE);
+  fields[FIELD_GYRO_Z] = quantize(data.gyro.z, GYRO_SCALE);
+  fields[FIELD_ACCEL_X] = quantize(data.accel.x, ACCEL_SCALE);
+  fields[FIELD_ACCEL_Y] = quantize(data.accel.y, ACCEL_SCALE);
+  fields[FIELD_ACCEL_Z] = quantize(data.accel.z, ACCEL_SCALE);
+
+  const control_t& command = RF_.command_manager_.combined_control();
+  fields[FIELD_SETPOINT_X] = quantize(command.x.value, COMMAND_SCALE);
+  fields[FIELD_SETPOINT_Y] = quantize(command.y.value, COMMAND_SCALE);
+  fields[FIELD_SETPOINT_Z] = quantize(command.z.value, COMMAND_SCALE);
+  fields[FIELD_SETPOINT_F] = quantize(command.F.value, COMMAND_SCALE);
+
+  const Controller::PIDTerms& terms = RF_.controller_.pid_terms();
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    fields[FIELD_P_X + i] = quantize(terms.p[i], COMMAND_SCALE);
+    fields[FIELD_I_X + i] = quantize(terms.i[i], COMMAND_SCALE);
+    fields[FIELD_D_X + i] = quantize(terms.d[i], COMMAND_SCALE);
+  }
+
+  const float *outputs = RF_.mixer_.get_outputs();
+  for (uint8_t i = 0; i < NUM_FIELDS - FIELD_OUTPUT_0; i++)
+    fields[FIELD_OUTPUT_0 + i] = quantize(outputs[i], COMMAND_SCALE);
+}
+
+} // namespace rosflight_firmware
@@ -65,15 +65,27 @@ typedef struct
   control_channel_t *combined;
 } mux_t;
 
+constexpr uint8_t CommandManager::OFFBOARD_LATENCY_SAMPLES;
+
 CommandManager::CommandManager(ROSflight& _rf) :
   RF_(_rf),
+  new_command_(true),
+  rc_override_(false),
+  in_failsafe_(false),
+  next_mux_time_ms_(0),
+  mux_count_(0),
+  offboard_pending_(false),
+  offboard_stamp_us_(0),
+  offboard_latency_us_(),
+  offboard_latency_count_(0),
+  offboard_latency_index_(0),
   failsafe_command_(multirotor_failsafe_command_)
 {}
 
 void CommandManager::init()
 {
-  RF_.params_.add_callback(std::bind(&CommandManager::param_change_callback, this, std::placeholders::_1), PARAM_FIXED_WING);
-  RF_.params_.add_callback(std::bind(&CommandManager::param_change_callback, this, std::placeholders::_1), PARAM_FAILSAFE_THROTTLE);
+  RF_.params_.add_callback<CommandManager, &CommandManager::param_change_callback>(this, PARAM_FIXED_WING);
+  RF_.params_.add_callback<CommandManager, &CommandManager::param_change_callback>(this, PARAM_FAILSAFE_THROTTLE);
 
   init_failsafe();
 }
@@ -82,6 +94,7 @@ void CommandManager::param_change_callback(uint16_t param_id)
 {
   (void) param_id; // suppress unused parameter warning
   init_failsafe();
+  new_command_ = true;
 }
 
 void CommandManager::init_failsafe()
@@ -243,10 +256,47 @@ bool CommandManager::offboard_control_active()
   return false;
 }
 
-void CommandManager::set_new_offboard_command(control_t new_offboard_command)
+void CommandManager::set_new_offboard_command(control_t new_offboard_command, uint64_t stamp_us)
 {
   new_command_ = true;
   offboard_command_ = new_offboard_command;
+  offboard_stamp_us_ = (stamp_us > 0) ? stamp_us : RF_.board_.clock_micros();
+  offboard_pending_ = true;
+}
+
+void CommandManager::apply_offboard_command()
+{
+  if (offboard_pending_ && !RF_.state_manager_.state().failsafe)
+    do_muxing();
+}
+
+uint32_t CommandManager::offboard_latency_percentile_us(uint8_t percent) const
+{
+  if (offboard_latency_count_ == 0)
+    return 0;
+
+  // insertion sort, the window is small and this only runs at the status stream rate
+  uint32_t sorted[OFFBOARD_LATENCY_SAMPLES];
+  for (uint8_t i = 0; i < offboard_latency_count_; i++)
+  {
+    uint32_t value = offboard_latency_us_[i];
+    uint8_t j = i;
+    for (; j > 0 && sorted[j - 1] > value; j--)
+      sorted[j] = sorted[j - 1];
+    sorted[j] = value;
+  }
+
+  if (percent > 100)
+    percent = 100;
+  uint8_t index = static_cast<uint8_t>((static_cast<uint16_t>(percent) * (offboard_latency_count_ - 1) + 50) / 100);
+  return sorted[index];
+}
+
+uint32_t CommandManager::offboard_command_age_us() const
+{
+  if (offboard_latency_count_ == 0)
+    return 0;
+  return static_cast<uint32_t>(RF_.board_.clock_micros() - offboard_stamp_us_);
 }
 
 void CommandManager::set_new_rc_command(control_t new_rc_command)
@@ -257,50 +307,53 @@ void CommandManager::set_new_rc_command(control_t new_rc_command)
 
 void CommandManager::override_combined_command_with_rc()
 {
-  new_command_ = true;
+  // applied directly, it holds until the next input changes the mux
   combined_command_ = rc_command_;
 }
 
 
-bool CommandManager::run()
+void CommandManager::do_muxing(void)
 {
   bool last_rc_override = rc_override_;
+  new_command_ = false;
+  mux_count_++;
 
-  // Check for and apply failsafe command
-  if (RF_.state_manager_.state().failsafe)
+  // Check for offboard control timeout (100 ms)
+  if (RF_.board_.clock_millis() > offboard_command_.stamp_ms + 100)
   {
-    combined_command_ = failsafe_command_;
+    // If it has been longer than 100 ms, then disable the offboard control
+    offboard_command_.F.active = false;
+    offboard_command_.x.active = false;
+    offboard_command_.y.active = false;
+    offboard_command_.z.active = false;
   }
-  else if (RF_.rc_.new_command())
-  {
-    // Read RC
-    interpret_rc();
 
-    // Check for offboard control timeout (100 ms)
-    if (RF_.board_.clock_millis() > offboard_command_.stamp_ms + 100)
-    {
-      // If it has been longer than 100 ms, then disable the offboard control
-      offboard_command_.F.active = false;
-      offboard_command_.x.active = false;
-      offboard_command_.y.active = false;
-      offboard_command_.z.active = false;
-    }
+  // Perform muxing
+  rc_override_  = do_roll_pitch_yaw_muxing(MUX_X);
+  rc_override_ |= do_roll_pitch_yaw_muxing(MUX_Y);
+  rc_override_ |= do_roll_pitch_yaw_muxing(MUX_Z);
+  rc_override_ |= do_throttle_muxing();
 
-    // Perform muxing
-    rc_override_  = do_roll_pitch_yaw_muxing(MUX_X);
-    rc_override_ |= do_roll_pitch_yaw_muxing(MUX_Y);
-    rc_override_ |= do_roll_pitch_yaw_muxing(MUX_Z);
-    rc_override_ |= do_throttle_muxing();
+  // Light to indicate override
+  if (rc_override_)
+  {
+    RF_.board_.led0_on();
+  }
+  else
+  {
+    RF_.board_.led0_off();
+  }
 
-    // Light to indicate override
-    if (rc_override_)
-    {
-      RF_.board_.led0_on();
-    }
-    else
-    {
-      RF_.board_.led0_off();
-    }
+  schedule_next_mux();
+
+  // The offboard command is now in use
+  if (offboard_pending_)
+  {
+    offboard_pending_ = false;
+    offboard_latency_us_[offboard_latency_index_] = static_cast<uint32_t>(RF_.board_.clock_micros() - offboard_stamp_us_);
+    offboard_latency_index_ = (offboard_latency_index_ + 1) % OFFBOARD_LATENCY_SAMPLES;
+    if (offboard_latency_count_ < OFFBOARD_LATENCY_SAMPLES)
+      offboard_latency_count_++;
   }
 
   // There was a change in rc_override state
@@ -308,6 +361,57 @@ bool CommandManager::run()
   {
     RF_.mavlink_.update_status();
   }
+}
+
+void CommandManager::schedule_next_mux(void)
+{
+  // Without new inputs the mux only changes when the offboard command times out, or when a stick
+  // override lag runs out
+  uint32_t now = RF_.board_.clock_millis();
+  next_mux_time_ms_ = UINT32_MAX;
+  if (offboard_control_active())
+    next_mux_time_ms_ = offboard_command_.stamp_ms + 101;
+
+  uint32_t lag_ms = static_cast<uint32_t>(RF_.params_.get_param_int(PARAM_OVERRIDE_LAG_TIME));
+  for (uint8_t i = 0; i < 3; i++)
+  {
+    uint32_t lag_end_ms = rc_stick_override_[i].last_override_time + lag_ms;
+    if (lag_end_ms > now && lag_end_ms < next_mux_time_ms_)
+      next_mux_time_ms_ = lag_end_ms;
+  }
+}
+
+bool CommandManager::run()
+{
+  // Check for and apply failsafe command
+  if (RF_.state_manager_.state().failsafe)
+  {
+    if (!in_failsafe_ || new_command_)
+    {
+      combined_command_ = failsafe_command_;
+      new_command_ = false;
+      mux_count_++;
+    }
+    in_failsafe_ = true;
+    return true;
+  }
+
+  // leaving failsafe, the combined command has to be rebuilt from the inputs
+  if (in_failsafe_)
+  {
+    in_failsafe_ = false;
+    new_command_ = true;
+  }
+
+  if (RF_.rc_.new_command())
+  {
+    // Read RC
+    interpret_rc();
+    new_command_ = true;
+  }
+
+  if (new_command_ || RF_.board_.clock_millis() >= next_mux_time_ms_)
+    do_muxing();
   return true;
 }
 
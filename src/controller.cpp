@@ -42,55 +42,166 @@ namespace rosflight_firmware
 {
 
 Controller::Controller(ROSflight& rf) :
-  RF_(rf)
+  RF_(rf),
+  config_({turbomath::Vector(), DEFAULT_PERIOD_US, static_cast<uint32_t>(DEFAULT_PERIOD_US)}),
+  pid_terms_(),
+  prev_time_us_(0),
+  timing_(),
+  control_period_us_(DEFAULT_PERIOD_US),
+  next_overrun_log_us_(0)
 {
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_ANGLE_P);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_ANGLE_I);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_ANGLE_D);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_RATE_P);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_RATE_I);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_ROLL_RATE_D);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_ANGLE_P);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_ANGLE_I);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_ANGLE_D);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_RATE_P);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_RATE_I);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_PITCH_RATE_D);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_YAW_RATE_P);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_YAW_RATE_I);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_YAW_RATE_D);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_MAX_COMMAND);
-  RF_.params_.add_callback(std::bind(&Controller::param_change_callback, this, std::placeholders::_1), PARAM_PID_TAU);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_ANGLE_P);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_ANGLE_I);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_ANGLE_D);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_RATE_P);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_RATE_I);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_RATE_D);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_ANGLE_P);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_ANGLE_I);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_ANGLE_D);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_RATE_P);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_RATE_I);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_RATE_D);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_YAW_RATE_P);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_YAW_RATE_I);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_YAW_RATE_D);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_MAX_COMMAND);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_TAU);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_X_EQ_TORQUE);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_Y_EQ_TORQUE);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_Z_EQ_TORQUE);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ROLL_FF);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_PITCH_FF);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_YAW_FF);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_DTERM_LPF_HZ);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_PID_ANTIWINDUP_TAU);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_IMU_SAMPLE_RATE);
+  RF_.params_.add_callback<Controller, &Controller::param_change_callback>(this, PARAM_CONTROL_PERIOD_TOLERANCE);
 }
 
+constexpr float Controller::PERIOD_FILTER_GAIN;
+constexpr float Controller::PERIOD_REDISCRETIZE_TOLERANCE;
+constexpr uint32_t Controller::OVERRUN_LOG_INTERVAL_US;
+constexpr float Controller::DEFAULT_PERIOD_US;
+
 void Controller::init()
+{
+  init_pids();
+  update_config();
+  reset_timing();
+}
+
+void Controller::init_pids()
 {
   prev_time_us_ = 0;
 
   float max = RF_.params_.get_param_float(PARAM_MAX_COMMAND);
-  float min = -max;
   float tau = RF_.params_.get_param_float(PARAM_PID_TAU);
+  float antiwindup_tau = RF_.params_.get_param_float(PARAM_PID_ANTIWINDUP_TAU);
+
+  const float rate_kp[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_P),
+                                         RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_P),
+                                         RF_.params_.get_param_float(PARAM_PID_YAW_RATE_P) };
+  const float rate_ki[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_I),
+                                         RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_I),
+                                         RF_.params_.get_param_float(PARAM_PID_YAW_RATE_I) };
+  const float rate_kd[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_D),
+                                         RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_D),
+                                         RF_.params_.get_param_float(PARAM_PID_YAW_RATE_D) };
+  const float rate_kff[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_FF),
+                                          RF_.params_.get_param_float(PARAM_PID_PITCH_FF),
+                                          RF_.params_.get_param_float(PARAM_PID_YAW_FF) };
+  rate_pid_.init(rate_kp, rate_ki, rate_kd, rate_kff, max, tau, antiwindup_tau);
+
+  // there is no yaw angle loop, so its lane is left with zero gains
+  const float angle_kp[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_P),
+                                          RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_P),
+                                          0.0f };
+  const float angle_ki[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_I),
+                                          RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_I),
+                                          0.0f };
+  const float angle_kd[PID::NUM_AXES] = { RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_D),
+                                          RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_D),
+                                          0.0f };
+  const float angle_kff[PID::NUM_AXES] = { 0.0f, 0.0f, 0.0f };
+  angle_pid_.init(angle_kp, angle_ki, angle_kd, angle_kff, max, tau, antiwindup_tau);
+
+  discretize_pids();
+}
+
+void Controller::discretize_pids()
+{
+  // the PID kernels discretize their own gains for the time step they are run with, only the D-term
+  // filter has to be told the rate
+  float sample_rate_hz = 1e6f / control_period_us_;
+  float dterm_cutoff_hz = RF_.params_.get_param_float(PARAM_PID_DTERM_LPF_HZ);
+  rate_pid_.set_dterm_lowpass(sample_rate_hz, dterm_cutoff_hz);
+  angle_pid_.set_dterm_lowpass(sample_rate_hz, dterm_cutoff_hz);
+}
+
+void Controller::update_config()
+{
+  config_.eq_torque.x = RF_.params_.get_param_float(PARAM_X_EQ_TORQUE);
+  config_.eq_torque.y = RF_.params_.get_param_float(PARAM_Y_EQ_TORQUE);
+  config_.eq_torque.z = RF_.params_.get_param_float(PARAM_Z_EQ_TORQUE);
+
+  // a rate of zero (or one not loaded yet) would give an infinite period, so the previous one is kept
+  int32_t rate_hz = RF_.params_.get_param_int(PARAM_IMU_SAMPLE_RATE);
+  if (rate_hz > 0)
+    config_.nominal_period_us = 1e6f / static_cast<float>(rate_hz);
+  float tolerance = RF_.params_.get_param_float(PARAM_CONTROL_PERIOD_TOLERANCE);
+  if (!(tolerance > 0.0f))
+    tolerance = 0.0f;
+  config_.max_period_us = static_cast<uint32_t>(config_.nominal_period_us * (1.0f + tolerance));
+}
+
+void Controller::reset_timing()
+{
+  timing_.period_us = config_.nominal_period_us;
+  timing_.jitter_us = 0.0f;
+  timing_.min_period_us = UINT32_MAX;
+  timing_.max_period_us = 0;
+  timing_.overruns = 0;
+
+  control_period_us_ = config_.nominal_period_us;
+  discretize_pids();
+}
+
+bool Controller::update_timing(uint32_t dt_us, uint64_t now_us)
+{
+  RF_.profiler_.record(Profiler::STAGE_CONTROL_PERIOD, dt_us);
+
+  if (dt_us < timing_.min_period_us)
+    timing_.min_period_us = dt_us;
+  if (dt_us > timing_.max_period_us)
+    timing_.max_period_us = dt_us;
+
+  if (dt_us > config_.max_period_us)
+  {
+    // a late update, e.g. after a stall, would throw off the filtered period, so it is only counted
+    timing_.overruns++;
+    if (now_us >= next_overrun_log_us_)
+    {
+      RF_.mavlink_.log(Mavlink::LOG_WARNING, "control update %d us late (%d overruns)",
+                       static_cast<int>(dt_us - static_cast<uint32_t>(config_.nominal_period_us)),
+                       static_cast<int>(timing_.overruns));
+      next_overrun_log_us_ = now_us + OVERRUN_LOG_INTERVAL_US;
+    }
+    return false;
+  }
+
+  float dt = static_cast<float>(dt_us);
+  float deviation = dt - timing_.period_us;
+  timing_.period_us += PERIOD_FILTER_GAIN * deviation;
+  timing_.jitter_us += PERIOD_FILTER_GAIN * (turbomath::fabs(deviation) - timing_.jitter_us);
 
-  roll_.init(RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_P),
-             RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_I),
-             RF_.params_.get_param_float(PARAM_PID_ROLL_ANGLE_D),
-             max, min, tau);
-  roll_rate_.init(RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_P),
-                  RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_I),
-                  RF_.params_.get_param_float(PARAM_PID_ROLL_RATE_D),
-                  max, min, tau);
-  pitch_.init(RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_P),
-              RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_I),
-              RF_.params_.get_param_float(PARAM_PID_PITCH_ANGLE_D),
-              max, min, tau);
-  pitch_rate_.init(RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_P),
-                   RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_I),
-                   RF_.params_.get_param_float(PARAM_PID_PITCH_RATE_D),
-                   max, min, tau);
-  yaw_rate_.init(RF_.params_.get_param_float(PARAM_PID_YAW_RATE_P),
-                 RF_.params_.get_param_float(PARAM_PID_YAW_RATE_I),
-                 RF_.params_.get_param_float(PARAM_PID_YAW_RATE_D),
-                 max, min, tau);
+  // follow the measured rate, but only now and then, as the D-term filter coefficients are expensive
+  if (turbomath::fabs(timing_.period_us - control_period_us_) > PERIOD_REDISCRETIZE_TOLERANCE * control_period_us_)
+  {
+    control_period_us_ = timing_.period_us;
+    discretize_pids();
+  }
+  return true;
 }
 
 void Controller::run()
@@ -102,25 +213,28 @@ void Controller::run()
     return;
   }
 
-  int32_t dt_us = (RF_.estimator_.state().timestamp_us - prev_time_us_);
+  uint64_t now_us = RF_.estimator_.state().timestamp_us;
+  int32_t dt_us = static_cast<int32_t>(now_us - prev_time_us_);
+  prev_time_us_ = now_us;
   if ( dt_us < 0 )
   {
     RF_.state_manager_.set_error(StateManager::ERROR_TIME_GOING_BACKWARDS);
-    prev_time_us_ = RF_.estimator_.state().timestamp_us;
     return;
   }
 
+  bool on_time = update_timing(static_cast<uint32_t>(dt_us), now_us);
+
   // Check if integrators should be updated
   //! @todo better way to figure out if throttle is high
-  bool update_integrators = (RF_.state_manager_.state().armed) && (RF_.command_manager_.combined_control().F.value > 0.1f) && dt_us < 100;
+  bool update_integrators = (RF_.state_manager_.state().armed) && (RF_.command_manager_.combined_control().F.value > 0.1f) && on_time;
 
-  // Run the PID loops
-  turbomath::Vector pid_output = run_pid_loops(dt_us, RF_.estimator_.state(), RF_.command_manager_.combined_control(), update_integrators);
+  // Run the PID loops, discretized for the measured loop rate rather than each sample's jittery dt
+  turbomath::Vector pid_output = run_pid_loops(1e-6f * control_period_us_, RF_.estimator_.state(), RF_.command_manager_.combined_control(), update_integrators);
 
   // Add feedforward torques
-  output_.x = pid_output.x + RF_.params_.get_param_float(PARAM_X_EQ_TORQUE);
-  output_.y = pid_output.y + RF_.params_.get_param_float(PARAM_Y_EQ_TORQUE);
-  output_.z = pid_output.z + RF_.params_.get_param_float(PARAM_Z_EQ_TORQUE);
+  output_.x = pid_output.x + config_.eq_torque.x;
+  output_.y = pid_output.y + config_.eq_torque.y;
+  output_.z = pid_output.z + config_.eq_torque.z;
   output_.F = RF_.command_manager_.combined_control().F.value;
 }
 
@@ -144,15 +258,11 @@ void Controller::calculate_equilbrium_torque_from_rc()
     fake_state.attitude.z = 0.0f;
     fake_state.attitude.w = 1.0f;
 
-    fake_state.roll = 0.0f;
-    fake_state.pitch = 0.0f;
-    fake_state.yaw = 0.0f;
-
     // pass the rc_control through the controller
     // dt is zero, so what this really does is applies the P gain with the settings
     // your RC transmitter, which if it flies level is a really good guess for
     // the static offset torques
-    turbomath::Vector pid_output = run_pid_loops(0, fake_state, RF_.command_manager_.rc_control(), false);
+    turbomath::Vector pid_output = run_pid_loops(0.0f, fake_state, RF_.command_manager_.rc_control(), false);
 
     // the output from the controller is going to be the static offsets
     RF_.params_.set_param_float(PARAM_X_EQ_TORQUE, pid_output.x);
@@ -170,121 +280,195 @@ void Controller::calculate_equilbrium_torque_from_rc()
 
 void Controller::param_change_callback(uint16_t param_id)
 {
-  (void) param_id; // suppress unused parameter warning
-  init();
+  switch (param_id)
+  {
+  case PARAM_X_EQ_TORQUE:
+  case PARAM_Y_EQ_TORQUE:
+  case PARAM_Z_EQ_TORQUE:
+    // the PID states don't need to be reset for a new trim
+    update_config();
+    break;
+  case PARAM_IMU_SAMPLE_RATE:
+  case PARAM_CONTROL_PERIOD_TOLERANCE:
+    update_config();
+    reset_timing();
+    break;
+  case Params::BATCH_CHANGED:
+    init();
+    break;
+  default:
+    init_pids();
+    break;
+  }
 }
 
-turbomath::Vector Controller::run_pid_loops(uint32_t dt_us, const Estimator::State& state, const control_t& command, bool update_integrators)
+turbomath::Vector Controller::run_pid_loops(float dt, const Estimator::State& state, const control_t& command, bool update_integrators)
 {
   // Based on the control types coming from the command manager, run the appropriate PID loops
-  turbomath::Vector out;
 
-  float dt = dt_us;
+  const float setpoint[PID::NUM_AXES] = { command.x.value, command.y.value, command.z.value };
+  const float rate[PID::NUM_AXES] = { state.angular_velocity.x, state.angular_velocity.y, state.angular_velocity.z };
+  const bool rate_active[PID::NUM_AXES] = { command.x.type == RATE, command.y.type == RATE, command.z.type == RATE };
+  const bool angle_active[PID::NUM_AXES] = { command.x.type == ANGLE, command.y.type == ANGLE, false };
 
-  // ROLL
-  if (command.x.type == RATE)
-    out.x = roll_rate_.run(dt, state.angular_velocity.x, command.x.value, update_integrators);
-  else if (command.x.type == ANGLE)
-    out.x = roll_.run(dt, state.roll, command.x.value, update_integrators, state.angular_velocity.x);
-  else
-    out.x = command.x.value;
+  float rate_out[PID::NUM_AXES];
+  rate_pid_.run(dt, rate, setpoint, rate_active, update_integrators, rate_out);
 
-  // PITCH
-  if (command.y.type == RATE)
-    out.y = pitch_rate_.run(dt, state.angular_velocity.y, command.y.value, update_integrators);
-  else if (command.y.type == ANGLE)
-    out.y = pitch_.run(dt, state.pitch, command.y.value, update_integrators, state.angular_velocity.y);
-  else
-    out.y = command.y.value;
+  pid_terms_ = rate_pid_.terms();
 
-  // YAW
-  if (command.z.type == RATE)
-    out.z = yaw_rate_.run(dt, state.angular_velocity.z, command.z.value, update_integrators);
-  else
-    out.z = command.z.value;
+  float angle_out[PID::NUM_AXES] = { 0.0f, 0.0f, 0.0f };
+  if (angle_active[0] || angle_active[1])
+  {
+    const float angle[PID::NUM_AXES] = { state.roll(), state.pitch(), 0.0f };
+    angle_pid_.run(dt, angle, setpoint, rate, angle_active, update_integrators, angle_out);
+
+    // an axis is active in at most one of the loops, and the inactive lanes of each have zero terms
+    const PIDTerms& angle_terms = angle_pid_.terms();
+    for (uint8_t i = 0; i < PID::NUM_AXES; i++)
+    {
+      pid_terms_.p[i] += angle_terms.p[i];
+      pid_terms_.i[i] += angle_terms.i[i];
+      pid_terms_.d[i] += angle_terms.d[i];
+    }
+  }
+
+  // inactive lanes are zero, so the sum selects the active loop, or passes the command through
+  float out[PID::NUM_AXES];
+  for (uint8_t i = 0; i < PID::NUM_AXES; i++)
+  {
+    bool passthrough = !(rate_active[i] || angle_active[i]);
+    out[i] = rate_out[i] + angle_out[i] + (passthrough ? setpoint[i] : 0.0f);
+  }
 
-  return out;
+  return turbomath::Vector(out[0], out[1], out[2]);
 }
 
+constexpr uint8_t Controller::PID::NUM_AXES;
+
 Controller::PID::PID() :
-  kp_(0.0f),
-  ki_(0.0f),
-  kd_(0.0f),
   max_(1.0f),
-  min_(-1.0f),
-  integrator_(0.0f),
-  differentiator_(0.0f),
-  prev_x_(0.0f),
-  tau_(0.05)
-{}
-
-void Controller::PID::init(float kp, float ki, float kd, float max, float min, float tau)
+  tau_(0.05f),
+  antiwindup_tau_(0.0f),
+  dt_(0.0f)
 {
-  kp_ = kp;
-  ki_ = ki;
-  kd_ = kd;
-  max_ = max;
-  min_ = min;
-  tau_ = tau;
+  for (uint8_t i = 0; i < NUM_AXES; i++)
+  {
+    kp_[i] = 0.0f;
+    ki_[i] = 0.0f;
+    kd_[i] = 0.0f;
+    kff_[i] = 0.0f;
+    antiwindup_gain_[i] = 0.0f;
+  }
+  discretize(dt_);
+  reset();
 }
 
-float Controller::PID::run(float dt, float x, float x_c, bool update_integrator)
+void Controller::PID::init(const float kp[NUM_AXES], const float ki[NUM_AXES], const float kd[NUM_AXES],
+                           const float kff[NUM_AXES], float max, float tau, float antiwindup_tau)
 {
-  float xdot;
-  if (dt > 0.0001f)
+  for (uint8_t i = 0; i < NUM_AXES; i++)
   {
-    // calculate D term (use dirty derivative if we don't have access to a measurement of the derivative)
-    // The dirty derivative is a sort of low-pass filtered version of the derivative.
-    //// (Include reference to Dr. Beard's notes here)
-    differentiator_ = (2.0f * tau_ - dt) / (2.0f * tau_ + dt) * differentiator_
-        + 2.0f / (2.0f * tau_ + dt) * (x - prev_x_);
-    xdot = differentiator_;
+    kp_[i] = kp[i];
+    ki_[i] = ki[i];
+    kd_[i] = kd[i];
+    kff_[i] = kff[i];
+    // without an I term the integrator stays at zero
+    antiwindup_gain_[i] = (ki[i] > 0.0f) ? 1.0f : 0.0f;
   }
-  else
+  max_ = max;
+  tau_ = tau;
+  antiwindup_tau_ = antiwindup_tau;
+  discretize(dt_);
+}
+
+void Controller::PID::discretize(float dt)
+{
+  dt_ = dt;
+
+  // with no time step the derivative is zero and nothing is integrated
+  derivative_a_ = 0.0f;
+  derivative_b_ = 0.0f;
+  if (dt > 0.0f)
   {
-    xdot = 0.0f;
+    derivative_a_ = (2.0f * tau_ - dt) / (2.0f * tau_ + dt);
+    derivative_b_ = 2.0f / (2.0f * tau_ + dt);
   }
-  prev_x_ = x;
 
-  return run(dt, x, x_c, update_integrator, xdot);
+  for (uint8_t i = 0; i < NUM_AXES; i++)
+    ki_dt_[i] = (dt > 0.0f) ? ki_[i] * dt : 0.0f;
+
+  // fraction of the saturation fed back into the integrators (back-calculation anti-windup)
+  antiwindup_k_ = (antiwindup_tau_ > dt) ? dt / antiwindup_tau_ : 1.0f;
 }
 
-float Controller::PID::run(float dt, float x, float x_c, bool update_integrator, float xdot)
+void Controller::PID::set_dterm_lowpass(float sample_rate_hz, float cutoff_hz)
 {
-  // Calculate Error
-  float error = x_c - x;
-
-  // Initialize Terms
-  float p_term = error * kp_;
-  float i_term = 0.0f;
-  float d_term = 0.0f;
+  dterm_lpf_.set_lowpass(sample_rate_hz, cutoff_hz);
+}
 
-  // If there is a derivative term
-  if (kd_ > 0.0f)
+void Controller::PID::reset()
+{
+  for (uint8_t i = 0; i < NUM_AXES; i++)
   {
-    d_term = kd_ * xdot;
+    integrator_[i] = 0.0f;
+    differentiator_[i] = 0.0f;
+    prev_x_[i] = 0.0f;
+    terms_.p[i] = 0.0f;
+    terms_.i[i] = 0.0f;
+    terms_.d[i] = 0.0f;
   }
+  dterm_lpf_.reset();
+}
 
-  //If there is an integrator term and we are updating integrators
-  if ((ki_ > 0.0f) && update_integrator)
+void Controller::PID::run(float dt, const float x[NUM_AXES], const float x_c[NUM_AXES], const bool active[NUM_AXES],
+                          bool update_integrators, float u[NUM_AXES])
+{
+  if (dt != dt_)
+    discretize(dt);
+
+  // calculate D term (use dirty derivative if we don't have access to a measurement of the derivative)
+  // The dirty derivative is a sort of low-pass filtered version of the derivative.
+  //// (Include reference to Dr. Beard's notes here)
+  float xdot[NUM_AXES];
+  for (uint8_t i = 0; i < NUM_AXES; i++)
   {
-    // integrate
-    integrator_ += error * dt;
-    // calculate I term
-    i_term = ki_ * integrator_;
+    differentiator_[i] = derivative_a_ * differentiator_[i] + derivative_b_ * (x[i] - prev_x_[i]);
+    xdot[i] = differentiator_[i];
+    prev_x_[i] = x[i];
   }
 
-  // sum three terms
-  float u = p_term - d_term + i_term;
+  run(dt, x, x_c, xdot, active, update_integrators, u);
+}
 
-  // Integrator anti-windup
-  //// Include reference to Dr. Beard's notes here
-  float u_sat = (u > max_) ? max_ : (u < min_) ? min_ : u;
-  if (u != u_sat && fabs(i_term) > fabs(u - p_term + d_term) && ki_ > 0.0f)
-    integrator_ = (u_sat - p_term + d_term)/ki_;
+void Controller::PID::run(float dt, const float x[NUM_AXES], const float x_c[NUM_AXES], const float xdot[NUM_AXES],
+                          const bool active[NUM_AXES], bool update_integrators, float u[NUM_AXES])
+{
+  if (dt != dt_)
+    discretize(dt);
 
-  // Set output
-  return u_sat;
+  float filtered_xdot[NUM_AXES];
+  dterm_lpf_.apply(xdot, filtered_xdot);
+
+  for (uint8_t i = 0; i < NUM_AXES; i++)
+  {
+    // 1 if this axis is active and integrating, 0 otherwise, applied by multiplication so the lanes don't branch
+    float integrate = (update_integrators && active[i]) ? 1.0f : 0.0f;
+    float on = active[i] ? 1.0f : 0.0f;
+    float error = x_c[i] - x[i];
+
+    float p = kp_[i] * error + kff_[i] * x_c[i];
+    float d = -kd_[i] * filtered_xdot[i];
+    // the integral is applied even while integration is paused, only its accumulation stops
+    float i_term = on * integrator_[i];
+    float u_i = p + i_term + d;
+    float u_sat = (u_i > max_) ? max_ : (u_i < -max_) ? -max_ : u_i;
+    integrator_[i] += integrate * (ki_dt_[i] * error + antiwindup_gain_[i] * antiwindup_k_ * (u_sat - u_i));
+
+    terms_.p[i] = on * p;
+    terms_.i[i] = on * i_term;
+    terms_.d[i] = on * d;
+    u[i] = active[i] ? u_sat : 0.0f;
+  }
 }
 
 } // namespace rosflight_firmware
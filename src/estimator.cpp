@@ -31,6 +31,7 @@
 
 #include "estimator.h"
 #include "rosflight.h"
+#include "cycle_timer.h"
 
 namespace rosflight_firmware
 {
@@ -50,9 +51,7 @@ void Estimator::reset_state()
   state_.angular_velocity.y = 0.0f;
   state_.angular_velocity.z = 0.0f;
 
-  state_.roll = 0.0f;
-  state_.pitch = 0.0f;
-  state_.yaw = 0.0f;
+  state_.attitude_changed();
 
   w1_.x = 0.0f;
   w1_.y = 0.0f;
@@ -66,6 +65,8 @@ void Estimator::reset_state()
   bias_.y = 0.0f;
   bias_.z = 0.0f;
 
+  reset_delta_angle();
+
   accel_LPF_.x = 0;
   accel_LPF_.y = 0;
   accel_LPF_.z = -9.80665;
@@ -89,75 +90,76 @@ void Estimator::reset_adaptive_bias()
 
 void Estimator::init()
 {
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_ACC_ALPHA);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_GYRO_ALPHA);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_KP);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_KI);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_INIT_TIME);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_USE_ACC);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_USE_QUAD_INT);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_USE_MAT_EXP);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FIXED_WING);
+  RF_.params_.add_callback<Estimator, &Estimator::param_change_callback>(this, PARAM_FILTER_UPDATE_RATE);
+  update_config();
+
   last_time_ = 0;
   last_acc_update_us_ = 0;
+  last_update_us_ = 0;
   reset_state();
 }
 
-void Estimator::run_LPF()
+void Estimator::param_change_callback(uint16_t param_id)
 {
-  float alpha_acc = RF_.params_.get_param_float(PARAM_ACC_ALPHA);
-  const turbomath::Vector& raw_accel = RF_.sensors_.data().accel;
-  accel_LPF_.x = (1.0f-alpha_acc)*raw_accel.x + alpha_acc*accel_LPF_.x;
-  accel_LPF_.y = (1.0f-alpha_acc)*raw_accel.y + alpha_acc*accel_LPF_.y;
-  accel_LPF_.z = (1.0f-alpha_acc)*raw_accel.z + alpha_acc*accel_LPF_.z;
-
-  float alpha_gyro = RF_.params_.get_param_float(PARAM_GYRO_ALPHA);
-  const turbomath::Vector& raw_gyro = RF_.sensors_.data().gyro;
-  gyro_LPF_.x = (1.0f-alpha_gyro)*raw_gyro.x + alpha_gyro*gyro_LPF_.x;
-  gyro_LPF_.y = (1.0f-alpha_gyro)*raw_gyro.y + alpha_gyro*gyro_LPF_.y;
-  gyro_LPF_.z = (1.0f-alpha_gyro)*raw_gyro.z + alpha_gyro*gyro_LPF_.z;
+  (void) param_id; // every parameter just refreshes the config
+  update_config();
 }
 
-void Estimator::run()
+void Estimator::update_config()
 {
-  float kp, ki;
-  uint64_t now_us = RF_.sensors_.data().imu_time;
-  if (last_time_ == 0)
+  config_.acc_alpha = RF_.params_.get_param_float(PARAM_ACC_ALPHA);
+  config_.acc_one_minus_alpha = 1.0f - config_.acc_alpha;
+  config_.gyro_alpha = RF_.params_.get_param_float(PARAM_GYRO_ALPHA);
+  config_.gyro_one_minus_alpha = 1.0f - config_.gyro_alpha;
+
+  config_.kp = RF_.params_.get_param_float(PARAM_FILTER_KP);
+  config_.ki = RF_.params_.get_param_float(PARAM_FILTER_KI);
+  config_.kp_init = config_.kp*10.0f;
+  config_.ki_init = config_.ki*10.0f;
+  config_.init_time_us = static_cast<uint64_t>(RF_.params_.get_param_int(PARAM_INIT_TIME))*1000;
+
+  config_.use_acc = RF_.params_.get_param_int(PARAM_FILTER_USE_ACC);
+  config_.use_quad_int = RF_.params_.get_param_int(PARAM_FILTER_USE_QUAD_INT);
+  config_.use_mat_exp = RF_.params_.get_param_int(PARAM_FILTER_USE_MAT_EXP);
+  config_.check_acc_timeout = config_.use_acc && !RF_.params_.get_param_int(PARAM_FIXED_WING);
+
+  int32_t update_rate = RF_.params_.get_param_int(PARAM_FILTER_UPDATE_RATE);
+  uint32_t update_period_us = (update_rate > 0) ? 1000000/update_rate : 0;
+  if (update_period_us != config_.update_period_us)
   {
-    last_time_ = now_us;
-    last_acc_update_us_ = last_time_;
-    return;
+    config_.update_period_us = update_period_us;
+    reset_delta_angle();
   }
-  else if (now_us < last_time_)
-  {
-    // this shouldn't happen
-    RF_.state_manager_.set_error(StateManager::ERROR_TIME_GOING_BACKWARDS);
-    last_time_ = now_us;
-    return;
-  }
-  else if (now_us  == last_time_)
-  {
-    return;
-  }
-
-  RF_.state_manager_.clear_error(StateManager::ERROR_TIME_GOING_BACKWARDS);
-
-  float dt = (now_us - last_time_) * 1e-6f;
-  last_time_ = now_us;
-  state_.timestamp_us = now_us;
 
-  // Crank up the gains for the first few seconds for quick convergence
-  if (now_us < static_cast<uint64_t>(RF_.params_.get_param_int(PARAM_INIT_TIME))*1000)
-  {
-    kp = RF_.params_.get_param_float(PARAM_FILTER_KP)*10.0f;
-    ki = RF_.params_.get_param_float(PARAM_FILTER_KI)*10.0f;
-  }
-  else
+  // pick the kernel for these options, so the per-sample path has no option branches
+  static const PropagateFcn kernels[8] =
   {
-    kp = RF_.params_.get_param_float(PARAM_FILTER_KP);
-    ki = RF_.params_.get_param_float(PARAM_FILTER_KI);
-  }
-
-  // Run LPF to reject a lot of noise
-  run_LPF();
-
-  // add in accelerometer
-  float a_sqrd_norm = accel_LPF_.sqrd_norm();
+    &Estimator::propagate<false, false, false>,
+    &Estimator::propagate<false, false, true>,
+    &Estimator::propagate<false, true, false>,
+    &Estimator::propagate<false, true, true>,
+    &Estimator::propagate<true, false, false>,
+    &Estimator::propagate<true, false, true>,
+    &Estimator::propagate<true, true, false>,
+    &Estimator::propagate<true, true, true>
+  };
+  propagate_ = kernels[(config_.use_acc << 2) | (config_.use_quad_int << 1) | config_.use_mat_exp];
+}
 
+turbomath::Vector Estimator::accel_correction(float ki, float dt, uint64_t now_us)
+{
   turbomath::Vector w_acc;
-  if (RF_.params_.get_param_int(PARAM_FILTER_USE_ACC)
-      && a_sqrd_norm < 1.1f*1.1f*9.80665f*9.80665f && a_sqrd_norm > 0.9f*0.9f*9.80665f*9.80665f)
+  float a_sqrd_norm = accel_LPF_.sqrd_norm();
+  if (a_sqrd_norm < 1.1f*1.1f*9.80665f*9.80665f && a_sqrd_norm > 0.9f*0.9f*9.80665f*9.80665f)
   {
     // Get error estimated by accelerometer measurement
     last_acc_update_us_ = now_us;
@@ -181,21 +183,65 @@ void Estimator::run()
     bias_.y -= ki*w_acc.y*dt;
     bias_.z = 0.0;  // Don't integrate z bias, because it's unobservable
   }
-  else
+  return w_acc;
+}
+
+void Estimator::reset_delta_angle()
+{
+  delta_angle_ = turbomath::Vector();
+  coning_ = turbomath::Vector();
+}
+
+void Estimator::integrate_delta_angle(float dt)
+{
+  // Sum the rotation over the sub-steps, plus the coning term that accounts for the rotation axis
+  // moving during the interval: 1/2 sum(alpha_k x dtheta_k), with alpha_k the angle accumulated so far
+  turbomath::Vector dtheta = gyro_LPF_*dt;
+  turbomath::axpy(0.5f, delta_angle_.cross(dtheta), coning_);
+  delta_angle_ += dtheta;
+}
+
+void Estimator::update_from_delta_angle(float kp, float ki, float dt, uint64_t now_us)
+{
+  uint64_t t = RF_.profiler_.tic();
+  turbomath::Vector w_acc;
+  if (config_.use_acc)
+    w_acc = accel_correction(ki, dt, now_us);
+  t = RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_ACC, t);
+
+  // the whole interval's rotation vector, with the bias and accelerometer corrections applied over it
+  turbomath::Vector phi = turbomath::lincomb(1.0f, delta_angle_, kp*dt, w_acc, -dt, bias_);
+  phi += coning_;
+  reset_delta_angle();
+
+  // rotate by phi with the matrix exponential, which is exact for a constant axis
+  float sqrd_norm_phi = phi.sqrd_norm();
+  if (sqrd_norm_phi > 0.0f)
   {
-    w_acc.x = 0.0f;
-    w_acc.y = 0.0f;
-    w_acc.z = 0.0f;
+    float t1, t2;
+    mat_exp_coefficients(sqrd_norm_phi, 1.0f, &t1, &t2);
+    state_.attitude = turbomath::propagate_normalize(state_.attitude, phi, t1, t2);
   }
+  RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_PROPAGATE, t);
+}
+
+template <bool UseAcc, bool UseQuadInt, bool UseMatExp>
+void Estimator::propagate(float dt, float kp, float ki, uint64_t now_us, uint64_t t)
+{
+  // add in accelerometer
+  turbomath::Vector w_acc;
+  if (UseAcc)
+    w_acc = accel_correction(ki, dt, now_us);
+  t = RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_ACC, t);
 
 
   // Handle Gyro Measurements
   turbomath::Vector wbar;
-  if (RF_.params_.get_param_int(PARAM_FILTER_USE_QUAD_INT))
+  if (UseQuadInt)
   {
     // Quadratic Interpolation (Eq. 14 Casey Paper)
     // this step adds 12 us on the STM32F10x chips
-    wbar = (w2_/-12.0f) + w1_*(8.0f/12.0f) + gyro_LPF_ * (5.0f/12.0f);
+    wbar = turbomath::lincomb(-1.0f/12.0f, w2_, 8.0f/12.0f, w1_, 5.0f/12.0f, gyro_LPF_);
     w2_ = w1_;
     w1_ = gyro_LPF_;
   }
@@ -203,61 +249,139 @@ void Estimator::run()
   {
     wbar = gyro_LPF_;
   }
+  t = RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_QUAD_INT, t);
 
   // Build the composite omega vector for kinematic propagation
   // This the stuff inside the p function in eq. 47a - Mahony Paper
-  turbomath::Vector wfinal = wbar - bias_ + w_acc * kp;
+  turbomath::Vector wfinal = turbomath::lincomb(1.0f, wbar, -1.0f, bias_, kp, w_acc);
 
   // Propagate Dynamics (only if we've moved)
   float sqrd_norm_w = wfinal.sqrd_norm();
   if (sqrd_norm_w > 0.0f)
   {
-    float p = wfinal.x;
-    float q = wfinal.y;
-    float r = wfinal.z;
-
-    if (RF_.params_.get_param_int(PARAM_FILTER_USE_MAT_EXP))
+    // Both integrators are t1*q + t2*Omega(wfinal)*q, renormalized
+    float t1, t2;
+    if (UseMatExp)
     {
       // Matrix Exponential Approximation (From Attitude Representation and Kinematic
       // Propagation for Low-Cost UAVs by Robert T. Casey)
       // (Eq. 12 Casey Paper)
-      // This adds 90 us on STM32F10x chips
-      float norm_w = sqrt(sqrd_norm_w);
-      turbomath::Quaternion qhat_np1;
-      float t1 = cos((norm_w*dt)/2.0f);
-      float t2 = 1.0f/norm_w * sin((norm_w*dt)/2.0f);
-      qhat_np1.w = t1*state_.attitude.w + t2*(-p*state_.attitude.x - q*state_.attitude.y - r*state_.attitude.z);
-      qhat_np1.x = t1*state_.attitude.x + t2*( p*state_.attitude.w + r*state_.attitude.y - q*state_.attitude.z);
-      qhat_np1.y = t1*state_.attitude.y + t2*( q*state_.attitude.w - r*state_.attitude.x + p*state_.attitude.z);
-      qhat_np1.z = t1*state_.attitude.z + t2*( r*state_.attitude.w + q*state_.attitude.x - p*state_.attitude.y);
-      state_.attitude = qhat_np1.normalize();
+      mat_exp_coefficients(sqrd_norm_w, dt, &t1, &t2);
     }
     else
     {
       // Euler Integration
-      // (Eq. 47a Mahony Paper), but this is pretty straight-forward
-      turbomath::Quaternion qdot(0.5f * (-p*state_.attitude.x - q*state_.attitude.y - r*state_.attitude.z),
-                                 0.5f * ( p*state_.attitude.w + r*state_.attitude.y - q*state_.attitude.z),
-                                 0.5f * ( q*state_.attitude.w - r*state_.attitude.x + p*state_.attitude.z),
-                                 0.5f * ( r*state_.attitude.w + q*state_.attitude.x - p*state_.attitude.y));
-      state_.attitude.w += qdot.w*dt;
-      state_.attitude.x += qdot.x*dt;
-      state_.attitude.y += qdot.y*dt;
-      state_.attitude.z += qdot.z*dt;
-      state_.attitude.normalize();
+      // (Eq. 47a Mahony Paper): q + 0.5*dt*Omega(w)*q
+      t1 = 1.0f;
+      t2 = 0.5f*dt;
+    }
+    state_.attitude = turbomath::propagate_normalize(state_.attitude, wfinal, t1, t2);
+  }
+  RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_PROPAGATE, t);
+}
+
+void Estimator::mat_exp_coefficients(float sqrd_norm_w, float dt, float *t1, float *t2)
+{
+  // t1 = cos(|w|dt/2) and t2 = sin(|w|dt/2)/|w|. At normal loop rates the half angle is tiny, so a
+  // series in its square needs neither a square root nor any trig; libm used to cost about 90 us here
+  // on STM32F10x chips.
+  float half_dt = 0.5f*dt;
+  float theta_sqrd = sqrd_norm_w*half_dt*half_dt;
+  if (theta_sqrd < MAT_EXP_SERIES_MAX_SQRD)
+  {
+    *t1 = 1.0f - theta_sqrd*(1.0f/2.0f - theta_sqrd*(1.0f/24.0f));
+    *t2 = half_dt*(1.0f - theta_sqrd*(1.0f/6.0f - theta_sqrd*(1.0f/120.0f)));
+  }
+  else
+  {
+    float inv_norm_w = turbomath::inv_sqrt(sqrd_norm_w);
+    float theta = sqrd_norm_w*inv_norm_w*half_dt;
+    *t1 = turbomath::cos(theta);
+    *t2 = turbomath::sin(theta)*inv_norm_w;
+  }
+}
+
+void Estimator::run_LPF()
+{
+  ROSFLIGHT_TIME_SCOPE(RF_, Profiler::STAGE_ESTIMATOR_LPF);
+  float alpha_acc = config_.acc_alpha;
+  float beta_acc = config_.acc_one_minus_alpha;
+  const turbomath::Vector& raw_accel = RF_.sensors_.data().accel;
+  turbomath::axpby(beta_acc, raw_accel, alpha_acc, accel_LPF_);
+
+  float alpha_gyro = config_.gyro_alpha;
+  float beta_gyro = config_.gyro_one_minus_alpha;
+  const turbomath::Vector& raw_gyro = RF_.sensors_.data().gyro;
+  turbomath::axpby(beta_gyro, raw_gyro, alpha_gyro, gyro_LPF_);
+}
+
+void Estimator::run()
+{
+  uint64_t now_us = RF_.sensors_.data().imu_time;
+  if (last_time_ == 0)
+  {
+    last_time_ = now_us;
+    last_acc_update_us_ = last_time_;
+    last_update_us_ = last_time_;
+    return;
+  }
+  else if (now_us < last_time_)
+  {
+    // this shouldn't happen
+    RF_.state_manager_.set_error(StateManager::ERROR_TIME_GOING_BACKWARDS);
+    last_time_ = now_us;
+    last_update_us_ = now_us;
+    reset_delta_angle();
+    return;
+  }
+  else if (now_us  == last_time_)
+  {
+    return;
+  }
+
+  RF_.state_manager_.clear_error(StateManager::ERROR_TIME_GOING_BACKWARDS);
+
+  float dt = (now_us - last_time_) * 1e-6f;
+  last_time_ = now_us;
+  state_.timestamp_us = now_us;
+
+  // Crank up the gains for the first few seconds for quick convergence
+  bool initializing = now_us < config_.init_time_us;
+  float kp = initializing ? config_.kp_init : config_.kp;
+  float ki = initializing ? config_.ki_init : config_.ki;
+
+  // Run LPF to reject a lot of noise
+  uint64_t t = RF_.profiler_.tic();
+  run_LPF();
+  t = RF_.profiler_.toc(Profiler::STAGE_ESTIMATOR_LPF, t);
+
+  if (config_.update_period_us > 0)
+  {
+    // Pre-integrate the sample, and only run the full update at FILTER_UPD_RATE
+    integrate_delta_angle(dt);
+    if (now_us < last_update_us_ + config_.update_period_us)
+    {
+      state_.angular_velocity = gyro_LPF_ - bias_;
+      return;
     }
+    update_from_delta_angle(kp, ki, (now_us - last_update_us_)*1e-6f, now_us);
+  }
+  else
+  {
+    // the rest of the update is specialized on the filter options
+    (this->*propagate_)(dt, kp, ki, now_us, t);
   }
+  last_update_us_ = now_us;
 
-  // Extract Euler Angles for controller
-  state_.attitude.get_RPY(&state_.roll, &state_.pitch, &state_.yaw);
+  // Euler angles are only extracted if the controller needs them
+  state_.attitude_changed();
 
   // Save off adjust gyro measurements with estimated biases for control
   state_.angular_velocity = gyro_LPF_ - bias_;
 
   // If it has been more than 0.5 seconds since the acc update ran and we are supposed to be getting them
   // then trigger an unhealthy estimator error
-  if (RF_.params_.get_param_int(PARAM_FILTER_USE_ACC) && now_us > 500000 + last_acc_update_us_
-      && !RF_.params_.get_param_int(PARAM_FIXED_WING))
+  if (config_.check_acc_timeout && now_us > 500000 + last_acc_update_us_)
   {
     RF_.state_manager_.set_error(StateManager::ERROR_UNHEALTHY_ESTIMATOR);
   }
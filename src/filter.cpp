@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "filter.h"
+
+namespace rosflight_firmware
+{
+
+constexpr float Biquad::BUTTERWORTH_Q;
+
+static const float TWO_PI = 6.28318531f;
+
+Biquad::Biquad() :
+  enabled_(false),
+  b0_(1.0f), b1_(0.0f), b2_(0.0f), a1_(0.0f), a2_(0.0f)
+{}
+
+// Coefficients from the Audio EQ Cookbook (R. Bristow-Johnson)
+bool Biquad::set_lowpass(float sample_rate_hz, float cutoff_hz, float q)
+{
+  if (cutoff_hz <= 0.0f || cutoff_hz >= 0.5f*sample_rate_hz || q <= 0.0f)
+  {
+    disable();
+    return false;
+  }
+
+  float w0 = TWO_PI*cutoff_hz/sample_rate_hz;
+  float cos_w0 = turbomath::cos(w0);
+  float alpha = turbomath::sin(w0)/(2.0f*q);
+  set_coefficients(0.5f*(1.0f - cos_w0), 1.0f - cos_w0, 0.5f*(1.0f - cos_w0),
+                   1.0f + alpha, -2.0f*cos_w0, 1.0f - alpha);
+  return true;
+}
+
+bool Biquad::set_notch(float sample_rate_hz, float center_hz, float q)
+{
+  if (center_hz <= 0.0f || center_hz >= 0.5f*sample_rate_hz || q <= 0.0f)
+  {
+    disable();
+    return false;
+  }
+
+  float w0 = TWO_PI*center_hz/sample_rate_hz;
+  float cos_w0 = turbomath::cos(w0);
+  float alpha = turbomath::sin(w0)/(2.0f*q);
+  set_coefficients(1.0f, -2.0f*cos_w0, 1.0f,
+                   1.0f + alpha, -2.0f*cos_w0, 1.0f - alpha);
+  return true;
+}
+
+void Biquad::set_coefficients(float b0, float b1, float b2, float a0, float a1, float a2)
+{
+  // start from a clean state when enabling, but keep it when retuning so the output doesn't jump
+  if (!enabled_)
+    reset();
+
+  float inv_a0 = 1.0f/a0;
+  b0_ = b0*inv_a0;
+  b1_ = b1*inv_a0;
+  b2_ = b2*inv_a0;
+  a1_ = a1*inv_a0;
+  a2_ = a2*inv_a0;
+  enabled_ = true;
+}
+
+void Biquad::disable()
+{
+  enabled_ = false;
+}
+
+void Biquad::reset()
+{
+  s1_ = turbomath::Vector();
+  s2_ = turbomath::Vector();
+}
+
+} // namespace rosflight_firmware
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "gyro_analyzer.h"
+#include "rosflight.h"
+
+namespace rosflight_firmware
+{
+
+constexpr uint16_t GyroAnalyzer::WINDOW_SIZE;
+constexpr uint8_t GyroAnalyzer::NUM_BINS;
+constexpr uint8_t GyroAnalyzer::MAX_PEAKS;
+constexpr uint32_t GyroAnalyzer::TIME_SLICE_US;
+constexpr float GyroAnalyzer::PEAK_THRESHOLD;
+constexpr float GyroAnalyzer::MIN_PEAK_AMPLITUDE;
+constexpr uint16_t GyroAnalyzer::CHUNK_SIZE;
+constexpr float GyroAnalyzer::NOTCH_TRACKING_ALPHA;
+
+static const float TWO_PI = 6.28318531f;
+
+GyroAnalyzer::GyroAnalyzer(ROSflight& rf) :
+  RF_(rf),
+  phase_(PHASE_DISABLED),
+  count_(0),
+  bin_(0),
+  min_hz_(0.0f),
+  bin_spacing_hz_(0.0f),
+  coeff_(),
+  power_(),
+  peaks_hz_(),
+  windows_analyzed_(0),
+  drive_notch_(false),
+  notch_hz_(0.0f)
+{}
+
+void GyroAnalyzer::init()
+{
+  for (uint16_t i = 0; i < WINDOW_SIZE; i++)
+    hann_[i] = 0.5f*(1.0f - turbomath::cos(TWO_PI*i/(WINDOW_SIZE - 1)));
+
+  RF_.params_.add_callback<GyroAnalyzer, &GyroAnalyzer::param_change_callback>(this, PARAM_GYRO_ANALYZER);
+  RF_.params_.add_callback<GyroAnalyzer, &GyroAnalyzer::param_change_callback>(this, PARAM_GYRO_ANALYZER_MIN_HZ);
+  RF_.params_.add_callback<GyroAnalyzer, &GyroAnalyzer::param_change_callback>(this, PARAM_GYRO_ANALYZER_MAX_HZ);
+  RF_.params_.add_callback<GyroAnalyzer, &GyroAnalyzer::param_change_callback>(this, PARAM_GYRO_ANALYZER_NOTCH);
+  RF_.params_.add_callback<GyroAnalyzer, &GyroAnalyzer::param_change_callback>(this, PARAM_IMU_SAMPLE_RATE);
+}
+
+void GyroAnalyzer::param_change_callback(uint16_t param_id)
+{
+  (void) param_id; // every parameter just restarts the analysis with the new bins
+  update_config();
+}
+
+void GyroAnalyzer::update_config()
+{
+  float sample_rate_hz = static_cast<float>(RF_.params_.get_param_int(PARAM_IMU_SAMPLE_RATE));
+  float max_hz = RF_.params_.get_param_float(PARAM_GYRO_ANALYZER_MAX_HZ);
+  if (max_hz > 0.45f*sample_rate_hz)
+    max_hz = 0.45f*sample_rate_hz;
+  min_hz_ = RF_.params_.get_param_float(PARAM_GYRO_ANALYZER_MIN_HZ);
+  if (min_hz_ > max_hz)
+    min_hz_ = max_hz;
+  bin_spacing_hz_ = (max_hz - min_hz_)/(NUM_BINS - 1);
+
+  for (uint8_t bin = 0; bin < NUM_BINS; bin++)
+  {
+    coeff_[bin] = 2.0f*turbomath::cos(TWO_PI*bin_hz(bin)/sample_rate_hz);
+    power_[bin] = 0.0f;
+  }
+  for (uint8_t i = 0; i < MAX_PEAKS; i++)
+    peaks_hz_[i] = 0.0f;
+
+  drive_notch_ = RF_.params_.get_param_int(PARAM_GYRO_ANALYZER_NOTCH);
+  notch_hz_ = 0.0f;
+
+  count_ = 0;
+  phase_ = RF_.params_.get_param_int(PARAM_GYRO_ANALYZER) ? PHASE_COLLECTING : PHASE_DISABLED;
+}
+
+void GyroAnalyzer::start_analysis()
+{
+  phase_ = PHASE_MEAN;
+  count_ = 0;
+  mean_ = turbomath::Vector();
+}
+
+void GyroAnalyzer::run()
+{
+  if (phase_ == PHASE_DISABLED || phase_ == PHASE_COLLECTING)
+    return;
+
+  uint64_t deadline_us = RF_.board_.clock_micros() + TIME_SLICE_US;
+  do
+  {
+    uint16_t end = count_ + CHUNK_SIZE;
+    if (end > WINDOW_SIZE)
+      end = WINDOW_SIZE;
+
+    if (phase_ == PHASE_MEAN)
+    {
+      // the mean (bias and slow rotation) would otherwise leak into the lowest bins
+      sum_window(end);
+      if (count_ == WINDOW_SIZE)
+      {
+        mean_ /= static_cast<float>(WINDOW_SIZE);
+        phase_ = PHASE_WINDOWING;
+        count_ = 0;
+      }
+    }
+    else if (phase_ == PHASE_WINDOWING)
+    {
+      apply_window(end);
+      if (count_ == WINDOW_SIZE)
+      {
+        phase_ = PHASE_FILTERING;
+        bin_ = 0;
+        count_ = 0;
+        s1_ = turbomath::Vector();
+        s2_ = turbomath::Vector();
+      }
+    }
+    else
+    {
+      filter_bin(end);
+      if (count_ == WINDOW_SIZE)
+      {
+        // power of the bin on each axis, s1^2 + s2^2 - coeff*s1*s2
+        float coeff = coeff_[bin_];
+        power_[bin_] = s1_.sqrd_norm() + s2_.sqrd_norm() - coeff*s1_.dot(s2_);
+        s1_ = turbomath::Vector();
+        s2_ = turbomath::Vector();
+        count_ = 0;
+        if (++bin_ >= NUM_BINS)
+        {
+          find_peaks();
+          windows_analyzed_++;
+          phase_ = PHASE_COLLECTING; // capture the next window
+          return;
+        }
+      }
+    }
+  } while (RF_.board_.clock_micros() < deadline_us);
+}
+
+void GyroAnalyzer::sum_window(uint16_t end)
+{
+  for (; count_ < end; count_++)
+    mean_ += window_[count_];
+}
+
+void GyroAnalyzer::apply_window(uint16_t end)
+{
+  for (; count_ < end; count_++)
+    window_[count_] = (window_[count_] - mean_)*hann_[count_];
+}
+
+void GyroAnalyzer::filter_bin(uint16_t end)
+{
+  float coeff = coeff_[bin_];
+  for (; count_ < end; count_++)
+  {
+    // s[n] = x[n] + coeff*s[n-1] - s[n-2], on the three axes at once
+    turbomath::Vector s = turbomath::lincomb(1.0f, window_[count_], coeff, s1_, -1.0f, s2_);
+    s2_ = s1_;
+    s1_ = s;
+  }
+}
+
+void GyroAnalyzer::find_peaks()
+{
+  // the median is the noise floor, unlike the mean it isn't raised by the peaks themselves
+  float sorted[NUM_BINS];
+  for (uint8_t bin = 0; bin < NUM_BINS; bin++)
+  {
+    uint8_t i = bin;
+    for (; i > 0 && sorted[i - 1] > power_[bin]; i--)
+      sorted[i] = sorted[i - 1];
+    sorted[i] = power_[bin];
+  }
+  float threshold = PEAK_THRESHOLD*0.5f*(sorted[NUM_BINS/2 - 1] + sorted[NUM_BINS/2]);
+
+  // a Hann windowed sinusoid of amplitude A has a power of (A*WINDOW_SIZE/4)^2 at its frequency
+  float min_power = MIN_PEAK_AMPLITUDE*WINDOW_SIZE/4.0f;
+  min_power *= min_power;
+  if (threshold < min_power)
+    threshold = min_power;
+
+  for (uint8_t i = 0; i < MAX_PEAKS; i++)
+    peaks_hz_[i] = 0.0f;
+  float peak_powers[MAX_PEAKS] = {};
+
+  for (uint8_t bin = 0; bin < NUM_BINS; bin++)
+  {
+    float p = power_[bin];
+    float left = (bin > 0) ? power_[bin - 1] : 0.0f;
+    float right = (bin < NUM_BINS - 1) ? power_[bin + 1] : 0.0f;
+    if (p < threshold || p < left || p <= right)
+      continue;
+
+    // refine the frequency with a parabola through the bin and its neighbours
+    float hz = bin_hz(bin);
+    float curvature = left - 2.0f*p + right;
+    if (bin > 0 && bin < NUM_BINS - 1 && curvature < 0.0f)
+      hz += 0.5f*(left - right)/curvature*bin_spacing_hz_;
+
+    // insert, keeping the peaks sorted by power
+    for (uint8_t i = 0; i < MAX_PEAKS; i++)
+    {
+      if (p > peak_powers[i])
+      {
+        for (uint8_t j = MAX_PEAKS - 1; j > i; j--)
+        {
+          peak_powers[j] = peak_powers[j - 1];
+          peaks_hz_[j] = peaks_hz_[j - 1];
+        }
+        peak_powers[i] = p;
+        peaks_hz_[i] = hz;
+        break;
+      }
+    }
+  }
+
+  if (drive_notch_ && peaks_hz_[0] > 0.0f)
+  {
+    notch_hz_ = (notch_hz_ > 0.0f) ? notch_hz_ + NOTCH_TRACKING_ALPHA*(peaks_hz_[0] - notch_hz_) : peaks_hz_[0];
+    RF_.sensors_.set_dynamic_notch_frequency(notch_hz_);
+  }
+}
+
+} // namespace rosflight_firmware
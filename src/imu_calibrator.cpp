@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "imu_calibrator.h"
+
+namespace rosflight_firmware
+{
+
+constexpr uint16_t ImuCalibrator::WINDOW_SIZE;
+constexpr uint8_t ImuCalibrator::NUM_BINS;
+constexpr float ImuCalibrator::MIN_TEMPERATURE;
+constexpr float ImuCalibrator::BIN_WIDTH;
+constexpr uint16_t ImuCalibrator::BIN_MAX_WEIGHT;
+constexpr float ImuCalibrator::MAX_GYRO_VARIANCE;
+constexpr float ImuCalibrator::MAX_ACCEL_VARIANCE;
+constexpr float ImuCalibrator::MAX_ACCEL_DRIFT;
+constexpr float ImuCalibrator::MAX_BIAS;
+constexpr float ImuCalibrator::MAX_BIAS_ERROR;
+
+ImuCalibrator::ImuCalibrator()
+{
+  reset();
+}
+
+void ImuCalibrator::reset()
+{
+  gyro_stats_.clear();
+  accel_stats_.clear();
+  temperature_mean_ = 0.0f;
+  have_last_accel_mean_ = false;
+
+  for (uint8_t i = 0; i < NUM_BINS; i++)
+  {
+    bins_[i].weight = 0;
+    bins_[i].temperature = 0.0f;
+    bins_[i].gyro_bias = turbomath::Vector(0.0f, 0.0f, 0.0f);
+  }
+  bins_populated_ = 0;
+  windows_accepted_ = 0;
+  windows_rejected_ = 0;
+}
+
+bool ImuCalibrator::push(const turbomath::Vector& accel, const turbomath::Vector& gyro, float temperature)
+{
+  gyro_stats_.add(gyro);
+  accel_stats_.add(accel);
+  temperature_mean_ += (temperature - temperature_mean_)/static_cast<float>(gyro_stats_.count());
+
+  if (gyro_stats_.count() < WINDOW_SIZE)
+    return false;
+
+  turbomath::Vector gyro_mean = gyro_stats_.mean();
+  bool still = window_is_still(gyro_mean, temperature_mean_);
+  if (still)
+  {
+    update_bin(temperature_mean_, gyro_mean);
+    windows_accepted_++;
+  }
+  else
+  {
+    windows_rejected_++;
+  }
+
+  last_accel_mean_ = accel_stats_.mean();
+  have_last_accel_mean_ = true;
+  gyro_stats_.clear();
+  accel_stats_.clear();
+  temperature_mean_ = 0.0f;
+  return still;
+}
+
+bool ImuCalibrator::window_is_still(const turbomath::Vector& gyro_mean, float temperature) const
+{
+  turbomath::Vector gyro_var = gyro_stats_.variance();
+  turbomath::Vector accel_var = accel_stats_.variance();
+  if (gyro_var.x > MAX_GYRO_VARIANCE || gyro_var.y > MAX_GYRO_VARIANCE || gyro_var.z > MAX_GYRO_VARIANCE
+      || accel_var.x > MAX_ACCEL_VARIANCE || accel_var.y > MAX_ACCEL_VARIANCE || accel_var.z > MAX_ACCEL_VARIANCE)
+    return false;
+
+  // a slow, steady rotation is quiet too, but it tilts gravity from one window to the next (except for a
+  // pure yaw, which the bias check below keeps small)
+  if (!have_last_accel_mean_ || (accel_stats_.mean() - last_accel_mean_).norm() > MAX_ACCEL_DRIFT)
+    return false;
+
+  // the first bias can be anything a gyro calibration would take, later ones have to agree with the model
+  if (bins_populated_ == 0)
+    return gyro_mean.norm() < MAX_BIAS;
+  return (gyro_mean - gyro_bias(temperature)).norm() < MAX_BIAS_ERROR;
+}
+
+void ImuCalibrator::update_bin(float temperature, const turbomath::Vector& gyro_mean)
+{
+  float position = (temperature - MIN_TEMPERATURE)/BIN_WIDTH;
+  uint8_t index = 0;
+  if (position >= static_cast<float>(NUM_BINS - 1))
+    index = NUM_BINS - 1;
+  else if (position > 0.0f)
+    index = static_cast<uint8_t>(position);
+
+  Bin &bin = bins_[index];
+  if (bin.weight == 0)
+    bins_populated_++;
+  if (bin.weight < BIN_MAX_WEIGHT)
+    bin.weight++;
+
+  // running mean, which turns into an exponential average once the weight is capped
+  float alpha = 1.0f/static_cast<float>(bin.weight);
+  bin.temperature += alpha*(temperature - bin.temperature);
+  turbomath::axpby(alpha, gyro_mean, 1.0f - alpha, bin.gyro_bias);
+}
+
+turbomath::Vector ImuCalibrator::gyro_bias(float temperature) const
+{
+  if (bins_populated_ == 0)
+    return default_gyro_bias_;
+
+  // the closest populated bins with a mean temperature below and above this one
+  const Bin *below = nullptr;
+  const Bin *above = nullptr;
+  for (uint8_t i = 0; i < NUM_BINS; i++)
+  {
+    const Bin &bin = bins_[i];
+    if (bin.weight == 0)
+      continue;
+    if (bin.temperature <= temperature)
+      below = &bin;
+    else if (above == nullptr)
+      above = &bin;
+  }
+
+  if (below == nullptr)
+    return above->gyro_bias;
+  if (above == nullptr)
+    return below->gyro_bias;
+
+  float t = (temperature - below->temperature)/(above->temperature - below->temperature);
+  return below->gyro_bias + (above->gyro_bias - below->gyro_bias)*t;
+}
+
+} // namespace rosflight_firmware
@@ -29,6 +29,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <stdint.h>
+#include <string.h>
 
 #include "mavlink.h"
 #include "rosflight.h"
@@ -39,6 +40,14 @@ Mavlink::Mavlink(ROSflight& _rf) :
   RF_(_rf)
 {
   initialized_ = false;
+  tx_priority_ = PRIORITY_CRITICAL;
+  tx_dropped_bytes_ = 0;
+  tx_dropped_messages_ = 0;
+  tx_attempted_bytes_ = 0;
+  rx_parse_errors_ = 0;
+  next_stream_rate_update_us_ = 0;
+  v2_ = false;
+  memset(&status_, 0, sizeof(status_));
 }
 
 // function definitions
@@ -51,30 +60,81 @@ void Mavlink::init()
 
   offboard_control_time_ = 0;
   send_params_index_ = PARAMS_COUNT;
+  send_profiler_index_ = 0;
+  encapsulated_seq_ = 0;
+  param_dump_chunk_ = PARAM_CHUNK_COUNT;
+  param_upload_received_ = 0;
+  param_upload_active_ = false;
+  blackbox_chunk_ = 0;
+  blackbox_chunk_count_ = 0;
+  telemetry_batch_.clear();
+  telemetry_last_time_us_ = 0;
 
   // Register Param change callbacks
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_HEARTBEAT, std::placeholders::_1), PARAM_STREAM_HEARTBEAT_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_ATTITUDE, std::placeholders::_1), PARAM_STREAM_ATTITUDE_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_IMU, std::placeholders::_1), PARAM_STREAM_IMU_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_ATTITUDE, std::placeholders::_1), PARAM_STREAM_ATTITUDE_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_DIFF_PRESSURE, std::placeholders::_1), PARAM_STREAM_AIRSPEED_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_BARO, std::placeholders::_1), PARAM_STREAM_BARO_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_SONAR, std::placeholders::_1), PARAM_STREAM_SONAR_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_MAG, std::placeholders::_1), PARAM_STREAM_MAG_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_SERVO_OUTPUT_RAW, std::placeholders::_1), PARAM_STREAM_OUTPUT_RAW_RATE);
-  RF_.params_.add_callback(std::bind(&Mavlink::set_streaming_rate, this, STREAM_ID_RC_RAW, std::placeholders::_1), PARAM_STREAM_RC_RAW_RATE);
+  for (uint8_t stream_id = 0; stream_id < STREAM_COUNT; stream_id++)
+  {
+    if (mavlink_streams_[stream_id].rate_param < PARAMS_COUNT)
+      RF_.params_.add_callback<Mavlink, &Mavlink::param_change_callback>(this, mavlink_streams_[stream_id].rate_param);
+  }
+  RF_.params_.add_callback<Mavlink, &Mavlink::param_change_callback>(this, PARAM_STREAM_ADAPTIVE);
+  RF_.params_.add_callback<Mavlink, &Mavlink::param_change_callback>(this, PARAM_STREAM_BANDWIDTH_FRACTION);
+  RF_.params_.add_callback<Mavlink, &Mavlink::param_change_callback>(this, PARAM_MAVLINK_VERSION);
 
   initialized_ = true;
   log(Mavlink::LOG_INFO, "Booting");
+  if (RF_.params_.dropped_callbacks() > 0)
+    log(Mavlink::LOG_ERROR, "%d param callbacks dropped, param changes may not take effect",
+        RF_.params_.dropped_callbacks());
 }
 
 void Mavlink::send_message(const mavlink_message_t &msg)
 {
-  if (initialized_)
+  if (!initialized_)
+    return;
+
+  uint16_t len = v2_ ? mavlink2_frame_length(msg) : msg.len + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+  tx_attempted_bytes_ += len;
+  uint16_t headroom = (TX_BUFFER_SIZE / 8) * (PRIORITY_CRITICAL - tx_priority_);
+  if (tx_buffer_.space() < len + headroom)
   {
-    uint8_t data[MAVLINK_MAX_PACKET_LEN];
-    uint16_t len = mavlink_msg_to_send_buffer(data, &msg);
-    RF_.board_.serial_write(data, len);
+    // The link can't keep up, drop this message rather than stall the loop
+    tx_dropped_bytes_ += len;
+    tx_dropped_messages_++;
+    return;
+  }
+
+  if (tx_buffer_.contiguous_space() >= len)
+  {
+    // Serialize straight into the TX buffer
+    uint8_t *buf = tx_buffer_.head_ptr();
+    tx_buffer_.commit(v2_ ? mavlink2_serialize(msg, buf) : mavlink_msg_to_send_buffer(buf, &msg));
+  }
+  else
+  {
+    // The message would wrap around the end of the buffer
+    uint8_t data[MAVLINK_MAX_PAYLOAD_LEN + MAVLINK2_NUM_NON_PAYLOAD_BYTES];
+    if (v2_)
+      mavlink2_serialize(msg, data);
+    else
+      mavlink_msg_to_send_buffer(data, &msg);
+    tx_buffer_.push(data, len);
+  }
+
+  drain_tx();
+}
+
+void Mavlink::drain_tx(void)
+{
+  // Hand the board only as much as it can take without blocking
+  uint16_t board_free = RF_.board_.serial_tx_bytes_free();
+  while (board_free > 0 && !tx_buffer_.empty())
+  {
+    uint16_t len = tx_buffer_.contiguous_size();
+    if (len > board_free)
+      len = board_free;
+    RF_.board_.serial_write(tx_buffer_.tail_ptr(), len);
+    tx_buffer_.consume(len);
+    board_free -= len;
   }
 }
 
@@ -170,7 +230,9 @@ void Mavlink::handle_msg_param_set(const mavlink_message_t *const msg)
 
 void Mavlink::send_next_param(void)
 {
-  if (send_params_index_ < PARAMS_COUNT)
+  // Wait for room rather than drop a parameter
+  if (send_params_index_ < PARAMS_COUNT
+      && tx_buffer_.space() >= MAVLINK_MSG_ID_PARAM_VALUE_LEN + non_payload_bytes())
   {
     update_param(static_cast<uint16_t>(send_params_index_));
     send_params_index_++;
@@ -178,6 +240,159 @@ void Mavlink::send_next_param(void)
 }
 
 
+void Mavlink::handle_msg_data_transmission_handshake(const mavlink_message_t *const msg)
+{
+  mavlink_data_transmission_handshake_t handshake;
+  mavlink_msg_data_transmission_handshake_decode(msg, &handshake);
+
+  switch (handshake.type)
+  {
+  case ENCAPSULATED_TYPE_PARAM_DUMP:
+    param_dump_chunk_ = handshake.width;
+    if (param_dump_chunk_ > PARAM_CHUNK_COUNT)
+      param_dump_chunk_ = PARAM_CHUNK_COUNT;
+    send_param_transfer_handshake(ENCAPSULATED_TYPE_PARAM_DUMP, param_dump_chunk_, PARAM_TRANSFER_IN_PROGRESS);
+    break;
+
+  case ENCAPSULATED_TYPE_PARAM_UPLOAD:
+  {
+    // Parameters can't be replaced wholesale while armed
+    if (RF_.state_manager_.state().armed || handshake.size != Params::BULK_IMAGE_SIZE)
+    {
+      param_upload_active_ = false;
+      send_param_transfer_handshake(ENCAPSULATED_TYPE_PARAM_UPLOAD, 0, PARAM_TRANSFER_REJECTED);
+      break;
+    }
+
+    if (handshake.width == 0 || !param_upload_active_)
+    {
+      param_upload_active_ = true;
+      param_upload_received_ = 0;
+    }
+
+    uint16_t missing = 0;
+    while (missing < PARAM_CHUNK_COUNT && (param_upload_received_ & (1u << missing)))
+      missing++;
+    send_param_transfer_handshake(ENCAPSULATED_TYPE_PARAM_UPLOAD, missing, PARAM_TRANSFER_IN_PROGRESS);
+    break;
+  }
+
+  case ENCAPSULATED_TYPE_BLACKBOX:
+  {
+    // reading the storage stalls the CPU, so the log can only be downloaded on the ground
+    if (RF_.state_manager_.state().armed)
+    {
+      blackbox_chunk_count_ = 0;
+      send_blackbox_handshake(ENCAPSULATED_TYPE_BLACKBOX, PARAM_TRANSFER_REJECTED);
+      break;
+    }
+
+    uint32_t chunks = (RF_.blackbox_.size() + BLACKBOX_CHUNK_SIZE - 1)/BLACKBOX_CHUNK_SIZE;
+    blackbox_chunk_count_ = static_cast<uint16_t>((chunks > UINT16_MAX) ? UINT16_MAX : chunks);
+    blackbox_chunk_ = (handshake.width > blackbox_chunk_count_) ? blackbox_chunk_count_ : handshake.width;
+    send_blackbox_handshake(ENCAPSULATED_TYPE_BLACKBOX, PARAM_TRANSFER_IN_PROGRESS);
+    break;
+  }
+
+  case ENCAPSULATED_TYPE_BLACKBOX_ERASE:
+    blackbox_chunk_count_ = 0;
+    send_blackbox_handshake(ENCAPSULATED_TYPE_BLACKBOX_ERASE,
+                            RF_.blackbox_.erase() ? PARAM_TRANSFER_IN_PROGRESS : PARAM_TRANSFER_REJECTED);
+    break;
+
+  default:
+    break;
+  }
+}
+
+void Mavlink::handle_msg_encapsulated_data(const mavlink_message_t *const msg)
+{
+  static_assert(PARAM_CHUNK_COUNT <= 32, "the parameter upload tracks received chunks in a 32-bit mask");
+
+  mavlink_encapsulated_data_t data;
+  mavlink_msg_encapsulated_data_decode(msg, &data);
+
+  if (data.data[0] != ENCAPSULATED_TYPE_PARAM_UPLOAD || !param_upload_active_ || data.seqnr >= PARAM_CHUNK_COUNT)
+    return;
+
+  RF_.params_.bulk_stage(static_cast<uint16_t>(data.seqnr*PARAM_CHUNK_SIZE), data.data + 1, PARAM_CHUNK_SIZE);
+  param_upload_received_ |= 1u << data.seqnr;
+
+  if (param_upload_received_ == (1ull << PARAM_CHUNK_COUNT) - 1)
+  {
+    param_upload_active_ = false;
+    bool applied = !RF_.state_manager_.state().armed && RF_.params_.bulk_commit();
+    send_param_transfer_handshake(ENCAPSULATED_TYPE_PARAM_UPLOAD, PARAM_CHUNK_COUNT,
+                                  applied ? PARAM_TRANSFER_APPLIED : PARAM_TRANSFER_REJECTED);
+    if (applied)
+      log(LOG_INFO, "Bulk parameter upload applied");
+    else
+      log(LOG_WARNING, "Bulk parameter upload rejected");
+  }
+}
+
+void Mavlink::send_param_transfer_handshake(uint8_t type, uint16_t chunk, uint8_t result)
+{
+  mavlink_message_t msg;
+  mavlink_msg_data_transmission_handshake_pack(sysid_, compid_, &msg, type, Params::BULK_IMAGE_SIZE,
+                                               chunk, 0, PARAM_CHUNK_COUNT, PARAM_CHUNK_SIZE, result);
+  send_message(msg);
+}
+
+void Mavlink::send_next_param_chunk(void)
+{
+  // Like send_next_param, wait for room rather than drop a chunk
+  if (param_dump_chunk_ < PARAM_CHUNK_COUNT
+      && tx_buffer_.space() >= MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN + 2 + non_payload_bytes())
+  {
+    uint8_t data[MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN];
+    data[0] = ENCAPSULATED_TYPE_PARAM_DUMP;
+    RF_.params_.bulk_read(static_cast<uint16_t>(param_dump_chunk_*PARAM_CHUNK_SIZE), data + 1, PARAM_CHUNK_SIZE);
+
+    mavlink_message_t msg;
+    mavlink_msg_encapsulated_data_pack(sysid_, compid_, &msg, param_dump_chunk_, data);
+    send_message(msg);
+    param_dump_chunk_++;
+  }
+}
+
+void Mavlink::send_blackbox_handshake(uint8_t type, uint8_t result)
+{
+  mavlink_message_t msg;
+  mavlink_msg_data_transmission_handshake_pack(sysid_, compid_, &msg, type, RF_.blackbox_.size(),
+                                               blackbox_chunk_, 0, blackbox_chunk_count_, BLACKBOX_CHUNK_SIZE, result);
+  send_message(msg);
+}
+
+void Mavlink::send_next_blackbox_chunk(void)
+{
+  // stop if the vehicle is armed part way through
+  if (blackbox_chunk_ < blackbox_chunk_count_ && RF_.state_manager_.state().armed)
+    blackbox_chunk_count_ = 0;
+
+  if (blackbox_chunk_ < blackbox_chunk_count_
+      && tx_buffer_.space() >= MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN + 2 + non_payload_bytes())
+  {
+    uint8_t data[MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN];
+    memset(data, 0xFF, sizeof(data));
+    data[0] = ENCAPSULATED_TYPE_BLACKBOX;
+
+    uint32_t offset = static_cast<uint32_t>(blackbox_chunk_)*BLACKBOX_CHUNK_SIZE;
+    uint32_t len = RF_.blackbox_.size() - offset;
+    if (len > BLACKBOX_CHUNK_SIZE)
+      len = BLACKBOX_CHUNK_SIZE;
+
+    // the storage may be busy finishing the last page, in which case try again next time
+    if (!RF_.blackbox_.read(offset, data + 1, len))
+      return;
+
+    mavlink_message_t msg;
+    mavlink_msg_encapsulated_data_pack(sysid_, compid_, &msg, blackbox_chunk_, data);
+    send_message(msg);
+    blackbox_chunk_++;
+  }
+}
+
 void Mavlink::handle_msg_rosflight_cmd(const mavlink_message_t *const msg)
 {
   mavlink_rosflight_cmd_t cmd;
@@ -247,6 +462,7 @@ void Mavlink::handle_msg_rosflight_cmd(const mavlink_message_t *const msg)
 
   if (reboot_flag || reboot_to_bootloader_flag)
   {
+    RF_.param_store_.flush();
     RF_.board_.clock_delay(20);
     RF_.board_.board_reset(reboot_to_bootloader_flag);
   }
@@ -265,6 +481,11 @@ void Mavlink::handle_msg_timesync(const mavlink_message_t *const msg)
     mavlink_msg_timesync_pack(sysid_, compid_, &out_msg, static_cast<int64_t>(now_us)*1000, tsync.ts1);
     send_message(out_msg);
   }
+  else if (tsync.ts1 > 0)
+  {
+    // the answer to one of our requests, which echoes our send time in ts1 (ns)
+    timesync_.add_round_trip(static_cast<uint64_t>(tsync.ts1)/1000, static_cast<uint64_t>(tsync.tc1)/1000, now_us);
+  }
 }
 
 void Mavlink::handle_msg_offboard_control(const mavlink_message_t *const msg)
@@ -338,6 +559,12 @@ void Mavlink::handle_mavlink_message(void)
   case MAVLINK_MSG_ID_TIMESYNC:
     handle_msg_timesync(&in_buf_);
     break;
+  case MAVLINK_MSG_ID_DATA_TRANSMISSION_HANDSHAKE:
+    handle_msg_data_transmission_handshake(&in_buf_);
+    break;
+  case MAVLINK_MSG_ID_ENCAPSULATED_DATA:
+    handle_msg_encapsulated_data(&in_buf_);
+    break;
   default:
     break;
   }
@@ -346,11 +573,41 @@ void Mavlink::handle_mavlink_message(void)
 // function definitions
 void Mavlink::receive(void)
 {
-  while (RF_.board_.serial_bytes_available())
+  // Read in chunks, and no more than RX_BYTES_PER_PASS in all, so that a burst (e.g. a parameter upload)
+  // can't hold up the control loop; the rest waits in the board's RX buffer for the next pass
+  uint8_t buf[RX_CHUNK_SIZE];
+  size_t budget = RX_BYTES_PER_PASS;
+  while (budget > 0)
   {
-    if (mavlink_parse_char(MAVLINK_COMM_0, RF_.board_.serial_read(), &in_buf_, &status_))
+    size_t len = RF_.board_.serial_read(buf, (budget < RX_CHUNK_SIZE) ? budget : RX_CHUNK_SIZE);
+    if (len == 0)
+      break;
+    budget -= len;
+    for (size_t i = 0; i < len; i++)
+      parse_byte(buf[i]);
+  }
+}
+
+uint32_t Mavlink::rx_overflows() const
+{
+  return RF_.board_.serial_rx_overflows();
+}
+
+void Mavlink::parse_byte(uint8_t byte)
+{
+  // MAVLink 2 frames are picked out by their start byte whenever the v1 parser isn't in the middle of a frame
+  if (!parser2_.idle() || (byte == MAVLINK2_STX && status_.parse_state <= MAVLINK_PARSE_STATE_IDLE))
+  {
+    if (parser2_.parse(byte, &in_buf_))
       handle_mavlink_message();
+    return;
   }
+
+  uint8_t received = mavlink_parse_char(MAVLINK_COMM_0, byte, &in_buf_, &status_);
+  // the v1 parser hands back the number of parse errors since its previous call as packet_rx_drop_count
+  rx_parse_errors_ += status_.packet_rx_drop_count;
+  if (received)
+    handle_mavlink_message();
 }
 
 void Mavlink::log(uint8_t severity, const char *fmt, ...)
@@ -407,6 +664,25 @@ void Mavlink::send_status(void)
                                     RF_.board_.num_sensor_errors(),
                                     RF_.get_loop_time_us());
   send_message(msg);
+  send_named_value_int("tx_drop", static_cast<int32_t>(tx_dropped_bytes_));
+  if (rx_parse_errors() > 0 || rx_overflows() > 0)
+  {
+    send_named_value_int("rx_err", static_cast<int32_t>(rx_parse_errors()));
+    send_named_value_int("rx_ovf", static_cast<int32_t>(rx_overflows()));
+  }
+
+  // DEBUG_VECT carries the median, 90th and 99th percentile latency of the recent offboard commands (us)
+  if (RF_.command_manager_.offboard_control_active())
+  {
+    mavlink_msg_debug_vect_pack(sysid_, compid_, &msg,
+                                "offb_lat",
+                                RF_.board_.clock_micros(),
+                                static_cast<float>(RF_.command_manager_.offboard_latency_percentile_us(50)),
+                                static_cast<float>(RF_.command_manager_.offboard_latency_percentile_us(90)),
+                                static_cast<float>(RF_.command_manager_.offboard_latency_percentile_us(99)));
+    send_message(msg);
+    send_named_value_int("offb_age", static_cast<int32_t>(RF_.command_manager_.offboard_command_age_us()));
+  }
 }
 
 
@@ -433,7 +709,7 @@ void Mavlink::send_imu(void)
   turbomath::Vector accel = RF_.sensors_.data().accel;
   turbomath::Vector gyro = RF_.sensors_.data().gyro;
   mavlink_msg_small_imu_pack(sysid_, compid_, &msg,
-                             RF_.sensors_.data().imu_time,
+                             timesync_.to_host_us(RF_.sensors_.data().imu_time),
                              accel.x,
                              accel.y,
                              accel.z,
@@ -478,6 +754,177 @@ void Mavlink::send_rc_raw(void)
   send_message(msg);
 }
 
+void Mavlink::send_profiler(void)
+{
+  // Each call reports a single stage, so the stream rate divided by STAGE_COUNT is the rate for each stage.
+  // DEBUG_VECT carries {min, mean, max} in us, MEMORY_VECT carries the log2 histogram (address = stage id).
+  // The statistics for the stage are cleared once sent, so each report covers the time since its last report.
+  uint8_t stage = send_profiler_index_;
+  const Profiler::Stage& stats = RF_.profiler_.stage(stage);
+
+  if (stats.count > 0)
+  {
+    mavlink_message_t msg;
+    mavlink_msg_debug_vect_pack(sysid_, compid_, &msg,
+                                Profiler::stage_name(stage),
+                                RF_.board_.clock_micros(),
+                                static_cast<float>(stats.min_us),
+                                static_cast<float>(RF_.profiler_.mean_us(stage)),
+                                static_cast<float>(stats.max_us));
+    send_message(msg);
+
+    int8_t histogram[32];
+    static_assert(sizeof(histogram) == sizeof(stats.histogram), "profiler histogram must fill a MEMORY_VECT payload");
+    memcpy(histogram, stats.histogram, sizeof(histogram));
+    mavlink_msg_memory_vect_pack(sysid_, compid_, &msg, stage, 1, 0, histogram);
+    send_message(msg);
+  }
+
+  // Stages timed by ROSFLIGHT_TIME_SCOPE also get {min, mean, max} in clock cycles, under the name with a "c_" prefix
+  const Profiler::Cycles& cycles = RF_.profiler_.cycles(stage);
+  if (cycles.count > 0)
+  {
+    char name[10] = {'c', '_'};
+    strncpy(name + 2, Profiler::stage_name(stage), sizeof(name) - 2);
+    mavlink_message_t msg;
+    mavlink_msg_debug_vect_pack(sysid_, compid_, &msg, name, RF_.board_.clock_micros(),
+                                static_cast<float>(cycles.min),
+                                static_cast<float>(RF_.profiler_.mean_cycles(stage)),
+                                static_cast<float>(cycles.max));
+    send_message(msg);
+  }
+
+  if (stats.count > 0 || cycles.count > 0)
+    RF_.profiler_.reset(stage);
+
+  send_profiler_index_ = (send_profiler_index_ + 1) % Profiler::STAGE_COUNT;
+}
+
+void Mavlink::send_timesync(void)
+{
+  mavlink_message_t msg;
+  mavlink_msg_timesync_pack(sysid_, compid_, &msg, 0, static_cast<int64_t>(RF_.board_.clock_micros())*1000);
+  send_message(msg);
+}
+
+void Mavlink::send_gyro_peaks(void)
+{
+  // DEBUG_VECT carries the three strongest peaks of the gyro spectrum (Hz), 0 where there is none
+  mavlink_message_t msg;
+  mavlink_msg_debug_vect_pack(sysid_, compid_, &msg,
+                              "gyro_peaks",
+                              RF_.board_.clock_micros(),
+                              RF_.gyro_analyzer_.peak_hz(0),
+                              RF_.gyro_analyzer_.peak_hz(1),
+                              RF_.gyro_analyzer_.peak_hz(2));
+  send_message(msg);
+}
+
+static uint8_t *put_u16(uint8_t *buf, uint16_t value)
+{
+  buf[0] = static_cast<uint8_t>(value);
+  buf[1] = static_cast<uint8_t>(value >> 8);
+  return buf + 2;
+}
+
+void Mavlink::send_imu_batch(void)
+{
+  // Only complete frames are sent; the rest wait in the sensors batch buffer for the next flush
+  static_assert(IMU_BATCH_HEADER_SIZE + IMU_BATCH_SAMPLES_PER_FRAME*IMU_BATCH_SAMPLE_SIZE
+                <= MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN, "IMU batch frame must fit in ENCAPSULATED_DATA");
+
+  while (RF_.sensors_.imu_batch_available() >= IMU_BATCH_SAMPLES_PER_FRAME)
+  {
+    uint8_t data[MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = {};
+    uint8_t *p = data + IMU_BATCH_HEADER_SIZE;
+    uint8_t count = 0;
+    uint64_t base_time_us = 0;
+
+    imu_sample_t sample;
+    while (count < IMU_BATCH_SAMPLES_PER_FRAME && RF_.sensors_.imu_batch_peek(&sample))
+    {
+      if (count == 0)
+      {
+        base_time_us = sample.time_us;
+        int32_t temperature = quantize(sample.temperature, 100.0f, INT16_MAX);
+        put_u16(data + 2, static_cast<uint16_t>(temperature));
+        uint64_t base_host_time_us = timesync_.to_host_us(base_time_us);
+        for (int i = 0; i < 8; i++)
+          data[4 + i] = static_cast<uint8_t>(base_host_time_us >> (8*i));
+      }
+
+      // a gap longer than the 16-bit offset can describe ends the frame early, the sample starts the next one
+      uint64_t offset_us = sample.time_us - base_time_us;
+      if (offset_us > UINT16_MAX)
+        break;
+      RF_.sensors_.imu_batch_pop(&sample);
+
+      p = put_u16(p, static_cast<uint16_t>(offset_us));
+      for (int i = 0; i < 3; i++)
+        p = put_u16(p, static_cast<uint16_t>(quantize(sample.accel[i], IMU_BATCH_ACCEL_LSB_PER_MPS2, INT16_MAX)));
+      for (int i = 0; i < 3; i++)
+        p = put_u16(p, static_cast<uint16_t>(quantize(sample.gyro[i], IMU_BATCH_GYRO_LSB_PER_RADPS, INT16_MAX)));
+      count++;
+    }
+
+    data[0] = ENCAPSULATED_TYPE_IMU_BATCH;
+    data[1] = count;
+
+    mavlink_message_t msg;
+    mavlink_msg_encapsulated_data_pack(sysid_, compid_, &msg, encapsulated_seq_++, data);
+    send_message(msg);
+  }
+}
+
+void Mavlink::send_telemetry(void)
+{
+  const Sensors::Data &data = RF_.sensors_.data();
+  if (data.imu_time != telemetry_last_time_us_)
+  {
+    telemetry_last_time_us_ = data.imu_time;
+
+    const turbomath::Quaternion &q = RF_.estimator_.state().attitude;
+    int32_t fields[TELEMETRY_NUM_FIELDS];
+    fields[TELEMETRY_ACCEL_X] = quantize(data.accel.x, IMU_BATCH_ACCEL_LSB_PER_MPS2);
+    fields[TELEMETRY_ACCEL_Y] = quantize(data.accel.y, IMU_BATCH_ACCEL_LSB_PER_MPS2);
+    fields[TELEMETRY_ACCEL_Z] = quantize(data.accel.z, IMU_BATCH_ACCEL_LSB_PER_MPS2);
+    fields[TELEMETRY_GYRO_X] = quantize(data.gyro.x, IMU_BATCH_GYRO_LSB_PER_RADPS);
+    fields[TELEMETRY_GYRO_Y] = quantize(data.gyro.y, IMU_BATCH_GYRO_LSB_PER_RADPS);
+    fields[TELEMETRY_GYRO_Z] = quantize(data.gyro.z, IMU_BATCH_GYRO_LSB_PER_RADPS);
+    fields[TELEMETRY_Q_W] = quantize(q.w, TELEMETRY_QUATERNION_LSB);
+    fields[TELEMETRY_Q_X] = quantize(q.x, TELEMETRY_QUATERNION_LSB);
+    fields[TELEMETRY_Q_Y] = quantize(q.y, TELEMETRY_QUATERNION_LSB);
+    fields[TELEMETRY_Q_Z] = quantize(q.z, TELEMETRY_QUATERNION_LSB);
+
+    // a sample that doesn't fit starts the next frame
+    if (!telemetry_batch_.add(data.imu_time, fields))
+    {
+      send_telemetry_frame();
+      telemetry_batch_.add(data.imu_time, fields);
+    }
+  }
+
+  if (telemetry_batch_.count() > 0
+      && telemetry_batch_.end_time_us() - telemetry_batch_.start_time_us() >= TELEMETRY_MAX_LATENCY_US)
+    send_telemetry_frame();
+}
+
+void Mavlink::send_telemetry_frame(void)
+{
+  uint8_t data[MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN] = {};
+  data[0] = ENCAPSULATED_TYPE_TELEMETRY;
+  data[1] = telemetry_batch_.count();
+  uint64_t start_host_time_us = timesync_.to_host_us(telemetry_batch_.start_time_us());
+  for (int i = 0; i < 8; i++)
+    data[2 + i] = static_cast<uint8_t>(start_host_time_us >> (8*i));
+  memcpy(data + TELEMETRY_HEADER_SIZE, telemetry_batch_.data(), telemetry_batch_.size());
+  telemetry_batch_.clear();
+
+  mavlink_message_t msg;
+  mavlink_msg_encapsulated_data_pack(sysid_, compid_, &msg, encapsulated_seq_++, data);
+  send_message(msg);
+}
+
 void Mavlink::send_diff_pressure(void)
 {
   if (RF_.sensors_.data().diff_pressure_valid)
@@ -534,6 +981,8 @@ void Mavlink::send_mag(void)
 void Mavlink::send_low_priority(void)
 {
   send_next_param();
+  send_next_param_chunk();
+  send_next_blackbox_chunk();
 }
 
 // function definitions
@@ -550,19 +999,98 @@ void Mavlink::stream()
         mavlink_streams_[i].next_time_us += mavlink_streams_[i].period_us;
       } while(mavlink_streams_[i].next_time_us < time_us);
 
+      uint32_t bytes_before = tx_attempted_bytes_;
+      tx_priority_ = mavlink_streams_[i].priority;
       (this->*mavlink_streams_[i].send_function)();
+      tx_priority_ = PRIORITY_CRITICAL;
+
+      // keep track of what each stream costs, for the adaptive rates
+      float bytes = static_cast<float>(tx_attempted_bytes_ - bytes_before);
+      if (mavlink_streams_[i].avg_bytes == 0.0f)
+        mavlink_streams_[i].avg_bytes = bytes;
+      else
+        mavlink_streams_[i].avg_bytes = 0.9f*mavlink_streams_[i].avg_bytes + 0.1f*bytes;
     }
   }
+
+  if (time_us >= next_stream_rate_update_us_)
+    update_stream_rates();
+
+  // Keep the UART fed with whatever is still waiting
+  drain_tx();
+}
+
+void Mavlink::param_change_callback(uint16_t param_id)
+{
+  for (uint8_t stream_id = 0; stream_id < STREAM_COUNT; stream_id++)
+  {
+    uint16_t rate_param = mavlink_streams_[stream_id].rate_param;
+    if (rate_param < PARAMS_COUNT && (param_id == rate_param || param_id == Params::BATCH_CHANGED))
+      set_streaming_rate(stream_id, rate_param);
+  }
+
+  if (param_id == PARAM_STREAM_ADAPTIVE || param_id == PARAM_STREAM_BANDWIDTH_FRACTION
+      || param_id == Params::BATCH_CHANGED)
+    update_stream_rates();
+
+  if (param_id == PARAM_MAVLINK_VERSION || param_id == Params::BATCH_CHANGED)
+    v2_ = (RF_.params_.get_param_int(PARAM_MAVLINK_VERSION) == 2);
 }
 
 void Mavlink::set_streaming_rate(uint8_t stream_id, int16_t param_id)
 {
-  mavlink_streams_[stream_id].period_us = (RF_.params_.get_param_int(param_id) == 0 ? 0 : 1000000/RF_.params_.get_param_int(param_id));
+  stream_set_period(stream_id, (RF_.params_.get_param_int(param_id) == 0 ? 0 : 1000000/RF_.params_.get_param_int(param_id)));
 }
 
 void Mavlink::stream_set_period(uint8_t stream_id, uint32_t period_us)
 {
+  mavlink_streams_[stream_id].requested_period_us = period_us;
   mavlink_streams_[stream_id].period_us = period_us;
+  next_stream_rate_update_us_ = 0; // rebalance on the next pass
+}
+
+void Mavlink::update_stream_rates(void)
+{
+  next_stream_rate_update_us_ = RF_.board_.clock_micros() + STREAM_RATE_UPDATE_US;
+
+  if (!RF_.params_.get_param_int(PARAM_STREAM_ADAPTIVE))
+  {
+    for (int i = 0; i < STREAM_COUNT; i++)
+      mavlink_streams_[i].period_us = mavlink_streams_[i].requested_period_us;
+    return;
+  }
+
+  // 10 bits on the wire per byte (8N1)
+  float budget = RF_.params_.get_param_int(PARAM_BAUD_RATE) / 10.0f
+                 * RF_.params_.get_param_float(PARAM_STREAM_BANDWIDTH_FRACTION);
+
+  // Hand out the bandwidth one priority level at a time, starting from the top. A level that doesn't fit
+  // in what is left gets all of it, shared by slowing all of its streams down by the same factor.
+  for (int priority = PRIORITY_CRITICAL; priority >= PRIORITY_LOW; priority--)
+  {
+    float demand = 0.0f;
+    for (int i = 0; i < STREAM_COUNT; i++)
+    {
+      if (mavlink_streams_[i].priority == priority && mavlink_streams_[i].requested_period_us > 0)
+        demand += mavlink_streams_[i].avg_bytes * 1e6f / mavlink_streams_[i].requested_period_us;
+    }
+
+    float scale = (demand <= budget) ? 1.0f : budget / demand;
+    budget -= demand * scale;
+
+    for (int i = 0; i < STREAM_COUNT; i++)
+    {
+      mavlink_stream_t& stream = mavlink_streams_[i];
+      if (stream.priority != priority || stream.requested_period_us == 0)
+        continue;
+
+      float period_us = (scale > 0.0f) ? stream.requested_period_us / scale : STREAM_MAX_ADAPTIVE_PERIOD_US;
+      if (period_us > STREAM_MAX_ADAPTIVE_PERIOD_US)
+        period_us = (stream.requested_period_us > STREAM_MAX_ADAPTIVE_PERIOD_US) ? stream.requested_period_us
+                                                                                 : STREAM_MAX_ADAPTIVE_PERIOD_US;
+      stream.period_us = static_cast<uint32_t>(period_us);
+    }
+  }
 }
 
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+
+#include "mavlink2.h"
+
+namespace rosflight_firmware
+{
+
+static const uint8_t message_crcs[256] = MAVLINK_MESSAGE_CRCS;
+
+static inline const uint8_t *payload(const mavlink_message_t &msg)
+{
+  return reinterpret_cast<const uint8_t *>(msg.payload64);
+}
+
+static uint8_t truncated_length(const mavlink_message_t &msg)
+{
+  size_t len = msg.len;
+  const uint8_t *p = payload(msg);
+  while (len > 1 && p[len - 1] == 0)
+    len--;
+  return static_cast<uint8_t>(len);
+}
+
+uint16_t mavlink2_frame_length(const mavlink_message_t &msg)
+{
+  return static_cast<uint16_t>(truncated_length(msg) + MAVLINK2_NUM_NON_PAYLOAD_BYTES);
+}
+
+uint16_t mavlink2_serialize(const mavlink_message_t &msg, uint8_t *buf)
+{
+  uint8_t len = truncated_length(msg);
+  buf[0] = MAVLINK2_STX;
+  buf[1] = len;
+  buf[2] = 0; // incompat flags
+  buf[3] = 0; // compat flags
+  buf[4] = msg.seq;
+  buf[5] = msg.sysid;
+  buf[6] = msg.compid;
+  buf[7] = msg.msgid;
+  buf[8] = 0;
+  buf[9] = 0;
+  memcpy(buf + MAVLINK2_HEADER_SIZE, payload(msg), len);
+
+  uint16_t crc;
+  crc_init(&crc);
+  size_t n = MAVLINK2_HEADER_SIZE + static_cast<size_t>(len);
+  for (size_t i = 1; i < n; i++)
+    crc_accumulate(buf[i], &crc);
+  crc_accumulate(message_crcs[msg.msgid], &crc);
+
+  buf[n++] = static_cast<uint8_t>(crc);
+  buf[n++] = static_cast<uint8_t>(crc >> 8);
+  return static_cast<uint16_t>(n);
+}
+
+Mavlink2Parser::Mavlink2Parser() :
+  state_(STATE_IDLE),
+  header_(),
+  index_(0),
+  crc_(0),
+  received_crc_(),
+  frames_received_(0),
+  frames_dropped_(0)
+{}
+
+bool Mavlink2Parser::parse(uint8_t byte, mavlink_message_t *msg)
+{
+  switch (state_)
+  {
+  case STATE_IDLE:
+    if (byte == MAVLINK2_STX)
+    {
+      header_[0] = byte;
+      index_ = 1;
+      crc_init(&crc_);
+      state_ = STATE_HEADER;
+    }
+    break;
+
+  case STATE_HEADER:
+    header_[index_++] = byte;
+    crc_accumulate(byte, &crc_);
+    if (index_ == MAVLINK2_HEADER_SIZE)
+    {
+      index_ = 0;
+      state_ = (header_[1] > 0) ? STATE_PAYLOAD : STATE_CRC;
+    }
+    break;
+
+  case STATE_PAYLOAD:
+    reinterpret_cast<uint8_t *>(msg->payload64)[index_++] = byte;
+    crc_accumulate(byte, &crc_);
+    if (index_ == header_[1])
+    {
+      index_ = 0;
+      state_ = STATE_CRC;
+    }
+    break;
+
+  case STATE_CRC:
+    received_crc_[index_++] = byte;
+    if (index_ == 2)
+    {
+      index_ = 0;
+      if (header_[2] & MAVLINK2_INCOMPAT_FLAG_SIGNED)
+      {
+        state_ = STATE_SIGNATURE;
+        break;
+      }
+      state_ = STATE_IDLE;
+      return finish_frame(msg);
+    }
+    break;
+
+  case STATE_SIGNATURE:
+    // skipped, the frame is dropped
+    if (++index_ == MAVLINK2_SIGNATURE_SIZE)
+    {
+      frames_dropped_++;
+      state_ = STATE_IDLE;
+    }
+    break;
+
+  default:
+    state_ = STATE_IDLE;
+    break;
+  }
+  return false;
+}
+
+bool Mavlink2Parser::finish_frame(mavlink_message_t *msg)
+{
+  // only the message ids of the dialect, and no incompatible features
+  if (header_[8] != 0 || header_[9] != 0 || header_[2] != 0)
+  {
+    frames_dropped_++;
+    return false;
+  }
+
+  uint8_t msgid = header_[7];
+  crc_accumulate(message_crcs[msgid], &crc_);
+  if (received_crc_[0] != static_cast<uint8_t>(crc_) || received_crc_[1] != static_cast<uint8_t>(crc_ >> 8))
+  {
+    frames_dropped_++;
+    return false;
+  }
+
+  uint8_t len = header_[1];
+  memset(reinterpret_cast<uint8_t *>(msg->payload64) + len, 0, MAVLINK_MAX_PAYLOAD_LEN - len);
+  msg->len = len;
+  msg->seq = header_[4];
+  msg->sysid = header_[5];
+  msg->compid = header_[6];
+  msg->msgid = msgid;
+  msg->checksum = static_cast<uint16_t>(received_crc_[0] | (received_crc_[1] << 8));
+  frames_received_++;
+  return true;
+}
+
+} // namespace rosflight_firmware
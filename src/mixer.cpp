@@ -33,23 +33,167 @@
 
 #include "mixer.h"
 #include "rosflight.h"
+#include "cycle_timer.h"
 
 namespace rosflight_firmware
 {
 
+constexpr int Mixer::THRUST_CURVE_POINTS;
+
+static_assert(PARAM_MIXER_CUSTOM_Z_7 == PARAM_MIXER_CUSTOM_F_0 + 31, "load_custom_mixer indexes the MIX_* params as F, x, y, z blocks of eight");
+
+const Mixer::mixer_t Mixer::esc_calibration_mixing =
+{
+  {M, M, M, M, M, M, NONE, NONE},
+  { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f}, // F Mix
+  { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+};
+
+const Mixer::mixer_t Mixer::quadcopter_plus_mixing =
+{
+  {M, M, M, M, NONE, NONE, NONE, NONE}, // output_type
+
+  { 1.0f,  1.0f,  1.0f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
+  { 0.0f, -1.0f,  0.0f,  1.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 1.0f,  0.0f, -1.0f,  0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
+  { 1.0f, -1.0f,  1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
+};
+
+const Mixer::mixer_t Mixer::quadcopter_x_mixing =
+{
+  {M, M, M, M, NONE, NONE, NONE, NONE}, // output_type
+
+  { 1.0f,  1.0f, 1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
+  {-1.0f, -1.0f, 1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 1.0f, -1.0f,-1.0f, 1.0f,  0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
+  { 1.0f, -1.0f, 1.0f,-1.0f,  0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
+};
+
+const Mixer::mixer_t Mixer::hex_plus_mixing =
+{
+  {M, M, M, M, M, M, M, M}, // output_type
+
+  { 1.0f,  1.0f,       1.0f,      1.0f,  1.0f,      1.0f,      0.0f, 0.0f}, //  F  Mix
+  { 0.0f, -0.866025f, -0.866025f, 0.0f,  0.866025f, 0.866025f, 0.0f, 0.0f}, //  X  Mix
+  { 1.0f,  0.5f,      -0.5f,     -1.0f, -0.5f,      0.5f,      0.0f, 0.0f}, //  Y  Mix
+  { 1.0f, -1.0f,       1.0f,     -1.0f,  1.0f,     -1.0f,      0.0f, 0.0f}  //  Z  Mix
+};
+
+const Mixer::mixer_t Mixer::hex_x_mixing =
+{
+  {M, M, M, M, M, M, M, M}, // output_type
+
+  {   1.0f,       1.0f,  1.0f,       1.0f,      1.0f,  1.0f,      0.0f,  0.0f}, //  F  Mix
+  {  -0.5f,      -1.0f, -0.5f,       0.5f,      1.0f,  0.5f,      0.0f,  0.0f}, //  X  Mix
+  {   0.866025f,  0.0f, -0.866025f, -0.866025f, 0.0f,  0.866025f, 0.0f,  0.0f}, //  Y  Mix
+  {  1.0f,       -1.0f,  1.0f,      -1.0f,      1.0f, -1.0f,      0.0f,  0.0f}  //  Z  Mix
+};
+
+const Mixer::mixer_t Mixer::octocopter_plus_mixing =
+{
+  {M, M, M, M, M, M, M, M}, // output_type
+
+  { 1.0f,   1.0f,    1.0f,   1.0f,     1.0f,   1.0f,    1.0f,  1.0f},   //  F  Mix
+  { 0.0f,  -0.707f, -1.0f,  -0.707f,   0.0f,   0.707f,  1.0f,  0.707f}, //  X  Mix
+  { 1.0f,   0.707f,  0.0f,  -0.707f,  -1.0f,  -0.707f,  0.0f,  0.707f}, //  Y  Mix
+  { 1.0f,  -1.0f,    1.0f,  -1.0f,     1.0f,  -1.0f,    1.0f, -1.0f}     //  Z  Mix
+};
+
+const Mixer::mixer_t Mixer::octocopter_x_mixing =
+{
+  {M, M, M, M, M, M, M, M}, // output_type
+
+  { 1.0f,    1.0f,    1.0f,    1.0f,   1.0f,    1.0f,   1.0f,   1.0f},  // F Mix
+  {-0.414f, -1.0f,   -1.0f,   -0.414f, 0.414f,  1.0f,   1.0f,   0.414}, // X Mix
+  { 1.0f,    0.414f, -0.414f, -1.0f,  -1.0f,   -0.414f, 0.414f, 1.0},   // Y Mix
+  { 1.0f,   -1.0f,    1.0f,   -1.0f,   1.0f,  -1.0f,    1.0f,  -1.0f}   // Z Mix
+};
+
+const Mixer::mixer_t Mixer::Y6_mixing =
+{
+  {M, M, M, M, M, M, NONE, NONE}, // output_type
+
+  { 1.0f,   1.0f,    1.0f,    1.0f,    1.0f,    1.0f,   0.0f, 0.0f}, // F Mix
+  {-1.0f,  -1.0f,    0.0f,    0.0f,    1.0f,    1.0f,   0.0f, 0.0f}, // X Mix
+  { 0.667f, 0.667f, -1.333f, -1.333f,  0.667f,  0.667f, 0.0f, 0.0f}, // Y Mix
+  { 1.0f,  -1.0f,    1.0f,   -1.0f,    1.0f,   -1.0f,   0.0f, 0.0f}  // Z Mix
+};
+
+const Mixer::mixer_t Mixer::X8_mixing =
+{
+  {M, M, M, M, M, M, M, M}, // output_type
+
+  { 1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f,  1.0f}, // F Mix
+  {-1.0f, -1.0f, -1.0f, -1.0f,  1.0f,  1.0f,  1.0f,  1.0f}, // X Mix
+  { 1.0f,  1.0f, -1.0f, -1.0f, -1.0f, -1.0f,  1.0f,  1.0f}, // Y Mix
+  { 1.0f, -1.0f,  1.0f, -1.0f,  1.0f, -1.0f,  1.0f, -1.0f}  // Z Mix
+};
+
+const Mixer::mixer_t Mixer::tricopter_mixing =
+{
+  {M, M, M, S, NONE, NONE, NONE, NONE}, // output_type
+
+  { 1.0f,   0.0f, 1.0f,    1.0f,   0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
+  {-1.0f,   0.0f, 0.0f,    1.0f,   0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 0.667f, 0.0f, 0.667f, -1.333f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
+  { 0.0f,   1.0f, 0.0f,    0.0f,   0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
+};
+
+const Mixer::mixer_t Mixer::fixedwing_mixing =
+{
+  {S, S, M, S, S, M, NONE, NONE},
+
+  { 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // F Mix
+  { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // X Mix
+  { 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, // Y Mix
+  { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f}  // Z Mix
+};
+
+const Mixer::mixer_t *const Mixer::array_of_mixers_[NUM_BUILT_IN_MIXERS] =
+{
+  &esc_calibration_mixing,
+  &quadcopter_plus_mixing,
+  &quadcopter_x_mixing,
+  &hex_plus_mixing,
+  &hex_x_mixing,
+  &octocopter_plus_mixing,
+  &octocopter_x_mixing,
+  &Y6_mixing,
+  &X8_mixing,
+  &tricopter_mixing,
+  &fixedwing_mixing,
+};
+
 Mixer::Mixer(ROSflight &_rf) :
-  RF_(_rf)
+  RF_(_rf),
+  config_(),
+  mixer_to_use_(NULL)
 {}
 
 void Mixer::init()
 {
-  RF_.params_.add_callback(std::bind(&Mixer::param_change_callback, this, std::placeholders::_1), PARAM_MOTOR_PWM_SEND_RATE);
-  RF_.params_.add_callback(std::bind(&Mixer::param_change_callback, this, std::placeholders::_1), PARAM_MOTOR_MIN_PWM);
-  RF_.params_.add_callback(std::bind(&Mixer::param_change_callback, this, std::placeholders::_1), PARAM_RC_TYPE);
-  RF_.params_.add_callback(std::bind(&Mixer::param_change_callback, this, std::placeholders::_1), PARAM_MIXER);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_PWM_SEND_RATE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_MIN_PWM);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_RC_TYPE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MIXER);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_MAX_PWM);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_IDLE_THROTTLE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_SPIN_MOTORS_WHEN_ARMED);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_FIXED_WING);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_AILERON_REVERSE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_ELEVATOR_REVERSE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_RUDDER_REVERSE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MIXER_AIRMODE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_THRUST_CURVE);
+  RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, PARAM_MOTOR_PROTOCOL);
+  for (uint16_t param_id = PARAM_MIXER_CUSTOM_TYPE_0; param_id <= PARAM_MIXER_CUSTOM_Z_7; param_id++)
+    RF_.params_.add_callback<Mixer, &Mixer::param_change_callback>(this, param_id);
 
   init_mixing();
   init_PWM();
+  update_config();
 }
 
 void Mixer::param_change_callback(uint16_t param_id)
@@ -58,13 +202,115 @@ void Mixer::param_change_callback(uint16_t param_id)
   {
   case PARAM_MIXER:
     init_mixing();
+    init_PWM(); // the motor outputs may have moved
     break;
-  default:
+  case PARAM_MOTOR_PWM_SEND_RATE:
+  case PARAM_MOTOR_PROTOCOL:
+  case PARAM_RC_TYPE:
     init_PWM();
     break;
+  case PARAM_MOTOR_MIN_PWM:
+    init_PWM();
+    update_config();
+    break;
+  case Params::BATCH_CHANGED:
+    init_mixing();
+    init_PWM();
+    update_config();
+    break;
+  default:
+    if (param_id >= PARAM_MIXER_CUSTOM_TYPE_0 && param_id <= PARAM_MIXER_CUSTOM_Z_7)
+    {
+      if (RF_.params_.get_param_int(PARAM_MIXER) == CUSTOM)
+        init_mixing();
+    }
+    else
+    {
+      update_config();
+    }
+    break;
   }
 }
 
+void Mixer::update_config()
+{
+  int32_t min_pwm = RF_.params_.get_param_int(PARAM_MOTOR_MIN_PWM);
+  config_.motor_min_pwm = min_pwm;
+  config_.motor_pwm_scale = RF_.params_.get_param_int(PARAM_MOTOR_MAX_PWM) - min_pwm;
+
+  float idle_throttle = RF_.params_.get_param_float(PARAM_MOTOR_IDLE_THROTTLE);
+  config_.motor_armed_min = (RF_.params_.get_param_int(PARAM_SPIN_MOTORS_WHEN_ARMED) && idle_throttle > 0.0f) ?
+                            idle_throttle : 0.0f;
+
+  config_.fixed_wing = RF_.params_.get_param_int(PARAM_FIXED_WING);
+  config_.aileron_sign = RF_.params_.get_param_int(PARAM_AILERON_REVERSE) ? -1.0f : 1.0f;
+  config_.elevator_sign = RF_.params_.get_param_int(PARAM_ELEVATOR_REVERSE) ? -1.0f : 1.0f;
+  config_.rudder_sign = RF_.params_.get_param_int(PARAM_RUDDER_REVERSE) ? -1.0f : 1.0f;
+
+  config_.airmode = RF_.params_.get_param_int(PARAM_MIXER_AIRMODE);
+  float thrust_curve = RF_.params_.get_param_float(PARAM_MOTOR_THRUST_CURVE);
+  config_.thrust_curve = thrust_curve > 0.0f;
+  if (config_.thrust_curve)
+  {
+    update_thrust_curve(thrust_curve);
+  }
+
+  update_pwm_scaling();
+}
+
+void Mixer::update_pwm_scaling()
+{
+  if (mixer_to_use_ == NULL)
+    return;
+
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    if (mixer_to_use_->output_type[i] == M && !config_.digital_motors)
+    {
+      pwm_scale_[i] = config_.motor_pwm_scale;
+      pwm_offset_[i] = config_.motor_min_pwm;
+    }
+    else if (mixer_to_use_->output_type[i] == S)
+    {
+      pwm_scale_[i] = 500.0f;
+      pwm_offset_[i] = 1500.0f;
+    }
+    else
+    {
+      // not a PWM output, or a motor on a digital protocol
+      pwm_scale_[i] = 0.0f;
+      pwm_offset_[i] = -1.0f;
+    }
+  }
+}
+
+void Mixer::update_thrust_curve(float a)
+{
+  // Invert thrust = (1-a)*u + a*u^2 for each entry, in the form 2*thrust / ((1-a) + sqrt((1-a)^2 + 4*a*thrust))
+  // that stays well conditioned for small a
+  thrust_curve_[0] = 0.0f;
+  for (int i = 1; i < THRUST_CURVE_POINTS; i++)
+  {
+    float thrust = static_cast<float>(i)/(THRUST_CURVE_POINTS - 1);
+    float discriminant = (1.0f - a)*(1.0f - a) + 4.0f*a*thrust;
+    float root = discriminant*turbomath::inv_sqrt(discriminant);
+    thrust_curve_[i] = 2.0f*thrust/((1.0f - a) + root);
+  }
+}
+
+float Mixer::thrust_to_command(float thrust) const
+{
+  float position = thrust*(THRUST_CURVE_POINTS - 1);
+  int index = static_cast<int>(position);
+  if (index < 0)
+    return thrust_curve_[0];
+  else if (index >= THRUST_CURVE_POINTS - 1)
+    return thrust_curve_[THRUST_CURVE_POINTS - 1];
+
+  float fraction = position - index;
+  return thrust_curve_[index] + fraction*(thrust_curve_[index + 1] - thrust_curve_[index]);
+}
+
 
 void Mixer::init_mixing()
 {
@@ -82,25 +328,150 @@ void Mixer::init_mixing()
     RF_.state_manager_.set_error(StateManager::ERROR_INVALID_MIXER);
   }
 
-  mixer_to_use_ = array_of_mixers_[mixer_choice];
+  if (mixer_choice == CUSTOM)
+  {
+    if (load_custom_mixer())
+    {
+      mixer_to_use_ = &custom_mixer_;
+    }
+    else
+    {
+      RF_.mavlink_.log(Mavlink::LOG_ERROR, "Invalid Custom Mixer");
+      mixer_to_use_ = array_of_mixers_[0];
+      RF_.state_manager_.set_error(StateManager::ERROR_INVALID_MIXER);
+    }
+  }
+  else
+  {
+    mixer_to_use_ = array_of_mixers_[mixer_choice];
+  }
 
   for (int8_t i=0; i<8; i++)
   {
     raw_outputs_[i] = 0.0f;
     unsaturated_outputs_[i] = 0.0f;
+    motor_inv_F_[i] = (mixer_to_use_->F[i] > 0.0f) ? 1.0f/mixer_to_use_->F[i] : 0.0f;
   }
+  update_pwm_scaling();
+}
+
+bool Mixer::load_custom_mixer()
+{
+  // The params give the effect of each output on the vehicle, E (4x8, rows F, x, y, z). The mixer is its
+  // pseudo-inverse E^T (E E^T)^-1, with a little damping so that an axis no output acts on (e.g. yaw on a
+  // frame without yaw authority) gets an all-zero column instead of a singular matrix.
+  float effect[4][8];
+  bool any_outputs = false;
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    int32_t type = RF_.params_.get_param_int(PARAM_MIXER_CUSTOM_TYPE_0 + i);
+    if (type != NONE && type != S && type != M)
+    {
+      RF_.mavlink_.log(Mavlink::LOG_ERROR, "invalid type %d for custom mixer output %d", type, i);
+      return false;
+    }
+    custom_mixer_.output_type[i] = static_cast<output_type_t>(type);
+    bool actuator = (type == S || type == M);
+    for (uint8_t axis = 0; axis < 4; axis++)
+    {
+      effect[axis][i] = actuator ? RF_.params_.get_param_float(PARAM_MIXER_CUSTOM_F_0 + 8*axis + i) : 0.0f;
+    }
+    any_outputs |= actuator;
+  }
+
+  float A[4][4];
+  float inverse[4][4];
+  float trace = 0.0f;
+  for (uint8_t a = 0; a < 4; a++)
+  {
+    for (uint8_t b = 0; b < 4; b++)
+    {
+      A[a][b] = 0.0f;
+      for (uint8_t i = 0; i < 8; i++)
+        A[a][b] += effect[a][i]*effect[b][i];
+      inverse[a][b] = (a == b) ? 1.0f : 0.0f;
+    }
+    trace += A[a][a];
+  }
+  if (!any_outputs || trace <= 0.0f)
+    return false;
+
+  for (uint8_t a = 0; a < 4; a++)
+    A[a][a] += 1e-6f*trace;
+
+  // Gauss-Jordan elimination, which needs no pivoting since A is symmetric positive definite
+  for (uint8_t k = 0; k < 4; k++)
+  {
+    float pivot = 1.0f/A[k][k];
+    for (uint8_t j = 0; j < 4; j++)
+    {
+      A[k][j] *= pivot;
+      inverse[k][j] *= pivot;
+    }
+    for (uint8_t r = 0; r < 4; r++)
+    {
+      if (r == k)
+        continue;
+      float factor = A[r][k];
+      for (uint8_t j = 0; j < 4; j++)
+      {
+        A[r][j] -= factor*A[k][j];
+        inverse[r][j] -= factor*inverse[k][j];
+      }
+    }
+  }
+
+  // Scale each column so that its largest entry is one, like the built-in mixers, so the gains carry over
+  float *columns[4] = {custom_mixer_.F, custom_mixer_.x, custom_mixer_.y, custom_mixer_.z};
+  for (uint8_t b = 0; b < 4; b++)
+  {
+    float largest = 0.0f;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      columns[b][i] = 0.0f;
+      for (uint8_t a = 0; a < 4; a++)
+        columns[b][i] += effect[a][i]*inverse[a][b];
+      if (turbomath::fabs(columns[b][i]) > largest)
+        largest = turbomath::fabs(columns[b][i]);
+    }
+    float scale = (largest > 0.0f) ? 1.0f/largest : 0.0f;
+    for (uint8_t i = 0; i < 8; i++)
+      columns[b][i] *= scale;
+  }
+  return true;
 }
 
 void Mixer::init_PWM()
 {
+  // SBUS comes in on a UART that shares pins with the parallel PWM inputs, so it needs those off as well
   bool useCPPM = false;
-  if (RF_.params_.get_param_int(PARAM_RC_TYPE) == 1)
+  if (RF_.params_.get_param_int(PARAM_RC_TYPE) != RC_PROTOCOL_PWM)
   {
     useCPPM = true;
   }
   int16_t motor_refresh_rate = RF_.params_.get_param_int(PARAM_MOTOR_PWM_SEND_RATE);
   int16_t off_pwm = RF_.params_.get_param_int(PARAM_MOTOR_MIN_PWM);
   RF_.board_.pwm_init(useCPPM, motor_refresh_rate, off_pwm);
+
+  config_.digital_motors = false;
+  motor_protocol_t protocol = static_cast<motor_protocol_t>(RF_.params_.get_param_int(PARAM_MOTOR_PROTOCOL));
+  if (protocol != MOTOR_PROTOCOL_PWM && mixer_to_use_ != NULL)
+  {
+    uint8_t motor_mask = 0;
+    uint8_t servo_mask = 0;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+      if (mixer_to_use_->output_type[i] == M)
+        motor_mask |= 1 << i;
+      else if (mixer_to_use_->output_type[i] == S)
+        servo_mask |= 1 << i;
+    }
+
+    config_.digital_motors = RF_.board_.motor_init(protocol, motor_refresh_rate, motor_mask, servo_mask);
+    if (!config_.digital_motors)
+      RF_.mavlink_.log(Mavlink::LOG_ERROR, "Motor protocol not supported, using PWM");
+  }
+  update_pwm_scaling();
 }
 
 
@@ -108,18 +479,18 @@ void Mixer::write_motor(uint8_t index, float value)
 {
   if (RF_.state_manager_.state().armed)
   {
-    if (value > 1.0)
+    // the curve maps thrust to a motor command, and the idle is a command, so the curve goes first
+    if (config_.thrust_curve)
     {
-      value = 1.0;
+      value = thrust_to_command(value);
     }
-    else if (value < RF_.params_.get_param_float(PARAM_MOTOR_IDLE_THROTTLE)
-             && RF_.params_.get_param_int(PARAM_SPIN_MOTORS_WHEN_ARMED))
+    if (value > 1.0)
     {
-      value = RF_.params_.get_param_float(PARAM_MOTOR_IDLE_THROTTLE);
+      value = 1.0;
     }
-    else if (value < 0.0)
+    else if (value < config_.motor_armed_min)
     {
-      value = 0.0;
+      value = config_.motor_armed_min;
     }
   }
   else
@@ -127,9 +498,6 @@ void Mixer::write_motor(uint8_t index, float value)
     value = 0.0;
   }
   raw_outputs_[index] = value;
-  int32_t pwm_us = value * (RF_.params_.get_param_int(PARAM_MOTOR_MAX_PWM) - RF_.params_.get_param_int(
-                              PARAM_MOTOR_MIN_PWM)) + RF_.params_.get_param_int(PARAM_MOTOR_MIN_PWM);
-  RF_.board_.pwm_write(index, pwm_us);
 }
 
 
@@ -144,22 +512,58 @@ void Mixer::write_servo(uint8_t index, float value)
     value = -1.0;
   }
   raw_outputs_[index] = value;
-  RF_.board_.pwm_write(index, raw_outputs_[index] * 500 + 1500);
 }
 
 
 void Mixer::mix_output()
 {
-  Controller::Output commands = RF_.controller_.output();
-  float max_output = 1.0f;
+  mix_output(RF_.controller_.output());
+}
+
+void Mixer::mix_output(const Controller::Output& controller_output)
+{
+  Controller::Output commands = controller_output;
 
   // Reverse Fixedwing channels just before mixing if we need to
-  if (RF_.params_.get_param_int(PARAM_FIXED_WING))
+  if (config_.fixed_wing)
+  {
+    commands.x *= config_.aileron_sign;
+    commands.y *= config_.elevator_sign;
+    commands.z *= config_.rudder_sign;
+  }
+
+  if (config_.airmode)
+    mix_airmode(commands);
+  else
+    mix_saturating(commands);
+
+  ROSFLIGHT_TIME_SCOPE(RF_, Profiler::STAGE_MIXER_OUTPUT);
+  for (int8_t i=0; i<8; i++)
+  {
+    // Write output to motors
+    if (mixer_to_use_->output_type[i] == S)
+    {
+      write_servo(i, unsaturated_outputs_[i]);
+    }
+    else if (mixer_to_use_->output_type[i] == M)
+    {
+      write_motor(i, unsaturated_outputs_[i]);
+    }
+  }
+
+  // Send everything in one batch, so that all of the outputs change on the same frame
+  for (int8_t i=0; i<8; i++)
   {
-    commands.x *= RF_.params_.get_param_int(PARAM_AILERON_REVERSE) ? -1 : 1;
-    commands.y *= RF_.params_.get_param_int(PARAM_ELEVATOR_REVERSE) ? -1 : 1;
-    commands.z *= RF_.params_.get_param_int(PARAM_RUDDER_REVERSE) ? -1 : 1;
+    pwm_outputs_[i] = raw_outputs_[i]*pwm_scale_[i] + pwm_offset_[i];
   }
+  RF_.board_.pwm_write_multi(pwm_outputs_, 8);
+  if (config_.digital_motors)
+    RF_.board_.motor_write(raw_outputs_, 8);
+}
+
+void Mixer::mix_saturating(const Controller::Output& commands)
+{
+  float max_output = 1.0f;
 
   for (int8_t i=0; i<8; i++)
   {
@@ -184,20 +588,110 @@ void Mixer::mix_output()
     scale_factor = 1.0/max_output;
   }
 
+  // scale all motor outputs by scale factor (this is usually 1.0, unless we saturated)
+  for (int8_t i=0; i<8; i++)
+  {
+    if (mixer_to_use_->output_type[i] == M)
+    {
+      unsaturated_outputs_[i] *= scale_factor;
+    }
+  }
+}
 
+void Mixer::mix_airmode(const Controller::Output& commands)
+{
+  const mixer_t& mixer = *mixer_to_use_;
+  const float motor_min = config_.motor_armed_min;
+  const float motor_range = 1.0f - motor_min;
 
+  // Split the motor outputs into roll/pitch and yaw torque, and find how far the roll/pitch part spreads
+  // across the motors. Servos get the plain matrix multiply.
+  float roll_pitch[8];
+  float yaw[8];
+  float rp_min = 1.0e9f;
+  float rp_max = -1.0e9f;
   for (int8_t i=0; i<8; i++)
   {
-    // Write output to motors
-    if (mixer_to_use_->output_type[i] == S)
+    if (mixer.output_type[i] == M)
     {
-      write_servo(i, unsaturated_outputs_[i]);
+      roll_pitch[i] = commands.x*mixer.x[i] + commands.y*mixer.y[i];
+      yaw[i] = commands.z*mixer.z[i];
+      if (roll_pitch[i] < rp_min)
+        rp_min = roll_pitch[i];
+      if (roll_pitch[i] > rp_max)
+        rp_max = roll_pitch[i];
     }
-    else if (mixer_to_use_->output_type[i] == M)
+    else if (mixer.output_type[i] == S)
     {
-      // scale all motor outputs by scale factor (this is usually 1.0, unless we saturated)
-      unsaturated_outputs_[i] *= scale_factor;
-      write_motor(i, unsaturated_outputs_[i]);
+      unsaturated_outputs_[i] = (commands.F*mixer.F[i] + commands.x*mixer.x[i] +
+                                 commands.y*mixer.y[i] + commands.z*mixer.z[i]);
+    }
+  }
+
+  // Roll and pitch come first: they are only scaled down if they alone don't fit in the motor range
+  float rp_scale = 1.0f;
+  float rp_spread = rp_max - rp_min;
+  if (rp_spread > motor_range)
+  {
+    rp_scale = motor_range/rp_spread;
+    rp_spread = motor_range;
+  }
+
+  // Yaw gets whatever range is left. The spread is convex in the yaw scale, so interpolating between the
+  // roll/pitch spread and the full spread gives a scale that is guaranteed to fit.
+  float torque_min = 1.0e9f;
+  float torque_max = -1.0e9f;
+  for (int8_t i=0; i<8; i++)
+  {
+    if (mixer.output_type[i] == M)
+    {
+      float torque = rp_scale*roll_pitch[i] + yaw[i];
+      if (torque < torque_min)
+        torque_min = torque;
+      if (torque > torque_max)
+        torque_max = torque;
+    }
+  }
+  float yaw_scale = 1.0f;
+  float torque_spread = torque_max - torque_min;
+  if (torque_spread > motor_range)
+  {
+    yaw_scale = (motor_range - rp_spread)/(torque_spread - rp_spread);
+  }
+
+  // Thrust goes last, shifted up or down as far as it takes to keep every motor in range
+  float thrust_min = -1.0e9f;
+  float thrust_max = 1.0e9f;
+  for (int8_t i=0; i<8; i++)
+  {
+    if (mixer.output_type[i] == M)
+    {
+      unsaturated_outputs_[i] = rp_scale*roll_pitch[i] + yaw_scale*yaw[i];
+      if (mixer.F[i] > 0.0f)
+      {
+        float lower = (motor_min - unsaturated_outputs_[i])*motor_inv_F_[i];
+        float upper = (1.0f - unsaturated_outputs_[i])*motor_inv_F_[i];
+        if (lower > thrust_min)
+          thrust_min = lower;
+        if (upper < thrust_max)
+          thrust_max = upper;
+      }
+    }
+  }
+
+  float thrust = commands.F;
+  if (thrust_min > thrust_max)
+    thrust = 0.5f*(thrust_min + thrust_max);
+  else if (thrust < thrust_min)
+    thrust = thrust_min;
+  else if (thrust > thrust_max)
+    thrust = thrust_max;
+
+  for (int8_t i=0; i<8; i++)
+  {
+    if (mixer.output_type[i] == M)
+    {
+      unsaturated_outputs_[i] += thrust*mixer.F[i];
     }
   }
 }
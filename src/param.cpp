@@ -34,6 +34,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 
 #include "board.h"
 #include "mavlink.h"
@@ -46,275 +47,463 @@
 namespace rosflight_firmware
 {
 
-Params::Params(ROSflight& _rf) :
-  RF_(_rf)
-{
-  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
-    callbacks[id] = NULL;
-}
-
-// local function definitions
-void Params::init_param_int(uint16_t id, const char name[PARAMS_NAME_LENGTH], int32_t value)
-{
-  memcpy(params.names[id], name, PARAMS_NAME_LENGTH);
-  params.values[id].ivalue = value;
-  params.types[id] = PARAM_TYPE_INT32;
-}
-
-void Params::init_param_float(uint16_t id, const char name[PARAMS_NAME_LENGTH], float value)
-{
-  memcpy(params.names[id], name, PARAMS_NAME_LENGTH);
-  params.values[id].fvalue = value;
-  params.types[id] = PARAM_TYPE_FLOAT;
-}
+// Compile-time table of every parameter, in ID order: ID, name, default value, then the min and max used
+// by the documentation and ground station. param_parser.py generates the parameter reference from it.
+#define PARAM_INT(id, name, value, min, max) \
+  { id, name, PARAM_TYPE_INT32, Params::param_value_t(static_cast<int32_t>(value)), \
+    static_cast<float>(min), static_cast<float>(max) }
+#define PARAM_FLOAT(id, name, value, min, max) \
+  { id, name, PARAM_TYPE_FLOAT, Params::param_value_t(static_cast<float>(value)), \
+    static_cast<float>(min), static_cast<float>(max) }
 
-uint8_t Params::compute_checksum(void)
-{
-  uint8_t chk = 0;
-  const char *p;
-
-  for (p = reinterpret_cast<const char *>(&params.values); p < reinterpret_cast<const char *>(&params.values) + 4*PARAMS_COUNT; p++)
-    chk ^= *p;
-  for (p = reinterpret_cast<const char *>(&params.names); p < reinterpret_cast<const char *>(&params.names) + PARAMS_COUNT*PARAMS_NAME_LENGTH; p++)
-    chk ^= *p;
-  for (p = reinterpret_cast<const char *>(&params.types); p < reinterpret_cast<const char *>(&params.types) + PARAMS_COUNT; p++)
-    chk ^= *p;
-
-  return chk;
-}
-
-
-// function definitions
-void Params::init()
-{
-  RF_.board_.memory_init();
-  if (!read())
-  {
-    set_defaults();
-    write();
-  }
-}
-
-void Params::set_defaults(void)
+static constexpr Params::param_info_t param_table[] =
 {
   /******************************/
   /*** HARDWARE CONFIGURATION ***/
   /******************************/
-  init_param_int(PARAM_BAUD_RATE, "BAUD_RATE", 921600); // Baud rate of MAVlink communication with onboard computer | 9600 | 921600
+  PARAM_INT(PARAM_BAUD_RATE, "BAUD_RATE", 921600, 9600, 921600), // Baud rate of MAVlink communication with onboard computer
 
   /*****************************/
   /*** MAVLINK CONFIGURATION ***/
   /*****************************/
-  init_param_int(PARAM_SYSTEM_ID, "SYS_ID", 1); // Mavlink System ID  | 1 | 255
-  init_param_int(PARAM_STREAM_HEARTBEAT_RATE, "STRM_HRTBT", 1); // Rate of heartbeat streaming (Hz) | 0 | 1000
-  init_param_int(PARAM_STREAM_STATUS_RATE, "STRM_STATUS", 10); // Rate of status streaming (Hz) | 0 | 1000
-
-  init_param_int(PARAM_STREAM_ATTITUDE_RATE, "STRM_ATTITUDE", 200); // Rate of attitude stream (Hz) | 0 | 1000
-  init_param_int(PARAM_STREAM_IMU_RATE, "STRM_IMU", 500); // Rate of IMU stream (Hz) | 0 | 1000
-  init_param_int(PARAM_STREAM_MAG_RATE, "STRM_MAG", 50); // Rate of magnetometer stream (Hz) | 0 | 75
-  init_param_int(PARAM_STREAM_BARO_RATE, "STRM_BARO", 50); // Rate of barometer stream (Hz) | 0 | 100
-  init_param_int(PARAM_STREAM_AIRSPEED_RATE, "STRM_AIRSPEED", 20); // Rate of airspeed stream (Hz) | 0 |  50
-  init_param_int(PARAM_STREAM_SONAR_RATE, "STRM_SONAR", 40); // Rate of sonar stream (Hz) | 0 | 40
+  PARAM_INT(PARAM_SYSTEM_ID, "SYS_ID", 1, 1, 255), // Mavlink System ID
+  PARAM_INT(PARAM_MAVLINK_VERSION, "MAVLINK_VER", 1, 1, 2), // MAVLink framing of the messages sent, 1 or 2 (payloads without trailing zeros); both are always received
+  PARAM_INT(PARAM_STREAM_HEARTBEAT_RATE, "STRM_HRTBT", 1, 0, 1000), // Rate of heartbeat streaming (Hz)
+  PARAM_INT(PARAM_STREAM_STATUS_RATE, "STRM_STATUS", 10, 0, 1000), // Rate of status streaming (Hz)
+
+  PARAM_INT(PARAM_STREAM_ATTITUDE_RATE, "STRM_ATTITUDE", 200, 0, 1000), // Rate of attitude stream (Hz)
+  PARAM_INT(PARAM_STREAM_IMU_RATE, "STRM_IMU", 500, 0, 1000), // Rate of IMU stream (Hz)
+  PARAM_INT(PARAM_STREAM_MAG_RATE, "STRM_MAG", 50, 0, 75), // Rate of magnetometer stream (Hz)
+  PARAM_INT(PARAM_STREAM_BARO_RATE, "STRM_BARO", 50, 0, 100), // Rate of barometer stream (Hz)
+  PARAM_INT(PARAM_STREAM_AIRSPEED_RATE, "STRM_AIRSPEED", 20, 0, 50), // Rate of airspeed stream (Hz)
+  PARAM_INT(PARAM_STREAM_SONAR_RATE, "STRM_SONAR", 40, 0, 40), // Rate of sonar stream (Hz)
+
+  PARAM_INT(PARAM_STREAM_OUTPUT_RAW_RATE, "STRM_SERVO", 50, 0, 490), // Rate of raw output stream
+  PARAM_INT(PARAM_STREAM_RC_RAW_RATE, "STRM_RC", 50, 0, 50), // Rate of raw RC input stream
+  PARAM_INT(PARAM_STREAM_PROFILER_RATE, "STRM_PROFILER", 0, 0, 100), // Rate of loop timing profiler stream, one stage per message (Hz)
+  PARAM_INT(PARAM_STREAM_IMU_BATCH_RATE, "STRM_IMU_BATCH", 0, 0, 1000), // Rate at which full-rate IMU samples are flushed as batched frames, 17 samples per frame (Hz)
+  PARAM_INT(PARAM_STREAM_TELEMETRY_RATE, "STRM_TELEM", 0, 0, 1000), // Rate of IMU and attitude samples in the compact delta-encoded telemetry stream, about 20 per frame (Hz)
+  PARAM_INT(PARAM_STREAM_GYRO_PEAKS_RATE, "STRM_GYRO_PEAK", 0, 0, 50), // Rate of the gyro spectrum analyzer peak frequency stream (Hz)
+  PARAM_INT(PARAM_STREAM_TIMESYNC_RATE, "STRM_TIMESYNC", 0, 0, 100), // Rate of TIMESYNC requests to the companion computer (Hz), once synchronized IMU timestamps are sent in its time
+
+  PARAM_INT(PARAM_STREAM_ADAPTIVE, "STRM_ADAPTIVE", 0, 0, 1), // Automatically slow down streams, lowest priority first, to fit the link bandwidth given by BAUD_RATE
+  PARAM_FLOAT(PARAM_STREAM_BANDWIDTH_FRACTION, "STRM_BW_FRAC", 0.8f, 0.0, 1.0), // Fraction of the link bandwidth available to streams when STRM_ADAPTIVE is set
 
-  init_param_int(PARAM_STREAM_OUTPUT_RAW_RATE, "STRM_SERVO", 50); // Rate of raw output stream | 0 |  490
-  init_param_int(PARAM_STREAM_RC_RAW_RATE, "STRM_RC", 50); // Rate of raw RC input stream | 0 | 50
+  /******************************/
+  /*** BLACKBOX CONFIGURATION ***/
+  /******************************/
+  PARAM_INT(PARAM_BLACKBOX, "BLACKBOX", false, 0, 1), // Log flight data to the on-board flash while armed
+  PARAM_INT(PARAM_BLACKBOX_RATE_DIV, "BLACKBOX_DIV", 2, 1, 1000), // Number of control updates per blackbox frame
 
   /********************************/
   /*** CONTROLLER CONFIGURATION ***/
   /********************************/
-  init_param_float(PARAM_MAX_COMMAND, "PARAM_MAX_CMD", 1.0); // saturation point for PID controller output | 0 | 1.0
+  PARAM_FLOAT(PARAM_MAX_COMMAND, "PARAM_MAX_CMD", 1.0, 0, 1.0), // saturation point for PID controller output
 
-  init_param_float(PARAM_PID_ROLL_RATE_P, "PID_ROLL_RATE_P", 0.070f); // Roll Rate Proportional Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_ROLL_RATE_I, "PID_ROLL_RATE_I", 0.000f); // Roll Rate Integral Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_ROLL_RATE_D, "PID_ROLL_RATE_D", 0.000f); // Rall Rate Derivative Gain | 0.0 | 1000.0
+  PARAM_FLOAT(PARAM_PID_ROLL_RATE_P, "PID_ROLL_RATE_P", 0.070f, 0.0, 1000.0), // Roll Rate Proportional Gain
+  PARAM_FLOAT(PARAM_PID_ROLL_RATE_I, "PID_ROLL_RATE_I", 0.000f, 0.0, 1000.0), // Roll Rate Integral Gain
+  PARAM_FLOAT(PARAM_PID_ROLL_RATE_D, "PID_ROLL_RATE_D", 0.000f, 0.0, 1000.0), // Rall Rate Derivative Gain
 
-  init_param_float(PARAM_PID_PITCH_RATE_P, "PID_PITCH_RATE_P", 0.070f);  // Pitch Rate Proporitional Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_PITCH_RATE_I, "PID_PITCH_RATE_I", 0.0000f); // Pitch Rate Integral Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_PITCH_RATE_D, "PID_PITCH_RATE_D", 0.0000f); // Pitch Rate Derivative Gain | 0.0 | 1000.0
+  PARAM_FLOAT(PARAM_PID_PITCH_RATE_P, "PID_PITCH_RATE_P", 0.070f, 0.0, 1000.0), // Pitch Rate Proporitional Gain
+  PARAM_FLOAT(PARAM_PID_PITCH_RATE_I, "PID_PITCH_RATE_I", 0.0000f, 0.0, 1000.0), // Pitch Rate Integral Gain
+  PARAM_FLOAT(PARAM_PID_PITCH_RATE_D, "PID_PITCH_RATE_D", 0.0000f, 0.0, 1000.0), // Pitch Rate Derivative Gain
 
-  init_param_float(PARAM_PID_YAW_RATE_P, "PID_YAW_RATE_P", 0.25f);   // Yaw Rate Proporitional Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_YAW_RATE_I, "PID_YAW_RATE_I", 0.0f);  // Yaw Rate Integral Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_YAW_RATE_D, "PID_YAW_RATE_D", 0.0f);  // Yaw Rate Derivative Gain | 0.0 | 1000.0
+  PARAM_FLOAT(PARAM_PID_YAW_RATE_P, "PID_YAW_RATE_P", 0.25f, 0.0, 1000.0), // Yaw Rate Proporitional Gain
+  PARAM_FLOAT(PARAM_PID_YAW_RATE_I, "PID_YAW_RATE_I", 0.0f, 0.0, 1000.0), // Yaw Rate Integral Gain
+  PARAM_FLOAT(PARAM_PID_YAW_RATE_D, "PID_YAW_RATE_D", 0.0f, 0.0, 1000.0), // Yaw Rate Derivative Gain
 
-  init_param_float(PARAM_PID_ROLL_ANGLE_P, "PID_ROLL_ANG_P", 0.15f);   // Roll Angle Proporitional Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_ROLL_ANGLE_I, "PID_ROLL_ANG_I", 0.0f);   // Roll Angle Integral Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_ROLL_ANGLE_D, "PID_ROLL_ANG_D", 0.05f);  // Roll Angle Derivative Gain | 0.0 | 1000.0
+  PARAM_FLOAT(PARAM_PID_ROLL_ANGLE_P, "PID_ROLL_ANG_P", 0.15f, 0.0, 1000.0), // Roll Angle Proporitional Gain
+  PARAM_FLOAT(PARAM_PID_ROLL_ANGLE_I, "PID_ROLL_ANG_I", 0.0f, 0.0, 1000.0), // Roll Angle Integral Gain
+  PARAM_FLOAT(PARAM_PID_ROLL_ANGLE_D, "PID_ROLL_ANG_D", 0.05f, 0.0, 1000.0), // Roll Angle Derivative Gain
 
-  init_param_float(PARAM_PID_PITCH_ANGLE_P, "PID_PITCH_ANG_P", 0.15f);  // Pitch Angle Proporitional Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_PITCH_ANGLE_I, "PID_PITCH_ANG_I", 0.0f);  // Pitch Angle Integral Gain | 0.0 | 1000.0
-  init_param_float(PARAM_PID_PITCH_ANGLE_D, "PID_PITCH_ANG_D", 0.05f); // Pitch Angle Derivative Gain | 0.0 | 1000.0
+  PARAM_FLOAT(PARAM_PID_PITCH_ANGLE_P, "PID_PITCH_ANG_P", 0.15f, 0.0, 1000.0), // Pitch Angle Proporitional Gain
+  PARAM_FLOAT(PARAM_PID_PITCH_ANGLE_I, "PID_PITCH_ANG_I", 0.0f, 0.0, 1000.0), // Pitch Angle Integral Gain
+  PARAM_FLOAT(PARAM_PID_PITCH_ANGLE_D, "PID_PITCH_ANG_D", 0.05f, 0.0, 1000.0), // Pitch Angle Derivative Gain
 
-  init_param_float(PARAM_X_EQ_TORQUE, "X_EQ_TORQUE", 0.0f); // Equilibrium torque added to output of controller on x axis | -1.0 | 1.0
-  init_param_float(PARAM_Y_EQ_TORQUE, "Y_EQ_TORQUE", 0.0f); // Equilibrium torque added to output of controller on y axis | -1.0 | 1.0
-  init_param_float(PARAM_Z_EQ_TORQUE, "Z_EQ_TORQUE", 0.0f); // Equilibrium torque added to output of controller on z axis | -1.0 | 1.0
+  PARAM_FLOAT(PARAM_X_EQ_TORQUE, "X_EQ_TORQUE", 0.0f, -1.0, 1.0), // Equilibrium torque added to output of controller on x axis
+  PARAM_FLOAT(PARAM_Y_EQ_TORQUE, "Y_EQ_TORQUE", 0.0f, -1.0, 1.0), // Equilibrium torque added to output of controller on y axis
+  PARAM_FLOAT(PARAM_Z_EQ_TORQUE, "Z_EQ_TORQUE", 0.0f, -1.0, 1.0), // Equilibrium torque added to output of controller on z axis
 
-  init_param_float(PARAM_PID_TAU, "PID_TAU", 0.05f); // Dirty Derivative time constant - See controller documentation | 0.0 | 1.0
+  PARAM_FLOAT(PARAM_PID_TAU, "PID_TAU", 0.05f, 0.0, 1.0), // Dirty Derivative time constant - See controller documentation
+  PARAM_FLOAT(PARAM_PID_ROLL_FF, "PID_ROLL_FF", 0.0f, 0.0, 1000.0), // Roll Rate Feed-Forward Gain, applied to the rate setpoint
+  PARAM_FLOAT(PARAM_PID_PITCH_FF, "PID_PITCH_FF", 0.0f, 0.0, 1000.0), // Pitch Rate Feed-Forward Gain, applied to the rate setpoint
+  PARAM_FLOAT(PARAM_PID_YAW_FF, "PID_YAW_FF", 0.0f, 0.0, 1000.0), // Yaw Rate Feed-Forward Gain, applied to the rate setpoint
+  PARAM_FLOAT(PARAM_PID_DTERM_LPF_HZ, "PID_DTERM_LPF", 0.0f, 0.0, 1000.0), // Cutoff of the biquad low-pass filter on the rate loop derivatives (Hz, 0 to disable)
+  PARAM_FLOAT(PARAM_PID_ANTIWINDUP_TAU, "PID_AW_TAU", 0.0f, 0.0, 10.0), // Time constant of the back-calculation anti-windup (s, 0 to unwind within one step)
+  PARAM_FLOAT(PARAM_CONTROL_PERIOD_TOLERANCE, "CTRL_DT_TOL", 0.5f, 0.0, 10.0), // Fraction by which a control update may be later than 1/IMU_RATE before it is logged and skips the integrators
 
 
   /*************************/
   /*** PWM CONFIGURATION ***/
   /*************************/
-  init_param_int(PARAM_MOTOR_PWM_SEND_RATE, "MOTOR_PWM_UPDATE", 490); // Refresh rate of motor commands to motors - See motor documentation | 0 | 1000
-  init_param_float(PARAM_MOTOR_IDLE_THROTTLE, "MOTOR_IDLE_THR", 0.1); // min throttle command sent to motors when armed (Set above 0.1 to spin when armed) | 0.0 | 1.0
-  init_param_float(PARAM_FAILSAFE_THROTTLE, "FAILSAFE_THR", 0.3); // Throttle sent to motors in failsafe condition (set just below hover throttle) | 0.0 | 1.0
-  init_param_int(PARAM_MOTOR_MIN_PWM, "MOTOR_MIN_PWM", 1000); // PWM value sent to motor ESCs at zero throttle | 1000 | 2000
-  init_param_int(PARAM_MOTOR_MAX_PWM, "MOTOR_MAX_PWM", 2000); // PWM value sent to motor ESCs at full throttle | 1000 | 2000
-  init_param_int(PARAM_SPIN_MOTORS_WHEN_ARMED, "ARM_SPIN_MOTORS", true); // Enforce MOTOR_IDLE_THR | 0 | 1
+  PARAM_INT(PARAM_MOTOR_PWM_SEND_RATE, "MOTOR_PWM_UPDATE", 490, 0, 1000), // Refresh rate of motor commands to motors - See motor documentation
+  PARAM_FLOAT(PARAM_MOTOR_IDLE_THROTTLE, "MOTOR_IDLE_THR", 0.1, 0.0, 1.0), // min throttle command sent to motors when armed (Set above 0.1 to spin when armed)
+  PARAM_FLOAT(PARAM_FAILSAFE_THROTTLE, "FAILSAFE_THR", 0.3, 0.0, 1.0), // Throttle sent to motors in failsafe condition (set just below hover throttle)
+  PARAM_INT(PARAM_MOTOR_MAX_PWM, "MOTOR_MAX_PWM", 2000, 1000, 2000), // PWM value sent to motor ESCs at full throttle
+  PARAM_INT(PARAM_MOTOR_MIN_PWM, "MOTOR_MIN_PWM", 1000, 1000, 2000), // PWM value sent to motor ESCs at zero throttle
+  PARAM_INT(PARAM_SPIN_MOTORS_WHEN_ARMED, "ARM_SPIN_MOTORS", true, 0, 1), // Enforce MOTOR_IDLE_THR
+  PARAM_FLOAT(PARAM_MOTOR_THRUST_CURVE, "MOTOR_THR_CURVE", 0.0f, 0.0f, 1.0f), // Quadratic part of the motor thrust curve, thrust = (1-a)*u + a*u^2 (0: linear)
+  PARAM_INT(PARAM_MOTOR_PROTOCOL, "MOTOR_PROTOCOL", MOTOR_PROTOCOL_PWM, 0, MOTOR_PROTOCOL_COUNT - 1), // ESC protocol (0: PWM, 1: OneShot125, 2: Multishot, 3: DShot150, 4: DShot300, 5: DShot600)
 
   /*******************************/
   /*** ESTIMATOR CONFIGURATION ***/
   /*******************************/
-  init_param_int(PARAM_INIT_TIME, "FILTER_INIT_T", 3000); // Time in ms to initialize estimator | 0 | 100000
-  init_param_float(PARAM_FILTER_KP, "FILTER_KP", 0.5f); // estimator proportional gain - See estimator documentation | 0 | 10.0
-  init_param_float(PARAM_FILTER_KI, "FILTER_KI", 0.05f); // estimator integral gain - See estimator documentation | 0 | 1.0
-
-  init_param_int(PARAM_FILTER_USE_QUAD_INT, "FILTER_QUAD_INT", 1); // Perform a quadratic averaging of LPF gyro data prior to integration (adds ~20 us to estimation loop on F1 processors) | 0 | 1
-  init_param_int(PARAM_FILTER_USE_MAT_EXP, "FILTER_MAT_EXP", 1); // 1 - Use matrix exponential to improve gyro integration (adds ~90 us to estimation loop in F1 processors) 0 - use euler integration | 0 | 1
-  init_param_int(PARAM_FILTER_USE_ACC, "FILTER_USE_ACC", 1);  // Use accelerometer to correct gyro integration drift (adds ~70 us to estimation loop) | 0 | 1
-
-  init_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, "CAL_GYRO_ARM", false); // True if desired to calibrate gyros on arm | 0 | 1
-
-  init_param_float(PARAM_GYRO_ALPHA, "GYRO_LPF_ALPHA", 0.3f); // Low-pass filter constant - See estimator documentation | 0 | 1.0
-  init_param_float(PARAM_ACC_ALPHA, "ACC_LPF_ALPHA", 0.5f); // Low-pass filter constant - See estimator documentation | 0 | 1.0
-
-  init_param_float(PARAM_GYRO_X_BIAS, "GYRO_X_BIAS", 0.0f); // Constant x-bias of gyroscope readings | -1.0 | 1.0
-  init_param_float(PARAM_GYRO_Y_BIAS, "GYRO_Y_BIAS", 0.0f); // Constant y-bias of gyroscope readings | -1.0 | 1.0
-  init_param_float(PARAM_GYRO_Z_BIAS, "GYRO_Z_BIAS", 0.0f); // Constant z-bias of gyroscope readings | -1.0 | 1.0
-  init_param_float(PARAM_ACC_X_BIAS,  "ACC_X_BIAS", 0.0f); // Constant x-bias of accelerometer readings | -2.0 | 2.0
-  init_param_float(PARAM_ACC_Y_BIAS,  "ACC_Y_BIAS", 0.0f); // Constant y-bias of accelerometer readings | -2.0 | 2.0
-  init_param_float(PARAM_ACC_Z_BIAS,  "ACC_Z_BIAS", 0.0f); // Constant z-bias of accelerometer readings | -2.0 | 2.0
-  init_param_float(PARAM_ACC_X_TEMP_COMP,  "ACC_X_TEMP_COMP", 0.0f); // Linear x-axis temperature compensation constant | -2.0 | 2.0
-  init_param_float(PARAM_ACC_Y_TEMP_COMP,  "ACC_Y_TEMP_COMP", 0.0f); // Linear y-axis temperature compensation constant | -2.0 | 2.0
-  init_param_float(PARAM_ACC_Z_TEMP_COMP,  "ACC_Z_TEMP_COMP", 0.0f); // Linear z-axis temperature compensation constant | -2.0 | 2.0
-
-  init_param_float(PARAM_MAG_A11_COMP,  "MAG_A11_COMP", 1.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A12_COMP,  "MAG_A12_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A13_COMP,  "MAG_A13_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A21_COMP,  "MAG_A21_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A22_COMP,  "MAG_A22_COMP", 1.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A23_COMP,  "MAG_A23_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A31_COMP,  "MAG_A31_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A32_COMP,  "MAG_A32_COMP", 0.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_A33_COMP,  "MAG_A33_COMP", 1.0f); // Soft iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_X_BIAS,  "MAG_X_BIAS", 0.0f); // Hard iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_Y_BIAS,  "MAG_Y_BIAS", 0.0f); // Hard iron compensation constant | -999.0 | 999.0
-  init_param_float(PARAM_MAG_Z_BIAS,  "MAG_Z_BIAS", 0.0f); // Hard iron compensation constant | -999.0 | 999.0
-
-  init_param_float(PARAM_BARO_BIAS, "BARO_BIAS", 0.0f); // Barometer measurement bias (Pa) | 0 | inf
-  init_param_float(PARAM_GROUND_LEVEL, "GROUND_LEVEL", 1387.0f); // Altitude of ground level (m) | -1000 | 10000
-
-  init_param_float(PARAM_DIFF_PRESS_BIAS, "DIFF_PRESS_BIAS", 0.0f); // Differential Pressure Bias (Pa) | -10 | 10
+  PARAM_INT(PARAM_INIT_TIME, "FILTER_INIT_T", 3000, 0, 100000), // Time in ms to initialize estimator
+  PARAM_FLOAT(PARAM_FILTER_KP, "FILTER_KP", 0.5f, 0, 10.0), // estimator proportional gain - See estimator documentation
+  PARAM_FLOAT(PARAM_FILTER_KI, "FILTER_KI", 0.05f, 0, 1.0), // estimator integral gain - See estimator documentation
+
+  PARAM_INT(PARAM_FILTER_USE_QUAD_INT, "FILTER_QUAD_INT", 1, 0, 1), // Perform a quadratic averaging of LPF gyro data prior to integration (adds ~20 us to estimation loop on F1 processors)
+  PARAM_INT(PARAM_FILTER_USE_MAT_EXP, "FILTER_MAT_EXP", 1, 0, 1), // 1 - Use matrix exponential to improve gyro integration (about the cost of euler integration at normal loop rates) 0 - use euler integration
+  PARAM_INT(PARAM_FILTER_USE_ACC, "FILTER_USE_ACC", 1, 0, 1), // Use accelerometer to correct gyro integration drift (adds ~70 us to estimation loop)
+  PARAM_INT(PARAM_FILTER_UPDATE_RATE, "FILTER_UPD_RATE", 0, 0, 8000), // Rate (Hz) of the full attitude update when gyro samples are pre-integrated with coning correction in between (0 - full update on every IMU sample)
+
+  PARAM_INT(PARAM_CALIBRATE_GYRO_ON_ARM, "CAL_GYRO_ARM", false, 0, 1), // True if desired to calibrate gyros on arm
+
+  PARAM_FLOAT(PARAM_GYRO_ALPHA, "GYRO_LPF_ALPHA", 0.3f, 0, 1.0), // Low-pass filter constant - See estimator documentation
+  PARAM_FLOAT(PARAM_ACC_ALPHA, "ACC_LPF_ALPHA", 0.5f, 0, 1.0), // Low-pass filter constant - See estimator documentation
+
+  PARAM_INT(PARAM_IMU_SAMPLE_RATE, "IMU_RATE", 1000, 100, 8000), // Nominal IMU sample rate (Hz), which is also the control loop rate, used to compute the IMU and controller filter coefficients
+  PARAM_FLOAT(PARAM_GYRO_LPF_HZ, "GYRO_LPF_HZ", 0.0f, 0.0, 4000.0), // Cutoff frequency (Hz) of the first biquad low-pass filter on the gyro (0 - disabled)
+  PARAM_FLOAT(PARAM_GYRO_LPF2_HZ, "GYRO_LPF2_HZ", 0.0f, 0.0, 4000.0), // Cutoff frequency (Hz) of the second, cascaded biquad low-pass filter on the gyro (0 - disabled)
+  PARAM_FLOAT(PARAM_ACC_LPF_HZ, "ACC_LPF_HZ", 0.0f, 0.0, 4000.0), // Cutoff frequency (Hz) of the biquad low-pass filter on the accelerometer (0 - disabled)
+  PARAM_FLOAT(PARAM_GYRO_NOTCH_HZ, "GYRO_NOTCH_HZ", 0.0f, 0.0, 4000.0), // Center frequency (Hz) of the static gyro notch filter (0 - disabled)
+  PARAM_FLOAT(PARAM_GYRO_NOTCH_Q, "GYRO_NOTCH_Q", 3.0f, 0.1, 100.0), // Quality factor of the static gyro notch filter (center frequency / bandwidth)
+  PARAM_INT(PARAM_GYRO_DYN_NOTCH, "GYRO_DNOTCH", false, 0, 1), // Enable the dynamic gyro notch filter, whose center frequency is set at run time (e.g. from motor RPM)
+  PARAM_FLOAT(PARAM_GYRO_DYN_NOTCH_Q, "GYRO_DNOTCH_Q", 3.0f, 0.1, 100.0), // Quality factor of the dynamic gyro notch filter (center frequency / bandwidth)
+  PARAM_FLOAT(PARAM_GYRO_DYN_NOTCH_MIN_HZ, "GYRO_DNOTCH_MIN", 80.0f, 0.0, 4000.0), // Lowest center frequency (Hz) of the dynamic gyro notch filter, it is bypassed below this
+
+  PARAM_INT(PARAM_GYRO_ANALYZER, "GYRO_ANLZ", false, 0, 1), // Run the gyro spectrum analyzer in idle loop time
+  PARAM_FLOAT(PARAM_GYRO_ANALYZER_MIN_HZ, "GYRO_ANLZ_MIN", 60.0f, 0.0, 4000.0), // Lowest frequency (Hz) searched by the gyro spectrum analyzer
+  PARAM_FLOAT(PARAM_GYRO_ANALYZER_MAX_HZ, "GYRO_ANLZ_MAX", 400.0f, 0.0, 4000.0), // Highest frequency (Hz) searched by the gyro spectrum analyzer, capped just below half of IMU_RATE
+  PARAM_INT(PARAM_GYRO_ANALYZER_NOTCH, "GYRO_ANLZ_NOTCH", false, 0, 1), // Set the dynamic gyro notch frequency to the strongest peak found by the gyro spectrum analyzer
+
+  PARAM_FLOAT(PARAM_GYRO_X_BIAS, "GYRO_X_BIAS", 0.0f, -1.0, 1.0), // Constant x-bias of gyroscope readings
+  PARAM_FLOAT(PARAM_GYRO_Y_BIAS, "GYRO_Y_BIAS", 0.0f, -1.0, 1.0), // Constant y-bias of gyroscope readings
+  PARAM_FLOAT(PARAM_GYRO_Z_BIAS, "GYRO_Z_BIAS", 0.0f, -1.0, 1.0), // Constant z-bias of gyroscope readings
+  PARAM_FLOAT(PARAM_ACC_X_BIAS, "ACC_X_BIAS", 0.0f, -2.0, 2.0), // Constant x-bias of accelerometer readings
+  PARAM_FLOAT(PARAM_ACC_Y_BIAS, "ACC_Y_BIAS", 0.0f, -2.0, 2.0), // Constant y-bias of accelerometer readings
+  PARAM_FLOAT(PARAM_ACC_Z_BIAS, "ACC_Z_BIAS", 0.0f, -2.0, 2.0), // Constant z-bias of accelerometer readings
+  PARAM_FLOAT(PARAM_ACC_X_TEMP_COMP, "ACC_X_TEMP_COMP", 0.0f, -2.0, 2.0), // Linear x-axis temperature compensation constant
+  PARAM_FLOAT(PARAM_ACC_Y_TEMP_COMP, "ACC_Y_TEMP_COMP", 0.0f, -2.0, 2.0), // Linear y-axis temperature compensation constant
+  PARAM_FLOAT(PARAM_ACC_Z_TEMP_COMP, "ACC_Z_TEMP_COMP", 0.0f, -2.0, 2.0), // Linear z-axis temperature compensation constant
+  PARAM_INT(PARAM_IMU_ONLINE_CAL, "IMU_ONLINE_CAL", false, 0, 1), // Learn the gyro bias over temperature whenever the vehicle sits still while disarmed, in place of GYRO_*_BIAS
+
+  PARAM_FLOAT(PARAM_MAG_A11_COMP, "MAG_A11_COMP", 1.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A12_COMP, "MAG_A12_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A13_COMP, "MAG_A13_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A21_COMP, "MAG_A21_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A22_COMP, "MAG_A22_COMP", 1.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A23_COMP, "MAG_A23_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A31_COMP, "MAG_A31_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A32_COMP, "MAG_A32_COMP", 0.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_A33_COMP, "MAG_A33_COMP", 1.0f, -999.0, 999.0), // Soft iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_X_BIAS, "MAG_X_BIAS", 0.0f, -999.0, 999.0), // Hard iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_Y_BIAS, "MAG_Y_BIAS", 0.0f, -999.0, 999.0), // Hard iron compensation constant
+  PARAM_FLOAT(PARAM_MAG_Z_BIAS, "MAG_Z_BIAS", 0.0f, -999.0, 999.0), // Hard iron compensation constant
+
+  PARAM_FLOAT(PARAM_BARO_BIAS, "BARO_BIAS", 0.0f, 0, INFINITY), // Barometer measurement bias (Pa)
+  PARAM_FLOAT(PARAM_GROUND_LEVEL, "GROUND_LEVEL", 1387.0f, -1000, 10000), // Altitude of ground level (m)
+
+  PARAM_FLOAT(PARAM_DIFF_PRESS_BIAS, "DIFF_PRESS_BIAS", 0.0f, -10, 10), // Differential Pressure Bias (Pa)
 
   /************************/
   /*** RC CONFIGURATION ***/
   /************************/
-  init_param_int(PARAM_RC_TYPE, "RC_TYPE", 1); // Type of RC input 0 - Parallel PWM (PWM), 1 - Pulse-Position Modulation (PPM) | 0 | 1
-  init_param_int(PARAM_RC_X_CHANNEL, "RC_X_CHN", 0); // RC input channel mapped to x-axis commands [0 - indexed] | 0 | 3
-  init_param_int(PARAM_RC_Y_CHANNEL, "RC_Y_CHN", 1); // RC input channel mapped to y-axis commands [0 - indexed] | 0 | 3
-  init_param_int(PARAM_RC_Z_CHANNEL, "RC_Z_CHN", 3); // RC input channel mapped to z-axis commands [0 - indexed] | 0 | 3
-  init_param_int(PARAM_RC_F_CHANNEL, "RC_F_CHN", 2); // RC input channel mapped to F-axis commands [0 - indexed] | 0 | 3
-  init_param_int(PARAM_RC_ATTITUDE_OVERRIDE_CHANNEL, "RC_ATT_OVRD_CHN", 4); // RC switch mapped to attitude override [0 indexed, -1 to disable] | 4 | 7
-  init_param_int(PARAM_RC_THROTTLE_OVERRIDE_CHANNEL, "RC_THR_OVRD_CHN", 4); // RC switch channel mapped to throttle override [0 indexed, -1 to disable] | 4 | 7
-  init_param_int(PARAM_RC_ATT_CONTROL_TYPE_CHANNEL,  "RC_ATT_CTRL_CHN", -1); // RC switch channel mapped to attitude control type [0 indexed, -1 to disable] | 4 | 7
-  init_param_int(PARAM_RC_ARM_CHANNEL, "ARM_CHANNEL", -1); // RC switch channel mapped to arming (only if PARAM_ARM_STICKS is false) [0 indexed, -1 to disable] | 4 | 7
-  init_param_int(PARAM_RC_NUM_CHANNELS, "RC_NUM_CHN", 6); // number of RC input channels | 1 | 8
-
-  init_param_int(PARAM_RC_SWITCH_5_DIRECTION, "SWITCH_5_DIR", 1); // RC switch 5 toggle direction | -1 | 1
-  init_param_int(PARAM_RC_SWITCH_6_DIRECTION, "SWITCH_6_DIR", 1); // RC switch 6 toggle direction | -1 | 1
-  init_param_int(PARAM_RC_SWITCH_7_DIRECTION, "SWITCH_7_DIR", 1); // RC switch 7 toggle direction | -1 | 1
-  init_param_int(PARAM_RC_SWITCH_8_DIRECTION, "SWITCH_8_DIR", 1); // RC switch 8 toggle direction | -1 | 1
-
-  init_param_float(PARAM_RC_OVERRIDE_DEVIATION, "RC_OVRD_DEV", 0.1); // RC stick deviation from center for overrride | 0.0 | 1.0
-  init_param_int(PARAM_OVERRIDE_LAG_TIME, "OVRD_LAG_TIME", 1000); // RC stick deviation lag time before returning control (ms) | 0 | 100000
-  init_param_int(PARAM_RC_OVERRIDE_TAKE_MIN_THROTTLE, "MIN_THROTTLE", false); // Take minimum throttle between RC and computer at all times | 0 | 1
-
-  init_param_int(PARAM_RC_ATTITUDE_MODE, "RC_ATT_MODE", 1); // Attitude mode for RC sticks (0: rate, 1: angle). Overridden if RC_ATT_CTRL_CHN is set. | 0 | 1
-  init_param_float(PARAM_RC_MAX_ROLL, "RC_MAX_ROLL", 0.786f); // Maximum roll angle command sent by full deflection of RC sticks | 0.0 | 3.14159
-  init_param_float(PARAM_RC_MAX_PITCH, "RC_MAX_PITCH", 0.786f); // Maximum pitch angle command sent by full stick deflection of RC sticks | 0.0 | 3.14159
-  init_param_float(PARAM_RC_MAX_ROLLRATE, "RC_MAX_ROLLRATE", 3.14159f); // Maximum roll rate command sent by full stick deflection of RC sticks | 0.0 | 9.42477796077
-  init_param_float(PARAM_RC_MAX_PITCHRATE, "RC_MAX_PITCHRATE", 3.14159f); // Maximum pitch command sent by full stick deflection of RC sticks | 0.0 | 3.14159
-  init_param_float(PARAM_RC_MAX_YAWRATE, "RC_MAX_YAWRATE", 1.507f); // Maximum pitch command sent by full stick deflection of RC sticks | 0.0 | 3.14159
+  PARAM_INT(PARAM_RC_TYPE, "RC_TYPE", 1, 0, 2), // Type of RC input 0 - Parallel PWM (PWM), 1 - Pulse-Position Modulation (PPM), 2 - SBUS
+  PARAM_INT(PARAM_RC_X_CHANNEL, "RC_X_CHN", 0, 0, 3), // RC input channel mapped to x-axis commands [0 - indexed]
+  PARAM_INT(PARAM_RC_Y_CHANNEL, "RC_Y_CHN", 1, 0, 3), // RC input channel mapped to y-axis commands [0 - indexed]
+  PARAM_INT(PARAM_RC_Z_CHANNEL, "RC_Z_CHN", 3, 0, 3), // RC input channel mapped to z-axis commands [0 - indexed]
+  PARAM_INT(PARAM_RC_F_CHANNEL, "RC_F_CHN", 2, 0, 3), // RC input channel mapped to F-axis commands [0 - indexed]
+  PARAM_INT(PARAM_RC_ATTITUDE_OVERRIDE_CHANNEL, "RC_ATT_OVRD_CHN", 4, 4, 7), // RC switch mapped to attitude override [0 indexed, -1 to disable]
+  PARAM_INT(PARAM_RC_THROTTLE_OVERRIDE_CHANNEL, "RC_THR_OVRD_CHN", 4, 4, 7), // RC switch channel mapped to throttle override [0 indexed, -1 to disable]
+  PARAM_INT(PARAM_RC_ATT_CONTROL_TYPE_CHANNEL, "RC_ATT_CTRL_CHN", -1, 4, 7), // RC switch channel mapped to attitude control type [0 indexed, -1 to disable]
+  PARAM_INT(PARAM_RC_ARM_CHANNEL, "ARM_CHANNEL", -1, 4, 7), // RC switch channel mapped to arming (only if PARAM_ARM_STICKS is false) [0 indexed, -1 to disable]
+  PARAM_INT(PARAM_RC_NUM_CHANNELS, "RC_NUM_CHN", 6, 1, 8), // number of RC input channels
+
+  PARAM_INT(PARAM_RC_SWITCH_5_DIRECTION, "SWITCH_5_DIR", 1, -1, 1), // RC switch 5 toggle direction
+  PARAM_INT(PARAM_RC_SWITCH_6_DIRECTION, "SWITCH_6_DIR", 1, -1, 1), // RC switch 6 toggle direction
+  PARAM_INT(PARAM_RC_SWITCH_7_DIRECTION, "SWITCH_7_DIR", 1, -1, 1), // RC switch 7 toggle direction
+  PARAM_INT(PARAM_RC_SWITCH_8_DIRECTION, "SWITCH_8_DIR", 1, -1, 1), // RC switch 8 toggle direction
+
+  PARAM_FLOAT(PARAM_RC_OVERRIDE_DEVIATION, "RC_OVRD_DEV", 0.1, 0.0, 1.0), // RC stick deviation from center for overrride
+  PARAM_INT(PARAM_OVERRIDE_LAG_TIME, "OVRD_LAG_TIME", 1000, 0, 100000), // RC stick deviation lag time before returning control (ms)
+  PARAM_INT(PARAM_RC_OVERRIDE_TAKE_MIN_THROTTLE, "MIN_THROTTLE", false, 0, 1), // Take minimum throttle between RC and computer at all times
+
+  PARAM_INT(PARAM_RC_ATTITUDE_MODE, "RC_ATT_MODE", 1, 0, 1), // Attitude mode for RC sticks (0: rate, 1: angle). Overridden if RC_ATT_CTRL_CHN is set.
+  PARAM_FLOAT(PARAM_RC_MAX_ROLL, "RC_MAX_ROLL", 0.786f, 0.0, 3.14159), // Maximum roll angle command sent by full deflection of RC sticks
+  PARAM_FLOAT(PARAM_RC_MAX_PITCH, "RC_MAX_PITCH", 0.786f, 0.0, 3.14159), // Maximum pitch angle command sent by full stick deflection of RC sticks
+  PARAM_FLOAT(PARAM_RC_MAX_ROLLRATE, "RC_MAX_ROLLRATE", 3.14159f, 0.0, 9.42477796077), // Maximum roll rate command sent by full stick deflection of RC sticks
+  PARAM_FLOAT(PARAM_RC_MAX_PITCHRATE, "RC_MAX_PITCHRATE", 3.14159f, 0.0, 3.14159), // Maximum pitch command sent by full stick deflection of RC sticks
+  PARAM_FLOAT(PARAM_RC_MAX_YAWRATE, "RC_MAX_YAWRATE", 1.507f, 0.0, 3.14159), // Maximum pitch command sent by full stick deflection of RC sticks
 
   /***************************/
   /*** FRAME CONFIGURATION ***/
   /***************************/
-  init_param_int(PARAM_MIXER, "MIXER", Mixer::INVALID_MIXER); // Which mixer to choose - See Mixer documentation | 0 | 10
-
-  init_param_int(PARAM_FIXED_WING, "FIXED_WING", false); // switches on passthrough commands for fixedwing operation | 0 | 1
-  init_param_int(PARAM_ELEVATOR_REVERSE, "ELEVATOR_REV", 0); // reverses elevator servo output | 0 | 1
-  init_param_int(PARAM_AILERON_REVERSE, "AIL_REV", 0); // reverses aileron servo output | 0 | 1
-  init_param_int(PARAM_RUDDER_REVERSE, "RUDDER_REV", 0); // reverses rudder servo output | 0 | 1
+  PARAM_INT(PARAM_MIXER, "MIXER", Mixer::INVALID_MIXER, 0, 11), // Which mixer to choose - See Mixer documentation
+  PARAM_INT(PARAM_MIXER_AIRMODE, "MIXER_AIRMODE", false, 0, 1), // Desaturate motor outputs by shifting thrust, keeping roll and pitch authority at any throttle
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_0, "MIX_TYPE_0", Mixer::NONE, 0, 2), // Output 0 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_1, "MIX_TYPE_1", Mixer::NONE, 0, 2), // Output 1 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_2, "MIX_TYPE_2", Mixer::NONE, 0, 2), // Output 2 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_3, "MIX_TYPE_3", Mixer::NONE, 0, 2), // Output 3 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_4, "MIX_TYPE_4", Mixer::NONE, 0, 2), // Output 4 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_5, "MIX_TYPE_5", Mixer::NONE, 0, 2), // Output 5 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_6, "MIX_TYPE_6", Mixer::NONE, 0, 2), // Output 6 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_INT(PARAM_MIXER_CUSTOM_TYPE_7, "MIX_TYPE_7", Mixer::NONE, 0, 2), // Output 7 of the custom mixer (0: none, 1: servo, 2: motor)
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_0, "MIX_F_0", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 0 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_1, "MIX_F_1", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 1 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_2, "MIX_F_2", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 2 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_3, "MIX_F_3", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 3 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_4, "MIX_F_4", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 4 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_5, "MIX_F_5", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 5 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_6, "MIX_F_6", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 6 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_F_7, "MIX_F_7", 0.0f, -1000.0f, 1000.0f), // Thrust produced by output 7 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_0, "MIX_X_0", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 0 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_1, "MIX_X_1", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 1 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_2, "MIX_X_2", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 2 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_3, "MIX_X_3", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 3 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_4, "MIX_X_4", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 4 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_5, "MIX_X_5", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 5 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_6, "MIX_X_6", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 6 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_X_7, "MIX_X_7", 0.0f, -1000.0f, 1000.0f), // Roll torque produced by output 7 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_0, "MIX_Y_0", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 0 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_1, "MIX_Y_1", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 1 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_2, "MIX_Y_2", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 2 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_3, "MIX_Y_3", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 3 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_4, "MIX_Y_4", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 4 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_5, "MIX_Y_5", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 5 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_6, "MIX_Y_6", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 6 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Y_7, "MIX_Y_7", 0.0f, -1000.0f, 1000.0f), // Pitch torque produced by output 7 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_0, "MIX_Z_0", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 0 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_1, "MIX_Z_1", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 1 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_2, "MIX_Z_2", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 2 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_3, "MIX_Z_3", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 3 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_4, "MIX_Z_4", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 4 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_5, "MIX_Z_5", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 5 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_6, "MIX_Z_6", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 6 of the custom mixer, in any consistent unit
+  PARAM_FLOAT(PARAM_MIXER_CUSTOM_Z_7, "MIX_Z_7", 0.0f, -1000.0f, 1000.0f), // Yaw torque produced by output 7 of the custom mixer, in any consistent unit
+
+  PARAM_INT(PARAM_FIXED_WING, "FIXED_WING", false, 0, 1), // switches on passthrough commands for fixedwing operation
+  PARAM_INT(PARAM_ELEVATOR_REVERSE, "ELEVATOR_REV", 0, 0, 1), // reverses elevator servo output
+  PARAM_INT(PARAM_AILERON_REVERSE, "AIL_REV", 0, 0, 1), // reverses aileron servo output
+  PARAM_INT(PARAM_RUDDER_REVERSE, "RUDDER_REV", 0, 0, 1), // reverses rudder servo output
 
   /********************/
   /*** ARMING SETUP ***/
   /********************/
-  init_param_float(PARAM_ARM_THRESHOLD, "ARM_THRESHOLD", 0.15); // RC deviation from max/min in yaw and throttle for arming and disarming check (us) | 0 | 500
+  PARAM_FLOAT(PARAM_ARM_THRESHOLD, "ARM_THRESHOLD", 0.15, 0, 500) // RC deviation from max/min in yaw and throttle for arming and disarming check (us)
+};
+
+#undef PARAM_INT
+#undef PARAM_FLOAT
+
+static constexpr bool param_table_in_order(uint16_t id)
+{
+  return id == PARAMS_COUNT || (param_table[id].id == id && param_table_in_order(static_cast<uint16_t>(id + 1)));
 }
+static_assert(sizeof(param_table)/sizeof(param_table[0]) == PARAMS_COUNT, "param_table must list every parameter");
+static_assert(param_table_in_order(0), "param_table must list the parameters in the same order as their IDs");
+
+constexpr uint16_t Params::BATCH_CHANGED;
 
-void Params::add_callback(std::function<void(int)> callback, uint16_t param_id)
+Params::Params(ROSflight& _rf) :
+  RF_(_rf),
+  bulk_staging_(),
+  name_index_(),
+  callbacks_(),
+  num_callbacks_(0),
+  dropped_callbacks_(0),
+  batch_changed_(),
+  batch_depth_(0)
 {
-  callbacks[param_id] = callback;
-  callback(param_id);
+  static_assert(MAX_CALLBACKS < NO_CALLBACK, "callback pool indices must fit below NO_CALLBACK");
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+    first_callback_[id] = NO_CALLBACK;
+
+  build_name_index();
 }
 
-bool Params::read(void)
+// local function definitions
+void Params::set_value(uint16_t id, param_value_t value)
 {
-  if (!RF_.board_.memory_read(&params, sizeof(params_t)))
-    return false;
+  if (value.ivalue != params.values[id].ivalue)
+  {
+    params.values[id] = value;
+    change_callback(id);
+  }
+}
 
-  if (params.version != GIT_VERSION_HASH)
-    return false;
 
-  if (params.size != sizeof(params_t) || params.magic_be != 0xBE || params.magic_ef != 0xEF)
+// function definitions
+void Params::init()
+{
+  // with nothing stored the defaults are used as they are; they get written the first time params are saved
+  RF_.param_store_.init();
+  read();
+}
+
+void Params::set_defaults(void)
+{
+  begin_batch();
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+    set_value(id, param_table[id].default_value);
+  end_batch();
+}
+
+Params::param_value_t Params::get_param_default(uint16_t id) const
+{
+  return param_table[id].default_value;
+}
+
+const char *Params::get_param_name(uint16_t id) const
+{
+  return param_table[id].name;
+}
+
+param_type_t Params::get_param_type(uint16_t id) const
+{
+  return param_table[id].type;
+}
+
+float Params::get_param_min(uint16_t id) const
+{
+  return param_table[id].min;
+}
+
+float Params::get_param_max(uint16_t id) const
+{
+  return param_table[id].max;
+}
+
+bool Params::add_callback(ParamCallback callback, void *context, uint16_t param_id)
+{
+  if (param_id >= PARAMS_COUNT)
     return false;
 
-  if (compute_checksum() != params.chk)
+  // walk to the end of this param's list, ignoring repeated registrations
+  uint8_t *link = &first_callback_[param_id];
+  while (*link != NO_CALLBACK)
+  {
+    const callback_entry_t &entry = callbacks_[*link];
+    if (entry.callback == callback && entry.context == context)
+    {
+      callback(context, param_id);
+      return true;
+    }
+    link = &callbacks_[*link].next;
+  }
+
+  if (num_callbacks_ >= MAX_CALLBACKS)
+  {
+    if (dropped_callbacks_ < UINT8_MAX)
+      dropped_callbacks_++;
     return false;
+  }
+
+  callbacks_[num_callbacks_] = {callback, context, param_id, NO_CALLBACK};
+  *link = num_callbacks_++;
 
+  callback(context, param_id);
   return true;
 }
 
-bool Params::write(void)
+void Params::begin_batch(void)
+{
+  batch_depth_++;
+}
+
+void Params::end_batch(void)
 {
-  params.version = GIT_VERSION_HASH;
-  params.size = sizeof(params_t);
-  params.magic_be = 0xBE;
-  params.magic_ef = 0xEF;
-  params.chk = compute_checksum();
+  if (batch_depth_ == 0 || --batch_depth_ > 0)
+    return;
 
-  if (!RF_.board_.memory_write(&params, sizeof(params_t)))
-    return false;
-  return true;
+  for (uint8_t i = 0; i < num_callbacks_; i++)
+  {
+    const callback_entry_t &entry = callbacks_[i];
+    if (!batch_changed(entry.param_id))
+      continue;
+
+    // find the subscriber's other changed params, it is only notified from its first one
+    bool notified = false;
+    bool several = false;
+    for (uint8_t j = 0; j < num_callbacks_; j++)
+    {
+      const callback_entry_t &other = callbacks_[j];
+      if (j == i || other.callback != entry.callback || other.context != entry.context
+          || !batch_changed(other.param_id))
+        continue;
+      if (j < i)
+        notified = true;
+      several = true;
+    }
+
+    if (!notified)
+      entry.callback(entry.context, several ? BATCH_CHANGED : entry.param_id);
+  }
+
+  memset(batch_changed_, 0, sizeof(batch_changed_));
+}
+
+bool Params::read(void)
+{
+  begin_batch();
+  set_defaults();
+  bool result = RF_.param_store_.load();
+  end_batch();
+  return result;
+}
+
+bool Params::write(void)
+{
+  return RF_.param_store_.save();
 }
 
 void Params::change_callback(uint16_t id)
 {
-  // call the callback function
-  if(callbacks[id])
-    callbacks[id](id);
+  RF_.param_store_.value_changed(id);
+
+  if (batch_depth_ > 0)
+  {
+    batch_changed_[id/32] |= 1u << (id%32);
+    return;
+  }
+
+  for (uint8_t i = first_callback_[id]; i != NO_CALLBACK; i = callbacks_[i].next)
+    callbacks_[i].callback(callbacks_[i].context, id);
 }
 
-uint16_t Params::lookup_param_id(const char name[PARAMS_NAME_LENGTH])
+void Params::build_name_index(void)
 {
-  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+  static_assert(PARAMS_COUNT <= UINT8_MAX, "the name index stores param IDs as uint8_t");
+
+  // insertion sort, only done once at boot
+  for (uint16_t i = 0; i < PARAMS_COUNT; i++)
   {
-    bool match = true;
-    for (uint8_t i = 0; i < PARAMS_NAME_LENGTH; i++)
+    uint16_t j = i;
+    while (j > 0 && strncmp(param_table[name_index_[j - 1]].name, param_table[i].name, PARAMS_NAME_LENGTH) > 0)
     {
-      // compare each character
-      if (name[i] != params.names[id][i])
-      {
-        match = false;
-        break;
-      }
-
-      // stop comparing if end of string is reached
-      if (params.names[id][i] == '\0')
-        break;
+      name_index_[j] = name_index_[j - 1];
+      j--;
     }
+    name_index_[j] = static_cast<uint8_t>(i);
+  }
+}
 
-    if (match)
+uint16_t Params::lookup_param_id(const char name[PARAMS_NAME_LENGTH])
+{
+  // binary search over the names in sorted order
+  uint16_t low = 0;
+  uint16_t high = PARAMS_COUNT;
+  while (low < high)
+  {
+    uint16_t mid = static_cast<uint16_t>((low + high)/2);
+    uint8_t id = name_index_[mid];
+    int cmp = strncmp(name, param_table[id].name, PARAMS_NAME_LENGTH);
+    if (cmp == 0)
       return id;
+    else if (cmp < 0)
+      high = mid;
+    else
+      low = static_cast<uint16_t>(mid + 1);
   }
 
   return PARAMS_COUNT;
@@ -354,4 +543,97 @@ bool Params::set_param_by_name_float(const char name[PARAMS_NAME_LENGTH], float
 {
   return set_param_by_name_int(name, reinterpret_cast<int32_t &>(value));
 }
+
+uint8_t Params::bulk_byte(uint16_t index) const
+{
+  if (index < 4)
+    return static_cast<uint8_t>(static_cast<uint32_t>(GIT_VERSION_HASH) >> (8*index));
+  if (index < 6)
+    return static_cast<uint8_t>(PARAMS_COUNT >> (8*(index - 4)));
+  if (index < BULK_HEADER_SIZE)
+    return 0; // checksum, filled in by bulk_read
+
+  index = static_cast<uint16_t>(index - BULK_HEADER_SIZE);
+  if (index < 4*PARAMS_COUNT)
+    return static_cast<uint8_t>(static_cast<uint32_t>(params.values[index/4].ivalue) >> (8*(index%4)));
+  return static_cast<uint8_t>(param_table[index - 4*PARAMS_COUNT].type);
+}
+
+uint8_t Params::bulk_checksum(const uint8_t *image)
+{
+  uint8_t chk = 0;
+  for (uint16_t i = 0; i < BULK_IMAGE_SIZE; i++)
+  {
+    if (i != BULK_HEADER_SIZE - 1)
+      chk ^= image[i];
+  }
+  return chk;
+}
+
+void Params::bulk_read(uint16_t offset, uint8_t *buf, uint16_t len) const
+{
+  for (uint16_t i = 0; i < len; i++)
+  {
+    uint32_t index = static_cast<uint32_t>(offset) + i;
+    if (index == BULK_HEADER_SIZE - 1)
+    {
+      uint8_t chk = 0;
+      for (uint16_t j = 0; j < BULK_IMAGE_SIZE; j++)
+        chk ^= bulk_byte(j);
+      buf[i] = chk;
+    }
+    else
+    {
+      buf[i] = (index < BULK_IMAGE_SIZE) ? bulk_byte(static_cast<uint16_t>(index)) : 0;
+    }
+  }
+}
+
+bool Params::bulk_stage(uint16_t offset, const uint8_t *buf, uint16_t len)
+{
+  if (offset >= BULK_IMAGE_SIZE)
+    return false;
+  if (len > BULK_IMAGE_SIZE - offset)
+    len = static_cast<uint16_t>(BULK_IMAGE_SIZE - offset);
+  memcpy(bulk_staging_ + offset, buf, len);
+  return true;
+}
+
+bool Params::bulk_commit(void)
+{
+  const uint8_t *image = bulk_staging_;
+
+  uint32_t version = 0;
+  for (int i = 0; i < 4; i++)
+    version |= static_cast<uint32_t>(image[i]) << (8*i);
+  uint16_t count = static_cast<uint16_t>(image[4] | (image[5] << 8));
+
+  if (version != static_cast<uint32_t>(GIT_VERSION_HASH) || count != PARAMS_COUNT
+      || bulk_checksum(image) != image[BULK_HEADER_SIZE - 1])
+    return false;
+
+  const uint8_t *values = image + BULK_HEADER_SIZE;
+  const uint8_t *types = values + 4*PARAMS_COUNT;
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+  {
+    if (types[id] != static_cast<uint8_t>(param_table[id].type))
+      return false;
+  }
+
+  begin_batch();
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+  {
+    int32_t value = static_cast<int32_t>(static_cast<uint32_t>(values[4*id])
+                                         | static_cast<uint32_t>(values[4*id + 1]) << 8
+                                         | static_cast<uint32_t>(values[4*id + 2]) << 16
+                                         | static_cast<uint32_t>(values[4*id + 3]) << 24);
+    if (value != params.values[id].ivalue)
+    {
+      params.values[id].ivalue = value;
+      change_callback(id);
+    }
+  }
+  end_batch();
+  return true;
+}
 }
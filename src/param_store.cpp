@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "param_store.h"
+
+#include "rosflight.h"
+
+namespace rosflight_firmware
+{
+
+constexpr uint32_t ParamStore::MAGIC;
+constexpr uint32_t ParamStore::HEADER_SIZE;
+constexpr uint32_t ParamStore::RECORD_SIZE;
+
+ParamStore::ParamStore(ROSflight& _rf) :
+  RF_(_rf)
+{
+  active_sector_ = NO_SECTOR;
+  generation_ = 0;
+  append_offset_ = HEADER_SIZE;
+  state_ = STATE_IDLE;
+  target_sector_ = NO_SECTOR;
+  snapshot_id_ = 0;
+  snapshot_offset_ = HEADER_SIZE;
+  failed_ = false;
+  memset(unsaved_, 0, sizeof(unsaved_));
+  memset(pending_, 0, sizeof(pending_));
+}
+
+bool ParamStore::init(void)
+{
+  RF_.board_.memory_init();
+
+  active_sector_ = NO_SECTOR;
+  generation_ = 0;
+  state_ = STATE_IDLE;
+  failed_ = false;
+  memset(unsaved_, 0, sizeof(unsaved_));
+  memset(pending_, 0, sizeof(pending_));
+
+  // the sector with the newest valid header is the active one
+  for (uint8_t sector = 0; sector < 2; sector++)
+  {
+    uint32_t generation;
+    if (read_header(sector, &generation) && (active_sector_ == NO_SECTOR || generation > generation_))
+    {
+      active_sector_ = sector;
+      generation_ = generation;
+    }
+  }
+
+  // records are appended in order, so the first erased slot is where the next one goes
+  append_offset_ = HEADER_SIZE;
+  if (active_sector_ != NO_SECTOR)
+  {
+    uint32_t sector_size = RF_.board_.memory_sector_size();
+    while (append_offset_ + RECORD_SIZE <= sector_size
+           && RF_.board_.memory_read_word(active_sector_, append_offset_) != ERASED_WORD)
+      append_offset_ += RECORD_SIZE;
+  }
+
+  return active_sector_ != NO_SECTOR;
+}
+
+bool ParamStore::load(void)
+{
+  bool found = (active_sector_ != NO_SECTOR);
+  if (found)
+  {
+    // later records override earlier ones, and records that fail their CRC (e.g. torn by a power loss) are skipped
+    for (uint32_t offset = HEADER_SIZE; offset < append_offset_; offset += RECORD_SIZE)
+    {
+      uint16_t id;
+      int32_t value;
+      if (record_valid(active_sector_, offset, &id, &value))
+        RF_.params_.set_value(id, Params::param_value_t(value));
+    }
+  }
+
+  // the values now match what is stored
+  memset(unsaved_, 0, sizeof(unsaved_));
+  memset(pending_, 0, sizeof(pending_));
+  return found;
+}
+
+void ParamStore::value_changed(uint16_t id)
+{
+  unsaved_[id/32] |= 1u << (id%32);
+}
+
+bool ParamStore::save(void)
+{
+  if (failed_)
+    return false;
+
+  for (size_t i = 0; i < sizeof(pending_)/sizeof(pending_[0]); i++)
+    pending_[i] |= unsaved_[i];
+  return true;
+}
+
+void ParamStore::run(void)
+{
+  if (failed_)
+    return;
+
+  if (state_ == STATE_SNAPSHOT)
+    run_snapshot();
+  else if (any_pending())
+    run_append();
+}
+
+void ParamStore::flush(void)
+{
+  while (busy() && !failed_ && !RF_.state_manager_.state().armed)
+    run();
+}
+
+uint16_t ParamStore::crc16(uint16_t crc, uint32_t word)
+{
+  // CRC-16/CCITT over the bytes of the word, least significant first
+  for (uint8_t i = 0; i < 4; i++)
+  {
+    crc = static_cast<uint16_t>(crc ^ (((word >> (8*i)) & 0xFF) << 8));
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+  }
+  return crc;
+}
+
+uint16_t ParamStore::header_crc(uint32_t generation)
+{
+  uint16_t crc = crc16(CRC_INIT, MAGIC);
+  crc = crc16(crc, static_cast<uint32_t>(GIT_VERSION_HASH));
+  return crc16(crc, generation);
+}
+
+bool ParamStore::read_header(uint8_t sector, uint32_t *generation) const
+{
+  // a sector written by other firmware is treated as empty, since the param IDs may have changed
+  if (RF_.board_.memory_read_word(sector, 0) != MAGIC
+      || RF_.board_.memory_read_word(sector, 4) != static_cast<uint32_t>(GIT_VERSION_HASH))
+    return false;
+
+  *generation = RF_.board_.memory_read_word(sector, 8);
+  return RF_.board_.memory_read_word(sector, 12) == header_crc(*generation);
+}
+
+bool ParamStore::record_valid(uint8_t sector, uint32_t offset, uint16_t *id, int32_t *value) const
+{
+  uint32_t key = RF_.board_.memory_read_word(sector, offset);
+  uint32_t raw = RF_.board_.memory_read_word(sector, offset + 4);
+
+  *id = static_cast<uint16_t>(key & 0xFFFF);
+  *value = static_cast<int32_t>(raw);
+  return *id < PARAMS_COUNT && (key >> 16) == crc16(crc16(CRC_INIT, *id), raw);
+}
+
+bool ParamStore::write_record(uint8_t sector, uint32_t offset, uint16_t id)
+{
+  uint32_t raw = static_cast<uint32_t>(RF_.params_.get_param_int(id));
+  uint32_t key = id | static_cast<uint32_t>(crc16(crc16(CRC_INIT, id), raw)) << 16;
+
+  // the key goes first, so the append position is still found if the value write is torn
+  return RF_.board_.memory_write_word(sector, offset, key)
+      && RF_.board_.memory_write_word(sector, offset + 4, raw);
+}
+
+bool ParamStore::any_pending(void) const
+{
+  for (size_t i = 0; i < sizeof(pending_)/sizeof(pending_[0]); i++)
+  {
+    if (pending_[i])
+      return true;
+  }
+  return false;
+}
+
+uint16_t ParamStore::next_pending(void) const
+{
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+  {
+    if (pending_[id/32] & (1u << (id%32)))
+      return id;
+  }
+  return PARAMS_COUNT;
+}
+
+void ParamStore::clear_bits(uint16_t id)
+{
+  unsaved_[id/32] &= ~(1u << (id%32));
+  pending_[id/32] &= ~(1u << (id%32));
+}
+
+void ParamStore::set_failed(void)
+{
+  failed_ = true;
+  state_ = STATE_IDLE;
+  RF_.mavlink_.log(Mavlink::LOG_ERROR, "parameter memory write failed");
+}
+
+void ParamStore::run_append(void)
+{
+  uint32_t sector_size = RF_.board_.memory_sector_size();
+  for (uint8_t i = 0; i < RECORDS_PER_RUN; i++)
+  {
+    uint16_t id = next_pending();
+    if (id == PARAMS_COUNT)
+      return;
+
+    if (active_sector_ == NO_SECTOR || append_offset_ + RECORD_SIZE > sector_size)
+    {
+      start_compaction();
+      return;
+    }
+
+    // a record that fails to write is left behind for its CRC to reject, and retried in the next slot
+    bool written = write_record(active_sector_, append_offset_, id);
+    append_offset_ += RECORD_SIZE;
+    if (written)
+      clear_bits(id);
+  }
+}
+
+void ParamStore::start_compaction(void)
+{
+  // erasing stalls the CPU, so wait until it can't disturb a flight
+  if (RF_.state_manager_.state().armed)
+    return;
+
+  if (RF_.board_.memory_sector_size() < HEADER_SIZE + PARAMS_COUNT*RECORD_SIZE)
+  {
+    set_failed();
+    return;
+  }
+
+  target_sector_ = (active_sector_ == 0) ? 1 : 0;
+  if (!RF_.board_.memory_erase_sector(target_sector_))
+  {
+    set_failed();
+    return;
+  }
+
+  // the snapshot stores the current value of every param, so anything queued is covered by it
+  memset(unsaved_, 0, sizeof(unsaved_));
+  memset(pending_, 0, sizeof(pending_));
+  snapshot_id_ = 0;
+  snapshot_offset_ = HEADER_SIZE;
+  state_ = STATE_SNAPSHOT;
+}
+
+void ParamStore::run_snapshot(void)
+{
+  uint8_t written = 0;
+  while (written < RECORDS_PER_RUN && snapshot_id_ < PARAMS_COUNT)
+  {
+    uint16_t id = snapshot_id_++;
+
+    // params left at their defaults don't need a record
+    if (RF_.params_.get_param_int(id) == RF_.params_.get_param_default(id).ivalue)
+      continue;
+
+    if (!write_record(target_sector_, snapshot_offset_, id))
+    {
+      set_failed();
+      return;
+    }
+    snapshot_offset_ += RECORD_SIZE;
+    written++;
+  }
+
+  if (snapshot_id_ < PARAMS_COUNT)
+    return;
+
+  // the header goes last, so until now the old sector is still the active one
+  uint32_t generation = generation_ + 1;
+  if (!RF_.board_.memory_write_word(target_sector_, 0, MAGIC)
+      || !RF_.board_.memory_write_word(target_sector_, 4, static_cast<uint32_t>(GIT_VERSION_HASH))
+      || !RF_.board_.memory_write_word(target_sector_, 8, generation)
+      || !RF_.board_.memory_write_word(target_sector_, 12, header_crc(generation)))
+  {
+    set_failed();
+    return;
+  }
+
+  active_sector_ = target_sector_;
+  generation_ = generation;
+  append_offset_ = snapshot_offset_;
+  state_ = STATE_IDLE;
+}
+
+} // namespace rosflight_firmware
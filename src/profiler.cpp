@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "profiler.h"
+#include "rosflight.h"
+
+namespace rosflight_firmware
+{
+
+Profiler::Profiler(ROSflight& _rf) :
+  RF_(_rf)
+{
+  init();
+}
+
+void Profiler::init()
+{
+  for (uint8_t i = 0; i < STAGE_COUNT; i++)
+    reset(i);
+}
+
+void Profiler::reset(uint8_t stage)
+{
+  if (stage >= STAGE_COUNT)
+    return;
+
+  stages_[stage].min_us = UINT32_MAX;
+  stages_[stage].max_us = 0;
+  stages_[stage].count = 0;
+  stages_[stage].total_us = 0;
+  memset(stages_[stage].histogram, 0, sizeof(stages_[stage].histogram));
+
+  cycles_[stage].min = UINT32_MAX;
+  cycles_[stage].max = 0;
+  cycles_[stage].count = 0;
+  cycles_[stage].total = 0;
+}
+
+uint64_t Profiler::tic()
+{
+  return RF_.board_.clock_micros();
+}
+
+uint64_t Profiler::toc(uint8_t stage, uint64_t start_us)
+{
+  uint64_t now_us = RF_.board_.clock_micros();
+  record(stage, static_cast<uint32_t>(now_us - start_us));
+  return now_us;
+}
+
+void Profiler::record(uint8_t stage, uint32_t elapsed_us)
+{
+  if (stage >= STAGE_COUNT)
+    return;
+
+  Stage& s = stages_[stage];
+  if (elapsed_us < s.min_us)
+    s.min_us = elapsed_us;
+  if (elapsed_us > s.max_us)
+    s.max_us = elapsed_us;
+  s.count++;
+  s.total_us += elapsed_us;
+
+  // log2 bin of the sample, capped at the last bin
+  uint8_t bin = 0;
+  while (elapsed_us > 0 && bin < HISTOGRAM_BINS - 1)
+  {
+    elapsed_us >>= 1;
+    bin++;
+  }
+
+  // saturate rather than roll over
+  if (s.histogram[bin] < UINT16_MAX)
+    s.histogram[bin]++;
+}
+
+void Profiler::record_cycles(uint8_t stage, uint32_t cycles)
+{
+  if (stage >= STAGE_COUNT)
+    return;
+
+  Cycles& c = cycles_[stage];
+  if (cycles < c.min)
+    c.min = cycles;
+  if (cycles > c.max)
+    c.max = cycles;
+  c.count++;
+  c.total += cycles;
+}
+
+uint32_t Profiler::mean_cycles(uint8_t id) const
+{
+  if (id >= STAGE_COUNT || cycles_[id].count == 0)
+    return 0;
+  return static_cast<uint32_t>(cycles_[id].total / cycles_[id].count);
+}
+
+uint32_t Profiler::mean_us(uint8_t id) const
+{
+  if (id >= STAGE_COUNT || stages_[id].count == 0)
+    return 0;
+  return static_cast<uint32_t>(stages_[id].total_us / stages_[id].count);
+}
+
+const char *Profiler::stage_name(uint8_t id)
+{
+  switch (id)
+  {
+  case STAGE_SENSORS:
+    return "sensors";
+  case STAGE_IMU_FILTER:
+    return "imu_filt";
+  case STAGE_ESTIMATOR:
+    return "est";
+  case STAGE_ESTIMATOR_LPF:
+    return "est_lpf";
+  case STAGE_ESTIMATOR_ACC:
+    return "est_acc";
+  case STAGE_ESTIMATOR_QUAD_INT:
+    return "est_qint";
+  case STAGE_ESTIMATOR_PROPAGATE:
+    return "est_prop";
+  case STAGE_CONTROLLER:
+    return "control";
+  case STAGE_MIXER:
+    return "mixer";
+  case STAGE_MIXER_OUTPUT:
+    return "mix_out";
+  case STAGE_BLACKBOX_FRAME:
+    return "bb_frame";
+  case STAGE_IMU_TO_MOTOR:
+    return "imu2motor";
+  case STAGE_CONTROL_PERIOD:
+    return "ctrl_dt";
+  case STAGE_RC_FRAME_PERIOD:
+    return "rc_dt";
+  case STAGE_RC_LATENCY:
+    return "rc_lat";
+  case STAGE_MAVLINK_STREAM:
+    return "ml_stream";
+  case STAGE_MAVLINK_RECEIVE:
+    return "ml_recv";
+  case STAGE_STATE_MANAGER:
+    return "state_mgr";
+  case STAGE_RC:
+    return "rc";
+  case STAGE_COMMAND_MANAGER:
+    return "cmd_mgr";
+  case STAGE_PARAM_STORE:
+    return "prm_store";
+  case STAGE_GYRO_ANALYZER:
+    return "gyro_anlz";
+  case STAGE_BLACKBOX:
+    return "blackbox";
+  default:
+    return "invalid";
+  }
+}
+
+} // namespace rosflight_firmware
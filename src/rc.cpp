@@ -41,18 +41,23 @@ RC::RC(ROSflight &_rf) :
 
 void RC::init()
 {
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_ATTITUDE_OVERRIDE_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_THROTTLE_OVERRIDE_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_ATT_CONTROL_TYPE_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_ARM_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_X_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_Y_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_Z_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_F_CHANNEL);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_SWITCH_5_DIRECTION);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_SWITCH_6_DIRECTION);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_SWITCH_7_DIRECTION);
-  RF_.params_.add_callback(std::bind(&RC::param_change_callback, this, std::placeholders::_1), PARAM_RC_SWITCH_8_DIRECTION);
+  frame_mode_ = false;
+  frame_count_ = 0;
+  next_poll_us_ = RF_.board_.clock_micros();
+
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_TYPE);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_ATTITUDE_OVERRIDE_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_THROTTLE_OVERRIDE_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_ATT_CONTROL_TYPE_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_ARM_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_X_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_Y_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_Z_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_F_CHANNEL);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_SWITCH_5_DIRECTION);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_SWITCH_6_DIRECTION);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_SWITCH_7_DIRECTION);
+  RF_.params_.add_callback<RC, &RC::param_change_callback>(this, PARAM_RC_SWITCH_8_DIRECTION);
   init_rc();
   new_command_ = false;
 }
@@ -63,10 +68,32 @@ void RC::init_rc()
   init_switches();
 }
 
+void RC::init_receiver()
+{
+  // Until the first frame arrives the receiver counts as lost
+  frame_ = {};
+  frame_.failsafe = true;
+  frame_.time_us = RF_.board_.clock_micros();
+
+  rc_protocol_t protocol = static_cast<rc_protocol_t>(RF_.params_.get_param_int(PARAM_RC_TYPE));
+  frame_mode_ = protocol != RC_PROTOCOL_PWM && RF_.board_.rc_init(protocol);
+}
+
 void RC::param_change_callback(uint16_t param_id)
 {
-  (void) param_id; // suppress unused parameter warning
-  init_rc();
+  switch (param_id)
+  {
+  case PARAM_RC_TYPE:
+    init_receiver();
+    break;
+  case Params::BATCH_CHANGED:
+    init_receiver();
+    init_rc();
+    break;
+  default:
+    init_rc();
+    break;
+  }
 }
 
 float RC::stick(Stick channel)
@@ -158,12 +185,19 @@ void RC::init_switches()
   }
 }
 
-bool RC::check_rc_lost()
+uint16_t RC::read_channel(uint8_t channel)
+{
+  if (!frame_mode_)
+    return RF_.board_.pwm_read(channel);
+  return (channel < frame_.num_channels) ? frame_.channels[channel] : 0;
+}
+
+bool RC::check_rc_lost(uint64_t now_us)
 {
   bool failsafe = false;
 
-  // If the board reports that we have lost RC, tell the state manager
-  if (RF_.board_.pwm_lost())
+  // If the board or the receiver reports that we have lost RC, tell the state manager
+  if (frame_mode_ ? (frame_.failsafe || now_us > frame_.time_us + FRAME_TIMEOUT_US) : RF_.board_.pwm_lost())
   {
     failsafe = true;
   }
@@ -172,7 +206,8 @@ bool RC::check_rc_lost()
     // go into failsafe if we get an invalid RC command for any channel
     for (int8_t i = 0; i<RF_.params_.get_param_int(PARAM_RC_NUM_CHANNELS); i++)
     {
-      if (RF_.board_.pwm_read(i) < 900 || RF_.board_.pwm_read(i) > 2100)
+      uint16_t pwm = read_channel(i);
+      if (pwm < 900 || pwm > 2100)
       {
         failsafe = true;
       }
@@ -250,25 +285,52 @@ void RC::look_for_arm_disarm_signal()
 
 bool RC::run()
 {
-  uint32_t now = RF_.board_.clock_millis();
-
-  // if it has been more than 20ms then look for new RC values and parse them
-  if (now - last_rc_receive_time < 20)
+  // Frames are interpreted as soon as the board has them, so that the mux sees them on the same pass.
+  // Receivers without frames are polled every POLL_PERIOD_US, which is also when a frame-based receiver
+  // that has gone quiet is checked for being lost.
+  uint64_t now_us = RF_.board_.clock_micros();
+  bool new_frame = false;
+  if (frame_mode_)
   {
-    return false;
+    rc_frame_t frame;
+    while (RF_.board_.rc_read(&frame))
+    {
+      if (frame_count_ > 0)
+        RF_.profiler_.record(Profiler::STAGE_RC_FRAME_PERIOD, static_cast<uint32_t>(frame.time_us - frame_.time_us));
+      frame_ = frame;
+      frame_count_++;
+      new_frame = true;
+    }
   }
-  last_rc_receive_time = now;
 
+  bool poll = now_us >= next_poll_us_;
+  if (!new_frame && !poll)
+    return false;
+  if (poll)
+  {
+    if (next_poll_us_ + POLL_PERIOD_US < now_us)
+      next_poll_us_ = now_us + POLL_PERIOD_US; // fell behind, so skip rather than poll back-to-back
+    else
+      next_poll_us_ += POLL_PERIOD_US;
+  }
 
   // Check for rc lost
-  if (check_rc_lost())
+  if (check_rc_lost(now_us))
     return false;
 
+  // Nothing new to interpret from a frame-based receiver
+  if (frame_mode_ && !new_frame)
+    return false;
+
+  // How long the frame waited between the end of its reception and reaching the mux
+  if (new_frame)
+    RF_.profiler_.record(Profiler::STAGE_RC_LATENCY, static_cast<uint32_t>(now_us - frame_.time_us));
+
 
   // read and normalize stick values
   for (uint8_t channel = 0; channel < static_cast<uint8_t>(STICKS_COUNT); channel++)
   {
-    uint16_t pwm = RF_.board_.pwm_read(sticks[channel].channel);
+    uint16_t pwm = read_channel(sticks[channel].channel);
     if (sticks[channel].one_sided) //generally only F is one_sided
     {
       stick_values[channel] = (static_cast<float>(pwm - 1000)) / 1000.0f;
@@ -286,11 +348,11 @@ bool RC::run()
     {
       if (switches[channel].direction < 0)
       {
-        switch_values[channel] = RF_.board_.pwm_read(switches[channel].channel) < 1200;
+        switch_values[channel] = read_channel(switches[channel].channel) < 1200;
       }
       else
       {
-        switch_values[channel] = RF_.board_.pwm_read(switches[channel].channel) >= 1800;
+        switch_values[channel] = read_channel(switches[channel].channel) >= 1800;
       }
     }
     else
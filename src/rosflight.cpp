@@ -38,13 +38,18 @@ ROSflight::ROSflight(Board& board) :
   board_(board),
   mavlink_(*this),
   params_(*this),
+  param_store_(*this),
   command_manager_(*this),
   controller_(*this),
   estimator_(*this),
   mixer_(*this),
   rc_(*this),
   sensors_(*this),
-  state_manager_(*this)
+  gyro_analyzer_(*this),
+  state_manager_(*this),
+  profiler_(*this),
+  blackbox_(*this),
+  scheduler_(*this)
 {
 }
 
@@ -54,10 +59,13 @@ void ROSflight::init()
   // Initialize the board
   board_.init_board();
 
+  // Clear the loop timing statistics
+  profiler_.init();
+
   // Initialize the arming finite state machine
   state_manager_.init();
 
-  // Read EEPROM to get initial params
+  // Read the stored params from non-volatile memory
   params_.init();
 
   // Initialize Mixer
@@ -75,6 +83,7 @@ void ROSflight::init()
 
   // Initialize Sensors
   sensors_.init();
+  gyro_analyzer_.init();
 
   /***********************/
   /***  Software Setup ***/
@@ -88,6 +97,12 @@ void ROSflight::init()
 
   // Initialize the command muxer
   command_manager_.init();
+
+  // Pick up the flight log where it left off
+  blackbox_.init();
+
+  // Start the housekeeping task timers
+  scheduler_.init();
 }
 
 
@@ -97,33 +112,43 @@ void ROSflight::run()
   /*********************/
   /***  Control Loop ***/
   /*********************/
-  uint64_t start = board_.clock_micros();
-  if (sensors_.run())
+  uint64_t start = profiler_.tic();
+  bool new_imu = sensors_.run();
+  uint64_t t = profiler_.toc(Profiler::STAGE_SENSORS, start);
+  if (new_imu)
   {
-    // If I have new IMU data, then perform control
+    // If I have new IMU data, then perform control. If we fell behind, integrate
+    // every sample that is waiting in the IMU FIFO, but only run control on the newest
     estimator_.run();
+    uint16_t backlog = board_.imu_samples_available();
+    while (backlog-- > 0 && sensors_.update_imu())
+      estimator_.run();
+    t = profiler_.toc(Profiler::STAGE_ESTIMATOR, t);
+    // Offboard commands that arrived since the last update go straight to the controller
+    command_manager_.apply_offboard_command();
     controller_.run();
+    t = profiler_.toc(Profiler::STAGE_CONTROLLER, t);
     mixer_.mix_output();
-    loop_time_us = board_.clock_micros() - start;
+    t = profiler_.toc(Profiler::STAGE_MIXER, t);
+    loop_time_us = t - start;
+
+    // End-to-end latency, from when the newest IMU sample was taken to when the motors were written
+    profiler_.record(Profiler::STAGE_IMU_TO_MOTOR, t - sensors_.data().imu_time);
+
+    // Log the update, after the motors so it doesn't add to the latency
+    blackbox_.log_frame();
+    profiler_.toc(Profiler::STAGE_BLACKBOX_FRAME, t);
+
+    // Let the scheduler know when to expect the next IMU sample
+    scheduler_.imu_update(sensors_.data().imu_time);
   }
 
   /*********************/
   /***  Post-Process ***/
   /*********************/
-//  // internal timers figure out what and when to send
-  mavlink_.stream();
-
-  // receive mavlink messages
-  mavlink_.receive();
-
-  // update the state machine, an internal timer runs this at a fixed rate
-  state_manager_.run();
-
-  // get RC, an internal timer runs this every 20 ms (50 Hz)
-  rc_.run();
-
-  // update commands (internal logic tells whether or not we should do anything or not)
-  command_manager_.run();
+  // Run the housekeeping tasks (MAVLink, RC, state machine, command muxing) that are due
+  // and fit in the time left before the next IMU sample
+  scheduler_.run();
 }
 
 uint32_t ROSflight::get_loop_time_us()
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "sbus.h"
+
+namespace rosflight_firmware
+{
+
+SbusDecoder::SbusDecoder()
+{
+  reset();
+}
+
+void SbusDecoder::reset()
+{
+  count_ = 0;
+  last_byte_us_ = 0;
+  errors_ = 0;
+}
+
+bool SbusDecoder::parse(uint8_t byte, uint64_t time_us, rc_frame_t *frame)
+{
+  if (count_ > 0 && time_us > last_byte_us_ + FRAME_GAP_US)
+  {
+    errors_++; // the frame before the gap was cut short
+    count_ = 0;
+  }
+  last_byte_us_ = time_us;
+
+  if (count_ == 0 && byte != HEADER)
+    return false;
+
+  buffer_[count_++] = byte;
+  if (count_ < FRAME_SIZE)
+    return false;
+  count_ = 0;
+
+  // SBUS ends frames with 0x00, SBUS2 with 0x04, 0x14, 0x24 or 0x34
+  if (byte != 0x00 && (byte & 0x0F) != 0x04)
+  {
+    errors_++;
+    return false;
+  }
+
+  decode(time_us, frame);
+  return true;
+}
+
+void SbusDecoder::decode(uint64_t time_us, rc_frame_t *frame) const
+{
+  // unpack the 11-bit channels from the bit stream in bytes 1-22
+  const uint8_t *data = &buffer_[1];
+  uint32_t bits = 0;
+  uint8_t num_bits = 0;
+  for (uint8_t i = 0; i < NUM_CHANNELS; i++)
+  {
+    while (num_bits < 11)
+    {
+      bits |= static_cast<uint32_t>(*data++) << num_bits;
+      num_bits = static_cast<uint8_t>(num_bits + 8);
+    }
+    uint16_t value = static_cast<uint16_t>(bits & 0x07FF);
+    bits >>= 11;
+    num_bits = static_cast<uint8_t>(num_bits - 11);
+
+    // 172-1811 is the usual 988-2012 us range
+    frame->channels[i] = static_cast<uint16_t>(value*5/8 + 880);
+  }
+  frame->num_channels = NUM_CHANNELS;
+
+  // the frame lost flag only means a single frame was dropped, the receiver sets failsafe once the link is gone
+  frame->failsafe = (buffer_[23] & FLAG_FAILSAFE) != 0;
+  frame->time_us = time_us;
+}
+
+} // namespace rosflight_firmware
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scheduler.h"
+#include "rosflight.h"
+
+namespace rosflight_firmware
+{
+
+Scheduler::Scheduler(ROSflight& _rf) :
+  RF_(_rf)
+{}
+
+void Scheduler::init()
+{
+  last_imu_us_ = 0;
+  imu_period_us_ = 0;
+  next_overrun_log_us_ = 0;
+  overrun_count_ = 0;
+
+  uint64_t now_us = RF_.board_.clock_micros();
+  for (uint8_t i = 0; i < TASK_COUNT; i++)
+  {
+    tasks_[i].next_time_us = now_us;
+    tasks_[i].overruns = 0;
+    tasks_[i].deferrals = 0;
+  }
+
+  // sort the tasks by priority (insertion sort, so equal priorities keep their table order)
+  for (uint8_t i = 0; i < TASK_COUNT; i++)
+  {
+    uint8_t j = i;
+    while (j > 0 && tasks_[order_[j-1]].priority < tasks_[i].priority)
+    {
+      order_[j] = order_[j-1];
+      j--;
+    }
+    order_[j] = i;
+  }
+}
+
+void Scheduler::imu_update(uint64_t imu_time_us)
+{
+  if (last_imu_us_ != 0 && imu_time_us > last_imu_us_)
+  {
+    uint32_t dt_us = static_cast<uint32_t>(imu_time_us - last_imu_us_);
+    if (imu_period_us_ == 0)
+      imu_period_us_ = dt_us;
+    else
+      imu_period_us_ = (7*imu_period_us_ + dt_us)/8;
+  }
+  last_imu_us_ = imu_time_us;
+}
+
+bool Scheduler::fits_before_imu(uint64_t now_us, uint32_t budget_us) const
+{
+  // Until we know the IMU rate there is nothing to protect
+  if (imu_period_us_ == 0)
+    return true;
+
+  // If the IMU has stopped, don't hold up the housekeeping waiting for it
+  uint64_t next_imu_us = last_imu_us_ + imu_period_us_;
+  if (now_us > next_imu_us + imu_period_us_)
+    return true;
+
+  return now_us + budget_us + IMU_GUARD_US <= next_imu_us;
+}
+
+void Scheduler::run()
+{
+  uint64_t now_us = RF_.board_.clock_micros();
+  for (uint8_t i = 0; i < TASK_COUNT; i++)
+  {
+    uint8_t id = order_[i];
+    task_t& task = tasks_[id];
+    if (now_us < task.next_time_us)
+      continue;
+
+    // Tasks wait for the next idle slot if they would delay the next IMU sample,
+    // but not forever
+    uint32_t max_wait_us = (task.period_us > MAX_DEFER_US) ? task.period_us : MAX_DEFER_US;
+    bool starved = now_us >= task.next_time_us + max_wait_us;
+    if (!starved && !fits_before_imu(now_us, task.budget_us))
+    {
+      task.deferrals++;
+      continue;
+    }
+
+    run_task(id, now_us);
+    now_us = RF_.board_.clock_micros();
+  }
+}
+
+void Scheduler::run_task(uint8_t id, uint64_t now_us)
+{
+  task_t& task = tasks_[id];
+
+  if (task.period_us == 0)
+    task.next_time_us = now_us;
+  else if (task.next_time_us + task.period_us < now_us)
+    task.next_time_us = now_us + task.period_us; // fell behind, so skip rather than run back-to-back
+  else
+    task.next_time_us += task.period_us;
+
+  task.run(RF_);
+
+  uint64_t end_us = RF_.board_.clock_micros();
+  uint32_t elapsed_us = static_cast<uint32_t>(end_us - now_us);
+  RF_.profiler_.record(task.profiler_stage, elapsed_us);
+
+  if (elapsed_us > task.budget_us)
+  {
+    task.overruns++;
+    overrun_count_++;
+    // a slow pass only costs some slack, so it is a warning rather than an error that would block arming
+    if (end_us >= next_overrun_log_us_)
+    {
+      RF_.mavlink_.log(Mavlink::LOG_WARNING, "task %d overran %d us budget (%d us)", id, task.budget_us, elapsed_us);
+      next_overrun_log_us_ = end_us + OVERRUN_LOG_INTERVAL_US;
+    }
+  }
+}
+
+void Scheduler::run_mavlink_receive(ROSflight& rf)
+{
+  rf.mavlink_.receive();
+}
+
+void Scheduler::run_rc(ROSflight& rf)
+{
+  rf.rc_.run();
+}
+
+void Scheduler::run_command_manager(ROSflight& rf)
+{
+  rf.command_manager_.run();
+}
+
+void Scheduler::run_state_manager(ROSflight& rf)
+{
+  rf.state_manager_.run();
+}
+
+void Scheduler::run_mavlink_stream(ROSflight& rf)
+{
+  rf.mavlink_.stream();
+}
+
+void Scheduler::run_param_store(ROSflight& rf)
+{
+  rf.param_store_.run();
+}
+
+void Scheduler::run_gyro_analyzer(ROSflight& rf)
+{
+  rf.gyro_analyzer_.run();
+}
+
+void Scheduler::run_blackbox(ROSflight& rf)
+{
+  rf.blackbox_.run();
+}
+
+} // namespace rosflight_firmware
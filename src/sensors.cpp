@@ -52,6 +52,8 @@ const float Sensors::SONAR_SAMPLE_RATE = 50.0f;
 const int Sensors::SENSOR_CAL_DELAY_CYCLES = 128;
 const int Sensors::SENSOR_CAL_CYCLES = 127;
 
+constexpr float Sensors::GYRO_BIAS_TEMPERATURE_STEP;
+
 const float Sensors::BARO_MAX_CALIBRATION_VARIANCE = 25.0;   // standard dev about 0.2 m
 const float Sensors::DIFF_PRESSURE_MAX_CALIBRATION_VARIANCE = 100.0;   // standard dev about 3 m/s
 
@@ -74,7 +76,8 @@ void Sensors::init()
   {
     rf_.state_manager_.set_error(StateManager::ERROR_UNCALIBRATED_IMU);
   }
-  next_sensor_to_update_ = BAROMETER;
+  next_sensor_to_update_ = SENSOR_BARO;
+  rf_.board_.sensor_set_callback(&Sensors::sensor_result_callback, this);
 
   float alt = rf_.params_.get_param_float(PARAM_GROUND_LEVEL);
   ground_pressure_ = 101325.0f*static_cast<float>(pow((1-2.25694e-5 * alt), 5.2553));
@@ -82,6 +85,91 @@ void Sensors::init()
   baro_outlier_filt_.init(BARO_MAX_CHANGE_RATE, BARO_SAMPLE_RATE, ground_pressure_);
   diff_outlier_filt_.init(DIFF_MAX_CHANGE_RATE, DIFF_SAMPLE_RATE, 0.0f);
   sonar_outlier_filt_.init(SONAR_MAX_CHANGE_RATE, SONAR_SAMPLE_RATE, 0.0f);
+
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_IMU_SAMPLE_RATE);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_LPF_HZ);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_LPF2_HZ);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_ACC_LPF_HZ);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_NOTCH_HZ);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_NOTCH_Q);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_DYN_NOTCH);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_DYN_NOTCH_Q);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_GYRO_DYN_NOTCH_MIN_HZ);
+  rf_.params_.add_callback<Sensors, &Sensors::param_change_callback>(this, PARAM_STREAM_IMU_BATCH_RATE);
+
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_GYRO_X_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_GYRO_Y_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_GYRO_Z_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_X_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_Y_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_Z_BIAS);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_X_TEMP_COMP);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_Y_TEMP_COMP);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_ACC_Z_TEMP_COMP);
+  rf_.params_.add_callback<Sensors, &Sensors::calibration_param_callback>(this, PARAM_IMU_ONLINE_CAL);
+}
+
+void Sensors::param_change_callback(uint16_t param_id)
+{
+  if (param_id == PARAM_STREAM_IMU_BATCH_RATE || param_id == Params::BATCH_CHANGED)
+    imu_batch_enabled_ = rf_.params_.get_param_int(PARAM_STREAM_IMU_BATCH_RATE) > 0;
+  // every filter parameter just recomputes the coefficients
+  if (param_id != PARAM_STREAM_IMU_BATCH_RATE)
+    update_imu_filters();
+}
+
+void Sensors::calibration_param_callback(uint16_t param_id)
+{
+  (void) param_id; // the corrections are cheap to reload all at once
+
+  accel_bias_.x = rf_.params_.get_param_float(PARAM_ACC_X_BIAS);
+  accel_bias_.y = rf_.params_.get_param_float(PARAM_ACC_Y_BIAS);
+  accel_bias_.z = rf_.params_.get_param_float(PARAM_ACC_Z_BIAS);
+  accel_temp_comp_.x = rf_.params_.get_param_float(PARAM_ACC_X_TEMP_COMP);
+  accel_temp_comp_.y = rf_.params_.get_param_float(PARAM_ACC_Y_TEMP_COMP);
+  accel_temp_comp_.z = rf_.params_.get_param_float(PARAM_ACC_Z_TEMP_COMP);
+
+  imu_calibrator_.set_default_gyro_bias(turbomath::Vector(rf_.params_.get_param_float(PARAM_GYRO_X_BIAS),
+                                                          rf_.params_.get_param_float(PARAM_GYRO_Y_BIAS),
+                                                          rf_.params_.get_param_float(PARAM_GYRO_Z_BIAS)));
+
+  // turning the online calibration off drops its model, so the gyro params apply again
+  online_calibration_enabled_ = rf_.params_.get_param_int(PARAM_IMU_ONLINE_CAL);
+  if (!online_calibration_enabled_)
+    imu_calibrator_.reset();
+  gyro_bias_stale_ = true;
+}
+
+void Sensors::update_gyro_bias(void)
+{
+  gyro_bias_ = imu_calibrator_.gyro_bias(data_.imu_temperature);
+  gyro_bias_temperature_ = data_.imu_temperature;
+  gyro_bias_stale_ = false;
+}
+
+void Sensors::update_imu_filters(void)
+{
+  // all the trig happens here, so the per-sample cost is just the multiply-adds
+  imu_sample_rate_hz_ = static_cast<float>(rf_.params_.get_param_int(PARAM_IMU_SAMPLE_RATE));
+  gyro_lpf_[0].set_lowpass(imu_sample_rate_hz_, rf_.params_.get_param_float(PARAM_GYRO_LPF_HZ));
+  gyro_lpf_[1].set_lowpass(imu_sample_rate_hz_, rf_.params_.get_param_float(PARAM_GYRO_LPF2_HZ));
+  acc_lpf_.set_lowpass(imu_sample_rate_hz_, rf_.params_.get_param_float(PARAM_ACC_LPF_HZ));
+  gyro_notch_.set_notch(imu_sample_rate_hz_, rf_.params_.get_param_float(PARAM_GYRO_NOTCH_HZ),
+                        rf_.params_.get_param_float(PARAM_GYRO_NOTCH_Q));
+
+  dyn_notch_enabled_ = rf_.params_.get_param_int(PARAM_GYRO_DYN_NOTCH);
+  dyn_notch_q_ = rf_.params_.get_param_float(PARAM_GYRO_DYN_NOTCH_Q);
+  dyn_notch_min_hz_ = rf_.params_.get_param_float(PARAM_GYRO_DYN_NOTCH_MIN_HZ);
+  set_dynamic_notch_frequency(dyn_notch_hz_);
+}
+
+void Sensors::set_dynamic_notch_frequency(float center_hz)
+{
+  dyn_notch_hz_ = center_hz;
+  if (dyn_notch_enabled_ && center_hz >= dyn_notch_min_hz_)
+    gyro_dyn_notch_.set_notch(imu_sample_rate_hz_, center_hz, dyn_notch_q_);
+  else
+    gyro_dyn_notch_.disable();
 }
 
 
@@ -106,57 +194,31 @@ bool Sensors::run(void)
 
 void Sensors::update_other_sensors()
 {
+  // Collect the results the board has finished with, then queue a read of the next sensor in turn. The reads
+  // only queue bus transactions, so a slow sensor never holds up the next IMU sample.
+  rf_.board_.sensor_poll();
+
+  bool present = false;
   switch (next_sensor_to_update_)
   {
-  case LowPrioritySensors::BAROMETER:
-    if (data_.baro_present)
-    {
-      float raw_pressure;
-      float raw_temp;
-      rf_.board_.baro_read(&raw_pressure, &raw_temp);
-      data_.baro_valid = baro_outlier_filt_.update(raw_pressure, &data_.baro_pressure);
-      if (data_.baro_valid)
-      {
-        data_.baro_temperature = raw_temp;
-        correct_baro();
-      }
-    }
+  case SENSOR_BARO:
+    present = data_.baro_present;
     break;
-  case LowPrioritySensors::DIFF_PRESSURE:
-    if (data_.diff_pressure_present)
-    {
-      float raw_pressure;
-      float raw_temp;
-      rf_.board_.diff_pressure_read(&raw_pressure, &raw_temp);
-      data_.diff_pressure_valid = diff_outlier_filt_.update(raw_pressure, &data_.diff_pressure);
-      if (data_.diff_pressure_valid)
-      {
-        data_.diff_pressure_temp = raw_temp;
-        correct_diff_pressure();
-      }
-    }
+  case SENSOR_DIFF_PRESSURE:
+    present = data_.diff_pressure_present;
     break;
-  case LowPrioritySensors::SONAR:
-    if (data_.sonar_present)
-    {
-      data_.sonar_range_valid = sonar_outlier_filt_.update(rf_.board_.sonar_read(), &data_.sonar_range);
-    }
+  case SENSOR_SONAR:
+    present = data_.sonar_present;
     break;
-  case LowPrioritySensors::MAGNETOMETER:
-    if (data_.mag_present)
-    {
-      float mag[3];
-      rf_.board_.mag_read(mag);
-      data_.mag.x = mag[0];
-      data_.mag.y = mag[1];
-      data_.mag.z = mag[2];
-      correct_mag();
-    }
+  case SENSOR_MAG:
+    present = data_.mag_present;
     break;
   default:
     break;
   }
-  next_sensor_to_update_ = static_cast<LowPrioritySensors>((next_sensor_to_update_ + 1) % NUM_LOW_PRIORITY_SENSORS);
+  if (present)
+    rf_.board_.sensor_request(next_sensor_to_update_);
+  next_sensor_to_update_ = static_cast<sensor_id_t>((next_sensor_to_update_ + 1) % SENSOR_COUNT);
 }
 
 
@@ -165,43 +227,87 @@ void Sensors::look_for_disabled_sensors()
   // Look for disabled sensors while disarmed (poll every second)
   // These sensors need power to respond, so they might not have been
   // detected on startup, but will be detected whenever power is applied
-  // to the 5V rail.
+  // to the 5V rail. The probes are reads like any other, and a sensor
+  // that answers is picked up in handle_sensor_result().
   uint32_t now = rf_.board_.clock_millis();
   if (now > (last_time_look_for_disarmed_sensors_ + 1000))
   {
     last_time_look_for_disarmed_sensors_ = now;
     if (!data_.sonar_present)
+      rf_.board_.sensor_request(SENSOR_SONAR);
+    if (!data_.diff_pressure_present)
+      rf_.board_.sensor_request(SENSOR_DIFF_PRESSURE);
+    if (!data_.baro_present)
+      rf_.board_.sensor_request(SENSOR_BARO);
+    if (!data_.mag_present)
+      rf_.board_.sensor_request(SENSOR_MAG);
+  }
+}
+
+void Sensors::sensor_result_callback(void *context, const sensor_result_t &result)
+{
+  static_cast<Sensors *>(context)->handle_sensor_result(result);
+}
+
+void Sensors::handle_sensor_result(const sensor_result_t &result)
+{
+  if (!result.present)
+    return;
+
+  // the first answer of a sensor that wasn't there just finds it, its reads start on its next turn
+  switch (result.sensor)
+  {
+  case SENSOR_BARO:
+    if (!data_.baro_present)
     {
-      if (rf_.board_.sonar_check())
-      {
-        data_.sonar_present = true;
-        rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND SONAR");
-      }
+      data_.baro_present = true;
+      rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND BAROMETER");
+      return;
     }
+    data_.baro_valid = baro_outlier_filt_.update(result.value[0], &data_.baro_pressure);
+    if (data_.baro_valid)
+    {
+      data_.baro_temperature = result.temperature;
+      correct_baro();
+    }
+    break;
+  case SENSOR_DIFF_PRESSURE:
     if (!data_.diff_pressure_present)
     {
-      if (rf_.board_.diff_pressure_check())
-      {
-        data_.diff_pressure_present = true;
-        rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND DIFF PRESS");
-      }
+      data_.diff_pressure_present = true;
+      rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND DIFF PRESS");
+      return;
     }
-    if (!data_.baro_present)
+    data_.diff_pressure_valid = diff_outlier_filt_.update(result.value[0], &data_.diff_pressure);
+    if (data_.diff_pressure_valid)
     {
-      if (rf_.board_.baro_check())
-      {
-        data_.baro_present = true;
-        rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND BAROMETER");
-      }
+      data_.diff_pressure_temp = result.temperature;
+      correct_diff_pressure();
     }
+    break;
+  case SENSOR_SONAR:
+    if (!data_.sonar_present)
+    {
+      data_.sonar_present = true;
+      rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND SONAR");
+      return;
+    }
+    data_.sonar_range_valid = sonar_outlier_filt_.update(result.value[0], &data_.sonar_range);
+    break;
+  case SENSOR_MAG:
     if (!data_.mag_present)
     {
-      if (rf_.board_.mag_check())
-      {
-        data_.mag_present = true;
-        rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND MAGNETOMETER");
-      }
+      data_.mag_present = true;
+      rf_.mavlink_.log(Mavlink::LOG_INFO, "FOUND MAGNETOMETER");
+      return;
     }
+    data_.mag.x = result.value[0];
+    data_.mag.y = result.value[1];
+    data_.mag.z = result.value[2];
+    correct_mag();
+    break;
+  default:
+    break;
   }
 }
 
@@ -254,29 +360,38 @@ bool Sensors::gyro_calibration_complete(void)
 // local function definitions
 bool Sensors::update_imu(void)
 {
-  if (rf_.board_.new_imu_data())
+  imu_sample_t sample;
+  if (rf_.board_.imu_read(&sample))
   {
     rf_.state_manager_.clear_error(StateManager::ERROR_IMU_NOT_RESPONDING);
     last_imu_update_ms_ = rf_.board_.clock_millis();
-    if (!rf_.board_.imu_read(accel_, &data_.imu_temperature, gyro_, &data_.imu_time))
-    {
-      return false;
-    }
 
-    data_.accel.x = accel_[0];
-    data_.accel.y = accel_[1];
-    data_.accel.z = accel_[2];
+    data_.imu_time = sample.time_us;
+    data_.imu_temperature = sample.temperature;
+
+    data_.accel.x = sample.accel[0];
+    data_.accel.y = sample.accel[1];
+    data_.accel.z = sample.accel[2];
 
-    data_.gyro.x = gyro_[0];
-    data_.gyro.y = gyro_[1];
-    data_.gyro.z = gyro_[2];
+    data_.gyro.x = sample.gyro[0];
+    data_.gyro.y = sample.gyro[1];
+    data_.gyro.z = sample.gyro[2];
 
     if (calibrating_acc_flag_)
       calibrate_accel();
     if (calibrating_gyro_flag_)
       calibrate_gyro();
+    if (online_calibration_enabled_ && !rf_.state_manager_.state().armed
+        && imu_calibrator_.push(data_.accel, data_.gyro, data_.imu_temperature))
+    {
+      gyro_bias_stale_ = true;
+      rf_.estimator_.reset_adaptive_bias();
+    }
 
     correct_imu();
+
+    if (imu_batch_enabled_)
+      batch_imu();
     return true;
   }
   else
@@ -505,17 +620,44 @@ void Sensors::calibrate_diff_pressure()
 // Correction Functions (These apply calibration constants)
 void Sensors::correct_imu(void)
 {
-  // correct according to known biases and temperature compensation
-  data_.accel.x -= rf_.params_.get_param_float(PARAM_ACC_X_TEMP_COMP)*data_.imu_temperature
-                    + rf_.params_.get_param_float(PARAM_ACC_X_BIAS);
-  data_.accel.y -= rf_.params_.get_param_float(PARAM_ACC_Y_TEMP_COMP)*data_.imu_temperature
-                    + rf_.params_.get_param_float(PARAM_ACC_Y_BIAS);
-  data_.accel.z -= rf_.params_.get_param_float(PARAM_ACC_Z_TEMP_COMP)*data_.imu_temperature
-                    + rf_.params_.get_param_float(PARAM_ACC_Z_BIAS);
-
-  data_.gyro.x -= rf_.params_.get_param_float(PARAM_GYRO_X_BIAS);
-  data_.gyro.y -= rf_.params_.get_param_float(PARAM_GYRO_Y_BIAS);
-  data_.gyro.z -= rf_.params_.get_param_float(PARAM_GYRO_Z_BIAS);
+  // correct according to known biases and temperature compensation, the gyro bias model is only
+  // evaluated again when the temperature has moved or the model changed
+  if (gyro_bias_stale_
+      || turbomath::fabs(data_.imu_temperature - gyro_bias_temperature_) > GYRO_BIAS_TEMPERATURE_STEP)
+    update_gyro_bias();
+
+  data_.accel.x -= accel_temp_comp_.x*data_.imu_temperature + accel_bias_.x;
+  data_.accel.y -= accel_temp_comp_.y*data_.imu_temperature + accel_bias_.y;
+  data_.accel.z -= accel_temp_comp_.z*data_.imu_temperature + accel_bias_.z;
+
+  data_.gyro -= gyro_bias_;
+
+  // the analyzer looks for the vibrations the filters are there to remove
+  rf_.gyro_analyzer_.push(data_.gyro);
+
+  uint64_t t = rf_.profiler_.tic();
+  data_.gyro = gyro_notch_.apply(data_.gyro);
+  data_.gyro = gyro_dyn_notch_.apply(data_.gyro);
+  data_.gyro = gyro_lpf_[0].apply(data_.gyro);
+  data_.gyro = gyro_lpf_[1].apply(data_.gyro);
+  data_.accel = acc_lpf_.apply(data_.accel);
+  rf_.profiler_.toc(Profiler::STAGE_IMU_FILTER, t);
+}
+
+void Sensors::batch_imu(void)
+{
+  imu_sample_t corrected;
+  corrected.accel[0] = data_.accel.x;
+  corrected.accel[1] = data_.accel.y;
+  corrected.accel[2] = data_.accel.z;
+  corrected.gyro[0] = data_.gyro.x;
+  corrected.gyro[1] = data_.gyro.y;
+  corrected.gyro[2] = data_.gyro.z;
+  corrected.temperature = data_.imu_temperature;
+  corrected.time_us = data_.imu_time;
+
+  // if the link falls behind the newest samples are dropped, which shows up as a gap in the batch timestamps
+  imu_batch_.push(corrected);
 }
 
 void Sensors::correct_mag(void)
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "timesync.h"
+
+namespace rosflight_firmware
+{
+
+constexpr float TimeSync::OFFSET_GAIN;
+constexpr float TimeSync::SKEW_GAIN;
+constexpr float TimeSync::MAX_SKEW;
+constexpr uint32_t TimeSync::RESYNC_THRESHOLD_US;
+constexpr uint32_t TimeSync::ROUND_TRIP_MARGIN_US;
+constexpr uint8_t TimeSync::MIN_SAMPLES;
+
+TimeSync::TimeSync()
+{
+  reset();
+}
+
+void TimeSync::reset()
+{
+  samples_ = 0;
+  offset_us_ = 0;
+  reference_us_ = 0;
+  skew_ = 0.0f;
+  min_round_trip_us_ = UINT32_MAX;
+  rejected_ = 0;
+  resyncs_ = 0;
+}
+
+bool TimeSync::add_round_trip(uint64_t local_send_us, uint64_t host_us, uint64_t local_receive_us)
+{
+  if (local_receive_us < local_send_us || local_receive_us - local_send_us > UINT32_MAX)
+  {
+    rejected_++;
+    return false;
+  }
+  uint32_t round_trip_us = static_cast<uint32_t>(local_receive_us - local_send_us);
+
+  // the quickest recent round trip, allowed to creep up so the gate follows a slower link
+  if (round_trip_us < min_round_trip_us_)
+    min_round_trip_us_ = round_trip_us;
+  else
+    min_round_trip_us_ += (min_round_trip_us_ >> 6) + 1;
+
+  if (samples_ > 0 && round_trip_us > 2*min_round_trip_us_ + ROUND_TRIP_MARGIN_US)
+  {
+    rejected_++;
+    return false;
+  }
+
+  // assume the host answered halfway through the trip
+  uint64_t local_us = local_send_us + round_trip_us/2;
+  int64_t measured_offset_us = static_cast<int64_t>(host_us - local_us);
+
+  if (samples_ == 0)
+  {
+    offset_us_ = measured_offset_us;
+    reference_us_ = local_us;
+    skew_ = 0.0f;
+    samples_ = 1;
+    return true;
+  }
+
+  float dt_us = static_cast<float>(local_us - reference_us_);
+  float predicted_us = skew_ * dt_us;
+  float residual_us = static_cast<float>(measured_offset_us - offset_us_) - predicted_us;
+  if (residual_us > static_cast<float>(RESYNC_THRESHOLD_US) || residual_us < -static_cast<float>(RESYNC_THRESHOLD_US))
+  {
+    // step to the new offset rather than start over, so that converted times never jump back to
+    // board time; the skew belongs to the oscillators and carries over
+    offset_us_ = measured_offset_us;
+    reference_us_ = local_us;
+    resyncs_++;
+    return true;
+  }
+
+  offset_us_ += static_cast<int64_t>(predicted_us + OFFSET_GAIN * residual_us);
+  if (dt_us > 0.0f)
+  {
+    skew_ += SKEW_GAIN * residual_us / dt_us;
+    if (skew_ > MAX_SKEW)
+      skew_ = MAX_SKEW;
+    else if (skew_ < -MAX_SKEW)
+      skew_ = -MAX_SKEW;
+  }
+  reference_us_ = local_us;
+
+  if (samples_ < MIN_SAMPLES)
+    samples_++;
+  return true;
+}
+
+uint64_t TimeSync::to_host_us(uint64_t local_us) const
+{
+  if (!synced())
+    return local_us;
+
+  // the conversion is only ever asked for times near the last round trip, so the skew term stays small
+  int64_t dt_us = static_cast<int64_t>(local_us - reference_us_);
+  int64_t offset_us = offset_us_ + static_cast<int64_t>(skew_ * static_cast<float>(dt_us));
+  return local_us + static_cast<uint64_t>(offset_us);
+}
+
+} // namespace rosflight_firmware
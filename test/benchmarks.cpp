@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+// Host microbenchmarks of the hot path, built as the benchmarks target when Google Benchmark is installed.
+// All of the host timing lives here; unit_tests only has tests that can pass or fail.
+// Run with --benchmark_out=<file>.json --benchmark_out_format=json and compare two releases with the
+// compare.py tool that comes with Google Benchmark. boards/naze/benchmark.cpp times the same kernels on the
+// flight controller, its kernel table lists which benchmark each one matches.
+
+#include <benchmark/benchmark.h>
+
+#include <turbomath/turbomath.h>
+
+#include "controller.h"
+#include "filter.h"
+#include "replay.h"
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+const uint32_t IMU_PERIOD_US = 1000;
+const uint16_t NUM_INPUTS = 256; // a table of inputs cycled through, so that nothing is constant-folded
+
+float input(uint16_t i, float scale)
+{
+  // deterministic values spread over [-scale, scale]
+  return scale*(static_cast<float>((i*37u) % NUM_INPUTS)/(NUM_INPUTS/2) - 1.0f);
+}
+
+// An initialized firmware flying a quadcopter, armed and at half throttle
+struct Firmware
+{
+  testBoard board;
+  ROSflight rf;
+  uint64_t time_us;
+  uint16_t sample;
+
+  Firmware() :
+    rf(board),
+    time_us(0),
+    sample(0)
+  {
+    rf.init();
+    rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+    rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+    uint16_t rc[8] = {1500, 1500, 1500, 1500, 1000, 1000, 1000, 1000};
+    board.set_rc(rc);
+    for (int i = 0; i < 100; i++)
+      step();
+    rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+    rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+    for (int i = 0; i < 100; i++)
+      step();
+  }
+
+  // queues the next IMU sample, with a bit of motion on every axis
+  void next_imu()
+  {
+    time_us += IMU_PERIOD_US;
+    sample = static_cast<uint16_t>((sample + 1) % NUM_INPUTS);
+    float acc[3] = {input(sample, 0.5f), input(sample + 7, 0.5f), -9.80665f + input(sample + 13, 0.5f)};
+    float gyro[3] = {input(sample + 3, 0.2f), input(sample + 5, 0.2f), input(sample + 11, 0.2f)};
+    board.set_imu(acc, gyro, time_us);
+  }
+
+  void step()
+  {
+    next_imu();
+    rf.run();
+  }
+};
+
+void BM_FullLoop(benchmark::State& state)
+{
+  Firmware fw;
+  for (auto _ : state)
+    fw.step();
+}
+BENCHMARK(BM_FullLoop);
+
+// The whole pipeline replaying a minute of 1 kHz synthetic flight on virtual time, as control updates per second
+void BM_Replay(benchmark::State& state)
+{
+  std::vector<Replay::Record> log = Replay::synthetic_flight(60.0f, 1000);
+  size_t updates = 0;
+  for (auto _ : state)
+  {
+    state.PauseTiming();
+    Replay replay;
+    ROSflight& rf = replay.firmware();
+    rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+    rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+    rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+    state.ResumeTiming();
+
+    replay.run(log);
+    updates += replay.outputs().size();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(updates));
+}
+BENCHMARK(BM_Replay)->Unit(benchmark::kMillisecond);
+
+void BM_SensorsImu(benchmark::State& state)
+{
+  Firmware fw;
+  for (auto _ : state)
+  {
+    fw.next_imu();
+    benchmark::DoNotOptimize(fw.rf.sensors_.run());
+  }
+}
+BENCHMARK(BM_SensorsImu);
+
+// Estimator::run needs a new IMU sample every time, so this includes BM_SensorsImu
+void BM_SensorsEstimator(benchmark::State& state)
+{
+  Firmware fw;
+  for (auto _ : state)
+  {
+    fw.next_imu();
+    fw.rf.sensors_.run();
+    fw.rf.estimator_.run();
+    benchmark::DoNotOptimize(fw.rf.estimator_.state().attitude.w);
+  }
+}
+BENCHMARK(BM_SensorsEstimator);
+
+// The three-axis PID kernel of Controller::run_pid_loops
+void BM_ControllerPID(benchmark::State& state)
+{
+  const float kp[3] = {0.3f, 0.3f, 0.2f};
+  const float ki[3] = {0.1f, 0.1f, 0.05f};
+  const float kd[3] = {0.05f, 0.05f, 0.0f};
+  const float kff[3] = {0.0f, 0.0f, 0.0f};
+  const bool active[3] = {true, true, true};
+  Controller::PID pid;
+  pid.init(kp, ki, kd, kff, 1.0f, 0.05f, 0.0f);
+  pid.set_dterm_lowpass(1000.0f, static_cast<float>(state.range(0)));
+
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    const float x[3] = {input(i, 0.2f), input(i + 1, 0.2f), input(i + 2, 0.2f)};
+    const float x_c[3] = {0.1f, -0.1f, 0.0f};
+    float u[3];
+    pid.run(0.001f, x, x_c, active, true, u);
+    benchmark::DoNotOptimize(u);
+  }
+}
+BENCHMARK(BM_ControllerPID)->Arg(0)->Arg(100);
+
+void BM_MixerMixOutput(benchmark::State& state)
+{
+  Firmware fw;
+  for (auto _ : state)
+  {
+    fw.rf.mixer_.mix_output();
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_MixerMixOutput);
+
+// An octocopter with a saturating command, through the saturating mixer (0), airmode (1) and airmode with a
+// thrust curve (2)
+void BM_MixerAllocation(benchmark::State& state)
+{
+  Firmware fw;
+  fw.rf.params_.set_param_int(PARAM_MIXER, Mixer::OCTO_X);
+  fw.rf.params_.set_param_int(PARAM_MIXER_AIRMODE, state.range(0) > 0);
+  fw.rf.params_.set_param_float(PARAM_MOTOR_THRUST_CURVE, (state.range(0) > 1) ? 0.5f : 0.0f);
+  Controller::Output commands = {0.9f, 0.2f, -0.1f, 0.05f};
+  for (auto _ : state)
+  {
+    fw.rf.mixer_.mix_output(commands);
+    commands.x = -commands.x;
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_MixerAllocation)->Arg(0)->Arg(1)->Arg(2);
+
+// One call per IMU period, with the default stream rates
+void BM_MavlinkStream(benchmark::State& state)
+{
+  Firmware fw;
+  for (auto _ : state)
+  {
+    fw.time_us += IMU_PERIOD_US;
+    fw.board.set_time(fw.time_us);
+    fw.rf.mavlink_.stream();
+  }
+}
+BENCHMARK(BM_MavlinkStream);
+
+// Link traffic of the armed firmware with the default stream rates, for each MAVLINK_VER, as a bytes_per_s counter
+void BM_MavlinkBandwidth(benchmark::State& state)
+{
+  Firmware fw;
+  fw.rf.params_.set_param_int(PARAM_MAVLINK_VERSION, static_cast<int>(state.range(0)));
+  size_t start_bytes = fw.board.serial_bytes_written();
+  uint64_t start_us = fw.time_us;
+  for (auto _ : state)
+    fw.step();
+  double seconds = static_cast<double>(fw.time_us - start_us)*1e-6;
+  state.counters["bytes_per_s"] = static_cast<double>(fw.board.serial_bytes_written() - start_bytes)/seconds;
+}
+BENCHMARK(BM_MavlinkBandwidth)->Arg(1)->Arg(2);
+
+void BM_BiquadApply(benchmark::State& state)
+{
+  Biquad filter;
+  filter.set_lowpass(1000.0f, 100.0f);
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    turbomath::Vector y = filter.apply(turbomath::Vector(input(i, 1.0f), input(i + 1, 1.0f), input(i + 2, 1.0f)));
+    benchmark::DoNotOptimize(y);
+  }
+}
+BENCHMARK(BM_BiquadApply);
+
+template <turbomath::precision_t P>
+void BM_Sin(benchmark::State& state)
+{
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    benchmark::DoNotOptimize(turbomath::sin<P>(input(i, 3.14159265f)));
+  }
+}
+BENCHMARK_TEMPLATE(BM_Sin, turbomath::PRECISION_TABLE);
+BENCHMARK_TEMPLATE(BM_Sin, turbomath::PRECISION_FINE_TABLE);
+BENCHMARK_TEMPLATE(BM_Sin, turbomath::PRECISION_POLYNOMIAL);
+
+template <turbomath::precision_t P>
+void BM_Asin(benchmark::State& state)
+{
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    benchmark::DoNotOptimize(turbomath::asin<P>(input(i, 0.99f)));
+  }
+}
+BENCHMARK_TEMPLATE(BM_Asin, turbomath::PRECISION_TABLE);
+BENCHMARK_TEMPLATE(BM_Asin, turbomath::PRECISION_FINE_TABLE);
+BENCHMARK_TEMPLATE(BM_Asin, turbomath::PRECISION_POLYNOMIAL);
+
+template <turbomath::precision_t P>
+void BM_Atan2(benchmark::State& state)
+{
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    benchmark::DoNotOptimize(turbomath::atan2<P>(input(i, 1.0f), input(i + 17, 1.0f)));
+  }
+}
+BENCHMARK_TEMPLATE(BM_Atan2, turbomath::PRECISION_TABLE);
+BENCHMARK_TEMPLATE(BM_Atan2, turbomath::PRECISION_FINE_TABLE);
+BENCHMARK_TEMPLATE(BM_Atan2, turbomath::PRECISION_POLYNOMIAL);
+
+// The first-order low-pass of the estimator's accel and gyro filters
+void BM_Axpby(benchmark::State& state)
+{
+  turbomath::Vector y(0.0f, 0.0f, 0.0f);
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    turbomath::axpby(0.5f, turbomath::Vector(input(i, 1.0f), input(i + 1, 1.0f), 9.8f), 0.5f, y);
+    benchmark::DoNotOptimize(y);
+  }
+}
+BENCHMARK(BM_Axpby);
+
+// The attitude update of the estimator's integrators
+void BM_PropagateNormalize(benchmark::State& state)
+{
+  turbomath::Quaternion q(1.0f, 0.0f, 0.0f, 0.0f);
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    turbomath::Vector w(input(i, 1.0f), input(i + 1, 1.0f), input(i + 2, 1.0f));
+    q = turbomath::propagate_normalize(q, w, 1.0f, 0.0005f);
+    benchmark::DoNotOptimize(q);
+  }
+}
+BENCHMARK(BM_PropagateNormalize);
+
+void BM_InvSqrt(benchmark::State& state)
+{
+  uint16_t i = 0;
+  for (auto _ : state)
+  {
+    i = static_cast<uint16_t>((i + 1) % NUM_INPUTS);
+    benchmark::DoNotOptimize(turbomath::inv_sqrt(1.5f + input(i, 1.0f)));
+  }
+}
+BENCHMARK(BM_InvSqrt);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <vector>
+
+#include "common.h"
+#include "blackbox.h"
+#include "rosflight.h"
+#include "test_board.h"
+#include "test_helpers.h"
+#include "varint.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+struct Frame
+{
+  uint8_t type;
+  uint64_t time_us;
+  int32_t fields[Blackbox::NUM_FIELDS];
+};
+
+// Decodes the log the way a ground station would, returns false if it is malformed
+bool decode_log(const uint8_t *log, uint32_t size, std::vector<Frame> *frames, int *sessions)
+{
+  Frame previous = {};
+  bool have_previous = false;
+  *sessions = 0;
+  for (uint32_t page = 0; page < size; page += Blackbox::PAGE_SIZE)
+  {
+    uint32_t i = page;
+    uint32_t page_end = page + Blackbox::PAGE_SIZE;
+    while (i < page_end && log[i] != 0xFF)
+    {
+      uint8_t type = log[i++];
+      if (type == Blackbox::FRAME_HEADER)
+      {
+        if (log[i] != Blackbox::FORMAT_VERSION || log[i+1] != Blackbox::NUM_FIELDS)
+          return false;
+        i += 6;
+        (*sessions)++;
+        have_previous = false;
+        continue;
+      }
+      if (type != Blackbox::FRAME_KEYFRAME && (type != Blackbox::FRAME_DELTA || !have_previous))
+        return false;
+
+      Frame frame;
+      frame.type = type;
+      uint64_t value = 0;
+      uint8_t len = varint_decode(log + i, page_end - i, &value);
+      if (len == 0)
+        return false;
+      i += len;
+      frame.time_us = (type == Blackbox::FRAME_KEYFRAME) ? value : previous.time_us + value;
+      for (uint8_t f = 0; f < Blackbox::NUM_FIELDS; f++)
+      {
+        len = varint_decode(log + i, page_end - i, &value);
+        if (len == 0)
+          return false;
+        i += len;
+        int32_t field = zigzag_decode(static_cast<uint32_t>(value));
+        frame.fields[f] = (type == Blackbox::FRAME_KEYFRAME) ? field : previous.fields[f] + field;
+      }
+      frames->push_back(frame);
+      previous = frame;
+      have_previous = true;
+    }
+  }
+  return true;
+}
+
+// The gyro turning slowly about z, so that the log has something to compress
+void turning_gyro(uint64_t time_us, float gyro[3])
+{
+  gyro[0] = 0.01f;
+  gyro[1] = -0.02f;
+  gyro[2] = 0.001f*static_cast<float>((time_us/1000) % 100);
+}
+
+class BlackboxTest : public ::testing::Test
+{
+public:
+  testBoard board;
+  ROSflight rf;
+
+  BlackboxTest() : rf(board) {}
+
+  void SetUp() override
+  {
+    rf.init();
+    rf.params_.set_param_int(PARAM_BLACKBOX, true);
+    rf.params_.set_param_int(PARAM_BLACKBOX_RATE_DIV, 1);
+    const uint16_t rc[8] = {1500, 1500, 1000, 1500, 1000, 1000, 1000, 1000};
+    board.set_rc(rc);
+    step_firmware(rf, board, 10000, turning_gyro);
+  }
+};
+
+} // namespace
+
+TEST(blackbox_test, varint_round_trip)
+{
+  const int32_t values[] = {0, 1, -1, 63, -64, 64, 1000000, -1000000, INT32_MAX, INT32_MIN};
+  for (int32_t value : values)
+  {
+    uint8_t bytes[VARINT_MAX_SIZE_64];
+    uint8_t len = varint_encode(zigzag_encode(value), bytes);
+    EXPECT_LE(len, VARINT_MAX_SIZE_32);
+
+    uint64_t decoded = 0;
+    EXPECT_EQ(varint_decode(bytes, len, &decoded), len);
+    EXPECT_EQ(zigzag_decode(static_cast<uint32_t>(decoded)), value);
+    EXPECT_EQ(varint_decode(bytes, len - 1, &decoded), 0); // truncated
+  }
+
+  // small deltas of either sign take one byte
+  uint8_t bytes[VARINT_MAX_SIZE_64];
+  EXPECT_EQ(varint_encode(zigzag_encode(-64), bytes), 1);
+  EXPECT_EQ(varint_encode(zigzag_encode(63), bytes), 1);
+  EXPECT_EQ(varint_encode(UINT64_MAX, bytes), VARINT_MAX_SIZE_64);
+}
+
+TEST_F(BlackboxTest, logs_only_while_armed)
+{
+  EXPECT_TRUE(rf.blackbox_.available());
+  EXPECT_FALSE(rf.blackbox_.logging());
+  EXPECT_EQ(rf.blackbox_.frames_logged(), 0u);
+
+  arm_quad_x(rf);
+  step_firmware(rf, board, 200000, turning_gyro);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+  EXPECT_TRUE(rf.blackbox_.logging());
+
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  step_firmware(rf, board, 10000, turning_gyro);
+  ASSERT_FALSE(rf.state_manager_.state().armed);
+  EXPECT_FALSE(rf.blackbox_.logging());
+
+  // a frame per control update, all written out once disarmed
+  uint32_t logged = rf.blackbox_.frames_logged();
+  EXPECT_NEAR(logged, 200, 5);
+  EXPECT_EQ(rf.blackbox_.frames_dropped(), 0u);
+  EXPECT_EQ(rf.blackbox_.size() % Blackbox::PAGE_SIZE, 0u);
+  EXPECT_GT(rf.blackbox_.size(), 0u);
+
+  std::vector<Frame> frames;
+  int sessions;
+  ASSERT_TRUE(decode_log(board.log_data(), rf.blackbox_.size(), &frames, &sessions));
+  EXPECT_EQ(sessions, 1);
+  ASSERT_EQ(frames.size(), logged);
+
+  // delta encoding takes less than a third of the space of the raw floats and timestamps
+  EXPECT_LT(rf.blackbox_.size(), logged*(Blackbox::NUM_FIELDS*4 + 8)/3);
+
+  const Frame& last = frames.back();
+  EXPECT_EQ(last.time_us, rf.sensors_.data().imu_time - 10000);
+  EXPECT_NEAR(last.fields[Blackbox::FIELD_ACCEL_Z], -981, 2);
+  EXPECT_EQ(frames[0].type, Blackbox::FRAME_KEYFRAME);
+  for (size_t i = 1; i < frames.size(); i++)
+  {
+    EXPECT_EQ(frames[i].time_us - frames[i-1].time_us, 1000u);
+    EXPECT_EQ(frames[i].type, (i % Blackbox::KEYFRAME_INTERVAL == 0) ? Blackbox::FRAME_KEYFRAME : Blackbox::FRAME_DELTA);
+  }
+}
+
+TEST_F(BlackboxTest, decoded_fields_match_the_flight_data)
+{
+  arm_quad_x(rf);
+  step_firmware(rf, board, 50000, turning_gyro);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+
+  // the last update of the session, before the disarm
+  float gyro_x = rf.sensors_.data().gyro.x;
+  float setpoint_f = rf.command_manager_.combined_control().F.value;
+  float p_z = rf.controller_.pid_terms().p[2];
+  float output_0 = rf.mixer_.get_outputs()[0];
+
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  step_firmware(rf, board, 10000, turning_gyro);
+
+  std::vector<Frame> frames;
+  int sessions;
+  ASSERT_TRUE(decode_log(board.log_data(), rf.blackbox_.size(), &frames, &sessions));
+  ASSERT_FALSE(frames.empty());
+  const Frame& last = frames.back();
+  EXPECT_NEAR(last.fields[Blackbox::FIELD_GYRO_X]/Blackbox::GYRO_SCALE, gyro_x, 1e-3);
+  EXPECT_NEAR(last.fields[Blackbox::FIELD_SETPOINT_F]/Blackbox::COMMAND_SCALE, setpoint_f, 1e-4);
+  EXPECT_NEAR(last.fields[Blackbox::FIELD_P_Z]/Blackbox::COMMAND_SCALE, p_z, 1e-4);
+  EXPECT_NEAR(last.fields[Blackbox::FIELD_OUTPUT_0]/Blackbox::COMMAND_SCALE, output_0, 1e-4);
+}
+
+TEST_F(BlackboxTest, drops_frames_instead_of_waiting_for_the_storage)
+{
+  arm_quad_x(rf);
+  step_firmware(rf, board, 20000, turning_gyro);
+  ASSERT_TRUE(rf.blackbox_.logging());
+
+  // with the storage stuck, both buffers fill and then the frames are dropped
+  board.set_log_busy(true);
+  uint32_t writes = board.log_write_count();
+  step_firmware(rf, board, 100000, turning_gyro);
+  EXPECT_EQ(board.log_write_count(), writes);
+  EXPECT_GT(rf.blackbox_.frames_dropped(), 0u);
+  EXPECT_TRUE(rf.state_manager_.state().armed);
+
+  // logging picks up again once the storage catches up, starting from a keyframe
+  board.set_log_busy(false);
+  step_firmware(rf, board, 50000, turning_gyro);
+  uint32_t dropped = rf.blackbox_.frames_dropped();
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  step_firmware(rf, board, 10000, turning_gyro);
+  EXPECT_EQ(rf.blackbox_.frames_dropped(), dropped);
+
+  std::vector<Frame> frames;
+  int sessions;
+  ASSERT_TRUE(decode_log(board.log_data(), rf.blackbox_.size(), &frames, &sessions));
+  EXPECT_EQ(frames.size(), rf.blackbox_.frames_logged());
+
+  bool found_gap = false;
+  for (size_t i = 1; i < frames.size(); i++)
+  {
+    if (frames[i].time_us - frames[i-1].time_us > 1000)
+    {
+      found_gap = true;
+      EXPECT_EQ(frames[i].type, Blackbox::FRAME_KEYFRAME);
+    }
+  }
+  EXPECT_TRUE(found_gap);
+}
+
+TEST_F(BlackboxTest, resumes_after_reboot_and_erases)
+{
+  arm_quad_x(rf);
+  step_firmware(rf, board, 50000, turning_gyro);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  step_firmware(rf, board, 10000, turning_gyro);
+  uint32_t first_size = rf.blackbox_.size();
+  ASSERT_GT(first_size, 0u);
+
+  // a second boot appends a new session after the first
+  ROSflight rf2(board);
+  rf2.init();
+  EXPECT_EQ(rf2.blackbox_.size(), first_size);
+  rf2.params_.set_param_int(PARAM_BLACKBOX, true);
+  arm_quad_x(rf2);
+  step_firmware(rf2, board, 50000, turning_gyro);
+  ASSERT_TRUE(rf2.state_manager_.state().armed);
+  EXPECT_FALSE(rf2.blackbox_.erase());
+  rf2.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  step_firmware(rf2, board, 10000, turning_gyro);
+  EXPECT_GT(rf2.blackbox_.size(), first_size);
+
+  std::vector<Frame> frames;
+  int sessions;
+  ASSERT_TRUE(decode_log(board.log_data(), rf2.blackbox_.size(), &frames, &sessions));
+  EXPECT_EQ(sessions, 2);
+
+  // the log can be read back, but not past its end
+  uint8_t page[Blackbox::PAGE_SIZE];
+  EXPECT_TRUE(rf2.blackbox_.read(0, page, sizeof(page)));
+  EXPECT_EQ(page[0], Blackbox::FRAME_HEADER);
+  EXPECT_FALSE(rf2.blackbox_.read(rf2.blackbox_.size(), page, 1));
+
+  ASSERT_TRUE(rf2.blackbox_.erase());
+  EXPECT_TRUE(rf2.blackbox_.erasing());
+  step_firmware(rf2, board, 10000, turning_gyro);
+  EXPECT_FALSE(rf2.blackbox_.erasing());
+  EXPECT_EQ(rf2.blackbox_.size(), 0u);
+  for (uint32_t i = 0; i < first_size*2; i++)
+    ASSERT_EQ(board.log_data()[i], 0xFF);
+}
@@ -1,6 +1,7 @@
 #include "common.h"
 #include "rosflight.h"
 #include "test_board.h"
+#include "test_helpers.h"
 #include "cmath"
 
 #define CHN_LOW 1100
@@ -10,18 +11,6 @@
 using namespace rosflight_firmware;
 
 // Initialize the full firmware, so that the state_manager can do its thing
-void step_firmware(ROSflight& rf, testBoard& board, uint32_t us)
-{
-  uint64_t start_time_us = board.clock_micros();
-  float dummy_acc[3] = {0, 0, -9.80665};
-  float dummy_gyro[3] = {0, 0, 0};
-  while(board.clock_micros() < start_time_us + us)
-  {
-    board.set_imu(dummy_acc, dummy_gyro, board.clock_micros() + 1000);
-    rf.run();
-  }
-}
-
 TEST(command_manager_test, rc) {
   testBoard board;
   ROSflight rf(board);
@@ -690,3 +679,110 @@ TEST(command_manager_test, partial_muxing_test ) {
   EXPECT_EQ(output.F.type, THROTTLE);
 }
 
+
+TEST(command_manager_test, offboard_command_reaches_next_control_update)
+{
+  testBoard board;
+  ROSflight rf(board);
+  board.set_pwm_lost(false);
+  rf.init();
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+
+  uint16_t rc_values[8];
+  for (int i = 0; i < 8; i++)
+  {
+    rc_values[i] = 1500;
+  }
+  rc_values[2] = 1000;
+  board.set_rc(rc_values);
+  while (board.clock_micros() < 1000000)
+  {
+    step_firmware(rf, board, 20000);
+  }
+
+  control_t offboard_command =
+  {
+    0,
+    {true, ANGLE, OFFBOARD_X},
+    {true, ANGLE, OFFBOARD_Y},
+    {true, RATE,  OFFBOARD_Z},
+    {true, THROTTLE, OFFBOARD_F}
+  };
+  EXPECT_EQ(rf.command_manager_.offboard_latency_percentile_us(50), 0u);
+
+  // send commands 300 us before the next IMU sample, which is well before the next RC frame
+  float acc[3] = {0, 0, -9.80665};
+  float gyro[3] = {0, 0, 0};
+  for (uint32_t i = 0; i < 10; i++)
+  {
+    board.set_time(board.clock_micros() + 700);
+    offboard_command.stamp_ms = board.clock_millis();
+    offboard_command.x.value = OFFBOARD_X + 0.01*i;
+    rf.command_manager_.set_new_offboard_command(offboard_command, board.clock_micros() - 10*i);
+    board.set_imu(acc, gyro, board.clock_micros() + 300);
+    rf.run();
+
+    control_t output = rf.command_manager_.combined_control();
+    EXPECT_CLOSE(output.x.value, OFFBOARD_X + 0.01*i);
+    EXPECT_CLOSE(output.F.value, OFFBOARD_F);
+  }
+
+  // the latencies were 300, 310, ... 390 us
+  EXPECT_EQ(rf.command_manager_.offboard_latency_percentile_us(0), 300u);
+  EXPECT_EQ(rf.command_manager_.offboard_latency_percentile_us(50), 350u);
+  EXPECT_EQ(rf.command_manager_.offboard_latency_percentile_us(100), 390u);
+  EXPECT_EQ(rf.command_manager_.offboard_command_age_us(), 390u);
+}
+
+TEST(command_manager_test, mux_only_recomputes_on_new_inputs)
+{
+  testBoard board;
+  ROSflight rf(board);
+  board.set_pwm_lost(false);
+  rf.init();
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+
+  uint16_t rc_values[8];
+  for (int i = 0; i < 8; i++)
+  {
+    rc_values[i] = 1500;
+  }
+  rc_values[2] = 1000;
+  board.set_rc(rc_values);
+  while (board.clock_micros() < 1000000)
+  {
+    step_firmware(rf, board, 20000);
+  }
+  rf.command_manager_.run();
+
+  // nothing changed, nothing to do
+  uint32_t count = rf.command_manager_.mux_count();
+  for (int i = 0; i < 100; i++)
+    rf.command_manager_.run();
+  EXPECT_EQ(rf.command_manager_.mux_count(), count);
+
+  // a new offboard command is muxed once
+  control_t offboard_command =
+  {
+    board.clock_millis(),
+    {true, ANGLE, OFFBOARD_X},
+    {true, ANGLE, OFFBOARD_Y},
+    {true, RATE,  OFFBOARD_Z},
+    {true, THROTTLE, OFFBOARD_F}
+  };
+  rf.command_manager_.set_new_offboard_command(offboard_command);
+  rf.command_manager_.run();
+  rf.command_manager_.run();
+  EXPECT_EQ(rf.command_manager_.mux_count(), count + 1);
+  EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, OFFBOARD_F);
+
+  // and its timeout hands control back to RC without waiting for a new RC frame
+  board.set_time(board.clock_micros() + 100000);
+  rf.command_manager_.run();
+  EXPECT_EQ(rf.command_manager_.mux_count(), count + 1);
+  board.set_time(board.clock_micros() + 1000);
+  rf.command_manager_.run();
+  EXPECT_EQ(rf.command_manager_.mux_count(), count + 2);
+  EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, 0.0);
+  EXPECT_FALSE(rf.command_manager_.offboard_control_active());
+}
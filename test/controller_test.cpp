@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include "controller.h"
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+// The scalar PID that the three-axis kernel replaced, with dt in seconds, as a reference for the arithmetic
+class LegacyPID
+{
+public:
+  LegacyPID(float kp, float ki, float kd, float max, float tau) :
+    kp_(kp), ki_(ki), kd_(kd), max_(max), min_(-max), integrator_(0.0f), differentiator_(0.0f),
+    prev_x_(0.0f), tau_(tau)
+  {}
+
+  float run(float dt, float x, float x_c, bool update_integrator)
+  {
+    float xdot;
+    if (dt > 0.0001f)
+    {
+      differentiator_ = (2.0f * tau_ - dt) / (2.0f * tau_ + dt) * differentiator_
+          + 2.0f / (2.0f * tau_ + dt) * (x - prev_x_);
+      xdot = differentiator_;
+    }
+    else
+    {
+      xdot = 0.0f;
+    }
+    prev_x_ = x;
+
+    return run(dt, x, x_c, update_integrator, xdot);
+  }
+
+  float run(float dt, float x, float x_c, bool update_integrator, float xdot)
+  {
+    float error = x_c - x;
+    float p_term = error * kp_;
+    float i_term = 0.0f;
+    float d_term = 0.0f;
+    if (kd_ > 0.0f)
+      d_term = kd_ * xdot;
+    if ((ki_ > 0.0f) && update_integrator)
+    {
+      integrator_ += error * dt;
+      i_term = ki_ * integrator_;
+    }
+    float u = p_term - d_term + i_term;
+    float u_sat = (u > max_) ? max_ : (u < min_) ? min_ : u;
+    if (u != u_sat && fabs(i_term) > fabs(u - p_term + d_term) && ki_ > 0.0f)
+      integrator_ = (u_sat - p_term + d_term)/ki_;
+    return u_sat;
+  }
+
+private:
+  float kp_, ki_, kd_, max_, min_;
+  float integrator_, differentiator_, prev_x_, tau_;
+};
+
+const float DT = 0.001f;
+const bool ALL_ACTIVE[3] = {true, true, true};
+
+void step_imu(ROSflight& rf, testBoard& board, uint32_t period_us, float gyro_z)
+{
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.0f, 0.0f, gyro_z};
+  board.set_imu(acc, gyro, board.clock_micros() + period_us);
+  rf.run();
+}
+
+void init_pid(Controller::PID& pid, float kp, float ki, float kd, float kff, float max, float antiwindup_tau)
+{
+  const float kp3[3] = {kp, kp, kp};
+  const float ki3[3] = {ki, ki, ki};
+  const float kd3[3] = {kd, kd, kd};
+  const float kff3[3] = {kff, kff, kff};
+  pid.init(kp3, ki3, kd3, kff3, max, 0.05f, antiwindup_tau);
+}
+
+} // namespace
+
+TEST(controller_test, pd_matches_legacy_pid)
+{
+  Controller::PID pid;
+  init_pid(pid, 0.3f, 0.0f, 0.05f, 0.0f, 1.0f, 0.0f);
+  LegacyPID legacy[3] = {LegacyPID(0.3f, 0.0f, 0.05f, 1.0f, 0.05f),
+                         LegacyPID(0.3f, 0.0f, 0.05f, 1.0f, 0.05f),
+                         LegacyPID(0.3f, 0.0f, 0.05f, 1.0f, 0.05f)};
+
+  for (int i = 0; i < 1000; i++)
+  {
+    float t = DT*i;
+    const float x[3] = {sinf(10.0f*t), cosf(7.0f*t), 0.5f*sinf(3.0f*t)};
+    const float x_c[3] = {0.2f, -0.1f, 0.0f};
+    float u[3];
+    pid.run(DT, x, x_c, ALL_ACTIVE, true, u);
+    for (int axis = 0; axis < 3; axis++)
+      ASSERT_NEAR(u[axis], legacy[axis].run(DT, x[axis], x_c[axis], true), 1e-6f);
+  }
+}
+
+TEST(controller_test, feed_forward_adds_scaled_setpoint)
+{
+  Controller::PID pid;
+  init_pid(pid, 0.5f, 0.0f, 0.0f, 0.2f, 10.0f, 0.0f);
+
+  const float x[3] = {0.0f, 1.0f, -1.0f};
+  const float xdot[3] = {0.0f, 0.0f, 0.0f};
+  const float x_c[3] = {1.0f, 1.0f, 2.0f};
+  float u[3];
+  pid.run(DT, x, x_c, xdot, ALL_ACTIVE, false, u);
+  EXPECT_NEAR(u[0], 0.5f*1.0f + 0.2f*1.0f, 1e-6f);
+  EXPECT_NEAR(u[1], 0.5f*0.0f + 0.2f*1.0f, 1e-6f);
+  EXPECT_NEAR(u[2], 0.5f*3.0f + 0.2f*2.0f, 1e-6f);
+}
+
+TEST(controller_test, inactive_axes_output_zero_and_hold_integrator)
+{
+  Controller::PID pid;
+  init_pid(pid, 1.0f, 10.0f, 0.0f, 0.0f, 10.0f, 0.0f);
+
+  const float x[3] = {0.0f, 0.0f, 0.0f};
+  const float x_c[3] = {0.1f, 0.1f, 0.1f};
+  const float xdot[3] = {0.0f, 0.0f, 0.0f};
+  const bool active[3] = {true, false, true};
+  float u[3];
+  for (int i = 0; i < 100; i++)
+    pid.run(DT, x, x_c, xdot, active, true, u);
+  EXPECT_EQ(u[1], 0.0f);
+
+  // the integrator of the inactive axis didn't wind up while it was off
+  pid.run(DT, x, x_c, xdot, ALL_ACTIVE, true, u);
+  EXPECT_NEAR(u[0], 0.1f + 10.0f*0.1f*DT*100.0f, 1e-4f);
+  EXPECT_NEAR(u[1], 0.1f, 1e-6f);
+}
+
+TEST(controller_test, back_calculation_prevents_windup)
+{
+  for (float antiwindup_tau : {0.0f, 0.01f})
+  {
+    Controller::PID pid;
+    init_pid(pid, 1.0f, 10.0f, 0.0f, 0.0f, 1.0f, antiwindup_tau);
+
+    // hold a large error for a second, long enough to wind an unprotected integrator far past the limit
+    const float xdot[3] = {0.0f, 0.0f, 0.0f};
+    float x[3] = {0.0f, 0.0f, 0.0f};
+    float x_c[3] = {2.0f, 2.0f, 2.0f};
+    float u[3];
+    for (int i = 0; i < 1000; i++)
+    {
+      pid.run(DT, x, x_c, xdot, ALL_ACTIVE, true, u);
+    }
+    EXPECT_EQ(u[0], 1.0f);
+
+    // then reverse it: the output follows within a few steps
+    x_c[0] = x_c[1] = x_c[2] = -0.5f;
+    int steps;
+    for (steps = 1; steps <= 10; steps++)
+    {
+      pid.run(DT, x, x_c, xdot, ALL_ACTIVE, true, u);
+      if (u[0] < 0.0f)
+        break;
+    }
+    EXPECT_LT(u[0], 0.0f) << "antiwindup_tau " << antiwindup_tau;
+  }
+}
+
+TEST(controller_test, dterm_lowpass_attenuates_noise)
+{
+  Controller::PID pid;
+  init_pid(pid, 0.0f, 0.0f, 1.0f, 0.0f, 10.0f, 0.0f);
+
+  const float x[3] = {0.0f, 0.0f, 0.0f};
+  float u[3];
+  float peak = 0.0f;
+  for (int pass = 0; pass < 2; pass++)
+  {
+    if (pass == 1)
+      pid.set_dterm_lowpass(1000.0f, 50.0f);
+
+    // a derivative alternating at half the sample rate
+    peak = 0.0f;
+    for (int i = 0; i < 200; i++)
+    {
+      const float xdot[3] = {(i % 2) ? 1.0f : -1.0f, 0.0f, 0.0f};
+      pid.run(DT, x, x, xdot, ALL_ACTIVE, false, u);
+      if (i >= 100)
+        peak = std::max(peak, std::fabs(u[0]));
+    }
+    if (pass == 0)
+    {
+      EXPECT_NEAR(peak, 1.0f, 1e-6f);
+    }
+  }
+  EXPECT_LT(peak, 0.01f);
+}
+
+TEST(controller_test, timing_follows_the_loop_rate)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_IMU_SAMPLE_RATE, 500);
+
+  // 500 Hz with +/- 20 us of jitter
+  for (int i = 0; i < 2000; i++)
+    step_imu(rf, board, (i % 2) ? 2020 : 1980, 0.0f);
+
+  const Controller::Timing& timing = rf.controller_.timing();
+  EXPECT_NEAR(timing.period_us, 2000.0f, 20.0f);
+  EXPECT_NEAR(timing.jitter_us, 20.0f, 2.0f);
+  EXPECT_EQ(timing.min_period_us, 1980u);
+  EXPECT_EQ(timing.max_period_us, 2020u);
+  EXPECT_EQ(timing.overruns, 0u);
+  EXPECT_EQ(rf.profiler_.stage(Profiler::STAGE_CONTROL_PERIOD).max_us, 2020u);
+
+  // a stall past the budget is counted, but doesn't move the filtered period
+  float period_us = timing.period_us;
+  step_imu(rf, board, 4001, 0.0f);
+  EXPECT_EQ(timing.overruns, 1u);
+  EXPECT_EQ(timing.max_period_us, 4001u);
+  EXPECT_EQ(timing.period_us, period_us);
+
+  // the filtered period follows a new rate
+  for (int i = 0; i < 2000; i++)
+    step_imu(rf, board, 2500, 0.0f);
+  EXPECT_NEAR(timing.period_us, 2500.0f, 1.0f);
+  EXPECT_EQ(timing.overruns, 1u);
+}
+
+TEST(controller_test, integrators_run_at_the_loop_rate)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.params_.set_param_float(PARAM_PID_YAW_RATE_P, 0.0f);
+  rf.params_.set_param_float(PARAM_PID_YAW_RATE_I, 1.0f);
+
+  // half throttle, so the integrators are enabled once armed
+  uint16_t rc_values[8] = {1500, 1500, 1500, 1500, 1000, 1000, 1000, 1000};
+  board.set_rc(rc_values);
+  for (int i = 0; i < 100; i++)
+    step_imu(rf, board, 1000, 0.0f);
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+  ASSERT_GT(rf.command_manager_.combined_control().F.value, 0.1f);
+
+  // a yaw rate error of -0.1 rad/s for 0.5 s at 1 kHz
+  for (int i = 0; i < 500; i++)
+    step_imu(rf, board, 1000, 0.1f);
+  EXPECT_NEAR(rf.controller_.output().z, -0.1f*0.5f, 0.005f);
+}
+
+TEST(controller_test, late_update_holds_the_integral)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.params_.set_param_float(PARAM_PID_YAW_RATE_P, 0.0f);
+  rf.params_.set_param_float(PARAM_PID_YAW_RATE_I, 1.0f);
+
+  uint16_t rc_values[8] = {1500, 1500, 1500, 1500, 1000, 1000, 1000, 1000};
+  board.set_rc(rc_values);
+  for (int i = 0; i < 100; i++)
+    step_imu(rf, board, 1000, 0.0f);
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+
+  // wind up the yaw integrator
+  for (int i = 0; i < 500; i++)
+    step_imu(rf, board, 1000, 0.1f);
+  float wound_up = rf.controller_.output().z;
+  ASSERT_LT(wound_up, -0.04f);
+
+  // a late update pauses the integration, but the integral stays in the output, which moves by no more
+  // than the last on-time sample added (0.1 rad/s * 1 * 1 ms)
+  step_imu(rf, board, 5000, 0.1f);
+  EXPECT_EQ(rf.controller_.timing().overruns, 1u);
+  EXPECT_NEAR(rf.controller_.output().z, wound_up, 1.5e-4f);
+}
+
+TEST(controller_test, zero_sample_rate_keeps_the_period)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_IMU_SAMPLE_RATE, 500);
+  rf.params_.set_param_int(PARAM_IMU_SAMPLE_RATE, 0);
+  EXPECT_EQ(rf.controller_.timing().period_us, 2000.0f);
+
+  for (int i = 0; i < 10; i++)
+    step_imu(rf, board, 2000, 0.0f);
+  EXPECT_EQ(rf.controller_.timing().overruns, 0u);
+}
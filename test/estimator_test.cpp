@@ -15,7 +15,8 @@ double sign(double y)
   return (y > 0.0) - (y < 0.0);
 }
 
-double run_estimator_test(std::string filename, ROSflight& rf, testBoard& board, std::vector<double> params)
+double run_estimator_test(std::string filename, ROSflight& rf, testBoard& board, std::vector<double> params,
+                          bool only_full_updates = false)
 {
 #ifndef DEBUG
   (void) filename;
@@ -42,6 +43,7 @@ double run_estimator_test(std::string filename, ROSflight& rf, testBoard& board,
 #endif
 
   double max_error = 0.0;
+  turbomath::Quaternion prev_estimate = rf.estimator_.state().attitude;
   volatile double t = 0.0;
   while(t < tmax)
   {
@@ -81,6 +83,13 @@ double run_estimator_test(std::string filename, ROSflight& rf, testBoard& board,
 
     Eigen::Quaternionf eig_quat(rotation.cast<float>());
     turbomath::Quaternion estimate = rf.estimator_.state().attitude;
+
+    // between full updates the attitude is held, so only compare when it has been updated
+    bool updated = estimate.w != prev_estimate.w || estimate.x != prev_estimate.x
+                   || estimate.y != prev_estimate.y || estimate.z != prev_estimate.z;
+    prev_estimate = estimate;
+    if (only_full_updates && !updated)
+      continue;
     if (eig_quat.w() < 0.0)
     {
       eig_quat.coeffs() *= -1.0;
@@ -106,7 +115,7 @@ double run_estimator_test(std::string filename, ROSflight& rf, testBoard& board,
     file << t << ", " << (error > error_limit) << ", ";
     file << estimate.w << ", " << estimate.x << ", " << estimate.y << ", " << estimate.z << ", ";
     file << eig_quat.w() << ", " << eig_quat.x() << ", " << eig_quat.y() << ", " << eig_quat.z() << ", ";
-    file << rf.estimator_.state().roll << ", " << rf.estimator_.state().pitch << ", " <<rf.estimator_.state().yaw << ", ";
+    file << rf.estimator_.state().roll() << ", " << rf.estimator_.state().pitch() << ", " <<rf.estimator_.state().yaw() << ", ";
     file << rf.estimator_.state().angular_velocity.x << ", " << rf.estimator_.state().angular_velocity.y << ", " << rf.estimator_.state().angular_velocity.z << ", ";
     file << p << ", " << q << ", " << r << ", ";
     file << error << "\n";
@@ -221,6 +230,67 @@ TEST(estimator_test, mat_exp_integration) {
 #endif
 }
 
+TEST(estimator_test, mat_exp_coefficients_match_libm) {
+  // rates up to 50 rad/s and steps from 8 kHz down to 10 Hz, covering both the series and the trig fallback
+  double max_t1_error = 0.0;
+  double max_t2_error = 0.0;
+  for (double rate = 0.01; rate < 50.0; rate *= 1.5)
+  {
+    for (double dt = 0.000125; dt < 0.1; dt *= 2.0)
+    {
+      float t1, t2;
+      Estimator::mat_exp_coefficients(static_cast<float>(rate*rate), static_cast<float>(dt), &t1, &t2);
+
+      double theta = rate*dt/2.0;
+      double t1_error = std::fabs(t1 - std::cos(theta));
+      double t2_error = std::fabs(t2 - std::sin(theta)/rate)/(dt/2.0); // relative to the small-angle value
+      if (theta*theta < Estimator::MAT_EXP_SERIES_MAX_SQRD)
+      {
+        EXPECT_LE(t1_error, 1e-6);
+        EXPECT_LE(t2_error, 1e-6);
+      }
+      max_t1_error = std::max(max_t1_error, t1_error);
+      max_t2_error = std::max(max_t2_error, t2_error);
+    }
+  }
+  EXPECT_LE(max_t1_error, 1e-3);
+  EXPECT_LE(max_t2_error, 1e-3);
+#ifdef DEBUG
+  printf("max_t1_error = %.9f, max_t2_error = %.9f\n", max_t1_error, max_t2_error);
+#endif
+}
+
+TEST(estimator_test, coning_sub_steps) {
+  testBoard board;
+  ROSflight rf(board);
+
+  std::vector<double> params = {
+    200.0, // xfreq
+    300.0, // yfreq
+    0.5, // zfreq
+    2.0, // xamp
+    2.0, // yamp
+    0.2, // zamp
+    10.0, // tmax
+    0.00085 // error_limit, what a full matrix exponential update on every sample gets for this motion
+  };
+
+  // Initialize the firmware
+  rf.init();
+
+  // 1 kHz samples, pre-integrated into a full update every 10 ms
+  rf.params_.set_param_int(PARAM_FILTER_USE_ACC, false);
+  rf.params_.set_param_int(PARAM_FILTER_UPDATE_RATE, 100);
+  rf.params_.set_param_int(PARAM_ACC_ALPHA, 0);
+  rf.params_.set_param_int(PARAM_GYRO_ALPHA, 0);
+
+  double max_error = run_estimator_test("coning_sim.csv", rf, board, params, true);
+  EXPECT_LE(max_error, params[7]);
+#ifdef DEBUG
+  printf("max_error = %.7f\n", max_error);
+#endif
+}
+
 TEST(estimator_test, mat_exp_quad_int) {
   testBoard board;
   ROSflight rf(board);
@@ -413,3 +483,59 @@ TEST(estimator_test, moving_bias_sim) {
   printf("estimated_bias = %.7f, %.7f\n", bias.x, bias.y);
 #endif
 }
+
+TEST(estimator_test, integrates_buffered_imu_samples) {
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  rf.params_.set_param_int(PARAM_FILTER_USE_ACC, false);
+  rf.params_.set_param_int(PARAM_FILTER_USE_QUAD_INT, false);
+  rf.params_.set_param_int(PARAM_FILTER_USE_MAT_EXP, true);
+  rf.params_.set_param_float(PARAM_GYRO_ALPHA, 0.0f);
+
+  // Queue up a burst of samples, as if the main loop had been held up for 10 ms
+  float acc[3] = {0, 0, -9.80665f};
+  float gyro[3] = {0, 0, 1.0f};
+  for (int i = 1; i <= 10; i++)
+  {
+    board.set_imu(acc, gyro, i*1000);
+  }
+  rf.run();
+
+  // All of the samples should have been integrated, not just the newest one
+  // (the first one only initializes the estimator time)
+  EXPECT_EQ(board.imu_samples_available(), 0);
+  EXPECT_EQ(rf.estimator_.state().timestamp_us, 10000u);
+  EXPECT_SUPERCLOSE(rf.estimator_.state().yaw(), 0.009f);
+}
+
+TEST(estimator_test, euler_angles_follow_attitude) {
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  rf.params_.set_param_int(PARAM_FILTER_USE_ACC, false);
+  rf.params_.set_param_int(PARAM_FILTER_USE_QUAD_INT, false);
+  rf.params_.set_param_int(PARAM_FILTER_USE_MAT_EXP, true);
+  rf.params_.set_param_float(PARAM_GYRO_ALPHA, 0.0f);
+
+  float acc[3] = {0, 0, -9.80665f};
+  float gyro[3] = {1.0f, 0, 0};
+  uint64_t time_us = 0;
+  for (int i = 0; i <= 10; i++)
+  {
+    board.set_imu(acc, gyro, time_us += 1000);
+    rf.run();
+  }
+  EXPECT_SUPERCLOSE(rf.estimator_.state().roll(), 0.01f);
+  EXPECT_SUPERCLOSE(rf.estimator_.state().pitch(), 0.0f);
+
+  // the angles read above must not stay cached once the attitude moves on
+  for (int i = 0; i < 10; i++)
+  {
+    board.set_imu(acc, gyro, time_us += 1000);
+    rf.run();
+  }
+  EXPECT_SUPERCLOSE(rf.estimator_.state().roll(), 0.02f);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include "filter.h"
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+// peak output amplitude of a filter driven by a sinusoid, once the transient has died out
+static float steady_state_amplitude(Biquad& filter, float sample_rate_hz, float freq_hz)
+{
+  filter.reset();
+  float peak = 0.0f;
+  for (int i = 0; i < 4000; i++)
+  {
+    float x = static_cast<float>(sin(2.0*M_PI*freq_hz*i/sample_rate_hz));
+    turbomath::Vector y = filter.apply(turbomath::Vector(x, 2.0f*x, -x));
+    EXPECT_NEAR(y.y, 2.0f*y.x, 1e-4f); // the axes are filtered independently
+    if (i >= 2000)
+      peak = std::max(peak, std::fabs(y.x));
+  }
+  return peak;
+}
+
+TEST(filter_test, disabled_passes_through)
+{
+  Biquad filter;
+  EXPECT_FALSE(filter.enabled());
+  turbomath::Vector x(1.0f, -2.0f, 3.0f);
+  turbomath::Vector y = filter.apply(x);
+  EXPECT_EQ(y.x, x.x);
+  EXPECT_EQ(y.y, x.y);
+  EXPECT_EQ(y.z, x.z);
+
+  // cutoffs at or above Nyquist disable the filter
+  EXPECT_FALSE(filter.set_lowpass(1000.0f, 500.0f));
+  EXPECT_FALSE(filter.set_notch(1000.0f, 0.0f, 3.0f));
+  EXPECT_FALSE(filter.enabled());
+}
+
+TEST(filter_test, lowpass_response)
+{
+  Biquad filter;
+  ASSERT_TRUE(filter.set_lowpass(1000.0f, 50.0f));
+  EXPECT_NEAR(steady_state_amplitude(filter, 1000.0f, 5.0f), 1.0f, 0.01f);
+  EXPECT_NEAR(steady_state_amplitude(filter, 1000.0f, 50.0f), 0.7071f, 0.01f); // -3 dB at the cutoff
+  EXPECT_LT(steady_state_amplitude(filter, 1000.0f, 400.0f), 0.02f);
+}
+
+TEST(filter_test, notch_response)
+{
+  Biquad filter;
+  ASSERT_TRUE(filter.set_notch(1000.0f, 150.0f, 3.0f));
+  EXPECT_LT(steady_state_amplitude(filter, 1000.0f, 150.0f), 0.01f);
+  EXPECT_NEAR(steady_state_amplitude(filter, 1000.0f, 10.0f), 1.0f, 0.02f);
+  EXPECT_NEAR(steady_state_amplitude(filter, 1000.0f, 450.0f), 1.0f, 0.05f);
+}
+
+TEST(filter_test, sensors_filter_pipeline)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  rf.params_.set_param_float(PARAM_GYRO_NOTCH_HZ, 200.0f);
+  rf.params_.set_param_int(PARAM_GYRO_DYN_NOTCH, true);
+
+  // a 200 Hz vibration from the static notch plus one the dynamic notch is tracking
+  rf.sensors_.set_dynamic_notch_frequency(320.0f);
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float peak = 0.0f;
+  uint32_t count_before = rf.profiler_.stage(Profiler::STAGE_IMU_FILTER).count;
+  for (int i = 0; i < 2000; i++)
+  {
+    float t = i*1e-3f;
+    float vibration = static_cast<float>(sin(2.0*M_PI*200.0*t) + sin(2.0*M_PI*320.0*t));
+    float gyro[3] = {0.1f + vibration, 0.0f, 0.0f};
+    board.set_imu(acc, gyro, 1000 + i*1000);
+    ASSERT_TRUE(rf.sensors_.update_imu());
+    if (i >= 1000)
+      peak = std::max(peak, std::fabs(rf.sensors_.data().gyro.x - 0.1f));
+  }
+  EXPECT_LT(peak, 0.02f);
+  EXPECT_EQ(rf.profiler_.stage(Profiler::STAGE_IMU_FILTER).count, count_before + 2000);
+
+  // below GYRO_DNOTCH_MIN the dynamic notch is bypassed
+  rf.sensors_.set_dynamic_notch_frequency(40.0f);
+  EXPECT_FLOAT_EQ(rf.sensors_.dynamic_notch_frequency(), 40.0f);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+// Feeds gyro samples with a vibration on each axis until the analyzer has finished a window
+static void analyze_window(ROSflight& rf, testBoard& board, uint64_t *time_us, float hz1, float hz2)
+{
+  uint32_t windows = rf.gyro_analyzer_.windows_analyzed();
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  for (int i = 0; i < 1000 && rf.gyro_analyzer_.windows_analyzed() == windows; i++)
+  {
+    double t = *time_us*1e-6;
+    float gyro[3] = {static_cast<float>(0.3 + sin(2.0*M_PI*hz1*t) + 0.5*sin(2.0*M_PI*hz2*t)),
+                     static_cast<float>(0.5*sin(2.0*M_PI*hz1*t + 1.0)),
+                     -0.2f};
+    board.set_imu(acc, gyro, *time_us);
+    *time_us += 1000;
+    rf.sensors_.update_imu();
+    rf.gyro_analyzer_.run();
+  }
+  ASSERT_EQ(rf.gyro_analyzer_.windows_analyzed(), windows + 1);
+}
+
+TEST(gyro_analyzer_test, finds_vibration_peaks)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_GYRO_ANALYZER, true);
+
+  uint64_t time_us = 1000;
+  analyze_window(rf, board, &time_us, 210.0f, 330.0f);
+  EXPECT_NEAR(rf.gyro_analyzer_.peak_hz(0), 210.0f, 8.0f);
+  EXPECT_NEAR(rf.gyro_analyzer_.peak_hz(1), 330.0f, 8.0f);
+  EXPECT_EQ(rf.gyro_analyzer_.peak_hz(2), 0.0f);
+}
+
+TEST(gyro_analyzer_test, ignores_a_quiet_gyro)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_GYRO_ANALYZER, true);
+
+  // a constant rate is removed with the window mean, so nothing stands out
+  uint64_t time_us = 1000;
+  analyze_window(rf, board, &time_us, 0.0f, 0.0f);
+  EXPECT_EQ(rf.gyro_analyzer_.peak_hz(0), 0.0f);
+}
+
+TEST(gyro_analyzer_test, disabled_by_default)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 200; i++)
+  {
+    board.set_imu(acc, gyro, 1000 + i*1000);
+    rf.sensors_.update_imu();
+    rf.gyro_analyzer_.run();
+  }
+  EXPECT_EQ(rf.gyro_analyzer_.windows_analyzed(), 0u);
+}
+
+TEST(gyro_analyzer_test, drives_dynamic_notch)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_GYRO_DYN_NOTCH, true);
+  rf.params_.set_param_int(PARAM_GYRO_ANALYZER_NOTCH, true);
+  rf.params_.set_param_int(PARAM_GYRO_ANALYZER, true);
+
+  uint64_t time_us = 1000;
+  analyze_window(rf, board, &time_us, 250.0f, 0.0f);
+  EXPECT_NEAR(rf.sensors_.dynamic_notch_frequency(), 250.0f, 8.0f);
+
+  // the notch follows a moving peak smoothly
+  analyze_window(rf, board, &time_us, 300.0f, 0.0f);
+  float notch_hz = rf.sensors_.dynamic_notch_frequency();
+  EXPECT_GT(notch_hz, 255.0f);
+  EXPECT_LT(notch_hz, 290.0f);
+}
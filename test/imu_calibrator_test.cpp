@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include <cmath>
+
+#include "imu_calibrator.h"
+
+using namespace rosflight_firmware;
+
+static const turbomath::Vector GRAVITY(0.0f, 0.0f, -9.80665f);
+
+// Feeds one window of samples from a vehicle at rest, with a small deterministic noise on every axis
+static bool push_still_window(ImuCalibrator& cal, const turbomath::Vector& bias, float temperature)
+{
+  bool accepted = false;
+  for (uint16_t i = 0; i < ImuCalibrator::WINDOW_SIZE; i++)
+  {
+    float noise = 0.003f*static_cast<float>(sin(1.3*i));
+    turbomath::Vector gyro = bias + turbomath::Vector(noise, -noise, 0.5f*noise);
+    turbomath::Vector accel = GRAVITY + turbomath::Vector(10.0f*noise, 10.0f*noise, -10.0f*noise);
+    accepted = cal.push(accel, gyro, temperature);
+  }
+  return accepted;
+}
+
+TEST(imu_calibrator_test, running_stats_keep_a_small_variance_on_a_large_offset)
+{
+  RunningStats stats;
+  stats.clear();
+  for (int i = 0; i < 1000; i++)
+  {
+    float d = (i % 2) ? 0.001f : -0.001f;
+    stats.add(turbomath::Vector(9.80665f + d, 1000.0f + d, d));
+  }
+
+  EXPECT_EQ(stats.count(), 1000u);
+  EXPECT_NEAR(stats.mean().x, 9.80665f, 1e-5f);
+  EXPECT_NEAR(stats.variance().x, 1e-6f, 1e-7f);
+  EXPECT_NEAR(stats.variance().y, 1e-6f, 2e-7f);
+  EXPECT_NEAR(stats.variance().z, 1e-6f, 1e-8f);
+}
+
+TEST(imu_calibrator_test, learns_the_gyro_bias_over_temperature)
+{
+  ImuCalibrator cal;
+  turbomath::Vector default_bias(0.01f, 0.01f, 0.01f);
+  cal.set_default_gyro_bias(default_bias);
+  EXPECT_FLOAT_EQ(cal.gyro_bias(20.0f).x, 0.01f);
+
+  // the first window only gives a reference for the accel drift
+  turbomath::Vector cold_bias(0.02f, -0.03f, 0.04f);
+  EXPECT_FALSE(push_still_window(cal, cold_bias, 10.0f));
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(push_still_window(cal, cold_bias, 10.0f));
+  EXPECT_TRUE(cal.has_model());
+  EXPECT_NEAR(cal.gyro_bias(10.0f).x, 0.02f, 1e-5f);
+
+  // warming up moves the bias a little at a time, within what the model accepts
+  turbomath::Vector warm_bias(0.04f, -0.01f, 0.04f);
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(push_still_window(cal, warm_bias, 30.0f));
+  EXPECT_EQ(cal.bins_populated(), 2u);
+  EXPECT_EQ(cal.windows_accepted(), 8u);
+
+  // interpolated between the bins, and held beyond them
+  turbomath::Vector mid = cal.gyro_bias(20.0f);
+  EXPECT_NEAR(mid.x, 0.03f, 1e-5f);
+  EXPECT_NEAR(mid.y, -0.02f, 1e-5f);
+  EXPECT_NEAR(mid.z, 0.04f, 1e-5f);
+  EXPECT_NEAR(cal.gyro_bias(-15.0f).y, -0.03f, 1e-5f);
+  EXPECT_NEAR(cal.gyro_bias(60.0f).y, -0.01f, 1e-5f);
+
+  cal.reset();
+  EXPECT_FALSE(cal.has_model());
+  EXPECT_FLOAT_EQ(cal.gyro_bias(20.0f).z, 0.01f);
+}
+
+TEST(imu_calibrator_test, ignores_windows_in_motion)
+{
+  ImuCalibrator cal;
+  turbomath::Vector bias(0.02f, 0.0f, 0.0f);
+  push_still_window(cal, bias, 25.0f);
+  ASSERT_TRUE(push_still_window(cal, bias, 25.0f));
+
+  // being handled: the rates and the accel vary within the window
+  bool accepted = false;
+  for (uint16_t i = 0; i < ImuCalibrator::WINDOW_SIZE; i++)
+  {
+    float wobble = 0.3f*static_cast<float>(sin(0.05*i));
+    accepted = cal.push(GRAVITY + turbomath::Vector(wobble, 0.0f, 0.0f), bias + turbomath::Vector(0.0f, wobble, 0.0f),
+                        25.0f);
+  }
+  EXPECT_FALSE(accepted);
+
+  // a quiet window after it, but the accel mean moved since the last one
+  for (uint16_t i = 0; i < ImuCalibrator::WINDOW_SIZE; i++)
+    accepted = cal.push(GRAVITY + turbomath::Vector(1.0f, 0.0f, 0.0f), bias, 25.0f);
+  EXPECT_FALSE(accepted);
+
+  EXPECT_FALSE(push_still_window(cal, bias, 25.0f));
+
+  // quiet and level, but yawing slowly: too far from the learned bias
+  EXPECT_FALSE(push_still_window(cal, bias + turbomath::Vector(0.0f, 0.0f, 0.2f), 25.0f));
+
+  EXPECT_EQ(cal.windows_accepted(), 1u);
+  EXPECT_EQ(cal.windows_rejected(), 5u);
+  EXPECT_NEAR(cal.gyro_bias(25.0f).x, 0.02f, 1e-5f);
+}
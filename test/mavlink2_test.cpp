@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include "mavlink2.h"
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+mavlink_message_t make_message(uint8_t msgid, uint8_t len, const uint8_t *data, uint8_t data_len)
+{
+  mavlink_message_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msgid = msgid;
+  msg.len = len;
+  msg.seq = 7;
+  msg.sysid = 1;
+  msg.compid = 250;
+  memcpy(msg.payload64, data, data_len);
+  return msg;
+}
+
+bool parse_frame(Mavlink2Parser &parser, const uint8_t *frame, uint16_t len, mavlink_message_t *msg)
+{
+  bool received = false;
+  for (uint16_t i = 0; i < len; i++)
+    received = parser.parse(frame[i], msg);
+  return received;
+}
+
+} // namespace
+
+TEST(mavlink2_test, trailing_zeros_are_truncated_and_restored)
+{
+  const uint8_t data[6] = {1, 2, 0, 3, 4, 5};
+  mavlink_message_t msg = make_message(MAVLINK_MSG_ID_PARAM_SET, 23, data, sizeof(data));
+
+  uint8_t frame[MAVLINK_MAX_PAYLOAD_LEN + MAVLINK2_NUM_NON_PAYLOAD_BYTES];
+  uint16_t len = mavlink2_serialize(msg, frame);
+  EXPECT_EQ(len, sizeof(data) + MAVLINK2_NUM_NON_PAYLOAD_BYTES);
+  EXPECT_EQ(len, mavlink2_frame_length(msg));
+  EXPECT_EQ(frame[0], MAVLINK2_STX);
+  EXPECT_EQ(frame[1], sizeof(data));
+  EXPECT_EQ(frame[7], MAVLINK_MSG_ID_PARAM_SET);
+
+  // the receiver gets the zeros back, even over what is left of a previous message
+  Mavlink2Parser parser;
+  mavlink_message_t received;
+  memset(&received, 0xAA, sizeof(received));
+  ASSERT_TRUE(parse_frame(parser, frame, len, &received));
+  EXPECT_TRUE(parser.idle());
+  EXPECT_EQ(received.msgid, MAVLINK_MSG_ID_PARAM_SET);
+  EXPECT_EQ(received.seq, 7);
+  EXPECT_EQ(received.sysid, 1);
+  EXPECT_EQ(received.compid, 250);
+  const uint8_t *payload = reinterpret_cast<const uint8_t *>(received.payload64);
+  EXPECT_EQ(memcmp(payload, data, sizeof(data)), 0);
+  for (int i = sizeof(data); i < MAVLINK_MAX_PAYLOAD_LEN; i++)
+    EXPECT_EQ(payload[i], 0);
+
+  // an all-zero payload still keeps its first byte
+  mavlink_message_t empty = make_message(MAVLINK_MSG_ID_PARAM_SET, 23, data, 0);
+  EXPECT_EQ(mavlink2_frame_length(empty), 1 + MAVLINK2_NUM_NON_PAYLOAD_BYTES);
+}
+
+TEST(mavlink2_test, bad_and_signed_frames_are_dropped)
+{
+  const uint8_t data[4] = {9, 8, 7, 6};
+  mavlink_message_t msg = make_message(MAVLINK_MSG_ID_PARAM_SET, 23, data, sizeof(data));
+  uint8_t frame[MAVLINK_MAX_PAYLOAD_LEN + MAVLINK2_NUM_NON_PAYLOAD_BYTES + MAVLINK2_SIGNATURE_SIZE];
+  uint16_t len = mavlink2_serialize(msg, frame);
+
+  Mavlink2Parser parser;
+  mavlink_message_t received;
+
+  // corrupted payload
+  frame[MAVLINK2_HEADER_SIZE] ^= 0x10;
+  EXPECT_FALSE(parse_frame(parser, frame, len, &received));
+  EXPECT_EQ(parser.frames_dropped(), 1u);
+  frame[MAVLINK2_HEADER_SIZE] ^= 0x10;
+
+  // signed, the signature is skipped without being mistaken for the start of a frame
+  frame[2] = MAVLINK2_INCOMPAT_FLAG_SIGNED;
+  memset(frame + len, MAVLINK2_STX, MAVLINK2_SIGNATURE_SIZE);
+  EXPECT_FALSE(parse_frame(parser, frame, len + MAVLINK2_SIGNATURE_SIZE, &received));
+  EXPECT_EQ(parser.frames_dropped(), 2u);
+  EXPECT_TRUE(parser.idle());
+  frame[2] = 0;
+
+  // and the next good frame gets through
+  EXPECT_TRUE(parse_frame(parser, frame, len, &received));
+  EXPECT_EQ(parser.frames_received(), 1u);
+}
+
+TEST(mavlink2_test, firmware_receives_and_sends_v2)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // received whatever MAVLINK_VER is
+  const uint8_t request[2] = {1, 250};
+  mavlink_message_t msg = make_message(MAVLINK_MSG_ID_PARAM_REQUEST_LIST, MAVLINK_MSG_ID_PARAM_REQUEST_LIST_LEN,
+                                       request, sizeof(request));
+  uint8_t frame[MAVLINK_MAX_PAYLOAD_LEN + MAVLINK2_NUM_NON_PAYLOAD_BYTES];
+  uint16_t len = mavlink2_serialize(msg, frame);
+  ASSERT_TRUE(board.push_serial_rx(frame, len));
+  rf.mavlink_.receive();
+  EXPECT_EQ(rf.mavlink_.mavlink2_parser().frames_received(), 1u);
+
+  // every frame sent is a v2 frame once it is selected
+  rf.params_.set_param_int(PARAM_MAVLINK_VERSION, 2);
+  board.set_serial_tx_capture(true);
+  for (int i = 0; i < 100; i++)
+  {
+    board.set_time(board.clock_micros() + 1000);
+    rf.mavlink_.stream();
+  }
+  const std::vector<uint8_t> &sent = board.serial_tx_data();
+  ASSERT_GT(sent.size(), 0u);
+  size_t frames = 0;
+  for (size_t i = 0; i < sent.size(); i += sent[i + 1] + MAVLINK2_NUM_NON_PAYLOAD_BYTES)
+  {
+    ASSERT_EQ(sent[i], MAVLINK2_STX);
+    frames++;
+  }
+  EXPECT_GT(frames, 10u);
+}
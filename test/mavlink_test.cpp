@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cmath>
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+#include "test_helpers.h"
+
+using namespace rosflight_firmware;
+
+TEST(mavlink_test, saturated_link_drops_instead_of_blocking)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  step_firmware(rf, board, 10000);
+  EXPECT_GT(board.serial_bytes_written(), 0u);
+  EXPECT_EQ(rf.mavlink_.tx_dropped_bytes(), 0u);
+
+  // Stop the UART from taking any more data; messages pile up and then get dropped
+  board.set_serial_tx_free(0);
+  size_t written = board.serial_bytes_written();
+  step_firmware(rf, board, 100000);
+  EXPECT_EQ(board.serial_bytes_written(), written);
+  EXPECT_GT(rf.mavlink_.tx_dropped_bytes(), 0u);
+  EXPECT_GT(rf.mavlink_.tx_dropped_messages(), 0u);
+
+  // Once the link frees up, everything flows again
+  board.set_serial_tx_free(4096);
+  step_firmware(rf, board, 1000);
+  uint32_t dropped = rf.mavlink_.tx_dropped_bytes();
+  step_firmware(rf, board, 100000);
+  EXPECT_GT(board.serial_bytes_written(), written);
+  EXPECT_EQ(rf.mavlink_.tx_dropped_bytes(), dropped);
+}
+
+TEST(mavlink_test, adaptive_rates_fit_link_budget)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // Valid RC, so the RC lost error isn't being reported on every RC update
+  uint16_t rc_values[8] = {1500, 1500, 1000, 1500, 1500, 1500, 1500, 1500};
+  board.set_rc(rc_values);
+
+  // The default stream rates oversubscribe a 115200 baud link
+  rf.params_.set_param_int(PARAM_BAUD_RATE, 115200);
+  rf.params_.set_param_float(PARAM_STREAM_BANDWIDTH_FRACTION, 0.8f);
+  rf.params_.set_param_int(PARAM_STREAM_ADAPTIVE, false);
+  step_firmware(rf, board, 2000000);
+  size_t start = board.serial_bytes_written();
+  step_firmware(rf, board, 1000000);
+  size_t fixed_rate_bytes = board.serial_bytes_written() - start;
+  float budget = 115200 / 10.0f * 0.8f;
+  EXPECT_GT(fixed_rate_bytes, budget);
+
+  // With adaptive rates on, the streams get slowed down to fit
+  rf.params_.set_param_int(PARAM_STREAM_ADAPTIVE, true);
+  step_firmware(rf, board, 2000000);
+  start = board.serial_bytes_written();
+  step_firmware(rf, board, 1000000);
+  size_t adaptive_bytes = board.serial_bytes_written() - start;
+  EXPECT_LE(adaptive_bytes, 1.1f*budget);
+  EXPECT_GE(adaptive_bytes, 0.5f*budget);
+  EXPECT_EQ(rf.mavlink_.tx_dropped_bytes(), 0u);
+}
+
+TEST(mavlink_test, imu_batch_keeps_up_with_imu)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // Nothing is accumulated while the batch stream is off
+  step_firmware(rf, board, 10000);
+  EXPECT_EQ(rf.sensors_.imu_batch_available(), 0u);
+
+  // At 100 Hz the flushes keep the buffer from ever holding more than a frame plus one flush period
+  rf.params_.set_param_int(PARAM_STREAM_IMU_BATCH_RATE, 100);
+  for (int i = 0; i < 50; i++)
+  {
+    step_firmware(rf, board, 5000);
+    EXPECT_LT(rf.sensors_.imu_batch_available(), Mavlink::IMU_BATCH_SAMPLES_PER_FRAME + 10);
+  }
+
+  // Batched samples have the calibration applied
+  imu_sample_t sample;
+  while (rf.sensors_.imu_batch_pop(&sample)) {}
+  rf.params_.set_param_float(PARAM_GYRO_X_BIAS, 0.1f);
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.5f, 0.0f, 0.0f};
+  uint64_t sample_time_us = board.clock_micros() + 1000;
+  board.set_imu(acc, gyro, sample_time_us);
+  ASSERT_TRUE(rf.sensors_.update_imu());
+  ASSERT_TRUE(rf.sensors_.imu_batch_pop(&sample));
+  EXPECT_NEAR(sample.gyro[0], 0.4f, 1e-6f);
+  EXPECT_NEAR(sample.accel[2], -9.80665f, 1e-5f);
+  EXPECT_EQ(sample.time_us, sample_time_us);
+}
+
+TEST(mavlink_test, telemetry_batch_round_trip)
+{
+  // A second of hover at 1 kHz: a slow gyro oscillation with a little noise on everything
+  Mavlink::TelemetryBatch batch;
+  static constexpr int NUM_SAMPLES = 1000;
+  static int32_t samples[NUM_SAMPLES][Mavlink::TELEMETRY_NUM_FIELDS];
+  uint32_t noise = 12345;
+  for (int n = 0; n < NUM_SAMPLES; n++)
+  {
+    for (int i = 0; i < Mavlink::TELEMETRY_NUM_FIELDS; i++)
+    {
+      noise = noise*1103515245u + 12345u;
+      samples[n][i] = static_cast<int32_t>((noise >> 16) % 5) - 2;
+    }
+    samples[n][Mavlink::TELEMETRY_ACCEL_Z] -= 3923;
+    samples[n][Mavlink::TELEMETRY_GYRO_X] += static_cast<int32_t>(90.0f*std::sin(0.02f*n));
+    samples[n][Mavlink::TELEMETRY_Q_W] += 9990;
+  }
+
+  int frames = 0;
+  int n = 0;
+  while (n < NUM_SAMPLES)
+  {
+    batch.clear();
+    int first = n;
+    while (n < NUM_SAMPLES && batch.add(1000000 + 1000*n, samples[n]))
+      n++;
+    ASSERT_GT(batch.count(), 0);
+    EXPECT_EQ(batch.start_time_us(), 1000000u + 1000u*first);
+    frames++;
+
+    // Decode the frame on its own
+    const uint8_t *p = batch.data();
+    size_t left = batch.size();
+    uint64_t time_us = batch.start_time_us();
+    int32_t fields[Mavlink::TELEMETRY_NUM_FIELDS] = {};
+    for (int k = 0; k < batch.count(); k++)
+    {
+      uint64_t value = 0;
+      uint8_t len = varint_decode(p, left, &value);
+      ASSERT_GT(len, 0);
+      p += len;
+      left -= len;
+      time_us += value;
+      EXPECT_EQ(time_us, 1000000u + 1000u*(first + k));
+      for (int i = 0; i < Mavlink::TELEMETRY_NUM_FIELDS; i++)
+      {
+        len = varint_decode(p, left, &value);
+        ASSERT_GT(len, 0);
+        p += len;
+        left -= len;
+        fields[i] += zigzag_decode(static_cast<uint32_t>(value));
+        EXPECT_EQ(fields[i], samples[first + k][i]);
+      }
+    }
+    EXPECT_EQ(left, 0u);
+  }
+
+  // SMALL_IMU and ATTITUDE_QUATERNION take 84 bytes per sample with the MAVLink framing, a 261 byte
+  // ENCAPSULATED_DATA frame of these carries at least 15
+  EXPECT_LE(frames, NUM_SAMPLES/15);
+}
+
+TEST(mavlink_test, telemetry_stream_fits_far_more_samples_per_byte)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  size_t start_bytes = board.serial_bytes_written();
+  step_firmware(rf, board, 1000000);
+  size_t other_bytes = board.serial_bytes_written() - start_bytes;
+
+  // A sample per IMU update, sent at least every TELEMETRY_MAX_LATENCY_US, in far fewer bytes than the 84 per
+  // sample of SMALL_IMU and ATTITUDE_QUATERNION
+  rf.params_.set_param_int(PARAM_STREAM_TELEMETRY_RATE, 1000);
+  start_bytes = board.serial_bytes_written();
+  step_firmware(rf, board, 1000000);
+  size_t telemetry_bytes = board.serial_bytes_written() - start_bytes - other_bytes;
+  size_t frame_bytes = 2 + MAVLINK_MSG_ENCAPSULATED_DATA_FIELD_DATA_LEN + MAVLINK_NUM_NON_PAYLOAD_BYTES;
+  EXPECT_GE(telemetry_bytes, 1000000/Mavlink::TELEMETRY_MAX_LATENCY_US*frame_bytes);
+  EXPECT_LE(telemetry_bytes, 1000u*84/4);
+}
+
+TEST(mavlink_test, receive_reads_in_chunks_within_a_budget)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  uint8_t noise[1000];
+  memset(noise, 0x55, sizeof(noise));
+  ASSERT_TRUE(board.push_serial_rx(noise, sizeof(noise)));
+
+  // a burst is spread over several passes, a chunk per board call
+  uint32_t calls = board.serial_read_calls();
+  rf.mavlink_.receive();
+  EXPECT_EQ(board.serial_bytes_available(), sizeof(noise) - Mavlink::RX_BYTES_PER_PASS);
+  EXPECT_EQ(board.serial_read_calls() - calls, Mavlink::RX_BYTES_PER_PASS/Mavlink::RX_CHUNK_SIZE);
+  while (board.serial_bytes_available() > 0)
+    rf.mavlink_.receive();
+
+  // with nothing waiting a pass costs a single call
+  calls = board.serial_read_calls();
+  rf.mavlink_.receive();
+  EXPECT_EQ(board.serial_read_calls() - calls, 1u);
+}
+
+TEST(mavlink_test, receive_counts_parse_errors_and_overflows)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  EXPECT_EQ(rf.mavlink_.rx_parse_errors(), 0u);
+  EXPECT_EQ(rf.mavlink_.rx_overflows(), 0u);
+
+  mavlink_message_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msgid = MAVLINK_MSG_ID_PARAM_REQUEST_LIST;
+  msg.len = MAVLINK_MSG_ID_PARAM_REQUEST_LIST_LEN;
+  reinterpret_cast<uint8_t *>(msg.payload64)[0] = 1;
+  uint8_t frame[MAVLINK_MAX_PAYLOAD_LEN + MAVLINK2_NUM_NON_PAYLOAD_BYTES];
+  uint16_t len = mavlink2_serialize(msg, frame);
+  frame[len - 1] ^= 0xFF;
+  ASSERT_TRUE(board.push_serial_rx(frame, len));
+  rf.mavlink_.receive();
+  EXPECT_EQ(rf.mavlink_.rx_parse_errors(), 1u);
+
+  uint8_t burst[600] = {};
+  ASSERT_TRUE(board.push_serial_rx(burst, sizeof(burst)));
+  EXPECT_FALSE(board.push_serial_rx(burst, sizeof(burst)));
+  EXPECT_EQ(rf.mavlink_.rx_overflows(), 1u);
+}
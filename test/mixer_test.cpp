@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+#include "test_helpers.h"
+
+using namespace rosflight_firmware;
+
+static void expect_outputs(ROSflight& rf, float m0, float m1, float m2, float m3)
+{
+  const float* outputs = rf.mixer_.get_outputs();
+  EXPECT_NEAR(outputs[0], m0, 1e-5f);
+  EXPECT_NEAR(outputs[1], m1, 1e-5f);
+  EXPECT_NEAR(outputs[2], m2, 1e-5f);
+  EXPECT_NEAR(outputs[3], m3, 1e-5f);
+}
+
+TEST(mixer_test, saturating_mixer_scales_motors_down)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+
+  Controller::Output commands = {0.95f, 0.3f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.65f/1.25f, 0.65f/1.25f, 1.0f, 1.0f);
+
+  // and the low side is clipped at the idle throttle
+  commands.F = 0.0f;
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.1f, 0.1f, 0.3f, 0.3f);
+}
+
+TEST(mixer_test, airmode_keeps_roll_authority)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+  rf.params_.set_param_int(PARAM_MIXER_AIRMODE, true);
+
+  // near full throttle the thrust gives way to the roll torque
+  Controller::Output commands = {0.95f, 0.3f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.4f, 0.4f, 1.0f, 1.0f);
+
+  // at zero throttle the thrust is raised instead
+  commands = {0.0f, 0.2f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.1f, 0.1f, 0.5f, 0.5f);
+
+  // unsaturated commands are mixed as they are
+  commands = {0.5f, 0.1f, -0.05f, 0.02f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.5f - 0.1f - 0.05f + 0.02f, 0.5f - 0.1f + 0.05f - 0.02f,
+                 0.5f + 0.1f + 0.05f + 0.02f, 0.5f + 0.1f - 0.05f - 0.02f);
+}
+
+TEST(mixer_test, airmode_gives_up_yaw_before_roll_and_pitch)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+  rf.params_.set_param_int(PARAM_MIXER_AIRMODE, true);
+
+  // roll fits in the 0.9 motor range on its own but not with the yaw, which is scaled by (0.9-0.6)/(1.4-0.6).
+  // That fills the whole range, so the thrust is moved to the middle of it.
+  Controller::Output commands = {0.5f, 0.3f, 0.0f, 0.4f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.55f - 0.3f + 0.15f, 0.55f - 0.3f - 0.15f, 0.55f + 0.3f + 0.15f, 0.55f + 0.3f - 0.15f);
+
+  // roll that doesn't fit on its own is scaled to the full range, and the yaw is dropped
+  commands = {0.5f, 0.6f, 0.0f, 0.4f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.1f, 0.1f, 1.0f, 1.0f);
+}
+
+TEST(mixer_test, thrust_curve_linearizes_motors)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+  const float a = 0.5f;
+  rf.params_.set_param_float(PARAM_MOTOR_THRUST_CURVE, a);
+
+  for (float thrust = 0.1f; thrust <= 1.0f; thrust += 0.05f)
+  {
+    Controller::Output commands = {thrust, 0.0f, 0.0f, 0.0f};
+    rf.mixer_.mix_output(commands);
+    float u = rf.mixer_.get_outputs()[0];
+    EXPECT_NEAR((1.0f - a)*u + a*u*u, thrust, 1e-3f);
+  }
+
+  // the idle is a motor command, so the curve doesn't move it
+  rf.params_.set_param_int(PARAM_SPIN_MOTORS_WHEN_ARMED, true);
+  rf.params_.set_param_float(PARAM_MOTOR_IDLE_THROTTLE, 0.1f);
+  Controller::Output idle = {0.0f, 0.0f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(idle);
+  expect_outputs(rf, 0.1f, 0.1f, 0.1f, 0.1f);
+
+  // a linear curve leaves the outputs alone
+  rf.params_.set_param_float(PARAM_MOTOR_THRUST_CURVE, 0.0f);
+  Controller::Output commands = {0.5f, 0.0f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, 0.5f, 0.5f, 0.5f, 0.5f);
+}
+
+static void set_custom_mixer(ROSflight& rf, const float effect[4][8], int num_motors)
+{
+  rf.params_.begin_batch();
+  for (int i = 0; i < 8; i++)
+  {
+    rf.params_.set_param_int(PARAM_MIXER_CUSTOM_TYPE_0 + i, (i < num_motors) ? Mixer::M : Mixer::NONE);
+    rf.params_.set_param_float(PARAM_MIXER_CUSTOM_F_0 + i, effect[0][i]);
+    rf.params_.set_param_float(PARAM_MIXER_CUSTOM_X_0 + i, effect[1][i]);
+    rf.params_.set_param_float(PARAM_MIXER_CUSTOM_Y_0 + i, effect[2][i]);
+    rf.params_.set_param_float(PARAM_MIXER_CUSTOM_Z_0 + i, effect[3][i]);
+  }
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::CUSTOM);
+  rf.params_.end_batch();
+}
+
+TEST(mixer_test, custom_mixer_reproduces_built_in_mixer)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+
+  Controller::Output commands = {0.6f, 0.1f, -0.05f, 0.08f};
+  rf.mixer_.mix_output(commands);
+  float built_in[4];
+  for (int i = 0; i < 4; i++)
+    built_in[i] = rf.mixer_.get_outputs()[i];
+
+  // the quad X mixing matrix is its own pseudo-inverse, up to the column scaling
+  const float effect[4][8] = {{ 1.0f,  1.0f,  1.0f,  1.0f},
+                              {-1.0f, -1.0f,  1.0f,  1.0f},
+                              { 1.0f, -1.0f, -1.0f,  1.0f},
+                              { 1.0f, -1.0f,  1.0f, -1.0f}};
+  set_custom_mixer(rf, effect, 4);
+  EXPECT_EQ(rf.state_manager_.state().error_codes, StateManager::ERROR_NONE);
+  rf.mixer_.mix_output(commands);
+  expect_outputs(rf, built_in[0], built_in[1], built_in[2], built_in[3]);
+}
+
+TEST(mixer_test, custom_mixer_decouples_axes)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+
+  // an irregular hexacopter, with unequal arms and one weaker motor
+  const float effect[4][8] = {{ 1.0f,  1.0f,  0.8f,  1.0f,  1.0f,  1.0f},
+                              { 0.0f, -0.9f, -0.7f,  0.0f,  1.1f,  0.8f},
+                              { 1.2f,  0.5f, -0.4f, -1.0f, -0.6f,  0.5f},
+                              { 0.1f, -0.1f,  0.08f, -0.1f,  0.1f, -0.1f}};
+  set_custom_mixer(rf, effect, 6);
+  EXPECT_EQ(rf.state_manager_.state().error_codes, StateManager::ERROR_NONE);
+
+  // each torque command changes only its own axis of the total effect of the outputs
+  Controller::Output hover = {0.5f, 0.0f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(hover);
+  float hover_outputs[6];
+  for (int i = 0; i < 6; i++)
+    hover_outputs[i] = rf.mixer_.get_outputs()[i];
+
+  for (int axis = 1; axis < 4; axis++)
+  {
+    Controller::Output commands = hover;
+    float *torque[4] = {&commands.F, &commands.x, &commands.y, &commands.z};
+    *torque[axis] = 0.05f;
+    rf.mixer_.mix_output(commands);
+
+    float total[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 6; i++)
+      for (int a = 0; a < 4; a++)
+        total[a] += effect[a][i]*(rf.mixer_.get_outputs()[i] - hover_outputs[i]);
+    for (int a = 0; a < 4; a++)
+    {
+      if (a == axis)
+        EXPECT_GT(turbomath::fabs(total[a]), 1e-3f);
+      else
+        EXPECT_NEAR(total[a], 0.0f, 1e-5f);
+    }
+  }
+}
+
+TEST(mixer_test, empty_custom_mixer_is_invalid)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::CUSTOM);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+}
+
+TEST(mixer_test, custom_mixer_with_unknown_output_type_is_invalid)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  const float effect[4][8] = {{ 1.0f,  1.0f,  1.0f,  1.0f},
+                              {-1.0f, -1.0f,  1.0f,  1.0f},
+                              { 1.0f, -1.0f, -1.0f,  1.0f},
+                              { 1.0f, -1.0f,  1.0f, -1.0f}};
+  set_custom_mixer(rf, effect, 4);
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+
+  rf.params_.set_param_int(PARAM_MIXER_CUSTOM_TYPE_2, Mixer::G);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+
+  rf.params_.set_param_int(PARAM_MIXER_CUSTOM_TYPE_2, Mixer::M);
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+
+  rf.params_.set_param_int(PARAM_MIXER_CUSTOM_TYPE_2, 7);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+}
+
+TEST(mixer_test, pwm_outputs_are_written_in_one_batch)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+
+  uint32_t writes = board.pwm_write_count();
+  Controller::Output commands = {0.5f, 0.1f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  EXPECT_EQ(board.pwm_write_count(), writes + 1);
+  EXPECT_NEAR(board.pwm_values()[0], 1400.0f, 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[1], 1400.0f, 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[2], 1600.0f, 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[3], 1600.0f, 1e-3f);
+  EXPECT_EQ(board.pwm_values()[4], 0.0f); // unused outputs are never written
+
+  // servos are centered on 1500 us
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::FIXEDWING);
+  rf.params_.set_param_int(PARAM_FIXED_WING, true);
+  commands = {0.5f, 0.2f, -0.4f, 0.1f};
+  rf.mixer_.mix_output(commands);
+  const float* outputs = rf.mixer_.get_outputs();
+  EXPECT_NEAR(board.pwm_values()[0], 1500.0f + 500.0f*outputs[0], 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[1], 1500.0f + 500.0f*outputs[1], 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[2], 1000.0f + 1000.0f*outputs[2], 1e-3f);
+  EXPECT_NEAR(board.pwm_values()[3], 1500.0f + 500.0f*outputs[3], 1e-3f);
+  EXPECT_NE(outputs[0], 0.0f);
+}
+
+TEST(mixer_test, digital_motors_are_written_in_one_batch)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+  rf.params_.set_param_int(PARAM_MOTOR_PROTOCOL, MOTOR_PROTOCOL_DSHOT600);
+  EXPECT_EQ(board.motor_protocol(), MOTOR_PROTOCOL_DSHOT600);
+  EXPECT_EQ(board.motor_mask(), 0x0F);
+
+  uint32_t writes = board.motor_write_count();
+  Controller::Output commands = {0.5f, 0.1f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  EXPECT_EQ(board.motor_write_count(), writes + 1);
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ(board.motor_values()[i], rf.mixer_.get_outputs()[i]);
+  expect_outputs(rf, 0.4f, 0.4f, 0.6f, 0.6f);
+
+  // and left out of the PWM batch
+  for (int i = 0; i < 4; i++)
+    EXPECT_EQ(board.pwm_values()[i], 0.0f);
+}
+
+TEST(mixer_test, unsupported_motor_protocol_falls_back_to_pwm)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  arm_quad_x(rf);
+  board.set_motor_protocols_supported(false);
+  rf.params_.set_param_int(PARAM_MOTOR_PROTOCOL, MOTOR_PROTOCOL_ONESHOT125);
+
+  uint32_t writes = board.motor_write_count();
+  Controller::Output commands = {0.5f, 0.1f, 0.0f, 0.0f};
+  rf.mixer_.mix_output(commands);
+  EXPECT_EQ(board.motor_write_count(), writes);
+  expect_outputs(rf, 0.4f, 0.4f, 0.6f, 0.6f);
+}
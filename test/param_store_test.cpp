@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+TEST(param_store_test, saved_params_survive_reboot)
+{
+  testBoard board;
+  {
+    ROSflight rf(board);
+    rf.init();
+    EXPECT_EQ(rf.param_store_.generation(), 0u); // blank memory, running on defaults
+
+    rf.params_.set_param_float(PARAM_PID_ROLL_RATE_P, 0.25f);
+    rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1900);
+    EXPECT_TRUE(rf.params_.write());
+    EXPECT_TRUE(rf.param_store_.busy()); // nothing is written until the store runs
+    rf.param_store_.flush();
+    EXPECT_FALSE(rf.param_store_.busy());
+
+    // changed but never saved
+    rf.params_.set_param_float(PARAM_FAILSAFE_THROTTLE, 0.5f);
+    rf.param_store_.flush();
+  }
+
+  ROSflight rf(board);
+  rf.init();
+  EXPECT_FLOAT_EQ(rf.params_.get_param_float(PARAM_PID_ROLL_RATE_P), 0.25f);
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM), 1900);
+  EXPECT_FLOAT_EQ(rf.params_.get_param_float(PARAM_FAILSAFE_THROTTLE),
+                  rf.params_.get_param_default(PARAM_FAILSAFE_THROTTLE).fvalue);
+  EXPECT_EQ(board.memory_erase_count(), 1u);
+}
+
+TEST(param_store_test, saves_append_until_the_sector_is_full)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // each save appends only the one param that changed
+  for (int i = 0; i < 400; i++)
+  {
+    rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1500 + i);
+    rf.params_.write();
+    rf.param_store_.flush();
+  }
+
+  // the first save and one compaction each erased a sector, and the snapshot only holds the non-default param
+  uint32_t records_per_sector = (board.memory_sector_size() - ParamStore::HEADER_SIZE)/ParamStore::RECORD_SIZE;
+  EXPECT_EQ(board.memory_erase_count(), 2u);
+  EXPECT_EQ(rf.param_store_.generation(), 2u);
+  EXPECT_EQ(rf.param_store_.records_used(), 400 - records_per_sector);
+
+  ROSflight rebooted(board);
+  rebooted.init();
+  EXPECT_EQ(rebooted.params_.get_param_int(PARAM_MOTOR_MAX_PWM), 1899);
+}
+
+TEST(param_store_test, corrupt_record_is_skipped)
+{
+  testBoard board;
+  {
+    ROSflight rf(board);
+    rf.init();
+    rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1800);
+    rf.params_.write();
+    rf.param_store_.flush();
+    rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1700);
+    rf.params_.write();
+    rf.param_store_.flush();
+  }
+
+  // sector 0 holds the snapshot record, then the appended one, as if its value write had been torn
+  board.set_memory_word(0, ParamStore::HEADER_SIZE + ParamStore::RECORD_SIZE + 4, 0xFFFFFFFF);
+
+  ROSflight rf(board);
+  rf.init();
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM), 1800);
+  EXPECT_EQ(rf.param_store_.records_used(), 2u);
+
+  // the next save goes after the torn record
+  rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1600);
+  rf.params_.write();
+  rf.param_store_.flush();
+
+  ROSflight rebooted(board);
+  rebooted.init();
+  EXPECT_EQ(rebooted.params_.get_param_int(PARAM_MOTOR_MAX_PWM), 1600);
+}
+
+TEST(param_store_test, no_erase_while_armed)
+{
+  testBoard board;
+  ROSflight rf(board);
+
+  // just the modules needed to arm
+  rf.board_.init_board();
+  rf.state_manager_.init();
+  rf.params_.init();
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+
+  // with no sector to append to, the save has to wait for a compaction
+  rf.params_.set_param_int(PARAM_MOTOR_MAX_PWM, 1900);
+  EXPECT_TRUE(rf.params_.write());
+  for (int i = 0; i < 10; i++)
+    rf.param_store_.run();
+  rf.param_store_.flush();
+  EXPECT_EQ(board.memory_erase_count(), 0u);
+  EXPECT_TRUE(rf.param_store_.busy());
+
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_DISARM);
+  ASSERT_FALSE(rf.state_manager_.state().armed);
+  rf.param_store_.flush();
+  EXPECT_EQ(board.memory_erase_count(), 1u);
+  EXPECT_FALSE(rf.param_store_.busy());
+
+  ROSflight rebooted(board);
+  rebooted.init();
+  EXPECT_EQ(rebooted.params_.get_param_int(PARAM_MOTOR_MAX_PWM), 1900);
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+static void count_callback(void *context, uint16_t param_id)
+{
+  (void) param_id;
+  (*static_cast<int *>(context))++;
+}
+
+static void read_image(ROSflight& rf, uint8_t *image)
+{
+  // read it back in odd-sized pieces, like the chunks of a transfer would
+  for (uint16_t offset = 0; offset < Params::BULK_IMAGE_SIZE; offset += 100)
+    rf.params_.bulk_read(offset, image + offset, 100);
+}
+
+static void stage_image(ROSflight& rf, const uint8_t *image)
+{
+  for (uint16_t offset = 0; offset < Params::BULK_IMAGE_SIZE; offset += 100)
+    rf.params_.bulk_stage(offset, image + offset, 100);
+}
+
+TEST(param_test, bulk_image_round_trip)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  uint8_t image[Params::BULK_IMAGE_SIZE + 100];
+  read_image(rf, image);
+  EXPECT_EQ(image[4] | (image[5] << 8), PARAMS_COUNT);
+
+  int callbacks = 0;
+  rf.params_.add_callback(count_callback, &callbacks, PARAM_MOTOR_MAX_PWM);
+  callbacks = 0; // add_callback calls it once on registration
+
+  // Patch a value in the image and fix up the checksum incrementally, as a host would
+  uint8_t *value = image + Params::BULK_HEADER_SIZE + 4*PARAM_MOTOR_MAX_PWM;
+  int32_t new_max = rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM) - 100;
+  for (int i = 0; i < 4; i++)
+  {
+    uint8_t byte = static_cast<uint8_t>(static_cast<uint32_t>(new_max) >> (8*i));
+    image[Params::BULK_HEADER_SIZE - 1] ^= value[i] ^ byte;
+    value[i] = byte;
+  }
+
+  stage_image(rf, image);
+  EXPECT_TRUE(rf.params_.bulk_commit());
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM), new_max);
+  EXPECT_EQ(callbacks, 1);
+
+  // The image of the new values matches what was uploaded
+  uint8_t readback[Params::BULK_IMAGE_SIZE + 100];
+  read_image(rf, readback);
+  EXPECT_EQ(memcmp(image, readback, Params::BULK_IMAGE_SIZE), 0);
+
+  // Committing the same image again changes nothing
+  EXPECT_TRUE(rf.params_.bulk_commit());
+  EXPECT_EQ(callbacks, 1);
+}
+
+TEST(param_test, bulk_commit_rejects_bad_images)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  int32_t max_pwm = rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM);
+
+  uint8_t image[Params::BULK_IMAGE_SIZE + 100];
+  read_image(rf, image);
+
+  // a value changed without updating the checksum
+  image[Params::BULK_HEADER_SIZE + 4*PARAM_MOTOR_MAX_PWM] ^= 0x01;
+  stage_image(rf, image);
+  EXPECT_FALSE(rf.params_.bulk_commit());
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_MOTOR_MAX_PWM), max_pwm);
+  image[Params::BULK_HEADER_SIZE + 4*PARAM_MOTOR_MAX_PWM] ^= 0x01;
+
+  // a type changed, with a consistent checksum
+  image[Params::BULK_HEADER_SIZE + 4*PARAMS_COUNT + PARAM_MOTOR_MAX_PWM] ^= 0x01;
+  image[Params::BULK_HEADER_SIZE - 1] ^= 0x01;
+  stage_image(rf, image);
+  EXPECT_FALSE(rf.params_.bulk_commit());
+  image[Params::BULK_HEADER_SIZE + 4*PARAMS_COUNT + PARAM_MOTOR_MAX_PWM] ^= 0x01;
+  image[Params::BULK_HEADER_SIZE - 1] ^= 0x01;
+
+  // a different parameter count, with a consistent checksum
+  image[4] ^= 0x01;
+  image[Params::BULK_HEADER_SIZE - 1] ^= 0x01;
+  stage_image(rf, image);
+  EXPECT_FALSE(rf.params_.bulk_commit());
+
+  EXPECT_FALSE(rf.params_.bulk_stage(Params::BULK_IMAGE_SIZE, image, 1));
+}
+
+TEST(param_test, lookup_param_id_finds_every_name)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  for (uint16_t id = 0; id < PARAMS_COUNT; id++)
+  {
+    char name[Params::PARAMS_NAME_LENGTH];
+    memcpy(name, rf.params_.get_param_name(id), Params::PARAMS_NAME_LENGTH);
+    EXPECT_EQ(rf.params_.lookup_param_id(name), id) << name;
+  }
+
+  char unknown[Params::PARAMS_NAME_LENGTH] = "NOT_A_PARAM";
+  EXPECT_EQ(rf.params_.lookup_param_id(unknown), PARAMS_COUNT);
+  char prefix[Params::PARAMS_NAME_LENGTH] = "PID_ROLL";
+  EXPECT_EQ(rf.params_.lookup_param_id(prefix), PARAMS_COUNT);
+  char longer[Params::PARAMS_NAME_LENGTH] = "MIXER_";
+  EXPECT_EQ(rf.params_.lookup_param_id(longer), PARAMS_COUNT);
+  char first[Params::PARAMS_NAME_LENGTH] = "";
+  EXPECT_EQ(rf.params_.lookup_param_id(first), PARAMS_COUNT);
+
+  EXPECT_TRUE(rf.params_.set_param_by_name_int("MIXER", 3));
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_MIXER), 3);
+}
+
+TEST(param_test, defaults_come_from_table)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  EXPECT_STREQ(rf.params_.get_param_name(PARAM_BAUD_RATE), "BAUD_RATE");
+  EXPECT_EQ(rf.params_.get_param_type(PARAM_BAUD_RATE), PARAM_TYPE_INT32);
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_BAUD_RATE), 921600);
+  EXPECT_EQ(rf.params_.get_param_min(PARAM_BAUD_RATE), 9600.0f);
+  EXPECT_EQ(rf.params_.get_param_max(PARAM_BAUD_RATE), 921600.0f);
+
+  EXPECT_EQ(rf.params_.get_param_type(PARAM_ARM_THRESHOLD), PARAM_TYPE_FLOAT);
+  EXPECT_FLOAT_EQ(rf.params_.get_param_float(PARAM_ARM_THRESHOLD), 0.15f);
+
+  // full 16 character names are kept whole
+  EXPECT_STREQ(rf.params_.get_param_name(PARAM_PID_PITCH_RATE_P), "PID_PITCH_RATE_P");
+
+  // resetting to defaults only touches the values
+  rf.params_.set_param_int(PARAM_BAUD_RATE, 115200);
+  rf.params_.set_defaults();
+  EXPECT_EQ(rf.params_.get_param_int(PARAM_BAUD_RATE), 921600);
+}
+
+class ParamSubscriber
+{
+public:
+  int calls = 0;
+  uint16_t last_id = PARAMS_COUNT + 1;
+  void param_change_callback(uint16_t param_id)
+  {
+    calls++;
+    last_id = param_id;
+  }
+};
+
+TEST(param_test, callbacks_allow_several_subscribers)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  ParamSubscriber a, b;
+  EXPECT_TRUE((rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&a, PARAM_MIXER)));
+  EXPECT_TRUE((rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&b, PARAM_MIXER)));
+  EXPECT_EQ(a.calls, 1);
+  EXPECT_EQ(b.calls, 1);
+
+  // registering again doesn't add a second subscription
+  EXPECT_TRUE((rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&a, PARAM_MIXER)));
+  a.calls = b.calls = 0;
+
+  // the mixer's own callback still runs alongside the new subscribers
+  rf.params_.set_param_int(PARAM_MIXER, 2);
+  EXPECT_EQ(a.calls, 1);
+  EXPECT_EQ(b.calls, 1);
+  EXPECT_EQ(a.last_id, PARAM_MIXER);
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_INVALID_MIXER);
+
+  // the pool is fixed size
+  int count = 0;
+  bool added = true;
+  for (uint16_t id = 0; id < PARAMS_COUNT && added; id++)
+    added = rf.params_.add_callback(count_callback, &count, id);
+  EXPECT_FALSE(added);
+  EXPECT_EQ(rf.params_.dropped_callbacks(), 1u);
+}
+
+TEST(param_test, every_module_subscription_fits_in_the_pool)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  ASSERT_EQ(rf.params_.dropped_callbacks(), 0u);
+}
+
+TEST(param_test, batch_notifies_each_subscriber_once)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  ParamSubscriber pid, single;
+  rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&pid, PARAM_PID_ROLL_RATE_P);
+  rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&pid, PARAM_PID_ROLL_RATE_I);
+  rf.params_.add_callback<ParamSubscriber, &ParamSubscriber::param_change_callback>(&single, PARAM_PID_TAU);
+  pid.calls = single.calls = 0;
+
+  rf.params_.begin_batch();
+  rf.params_.set_param_float(PARAM_PID_ROLL_RATE_P, 0.1f);
+  rf.params_.set_param_float(PARAM_PID_ROLL_RATE_I, 0.01f);
+  rf.params_.set_param_float(PARAM_PID_ROLL_RATE_P, 0.2f);
+  rf.params_.set_param_float(PARAM_PID_TAU, 0.1f);
+  EXPECT_EQ(pid.calls, 0);
+  EXPECT_EQ(single.calls, 0);
+  rf.params_.end_batch();
+
+  EXPECT_EQ(pid.calls, 1);
+  EXPECT_EQ(pid.last_id, Params::BATCH_CHANGED);
+  EXPECT_EQ(single.calls, 1);
+  EXPECT_EQ(single.last_id, PARAM_PID_TAU);
+
+  // outside a batch every change is notified right away
+  rf.params_.set_param_float(PARAM_PID_ROLL_RATE_P, 0.3f);
+  EXPECT_EQ(pid.calls, 2);
+  EXPECT_EQ(pid.last_id, PARAM_PID_ROLL_RATE_P);
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "cycle_timer.h"
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+TEST(profiler_test, statistics)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.profiler_.init();
+
+  uint8_t stage = Profiler::STAGE_CONTROLLER;
+  EXPECT_EQ(rf.profiler_.stage(stage).count, 0u);
+  EXPECT_EQ(rf.profiler_.mean_us(stage), 0u);
+
+  rf.profiler_.record(stage, 0);
+  rf.profiler_.record(stage, 1);
+  rf.profiler_.record(stage, 3);
+  rf.profiler_.record(stage, 100);
+  rf.profiler_.record(stage, 1000000);
+
+  const Profiler::Stage& stats = rf.profiler_.stage(stage);
+  EXPECT_EQ(stats.count, 5u);
+  EXPECT_EQ(stats.min_us, 0u);
+  EXPECT_EQ(stats.max_us, 1000000u);
+  EXPECT_EQ(rf.profiler_.mean_us(stage), 200020u);
+
+  // log2 bins, with the last bin catching everything longer
+  EXPECT_EQ(stats.histogram[0], 1u);
+  EXPECT_EQ(stats.histogram[1], 1u);
+  EXPECT_EQ(stats.histogram[2], 1u);
+  EXPECT_EQ(stats.histogram[7], 1u);
+  EXPECT_EQ(stats.histogram[Profiler::HISTOGRAM_BINS - 1], 1u);
+
+  // other stages are untouched
+  EXPECT_EQ(rf.profiler_.stage(Profiler::STAGE_MIXER).count, 0u);
+
+  rf.profiler_.reset(stage);
+  EXPECT_EQ(rf.profiler_.stage(stage).count, 0u);
+  EXPECT_EQ(rf.profiler_.stage(stage).max_us, 0u);
+  EXPECT_EQ(rf.profiler_.stage(stage).histogram[7], 0u);
+}
+
+TEST(profiler_test, stage_names_fit_debug_vect)
+{
+  for (uint8_t i = 0; i < Profiler::STAGE_COUNT; i++)
+  {
+    EXPECT_LE(strlen(Profiler::stage_name(i)), 10u);
+  }
+}
+
+TEST(profiler_test, imu_to_motor_latency)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // the sample was taken 250 us before the control loop got to it
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.0f, 0.0f, 0.0f};
+  board.set_imu(acc, gyro, 10000);
+  board.set_time(10250);
+  rf.run();
+
+  const Profiler::Stage& stats = rf.profiler_.stage(Profiler::STAGE_IMU_TO_MOTOR);
+  EXPECT_EQ(stats.count, 1u);
+  EXPECT_EQ(stats.max_us, 250u);
+}
+
+TEST(profiler_test, cycle_timers)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  EXPECT_EQ(board.clock_cycles_per_us(), 1000u);
+
+  // the scope is timed when it ends
+  {
+    ROSFLIGHT_TIME_SCOPE(rf, Profiler::STAGE_MIXER_OUTPUT);
+    uint32_t start = board.clock_cycles();
+    while (board.clock_cycles() - start < 20000) {} // 20 us
+    EXPECT_EQ(rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT).count, 0u);
+  }
+  const Profiler::Cycles& stats = rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT);
+  EXPECT_EQ(stats.count, 1u);
+  EXPECT_GE(stats.min, 20000u);
+  EXPECT_EQ(rf.profiler_.mean_cycles(Profiler::STAGE_MIXER_OUTPUT), stats.total);
+
+  // the instrumented kernels time themselves on every control update
+  rf.profiler_.init();
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.0f, 0.0f, 0.0f};
+  for (uint64_t t = 1000; t <= 10000; t += 1000)
+  {
+    board.set_imu(acc, gyro, t);
+    rf.run();
+  }
+  EXPECT_EQ(rf.profiler_.cycles(Profiler::STAGE_ESTIMATOR_LPF).count, 9u); // not on the first sample
+  EXPECT_EQ(rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT).count, 10u);
+  EXPECT_LE(rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT).min, rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT).max);
+
+  rf.profiler_.reset(Profiler::STAGE_MIXER_OUTPUT);
+  EXPECT_EQ(rf.profiler_.cycles(Profiler::STAGE_MIXER_OUTPUT).count, 0u);
+}
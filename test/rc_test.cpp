@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+#include "rosflight.h"
+#include "sbus.h"
+#include "test_board.h"
+#include "test_helpers.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+// Packs 16 11-bit channel values into an SBUS frame
+void make_sbus_frame(const uint16_t values[16], uint8_t flags, uint8_t frame[SbusDecoder::FRAME_SIZE])
+{
+  for (uint8_t i = 0; i < SbusDecoder::FRAME_SIZE; i++)
+    frame[i] = 0;
+  frame[0] = 0x0F;
+  for (uint16_t bit = 0; bit < 16*11; bit++)
+  {
+    if (values[bit/11] & (1 << (bit % 11)))
+      frame[1 + bit/8] |= static_cast<uint8_t>(1 << (bit % 8));
+  }
+  frame[23] = flags;
+  frame[24] = 0x00;
+}
+
+// Feeds a frame to the decoder a byte every 120 us (100 kbaud 8E2), returns how many frames it completed
+int feed_sbus(SbusDecoder& sbus, const uint8_t *bytes, uint8_t len, uint64_t *time_us, rc_frame_t *frame)
+{
+  int frames = 0;
+  for (uint8_t i = 0; i < len; i++)
+  {
+    *time_us += 120;
+    if (sbus.parse(bytes[i], *time_us, frame))
+      frames++;
+  }
+  return frames;
+}
+
+rc_frame_t make_rc_frame(uint16_t throttle, uint64_t time_us)
+{
+  rc_frame_t frame = {};
+  for (uint8_t i = 0; i < 8; i++)
+    frame.channels[i] = 1500;
+  frame.channels[2] = throttle;
+  frame.num_channels = 8;
+  frame.failsafe = false;
+  frame.time_us = time_us;
+  return frame;
+}
+
+} // namespace
+
+TEST(rc_test, sbus_decodes_channels_and_flags)
+{
+  uint16_t values[16];
+  for (uint8_t i = 0; i < 16; i++)
+    values[i] = static_cast<uint16_t>(172 + 100*i);
+  values[15] = 1811;
+
+  uint8_t bytes[SbusDecoder::FRAME_SIZE];
+  make_sbus_frame(values, 0x00, bytes);
+
+  SbusDecoder sbus;
+  rc_frame_t frame;
+  uint64_t time_us = 1000;
+  EXPECT_EQ(feed_sbus(sbus, bytes, SbusDecoder::FRAME_SIZE, &time_us, &frame), 1);
+  EXPECT_EQ(frame.num_channels, 16);
+  EXPECT_FALSE(frame.failsafe);
+  EXPECT_EQ(frame.time_us, time_us);
+  EXPECT_EQ(frame.channels[0], 987);
+  EXPECT_EQ(frame.channels[15], 2011);
+  for (uint8_t i = 0; i < 15; i++)
+    EXPECT_EQ(frame.channels[i], values[i]*5/8 + 880);
+  EXPECT_EQ(sbus.errors(), 0u);
+
+  // the failsafe flag comes through, a single lost frame doesn't count
+  make_sbus_frame(values, 0x04, bytes);
+  time_us += 7000;
+  EXPECT_EQ(feed_sbus(sbus, bytes, SbusDecoder::FRAME_SIZE, &time_us, &frame), 1);
+  EXPECT_FALSE(frame.failsafe);
+  make_sbus_frame(values, 0x0C, bytes);
+  time_us += 7000;
+  EXPECT_EQ(feed_sbus(sbus, bytes, SbusDecoder::FRAME_SIZE, &time_us, &frame), 1);
+  EXPECT_TRUE(frame.failsafe);
+}
+
+TEST(rc_test, sbus_resyncs_on_the_frame_gap)
+{
+  uint16_t values[16];
+  for (uint8_t i = 0; i < 16; i++)
+    values[i] = 992;
+  uint8_t bytes[SbusDecoder::FRAME_SIZE];
+  make_sbus_frame(values, 0x00, bytes);
+
+  SbusDecoder sbus;
+  rc_frame_t frame;
+  uint64_t time_us = 1000;
+
+  // joining in the middle of a frame, where a channel byte happens to look like a header
+  bytes[10] = 0x0F;
+  EXPECT_EQ(feed_sbus(sbus, &bytes[10], SbusDecoder::FRAME_SIZE - 10, &time_us, &frame), 0);
+
+  // the partial frame is dropped at the gap and the next one decodes
+  make_sbus_frame(values, 0x00, bytes);
+  time_us += 7000;
+  EXPECT_EQ(feed_sbus(sbus, bytes, SbusDecoder::FRAME_SIZE, &time_us, &frame), 1);
+  EXPECT_EQ(frame.channels[3], 1500);
+  EXPECT_EQ(sbus.errors(), 1u);
+
+  // a bad end byte drops the frame
+  bytes[24] = 0xFF;
+  time_us += 7000;
+  EXPECT_EQ(feed_sbus(sbus, bytes, SbusDecoder::FRAME_SIZE, &time_us, &frame), 0);
+  EXPECT_EQ(sbus.errors(), 2u);
+}
+
+TEST(rc_test, frames_reach_the_mux_on_the_next_pass)
+{
+  testBoard board;
+  board.set_rc_frames_supported(true);
+  ROSflight rf(board);
+  rf.init();
+  rf.params_.set_param_int(PARAM_RC_TYPE, RC_PROTOCOL_SBUS);
+  ASSERT_TRUE(rf.rc_.frame_mode());
+  EXPECT_EQ(board.rc_protocol(), RC_PROTOCOL_SBUS);
+
+  // no frames yet, so RC is lost
+  step_firmware(rf, board, 50000);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_RC_LOST);
+
+  // every frame is interpreted and muxed as soon as it shows up, without waiting for a 20 ms poll
+  for (uint16_t i = 0; i < 10; i++)
+  {
+    uint16_t throttle = static_cast<uint16_t>(1000 + 50*i);
+    board.push_rc_frame(make_rc_frame(throttle, board.clock_micros()));
+    step_firmware(rf, board, 1000);
+    EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, (throttle - 1000)/1000.0f);
+    step_firmware(rf, board, 6000);
+  }
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_RC_LOST);
+  EXPECT_EQ(rf.rc_.frame_count(), 10u);
+
+  // the frame period and latency are profiled
+  const Profiler::Stage& period = rf.profiler_.stage(Profiler::STAGE_RC_FRAME_PERIOD);
+  EXPECT_EQ(period.count, 9u);
+  EXPECT_EQ(period.max_us, 7000u);
+  EXPECT_LE(rf.profiler_.stage(Profiler::STAGE_RC_LATENCY).max_us, 1000u);
+
+  // a receiver that stops sending frames is lost
+  step_firmware(rf, board, 50000);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_RC_LOST);
+
+  // and so is one that reports failsafe
+  rc_frame_t frame = make_rc_frame(1000, board.clock_micros());
+  board.push_rc_frame(frame);
+  step_firmware(rf, board, 1000);
+  EXPECT_FALSE(rf.state_manager_.state().error_codes & StateManager::ERROR_RC_LOST);
+  frame.failsafe = true;
+  frame.time_us = board.clock_micros();
+  board.push_rc_frame(frame);
+  step_firmware(rf, board, 1000);
+  EXPECT_TRUE(rf.state_manager_.state().error_codes & StateManager::ERROR_RC_LOST);
+}
+
+TEST(rc_test, boards_without_frames_are_polled)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+  EXPECT_FALSE(rf.rc_.frame_mode());
+
+  uint16_t rc_values[8] = {1500, 1500, 1000, 1500, 1500, 1500, 1500, 1500};
+  board.set_rc(rc_values);
+  step_firmware(rf, board, 20000);
+  EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, 0.0f);
+
+  // a new value isn't seen until the next poll
+  rc_values[2] = 1500;
+  board.set_rc(rc_values);
+  step_firmware(rf, board, 1000);
+  EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, 0.0f);
+  step_firmware(rf, board, 20000);
+  EXPECT_CLOSE(rf.command_manager_.combined_control().F.value, 0.5f);
+}
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "replay.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace rosflight_firmware
+{
+
+Replay::Replay() :
+  board_(),
+  rf_(board_)
+{
+  rf_.init();
+}
+
+bool Replay::run(const std::vector<Record>& log)
+{
+  for (size_t i = 0; i < log.size(); i++)
+  {
+    const Record& record = log[i];
+    if (record.time_us < board_.clock_micros())
+      return false;
+
+    switch (record.type)
+    {
+    case Record::IMU:
+      board_.set_imu(&record.value[0], &record.value[3], record.time_us);
+      break;
+    case Record::BARO:
+      board_.set_time(record.time_us);
+      board_.set_baro(record.value[0], record.value[1]);
+      break;
+    case Record::MAG:
+      board_.set_time(record.time_us);
+      board_.set_mag(record.value);
+      break;
+    case Record::RC:
+    default:
+      board_.set_time(record.time_us);
+      board_.set_rc(record.rc);
+      break;
+    }
+
+    rf_.run();
+
+    if (record.type == Record::IMU)
+    {
+      Output output;
+      output.time_us = record.time_us;
+      output.armed = rf_.state_manager_.state().armed;
+      const turbomath::Quaternion& q = rf_.estimator_.state().attitude;
+      output.attitude[0] = q.w;
+      output.attitude[1] = q.x;
+      output.attitude[2] = q.y;
+      output.attitude[3] = q.z;
+      for (uint8_t j = 0; j < 8; j++)
+        output.outputs[j] = board_.pwm_values()[j];
+      outputs_.push_back(output);
+    }
+  }
+  return true;
+}
+
+bool Replay::load_log(const char *filename, std::vector<Record> *log)
+{
+  FILE *file = fopen(filename, "r");
+  if (file == NULL)
+    return false;
+
+  bool ok = true;
+  char line[256];
+  while (ok && fgets(line, sizeof(line), file) != NULL)
+  {
+    char type[8];
+    unsigned long long time_us;
+    int offset;
+    if (line[0] == '#' || sscanf(line, "%7s %llu%n", type, &time_us, &offset) < 2)
+      continue;
+
+    Record record = {};
+    record.time_us = time_us;
+    const char *args = line + offset;
+    if (strcmp(type, "imu") == 0)
+    {
+      record.type = Record::IMU;
+      ok = sscanf(args, "%f %f %f %f %f %f", &record.value[0], &record.value[1], &record.value[2],
+                  &record.value[3], &record.value[4], &record.value[5]) == 6;
+    }
+    else if (strcmp(type, "baro") == 0)
+    {
+      record.type = Record::BARO;
+      ok = sscanf(args, "%f %f", &record.value[0], &record.value[1]) == 2;
+    }
+    else if (strcmp(type, "mag") == 0)
+    {
+      record.type = Record::MAG;
+      ok = sscanf(args, "%f %f %f", &record.value[0], &record.value[1], &record.value[2]) == 3;
+    }
+    else if (strcmp(type, "rc") == 0)
+    {
+      record.type = Record::RC;
+      unsigned int rc[8];
+      ok = sscanf(args, "%u %u %u %u %u %u %u %u", &rc[0], &rc[1], &rc[2], &rc[3], &rc[4], &rc[5], &rc[6],
+                  &rc[7]) == 8;
+      for (uint8_t i = 0; i < 8; i++)
+        record.rc[i] = static_cast<uint16_t>(rc[i]);
+    }
+    else
+    {
+      ok = false;
+    }
+
+    if (ok)
+      log->push_back(record);
+  }
+  fclose(file);
+  return ok;
+}
+
+bool Replay::save_log(const char *filename, const std::vector<Record>& log)
+{
+  FILE *file = fopen(filename, "w");
+  if (file == NULL)
+    return false;
+
+  // %.9g round-trips a float exactly
+  for (size_t i = 0; i < log.size(); i++)
+  {
+    const Record& r = log[i];
+    unsigned long long time_us = r.time_us;
+    switch (r.type)
+    {
+    case Record::IMU:
+      fprintf(file, "imu %llu %.9g %.9g %.9g %.9g %.9g %.9g\n", time_us, r.value[0], r.value[1], r.value[2],
+              r.value[3], r.value[4], r.value[5]);
+      break;
+    case Record::BARO:
+      fprintf(file, "baro %llu %.9g %.9g\n", time_us, r.value[0], r.value[1]);
+      break;
+    case Record::MAG:
+      fprintf(file, "mag %llu %.9g %.9g %.9g\n", time_us, r.value[0], r.value[1], r.value[2]);
+      break;
+    case Record::RC:
+    default:
+      fprintf(file, "rc %llu %u %u %u %u %u %u %u %u\n", time_us, r.rc[0], r.rc[1], r.rc[2], r.rc[3], r.rc[4],
+              r.rc[5], r.rc[6], r.rc[7]);
+      break;
+    }
+  }
+  return fclose(file) == 0;
+}
+
+bool Replay::load_outputs(const char *filename, std::vector<Output> *outputs)
+{
+  FILE *file = fopen(filename, "r");
+  if (file == NULL)
+    return false;
+
+  bool ok = true;
+  char line[256];
+  while (ok && fgets(line, sizeof(line), file) != NULL)
+  {
+    if (line[0] == '#')
+      continue;
+    Output output;
+    unsigned long long time_us;
+    int armed;
+    int fields = sscanf(line, "%llu %d %f %f %f %f %f %f %f %f %f %f %f %f", &time_us, &armed,
+                        &output.attitude[0], &output.attitude[1], &output.attitude[2], &output.attitude[3],
+                        &output.outputs[0], &output.outputs[1], &output.outputs[2], &output.outputs[3],
+                        &output.outputs[4], &output.outputs[5], &output.outputs[6], &output.outputs[7]);
+    if (fields <= 0)
+      continue;
+    ok = fields == 14;
+    output.time_us = time_us;
+    output.armed = armed != 0;
+    if (ok)
+      outputs->push_back(output);
+  }
+  fclose(file);
+  return ok;
+}
+
+bool Replay::save_outputs(const char *filename, const std::vector<Output>& outputs)
+{
+  FILE *file = fopen(filename, "w");
+  if (file == NULL)
+    return false;
+
+  for (size_t i = 0; i < outputs.size(); i++)
+  {
+    const Output& o = outputs[i];
+    fprintf(file, "%llu %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+            static_cast<unsigned long long>(o.time_us), o.armed ? 1 : 0,
+            o.attitude[0], o.attitude[1], o.attitude[2], o.attitude[3], o.outputs[0], o.outputs[1],
+            o.outputs[2], o.outputs[3], o.outputs[4], o.outputs[5], o.outputs[6], o.outputs[7]);
+  }
+  return fclose(file) == 0;
+}
+
+Replay::Comparison Replay::compare(const std::vector<Output>& a, const std::vector<Output>& b,
+                                   float attitude_tolerance, float output_tolerance)
+{
+  Comparison result;
+  result.compared = (a.size() < b.size()) ? a.size() : b.size();
+  result.first_mismatch = result.compared;
+  result.max_attitude_error = 0.0f;
+  result.max_output_error = 0.0f;
+  result.lengths_match = a.size() == b.size();
+
+  for (size_t i = 0; i < result.compared; i++)
+  {
+    float attitude_error = 0.0f;
+    for (uint8_t j = 0; j < 4; j++)
+      attitude_error = std::fmax(attitude_error, std::fabs(a[i].attitude[j] - b[i].attitude[j]));
+    float output_error = 0.0f;
+    for (uint8_t j = 0; j < 8; j++)
+      output_error = std::fmax(output_error, std::fabs(a[i].outputs[j] - b[i].outputs[j]));
+
+    result.max_attitude_error = std::fmax(result.max_attitude_error, attitude_error);
+    result.max_output_error = std::fmax(result.max_output_error, output_error);
+
+    bool mismatch = a[i].time_us != b[i].time_us || a[i].armed != b[i].armed
+                    || attitude_error > attitude_tolerance || output_error > output_tolerance;
+    if (mismatch && result.first_mismatch == result.compared)
+      result.first_mismatch = i;
+  }
+  return result;
+}
+
+std::vector<Replay::Record> Replay::synthetic_flight(float duration_s, uint32_t imu_rate_hz)
+{
+  std::vector<Record> log;
+  const uint64_t end_us = static_cast<uint64_t>(duration_s*1e6f);
+  const uint64_t imu_period_us = 1000000/imu_rate_hz;
+  const uint64_t slow_period_us = 20000; // baro, mag and RC
+  const float two_pi = 6.2831853f;
+
+  // a small LCG, so the noise is the same on every platform
+  uint32_t seed = 12345;
+  auto noise = [&seed](float scale)
+  {
+    seed = seed*1664525u + 1013904223u;
+    return scale*(static_cast<float>(seed >> 8)/static_cast<float>(1 << 24) - 0.5f);
+  };
+
+  uint64_t next_slow_us = 1000;
+  for (uint64_t t_us = 1000; t_us <= end_us; t_us += imu_period_us)
+  {
+    float t = 1e-6f*static_cast<float>(t_us);
+
+    // the slow sensors and RC come in just ahead of the IMU sample they line up with
+    if (t_us >= next_slow_us)
+    {
+      next_slow_us += slow_period_us;
+
+      Record rc = {};
+      rc.type = Record::RC;
+      rc.time_us = t_us - 1;
+      for (uint8_t i = 0; i < 8; i++)
+        rc.rc[i] = 1500;
+      if (t < 0.5f)
+      {
+        rc.rc[2] = 1000;
+      }
+      else if (t < 2.0f)
+      {
+        rc.rc[2] = 1000; // throttle down and yaw right to arm
+        rc.rc[3] = 2000;
+      }
+      else
+      {
+        rc.rc[0] = static_cast<uint16_t>(1500.0f + 200.0f*std::sin(two_pi*t));
+        rc.rc[2] = 1500;
+      }
+      log.push_back(rc);
+
+      Record baro = {};
+      baro.type = Record::BARO;
+      baro.time_us = t_us - 1;
+      baro.value[0] = 101325.0f + noise(4.0f);
+      baro.value[1] = 25.0f;
+      log.push_back(baro);
+
+      Record mag = {};
+      mag.type = Record::MAG;
+      mag.time_us = t_us - 1;
+      mag.value[0] = 0.2f + noise(0.01f);
+      mag.value[1] = 0.05f + noise(0.01f);
+      mag.value[2] = 0.4f + noise(0.01f);
+      log.push_back(mag);
+    }
+
+    // a 0.1 rad roll wobble at 2 Hz
+    float roll = 0.1f*std::sin(2.0f*two_pi*t);
+    float roll_rate = 0.1f*2.0f*two_pi*std::cos(2.0f*two_pi*t);
+    Record imu = {};
+    imu.type = Record::IMU;
+    imu.time_us = t_us;
+    imu.value[0] = noise(0.2f);
+    imu.value[1] = 9.80665f*std::sin(roll) + noise(0.2f);
+    imu.value[2] = -9.80665f*std::cos(roll) + noise(0.2f);
+    imu.value[3] = roll_rate + noise(0.02f);
+    imu.value[4] = noise(0.02f);
+    imu.value[5] = noise(0.02f);
+    log.push_back(imu);
+  }
+  return log;
+}
+
+} // namespace rosflight_firmware
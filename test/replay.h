@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_REPLAY_H
+#define ROSFLIGHT_FIRMWARE_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "rosflight.h"
+#include "test_board.h"
+
+namespace rosflight_firmware
+{
+
+/**
+ * @brief Software-in-the-loop replay of sensor and RC logs through the full firmware
+ *
+ * Each record of a log is injected into a testBoard at its timestamp and followed by one pass of
+ * ROSflight::run(), so the firmware sees exactly the clock and the inputs it would have seen in flight, only
+ * without waiting for them. The attitude, armed state and outputs after every IMU sample are kept, so that two
+ * replays (or a replay and a stored reference) can be compared.
+ *
+ * Logs and outputs are plain text, one record per line ('#' starts a comment):
+ *   imu  <time_us> <ax> <ay> <az> <gx> <gy> <gz>
+ *   baro <time_us> <pressure> <temperature>
+ *   mag  <time_us> <mx> <my> <mz>
+ *   rc   <time_us> <ch0> ... <ch7>
+ * and
+ *   <time_us> <armed> <qw> <qx> <qy> <qz> <out0> ... <out7>
+ */
+class Replay
+{
+public:
+  struct Record
+  {
+    enum Type : uint8_t
+    {
+      IMU,
+      BARO,
+      MAG,
+      RC
+    } type;
+    uint64_t time_us;
+    float value[6];  // accel and gyro, pressure and temperature, or the mag field
+    uint16_t rc[8];  // us
+  };
+
+  struct Output
+  {
+    uint64_t time_us;
+    bool armed;
+    float attitude[4]; // w, x, y, z
+    float outputs[8];  // as written to the PWM outputs
+  };
+
+  struct Comparison
+  {
+    size_t compared;
+    size_t first_mismatch; // index of the first output out of tolerance, or compared if there is none
+    float max_attitude_error;
+    float max_output_error;
+    bool lengths_match;
+
+    inline bool matches() const { return lengths_match && first_mismatch == compared; }
+  };
+
+  Replay();
+
+  inline ROSflight& firmware() { return rf_; }
+  inline testBoard& board() { return board_; }
+
+  /**
+   * @brief Replay a log, appending to outputs()
+   * @return False (and stops) at the first record that goes back in time
+   */
+  bool run(const std::vector<Record>& log);
+  inline const std::vector<Output>& outputs() const { return outputs_; }
+
+  static bool load_log(const char *filename, std::vector<Record> *log);
+  static bool save_log(const char *filename, const std::vector<Record>& log);
+  static bool load_outputs(const char *filename, std::vector<Output> *outputs);
+  static bool save_outputs(const char *filename, const std::vector<Output>& outputs);
+
+  static Comparison compare(const std::vector<Output>& a, const std::vector<Output>& b,
+                            float attitude_tolerance, float output_tolerance);
+
+  /**
+   * @brief A repeatable flight: IMU at imu_rate_hz with a wobble and noise, baro and mag at 50 Hz, and RC
+   * at 50 Hz that waits half a second, arms with the sticks, then flies at half throttle with the roll stick swinging at 1 Hz
+   */
+  static std::vector<Record> synthetic_flight(float duration_s, uint32_t imu_rate_hz);
+
+private:
+  testBoard board_;
+  ROSflight rf_;
+  std::vector<Output> outputs_;
+};
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_REPLAY_H
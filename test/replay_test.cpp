@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "replay.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+// A quadcopter that arms from the sticks, as in the synthetic flight
+void setup_quad(Replay& replay)
+{
+  ROSflight& rf = replay.firmware();
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+}
+
+} // namespace
+
+TEST(replay_test, replays_are_deterministic)
+{
+  std::vector<Replay::Record> log = Replay::synthetic_flight(5.0f, 1000);
+
+  Replay first;
+  setup_quad(first);
+  ASSERT_TRUE(first.run(log));
+  Replay second;
+  setup_quad(second);
+  ASSERT_TRUE(second.run(log));
+
+  ASSERT_EQ(first.outputs().size(), 5000u);
+  Replay::Comparison comparison = Replay::compare(first.outputs(), second.outputs(), 0.0f, 0.0f);
+  EXPECT_TRUE(comparison.matches());
+  EXPECT_EQ(comparison.max_attitude_error, 0.0f);
+  EXPECT_EQ(comparison.max_output_error, 0.0f);
+
+  // the flight did something: it armed, spun the motors up and tracked the wobble
+  const Replay::Output& last = first.outputs().back();
+  EXPECT_FALSE(first.outputs().front().armed);
+  EXPECT_TRUE(last.armed);
+  EXPECT_GT(last.outputs[0], 1300.0f);
+  float max_roll_q = 0.0f;
+  for (size_t i = 0; i < first.outputs().size(); i++)
+    max_roll_q = std::fmax(max_roll_q, first.outputs()[i].attitude[1]);
+  EXPECT_GT(max_roll_q, 0.02f);
+}
+
+TEST(replay_test, logs_and_outputs_round_trip_through_files)
+{
+  std::vector<Replay::Record> log = Replay::synthetic_flight(1.0f, 500);
+  const char *log_file = "replay_test_log.txt";
+  const char *output_file = "replay_test_outputs.txt";
+
+  ASSERT_TRUE(Replay::save_log(log_file, log));
+  std::vector<Replay::Record> loaded;
+  ASSERT_TRUE(Replay::load_log(log_file, &loaded));
+  ASSERT_EQ(loaded.size(), log.size());
+
+  Replay original;
+  ASSERT_TRUE(original.run(log));
+  Replay reloaded;
+  ASSERT_TRUE(reloaded.run(loaded));
+  EXPECT_TRUE(Replay::compare(original.outputs(), reloaded.outputs(), 0.0f, 0.0f).matches());
+
+  ASSERT_TRUE(Replay::save_outputs(output_file, original.outputs()));
+  std::vector<Replay::Output> reference;
+  ASSERT_TRUE(Replay::load_outputs(output_file, &reference));
+  EXPECT_TRUE(Replay::compare(original.outputs(), reference, 0.0f, 0.0f).matches());
+
+  remove(log_file);
+  remove(output_file);
+}
+
+TEST(replay_test, comparison_finds_where_a_change_diverges)
+{
+  std::vector<Replay::Record> log = Replay::synthetic_flight(4.0f, 1000);
+
+  Replay baseline;
+  setup_quad(baseline);
+  ASSERT_TRUE(baseline.run(log));
+
+  Replay changed;
+  setup_quad(changed);
+  changed.firmware().params_.set_param_float(PARAM_PID_ROLL_ANGLE_P, 0.3f);
+  ASSERT_TRUE(changed.run(log));
+
+  // nothing changes until the motors spin up after arming
+  Replay::Comparison comparison = Replay::compare(baseline.outputs(), changed.outputs(), 1e-6f, 1e-3f);
+  EXPECT_FALSE(comparison.matches());
+  EXPECT_TRUE(comparison.lengths_match);
+  EXPECT_GT(baseline.outputs()[comparison.first_mismatch].time_us, 1000000u);
+  EXPECT_GT(comparison.max_output_error, 1.0f);
+
+  // a log that goes back in time is refused
+  std::swap(log[10], log[20]);
+  Replay backwards;
+  EXPECT_FALSE(backwards.run(log));
+}
+
+// Replays a recorded log given by ROSFLIGHT_REPLAY_LOG, and checks it against ROSFLIGHT_REPLAY_REFERENCE
+// (writing the reference instead if that file doesn't exist yet). Does nothing without a log.
+TEST(replay_test, recorded_log_matches_reference)
+{
+  const char *log_file = getenv("ROSFLIGHT_REPLAY_LOG");
+  const char *reference_file = getenv("ROSFLIGHT_REPLAY_REFERENCE");
+  if (log_file == NULL)
+  {
+    printf("ROSFLIGHT_REPLAY_LOG not set, skipping\n");
+    return;
+  }
+
+  std::vector<Replay::Record> log;
+  ASSERT_TRUE(Replay::load_log(log_file, &log));
+  Replay replay;
+  setup_quad(replay);
+  ASSERT_TRUE(replay.run(log));
+  printf("replayed %zu records, %zu control updates\n", log.size(), replay.outputs().size());
+  if (reference_file == NULL)
+    return;
+
+  std::vector<Replay::Output> reference;
+  if (!Replay::load_outputs(reference_file, &reference))
+  {
+    ASSERT_TRUE(Replay::save_outputs(reference_file, replay.outputs()));
+    printf("wrote reference %s\n", reference_file);
+    return;
+  }
+  Replay::Comparison comparison = Replay::compare(replay.outputs(), reference, 1e-4f, 1.0f);
+  EXPECT_TRUE(comparison.matches()) << "diverged at output " << comparison.first_mismatch
+                                    << ", max attitude error " << comparison.max_attitude_error
+                                    << ", max output error " << comparison.max_output_error;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "ring_buffer.h"
+
+using namespace rosflight_firmware;
+
+TEST(ring_buffer_test, fifo_order_and_overflow)
+{
+  RingBuffer<int, 4> ring;
+  EXPECT_TRUE(ring.empty());
+  EXPECT_EQ(ring.space(), 4);
+
+  int out;
+  EXPECT_FALSE(ring.pop(&out));
+
+  for (int i = 0; i < 4; i++)
+  {
+    EXPECT_TRUE(ring.push(i));
+  }
+  EXPECT_TRUE(ring.full());
+
+  // the newest item is dropped when full
+  EXPECT_FALSE(ring.push(4));
+  EXPECT_EQ(ring.overflows(), 1u);
+
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_TRUE(ring.pop(&out));
+    EXPECT_EQ(out, i);
+  }
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(ring_buffer_test, index_wraparound)
+{
+  // run the free-running indices past 2^16 to make sure the wrap is handled
+  RingBuffer<uint32_t, 8> ring;
+  uint32_t expected = 0;
+  for (uint32_t i = 0; i < 70000; i++)
+  {
+    ASSERT_TRUE(ring.push(i));
+    if (ring.size() > 5)
+    {
+      uint32_t out;
+      ASSERT_TRUE(ring.pop(&out));
+      ASSERT_EQ(out, expected++);
+    }
+  }
+  EXPECT_EQ(ring.size(), 5);
+  EXPECT_EQ(ring.overflows(), 0u);
+}
+
+TEST(ring_buffer_test, in_place_access)
+{
+  RingBuffer<uint8_t, 8> ring;
+  uint8_t data[6] = {0, 1, 2, 3, 4, 5};
+  ASSERT_TRUE(ring.push(data, 6));
+  ring.consume(4);
+
+  // 2 bytes used at the end, so only 2 bytes can be written before the wrap
+  EXPECT_EQ(ring.space(), 6);
+  EXPECT_EQ(ring.contiguous_space(), 2);
+  ring.head_ptr()[0] = 6;
+  ring.head_ptr()[1] = 7;
+  ring.commit(2);
+  EXPECT_EQ(ring.contiguous_space(), 4);
+
+  // a multi-item push wraps around the end
+  EXPECT_FALSE(ring.push(data, 5));
+  ASSERT_TRUE(ring.push(data, 4));
+  EXPECT_TRUE(ring.full());
+
+  EXPECT_EQ(ring.contiguous_size(), 4);
+  EXPECT_EQ(ring.tail_ptr()[0], 4);
+  EXPECT_EQ(ring.tail_ptr()[3], 7);
+  ring.consume(4);
+  EXPECT_EQ(ring.contiguous_size(), 4);
+  EXPECT_EQ(ring.tail_ptr()[0], 0);
+  EXPECT_EQ(ring.tail_ptr()[3], 3);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "common.h"
+
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+TEST(scheduler_test, defers_tasks_near_imu_deadline)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // Run the firmware at a 1 kHz IMU rate so the scheduler learns the IMU period
+  float acc[3] = {0, 0, -9.80665};
+  float gyro[3] = {0, 0, 0};
+  uint64_t t = 0;
+  for (int i = 0; i < 100; i++)
+  {
+    t += 1000;
+    board.set_imu(acc, gyro, t);
+    rf.run();
+  }
+  EXPECT_EQ(rf.scheduler_.imu_period_us(), 1000u);
+
+  // Right after an IMU sample everything that is due gets to run
+  const Scheduler::task_t& stream = rf.scheduler_.task(Scheduler::TASK_MAVLINK_STREAM);
+  EXPECT_EQ(stream.next_time_us, t);
+  EXPECT_EQ(stream.deferrals, 0u);
+
+  // Just before the next sample, even the cheapest housekeeping has to wait
+  board.set_time(t + 990);
+  rf.scheduler_.run();
+  EXPECT_EQ(stream.next_time_us, t);
+  EXPECT_EQ(stream.deferrals, 1u);
+  EXPECT_EQ(rf.scheduler_.task(Scheduler::TASK_COMMAND_MANAGER).deferrals, 1u);
+
+  // If the IMU stops, housekeeping carries on
+  board.set_time(t + 5000);
+  rf.scheduler_.run();
+  EXPECT_EQ(stream.next_time_us, t + 5000);
+  EXPECT_EQ(stream.deferrals, 1u);
+
+  // Nothing here takes any (simulated) time, so there shouldn't be any overruns
+  EXPECT_EQ(rf.scheduler_.overrun_count(), 0u);
+}
+
+TEST(scheduler_test, periodic_task_timing)
+{
+  testBoard board;
+  ROSflight rf(board);
+  rf.init();
+
+  // The param store runs every 5 ms, phase-locked to when the scheduler started
+  const Scheduler::task_t& store = rf.scheduler_.task(Scheduler::TASK_PARAM_STORE);
+  board.set_time(1000);
+  rf.scheduler_.run();
+  EXPECT_EQ(store.next_time_us, 5000u);
+
+  board.set_time(4999);
+  rf.scheduler_.run();
+  EXPECT_EQ(store.next_time_us, 5000u);
+
+  board.set_time(5500);
+  rf.scheduler_.run();
+  EXPECT_EQ(store.next_time_us, 10000u);
+
+  // Falling far behind skips ahead instead of running back-to-back
+  board.set_time(100000);
+  rf.scheduler_.run();
+  EXPECT_EQ(store.next_time_us, 105000u);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include <cmath>
+
+#include "rosflight.h"
+#include "test_board.h"
+
+using namespace rosflight_firmware;
+
+class SensorsTest : public ::testing::Test
+{
+public:
+  testBoard board;
+  ROSflight rf;
+
+  SensorsTest() : rf(board) {}
+
+  void SetUp() override
+  {
+    board.set_time(0);
+    rf.init();
+  }
+
+  // passes without a new IMU sample, which is when the low-priority sensors are serviced
+  void run_for(uint32_t us)
+  {
+    uint64_t end_us = board.clock_micros() + us;
+    while (board.clock_micros() < end_us)
+    {
+      board.set_time(board.clock_micros() + 1000);
+      rf.sensors_.run();
+    }
+  }
+};
+
+TEST_F(SensorsTest, sensors_are_found_and_read_through_the_queue)
+{
+  // at the ground level, so that the outlier filter takes it
+  float alt = rf.params_.get_param_float(PARAM_GROUND_LEVEL);
+  board.set_baro(101325.0f*static_cast<float>(pow(1.0 - 2.25694e-5*alt, 5.2553)), 25.0f);
+  board.set_sensor_bus_stalled(true);
+
+  // the probe of the missing baro is queued once a second, and nothing waits on it
+  run_for(1100000);
+  EXPECT_EQ(board.sensor_requests(SENSOR_BARO), 1u);
+  EXPECT_FALSE(rf.sensors_.data().baro_present);
+
+  // found once the bus gets to it, and from then on read in turn
+  board.set_sensor_bus_stalled(false);
+  run_for(2000);
+  EXPECT_TRUE(rf.sensors_.data().baro_present);
+  EXPECT_FALSE(rf.sensors_.data().mag_present);
+  uint32_t requests = board.sensor_requests(SENSOR_BARO);
+  run_for(100000);
+  EXPECT_GT(board.sensor_requests(SENSOR_BARO), requests + 10);
+  EXPECT_TRUE(rf.sensors_.data().baro_valid);
+  EXPECT_FLOAT_EQ(rf.sensors_.data().baro_temperature, 25.0f);
+}
+
+TEST_F(SensorsTest, a_slow_bus_holds_back_only_that_sensor)
+{
+  float mag[3] = {0.2f, 0.0f, 0.4f};
+  board.set_mag(mag);
+  run_for(1100000);
+  run_for(100000);
+  ASSERT_TRUE(rf.sensors_.data().mag_present);
+
+  // while a read is outstanding no more are queued, and the old measurement stands
+  board.set_sensor_bus_stalled(true);
+  run_for(2000);
+  uint32_t requests = board.sensor_requests(SENSOR_MAG);
+  float stale = rf.sensors_.data().mag.z;
+  mag[2] = 0.5f;
+  board.set_mag(mag);
+  run_for(100000);
+  EXPECT_EQ(board.sensor_requests(SENSOR_MAG), requests);
+  EXPECT_EQ(rf.sensors_.data().mag.z, stale);
+
+  board.set_sensor_bus_stalled(false);
+  run_for(10000);
+  EXPECT_GT(board.sensor_requests(SENSOR_MAG), requests);
+  EXPECT_NE(rf.sensors_.data().mag.z, stale);
+}
+
+TEST_F(SensorsTest, online_calibration_learns_the_gyro_bias_while_disarmed)
+{
+  rf.params_.set_param_float(PARAM_GYRO_X_BIAS, 0.01f);
+  rf.params_.set_param_int(PARAM_IMU_ONLINE_CAL, true);
+
+  float acc[3] = {0.0f, 0.0f, -9.80665f};
+  float gyro[3] = {0.03f, -0.02f, 0.01f};
+  uint64_t time_us = 1000;
+  auto feed = [&](uint32_t samples)
+  {
+    for (uint32_t i = 0; i < samples; i++)
+    {
+      board.set_imu(acc, gyro, time_us);
+      time_us += 1000;
+      rf.sensors_.update_imu();
+    }
+  };
+
+  // the params apply until a still window was learned
+  feed(ImuCalibrator::WINDOW_SIZE);
+  EXPECT_FALSE(rf.sensors_.imu_calibrator().has_model());
+  EXPECT_NEAR(rf.sensors_.data().gyro.x, 0.02f, 1e-6f);
+
+  feed(ImuCalibrator::WINDOW_SIZE);
+  EXPECT_TRUE(rf.sensors_.imu_calibrator().has_model());
+  EXPECT_NEAR(rf.sensors_.data().gyro.x, 0.0f, 1e-6f);
+  EXPECT_NEAR(rf.sensors_.data().gyro.y, 0.0f, 1e-6f);
+  EXPECT_NEAR(rf.sensors_.data().gyro.z, 0.0f, 1e-6f);
+
+  // nothing is learned while armed
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+  uint32_t accepted = rf.sensors_.imu_calibrator().windows_accepted();
+  feed(2*ImuCalibrator::WINDOW_SIZE);
+  EXPECT_EQ(rf.sensors_.imu_calibrator().windows_accepted(), accepted);
+
+  // and turning it off goes back to the params
+  rf.params_.set_param_int(PARAM_IMU_ONLINE_CAL, false);
+  feed(1);
+  EXPECT_NEAR(rf.sensors_.data().gyro.x, 0.02f, 1e-6f);
+}
@@ -31,13 +31,22 @@
 
 #include "test_board.h"
 
+#include <chrono>
+#include <cstring>
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 
 namespace rosflight_firmware
 {
 
-  void testBoard::set_rc(uint16_t *values)
+  testBoard::testBoard()
+  {
+    // the log flash starts out blank, so there is no log until something has been written to it
+    memset(log_, 0xFF, sizeof(log_));
+  }
+
+  void testBoard::set_rc(const uint16_t *values)
   {
     for (int i = 0; i < 8; i++)
     {
@@ -50,20 +59,47 @@ namespace rosflight_firmware
     time_us_ = time_us;
   }
 
+  void testBoard::set_serial_tx_free(uint16_t bytes)
+  {
+    serial_tx_free_ = bytes;
+  }
+
   void testBoard::set_pwm_lost(bool lost)
   {
     rc_lost_ = lost;
   }
 
-  void testBoard::set_imu(float *acc, float *gyro, uint64_t time_us)
+  void testBoard::set_memory_word(uint8_t sector, uint32_t offset, uint32_t word)
+  {
+    memory_[sector][offset/4] = word;
+  }
+
+  void testBoard::set_imu(const float *acc, const float *gyro, uint64_t time_us)
   {
     time_us_ = time_us;
+    imu_sample_t sample;
     for (int i = 0; i < 3; i++)
     {
-      acc_[i] = acc[i];
-      gyro_[i] = gyro[i];
+      sample.accel[i] = acc[i];
+      sample.gyro[i] = gyro[i];
     }
-    new_imu_ = true;
+    sample.temperature = 25.0;
+    sample.time_us = time_us;
+    imu_fifo_.push(sample);
+  }
+
+  void testBoard::set_baro(float pressure, float temperature)
+  {
+    baro_present_ = true;
+    baro_pressure_ = pressure;
+    baro_temperature_ = temperature;
+  }
+
+  void testBoard::set_mag(const float mag[3])
+  {
+    mag_present_ = true;
+    for (int i = 0; i < 3; i++)
+      mag_[i] = mag[i];
   }
 
 
@@ -75,53 +111,92 @@ namespace rosflight_firmware
   uint32_t testBoard::clock_millis(){ return time_us_/1000; }
   uint64_t testBoard::clock_micros(){ return time_us_; }
   void testBoard::clock_delay(uint32_t milliseconds){}
+  uint32_t testBoard::clock_cycles()
+  {
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+  uint32_t testBoard::clock_cycles_per_us(){ return 1000; }
 
 // serial
   void testBoard::serial_init(uint32_t baud_rate){}
-  void testBoard::serial_write(const uint8_t *src, size_t len){}
-  uint16_t testBoard::serial_bytes_available(void){ return 0; }
-  uint8_t testBoard::serial_read(void){return 0;}
+  void testBoard::serial_write(const uint8_t *src, size_t len)
+  {
+    serial_bytes_written_ += len;
+    if (serial_tx_capture_)
+      serial_tx_data_.insert(serial_tx_data_.end(), src, src + len);
+  }
+  uint16_t testBoard::serial_tx_bytes_free(void){ return serial_tx_free_; }
+  uint16_t testBoard::serial_bytes_available(void){ return serial_rx_.size(); }
+  size_t testBoard::serial_read(uint8_t *dst, size_t max)
+  {
+    serial_read_calls_++;
+    size_t len = 0;
+    while (len < max && serial_rx_.pop(&dst[len]))
+      len++;
+    return len;
+  }
+  uint32_t testBoard::serial_rx_overflows(void){ return serial_rx_.overflows(); }
 
 // sensors
   void testBoard::sensors_init(){}
   uint16_t testBoard::num_sensor_errors(void) {return 0;}
 
-  bool testBoard::new_imu_data()
+  uint16_t testBoard::imu_samples_available()
   {
-    if (new_imu_)
-    {
-      new_imu_ = false;
-      return true;
-    }
-    return false;
+    return imu_fifo_.size();
   }
 
-
-  bool testBoard::imu_read(float accel[3], float *temperature, float gyro[3], uint64_t* time)
+  bool testBoard::imu_read(imu_sample_t *sample)
   {
-    for (int i = 0; i < 3; i++)
-    {
-      accel[i] = acc_[i];
-      gyro[i] = gyro_[i];
-    }
-    *temperature = 25.0;
-    *time = time_us_;
-    return true;
+    return imu_fifo_.pop(sample);
   }
 
   void testBoard::imu_not_responding_error(void){}
 
-  bool testBoard::mag_check(void){ return false; }
-  void testBoard::mag_read(float mag[3]){}
+  void testBoard::sensor_set_callback(sensor_callback_t callback, void *context)
+  {
+    sensor_callback_ = callback;
+    sensor_context_ = context;
+  }
 
-  bool testBoard::baro_check(void){ return false; }
-  void testBoard::baro_read(float *pressure, float *temperature) {}
+  bool testBoard::sensor_request(sensor_id_t sensor)
+  {
+    if (sensor_pending_[sensor])
+      return false;
+    sensor_pending_[sensor] = true;
+    sensor_requests_[sensor]++;
+    return true;
+  }
 
-  bool testBoard::diff_pressure_check(void){ return false; }
-  void testBoard::diff_pressure_read(float *diff_pressure, float *temperature) {}
+  void testBoard::sensor_poll(void)
+  {
+    if (sensor_bus_stalled_ || !sensor_callback_)
+      return;
+
+    for (int i = 0; i < SENSOR_COUNT; i++)
+    {
+      if (!sensor_pending_[i])
+        continue;
+      sensor_pending_[i] = false;
 
-  bool testBoard::sonar_check(void){ return false; }
-  float testBoard::sonar_read(void){return 0;}
+      sensor_result_t result = {};
+      result.sensor = static_cast<sensor_id_t>(i);
+      if (result.sensor == SENSOR_BARO)
+      {
+        result.present = baro_present_;
+        result.value[0] = baro_pressure_;
+        result.temperature = baro_temperature_;
+      }
+      else if (result.sensor == SENSOR_MAG)
+      {
+        result.present = mag_present_;
+        for (int j = 0; j < 3; j++)
+          result.value[j] = mag_[j];
+      }
+      sensor_callback_(sensor_context_, result);
+    }
+  }
 
 // PWM
 // TODO make these deal in normalized (-1 to 1 or 0 to 1) values (not pwm-specific)
@@ -129,11 +204,95 @@ namespace rosflight_firmware
   bool testBoard::pwm_lost(){ return rc_lost_; }
   uint16_t testBoard::pwm_read(uint8_t channel){ return rc_values[channel];}
   void testBoard::pwm_write(uint8_t channel, uint16_t value){}
+  void testBoard::pwm_write_multi(const float *value, uint8_t num_channels)
+  {
+    for (uint8_t i = 0; i < num_channels && i < 8; i++)
+      if (value[i] >= 0.0f)
+        pwm_values_[i] = value[i];
+    pwm_write_count_++;
+  }
+
+// RC
+  bool testBoard::rc_init(rc_protocol_t protocol)
+  {
+    if (!rc_frames_supported_)
+      return false;
+    rc_protocol_ = protocol;
+    return true;
+  }
+  bool testBoard::rc_read(rc_frame_t *frame){ return rc_fifo_.pop(frame); }
+
+// motors
+  bool testBoard::motor_init(motor_protocol_t protocol, uint32_t refresh_rate, uint8_t motor_mask, uint8_t servo_mask)
+  {
+    if (!motor_protocols_supported_)
+      return false;
+    motor_protocol_ = protocol;
+    motor_mask_ = motor_mask;
+    return true;
+  }
+  void testBoard::motor_write(const float *values, uint8_t num_outputs)
+  {
+    for (uint8_t i = 0; i < num_outputs && i < 8; i++)
+      if (motor_mask_ & (1 << i))
+        motor_values_[i] = values[i];
+    motor_write_count_++;
+  }
 
 // non-volatile memory
   void testBoard::memory_init(void){}
-  bool testBoard::memory_read(void *dest, size_t len){ return false; }
-  bool testBoard::memory_write(const void *src, size_t len){ return false; }
+  uint32_t testBoard::memory_sector_size(void){ return MEMORY_SECTOR_SIZE; }
+  bool testBoard::memory_erase_sector(uint8_t sector)
+  {
+    if (sector >= 2)
+      return false;
+    for (uint32_t i = 0; i < MEMORY_SECTOR_SIZE/4; i++)
+      memory_[sector][i] = 0xFFFFFFFF;
+    memory_erase_count_++;
+    return true;
+  }
+  uint32_t testBoard::memory_read_word(uint8_t sector, uint32_t offset)
+  {
+    return (sector < 2 && offset < MEMORY_SECTOR_SIZE) ? memory_[sector][offset/4] : 0xFFFFFFFF;
+  }
+  bool testBoard::memory_write_word(uint8_t sector, uint32_t offset, uint32_t word)
+  {
+    if (sector >= 2 || offset >= MEMORY_SECTOR_SIZE)
+      return false;
+    // programming can only clear bits, like flash
+    memory_[sector][offset/4] &= word;
+    return memory_[sector][offset/4] == word;
+  }
+
+// log storage
+  uint32_t testBoard::log_size(void){ return LOG_SIZE; }
+  uint32_t testBoard::log_page_size(void){ return LOG_PAGE_SIZE; }
+  uint32_t testBoard::log_erase_size(void){ return LOG_ERASE_SIZE; }
+  bool testBoard::log_busy(void){ return log_busy_; }
+  bool testBoard::log_erase(uint32_t address)
+  {
+    if (log_busy_ || address % LOG_ERASE_SIZE != 0 || address >= LOG_SIZE)
+      return false;
+    memset(log_ + address, 0xFF, LOG_ERASE_SIZE);
+    return true;
+  }
+  bool testBoard::log_write(uint32_t address, const uint8_t *data, size_t len)
+  {
+    if (log_busy_ || address/LOG_PAGE_SIZE != (address + len - 1)/LOG_PAGE_SIZE || address + len > LOG_SIZE)
+      return false;
+    // programming can only clear bits, like flash
+    for (size_t i = 0; i < len; i++)
+      log_[address + i] &= data[i];
+    log_write_count_++;
+    return true;
+  }
+  bool testBoard::log_read(uint32_t address, uint8_t *data, size_t len)
+  {
+    if (log_busy_ || address + len > LOG_SIZE)
+      return false;
+    memcpy(data, log_ + address, len);
+    return true;
+  }
 
 // LEDs
   void testBoard::led0_on(void){}
@@ -32,7 +32,10 @@
 #ifndef ROSFLIGHT_FIRMWARE_TEST_BOARD_H
 #define ROSFLIGHT_FIRMWARE_TEST_BOARD_H
 
-#include "board.h" 
+#include <vector>
+
+#include "board.h"
+#include "ring_buffer.h"
 
 namespace rosflight_firmware
 {
@@ -44,11 +47,46 @@ private:
   uint16_t rc_values[8] = {0, 0, 0, 0, 0, 0, 0, 0};
   uint64_t time_us_ = 0;
   bool rc_lost_ = false;
-  float acc_[3] = {0, 0, 0};
-  float gyro_[3] = {0, 0, 0};
-  bool new_imu_ = false;
+  RingBuffer<imu_sample_t, 16> imu_fifo_;
+  uint16_t serial_tx_free_ = 4096;
+  size_t serial_bytes_written_ = 0;
+  RingBuffer<uint8_t, 1024> serial_rx_;
+  uint32_t serial_read_calls_ = 0;
+  bool serial_tx_capture_ = false;
+  std::vector<uint8_t> serial_tx_data_;
+  static constexpr uint32_t MEMORY_SECTOR_SIZE = 2048;
+  uint32_t memory_[2][MEMORY_SECTOR_SIZE/4] = {}; // blank flash is all ones, but this starts out as garbage
+  uint32_t memory_erase_count_ = 0;
+  static constexpr uint32_t LOG_SIZE = 64*1024;
+  static constexpr uint32_t LOG_PAGE_SIZE = 256;
+  static constexpr uint32_t LOG_ERASE_SIZE = 4096;
+  uint8_t log_[LOG_SIZE];
+  bool log_busy_ = false;
+  uint32_t log_write_count_ = 0;
+  bool motor_protocols_supported_ = true;
+  motor_protocol_t motor_protocol_ = MOTOR_PROTOCOL_PWM;
+  uint8_t motor_mask_ = 0;
+  float motor_values_[8] = {};
+  uint32_t motor_write_count_ = 0;
+  float pwm_values_[8] = {};
+  uint32_t pwm_write_count_ = 0;
+  bool rc_frames_supported_ = false;
+  rc_protocol_t rc_protocol_ = RC_PROTOCOL_PWM;
+  RingBuffer<rc_frame_t, 8> rc_fifo_;
+  bool baro_present_ = false;
+  float baro_pressure_ = 0.0f;
+  float baro_temperature_ = 0.0f;
+  bool mag_present_ = false;
+  float mag_[3] = {};
+  sensor_callback_t sensor_callback_ = nullptr;
+  void *sensor_context_ = nullptr;
+  bool sensor_pending_[SENSOR_COUNT] = {};
+  uint32_t sensor_requests_[SENSOR_COUNT] = {};
+  bool sensor_bus_stalled_ = false;
 
 public:
+  testBoard();
+
 // setup
   void init_board(void);
   void board_reset(bool bootloader);
@@ -57,32 +95,28 @@ public:
   uint32_t clock_millis();
   uint64_t clock_micros();
   void clock_delay(uint32_t milliseconds);
+  uint32_t clock_cycles(); // real time (ns) rather than the simulated clock, so that code can be timed
+  uint32_t clock_cycles_per_us();
 
 // serial
   void serial_init(uint32_t baud_rate);
   void serial_write(const uint8_t *src, size_t len);
+  uint16_t serial_tx_bytes_free(void);
   uint16_t serial_bytes_available(void);
-  uint8_t serial_read(void);
+  size_t serial_read(uint8_t *dst, size_t max);
+  uint32_t serial_rx_overflows(void);
 
 // sensors
   void sensors_init();
   uint16_t num_sensor_errors(void) ;
 
-  bool new_imu_data();
-  bool imu_read(float accel[3], float *temperature, float gyro[3], uint64_t* time);
+  uint16_t imu_samples_available();
+  bool imu_read(imu_sample_t *sample);
   void imu_not_responding_error(void);
 
-  bool mag_check(void);
-  void mag_read(float mag[3]);
-
-  bool baro_check(void);
-  void baro_read(float *pressure, float *temperature);
-
-  bool diff_pressure_check(void);
-  void diff_pressure_read(float *diff_pressure, float *temperature);
-
-  bool sonar_check(void);
-  float sonar_read(void);
+  void sensor_set_callback(sensor_callback_t callback, void *context);
+  bool sensor_request(sensor_id_t sensor);
+  void sensor_poll(void);
 
 // PWM
 // TODO make these deal in normalized (-1 to 1 or 0 to 1) values (not pwm-specific)
@@ -90,11 +124,31 @@ public:
   bool pwm_lost();
   uint16_t pwm_read(uint8_t channel);
   void pwm_write(uint8_t channel, uint16_t value);
+  void pwm_write_multi(const float *value, uint8_t num_channels);
+
+// RC
+  bool rc_init(rc_protocol_t protocol);
+  bool rc_read(rc_frame_t *frame);
+
+// motors
+  bool motor_init(motor_protocol_t protocol, uint32_t refresh_rate, uint8_t motor_mask, uint8_t servo_mask);
+  void motor_write(const float *values, uint8_t num_outputs);
 
 // non-volatile memory
   void memory_init(void);
-  bool memory_read(void *dest, size_t len);
-  bool memory_write(const void *src, size_t len);
+  uint32_t memory_sector_size(void);
+  bool memory_erase_sector(uint8_t sector);
+  uint32_t memory_read_word(uint8_t sector, uint32_t offset);
+  bool memory_write_word(uint8_t sector, uint32_t offset, uint32_t word);
+
+// log storage
+  uint32_t log_size(void);
+  uint32_t log_page_size(void);
+  uint32_t log_erase_size(void);
+  bool log_busy(void);
+  bool log_erase(uint32_t address);
+  bool log_write(uint32_t address, const uint8_t *data, size_t len);
+  bool log_read(uint32_t address, uint8_t *data, size_t len);
 
 // LEDs
   void led0_on(void);
@@ -107,10 +161,35 @@ public:
 
 
 
-  void set_imu(float* acc, float* gyro, uint64_t time_us);
-  void set_rc(uint16_t* values);
+  void set_imu(const float* acc, const float* gyro, uint64_t time_us);
+  void set_baro(float pressure, float temperature); // the baro and mag show up once they have a value
+  void set_mag(const float mag[3]);
+  void set_sensor_bus_stalled(bool stalled) { sensor_bus_stalled_ = stalled; } // requests otherwise finish by the next poll
+  uint32_t sensor_requests(sensor_id_t sensor) const { return sensor_requests_[sensor]; }
+  void set_serial_tx_free(uint16_t bytes);
+  size_t serial_bytes_written() const { return serial_bytes_written_; }
+  bool push_serial_rx(const uint8_t *data, uint16_t len) { return serial_rx_.push(data, len); } // false if full
+  uint32_t serial_read_calls() const { return serial_read_calls_; }
+  void set_serial_tx_capture(bool capture) { serial_tx_capture_ = capture; serial_tx_data_.clear(); }
+  const std::vector<uint8_t>& serial_tx_data() const { return serial_tx_data_; } // written since capture was set
+  void set_rc(const uint16_t* values);
   void set_time(uint64_t time_us);
   void set_pwm_lost(bool lost);
+  void set_rc_frames_supported(bool supported) { rc_frames_supported_ = supported; }
+  rc_protocol_t rc_protocol() const { return rc_protocol_; }
+  void push_rc_frame(const rc_frame_t& frame) { rc_fifo_.push(frame); }
+  void set_memory_word(uint8_t sector, uint32_t offset, uint32_t word);
+  uint32_t memory_erase_count() const { return memory_erase_count_; }
+  void set_log_busy(bool busy) { log_busy_ = busy; } // the log flash finishes each operation at once otherwise
+  uint32_t log_write_count() const { return log_write_count_; }
+  const uint8_t *log_data() const { return log_; }
+  void set_motor_protocols_supported(bool supported) { motor_protocols_supported_ = supported; }
+  motor_protocol_t motor_protocol() const { return motor_protocol_; }
+  uint8_t motor_mask() const { return motor_mask_; }
+  const float *motor_values() const { return motor_values_; }
+  uint32_t motor_write_count() const { return motor_write_count_; }
+  const float *pwm_values() const { return pwm_values_; }
+  uint32_t pwm_write_count() const { return pwm_write_count_; }
 
 };
 
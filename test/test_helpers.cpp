@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <gtest/gtest.h>
+
+#include "test_helpers.h"
+
+namespace rosflight_firmware
+{
+
+void step_firmware(ROSflight& rf, testBoard& board, uint32_t us, GyroSignal gyro_signal)
+{
+  uint64_t start_time_us = board.clock_micros();
+  float acc[3] = {0, 0, -9.80665f};
+  float gyro[3] = {0, 0, 0};
+  while (board.clock_micros() < start_time_us + us)
+  {
+    if (gyro_signal)
+      gyro_signal(board.clock_micros(), gyro);
+    board.set_imu(acc, gyro, board.clock_micros() + 1000);
+    rf.run();
+  }
+}
+
+void arm_quad_x(ROSflight& rf)
+{
+  rf.params_.set_param_int(PARAM_MIXER, Mixer::QUADCOPTER_X);
+  rf.params_.set_param_int(PARAM_CALIBRATE_GYRO_ON_ARM, false);
+  rf.state_manager_.clear_error(rf.state_manager_.state().error_codes);
+  rf.state_manager_.set_event(StateManager::EVENT_REQUEST_ARM);
+  ASSERT_TRUE(rf.state_manager_.state().armed);
+}
+
+} // namespace rosflight_firmware
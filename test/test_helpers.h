@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ROSFLIGHT_FIRMWARE_TEST_HELPERS_H
+#define ROSFLIGHT_FIRMWARE_TEST_HELPERS_H
+
+#include <stdint.h>
+
+#include "rosflight.h"
+#include "test_board.h"
+
+namespace rosflight_firmware
+{
+
+// The gyro reading (rad/s) at a time, for step_firmware
+typedef void (*GyroSignal)(uint64_t time_us, float gyro[3]);
+
+/**
+ * @brief Run the full firmware with a 1 kHz IMU sitting level
+ * @param us How long to run for
+ * @param gyro_signal The gyro readings, or nullptr to hold the gyro at zero
+ */
+void step_firmware(ROSflight& rf, testBoard& board, uint32_t us, GyroSignal gyro_signal = nullptr);
+
+// Arm a quadcopter X without waiting for the RC or a gyro calibration
+void arm_quad_x(ROSflight& rf);
+
+} // namespace rosflight_firmware
+
+#endif // ROSFLIGHT_FIRMWARE_TEST_HELPERS_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2017, James Jackson and Daniel Koch, BYU MAGICC Lab
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the copyright holder nor the names of its
+ *   contributors may be used to endorse or promote products derived from
+ *   this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "common.h"
+
+#include <cstdlib>
+
+#include "timesync.h"
+
+using namespace rosflight_firmware;
+
+namespace
+{
+
+// A host clock running 40 ppm fast, set to an epoch time
+const uint64_t HOST_EPOCH_US = 1500000000000000ull;
+const double HOST_SKEW = 40e-6;
+
+uint64_t host_time_us(uint64_t local_us, int64_t step_us = 0)
+{
+  return HOST_EPOCH_US + static_cast<uint64_t>(static_cast<double>(local_us) * (1.0 + HOST_SKEW)) + step_us;
+}
+
+// Deterministic link delays of 150-210 us each way, with every 20th round trip held up 5 ms in a queue
+class Link
+{
+public:
+  uint32_t delay_us(uint32_t trip)
+  {
+    seed_ = seed_ * 1103515245u + 12345u;
+    uint32_t delay = 150 + (seed_ >> 16) % 61;
+    if (trip % 20 == 19)
+      delay += 5000;
+    return delay;
+  }
+
+private:
+  uint32_t seed_ = 1;
+};
+
+void run_round_trips(TimeSync& sync, Link& link, uint64_t& local_us, uint32_t trips, int64_t host_step_us = 0)
+{
+  for (uint32_t i = 0; i < trips; i++)
+  {
+    local_us += 100000;
+    uint64_t host_us = host_time_us(local_us + link.delay_us(i), host_step_us);
+    uint64_t receive_us = local_us + 2*link.delay_us(i);
+    sync.add_round_trip(local_us, host_us, receive_us);
+  }
+}
+
+} // namespace
+
+TEST(timesync_test, passes_local_time_through_until_synced)
+{
+  TimeSync sync;
+  EXPECT_FALSE(sync.synced());
+  EXPECT_EQ(sync.to_host_us(123456u), 123456u);
+
+  Link link;
+  uint64_t local_us = 0;
+  run_round_trips(sync, link, local_us, TimeSync::MIN_SAMPLES - 1);
+  EXPECT_FALSE(sync.synced());
+  run_round_trips(sync, link, local_us, 1);
+  EXPECT_TRUE(sync.synced());
+}
+
+TEST(timesync_test, tracks_offset_and_skew)
+{
+  TimeSync sync;
+  Link link;
+  uint64_t local_us = 0;
+  run_round_trips(sync, link, local_us, 1200); // two minutes at 10 Hz
+
+  EXPECT_NEAR(sync.skew(), HOST_SKEW, 3e-6);
+  EXPECT_GT(sync.rejected(), 50u);
+
+  // between round trips, and 50 ms past the last one
+  for (uint64_t t : {local_us - 50000, local_us, local_us + 50000})
+  {
+    int64_t error_us = static_cast<int64_t>(sync.to_host_us(t) - host_time_us(t));
+    EXPECT_LT(std::abs(error_us), 50) << "at " << t;
+  }
+}
+
+TEST(timesync_test, steps_the_offset_when_the_host_clock_is_set)
+{
+  TimeSync sync;
+  Link link;
+  uint64_t local_us = 0;
+  run_round_trips(sync, link, local_us, 600);
+
+  // the first round trip after the step moves the offset, without passing board time through
+  run_round_trips(sync, link, local_us, 1, 2000000);
+  EXPECT_TRUE(sync.synced());
+  EXPECT_EQ(sync.resyncs(), 1u);
+  int64_t step_error_us = static_cast<int64_t>(sync.to_host_us(local_us) - host_time_us(local_us, 2000000));
+  EXPECT_LT(std::abs(step_error_us), 200);
+
+  run_round_trips(sync, link, local_us, 50, 2000000);
+  EXPECT_EQ(sync.resyncs(), 1u);
+  int64_t error_us = static_cast<int64_t>(sync.to_host_us(local_us) - host_time_us(local_us, 2000000));
+  EXPECT_LT(std::abs(error_us), 100);
+}
@@ -34,6 +34,8 @@
 #include "math.h"
 #include "common.h"
 #include <stdio.h>
+#include <algorithm>
+#include <cmath>
 
 turbomath::Vector random_vectors[25] = {
   turbomath::Vector(-0.0376278050814 , 0.471775699711 , -0.336572370974 ),
@@ -130,6 +132,48 @@ TEST(turbotrig_test, asin_test) {
   }
 }
 
+template <turbomath::precision_t P>
+struct trig_errors
+{
+  double sin, cos, atan, atan2, asin;
+
+  trig_errors() : sin(0), cos(0), atan(0), atan2(0), asin(0)
+  {
+    for (float x = -2.0f*M_PI; x <= 2.0f*M_PI; x += 0.0001f)
+    {
+      sin = std::max(sin, std::fabs(turbomath::sin<P>(x) - std::sin(static_cast<double>(x))));
+      cos = std::max(cos, std::fabs(turbomath::cos<P>(x) - std::cos(static_cast<double>(x))));
+    }
+    for (float x = -50.0f; x <= 50.0f; x += 0.001f)
+      atan = std::max(atan, std::fabs(turbomath::atan<P>(x) - std::atan(static_cast<double>(x))));
+    for (float y = -10.0f; y <= 10.0f; y += 0.1f)
+      for (float x = -1.0f; x <= 1.0f; x += 0.01f)
+        atan2 = std::max(atan2, std::fabs(turbomath::atan2<P>(y, x) - std::atan2(static_cast<double>(y), static_cast<double>(x))));
+    for (float x = -1.0f; x <= 1.0f; x += 0.0001f)
+      asin = std::max(asin, std::fabs(turbomath::asin<P>(x) - std::asin(static_cast<double>(x))));
+  }
+};
+
+TEST(turbotrig_test, fine_table_precision_test)
+{
+  trig_errors<turbomath::PRECISION_FINE_TABLE> errors;
+  EXPECT_LE(errors.sin, 5e-6);
+  EXPECT_LE(errors.cos, 5e-6);
+  EXPECT_LE(errors.atan, 5e-6);
+  EXPECT_LE(errors.atan2, 5e-6);
+  EXPECT_LE(errors.asin, 5e-6);
+}
+
+TEST(turbotrig_test, polynomial_precision_test)
+{
+  trig_errors<turbomath::PRECISION_POLYNOMIAL> errors;
+  EXPECT_LE(errors.sin, 3e-7);
+  EXPECT_LE(errors.cos, 3e-7);
+  EXPECT_LE(errors.atan, 5e-7);
+  EXPECT_LE(errors.atan2, 1e-6);
+  EXPECT_LE(errors.asin, 5e-7);
+}
+
 TEST(turbotrig_test, fast_alt_test) {
 
   //out of bounds
@@ -288,3 +332,34 @@ TEST(turbovec_test, quat_from_two_vectors_test){
   }
 }
 
+
+TEST(turbovec_test, fused_kernels_test)
+{
+  for (int i = 0; i < 23; i++)
+  {
+    turbomath::Vector u = random_vectors[i];
+    turbomath::Vector v = random_vectors[i + 1];
+    turbomath::Vector w = random_vectors[i + 2];
+    float a = u.x, b = v.y, c = w.z;
+
+    turbomath::Vector y = v;
+    turbomath::axpy(a, u, y);
+    EXPECT_VEC3_SUPERCLOSE(y, Eigen::Vector3f(v.x + a*u.x, v.y + a*u.y, v.z + a*u.z));
+
+    y = v;
+    turbomath::axpby(a, u, b, y);
+    turbomath::Vector expected = u*a + v*b;
+    EXPECT_VEC3_SUPERCLOSE(y, Eigen::Vector3f(expected.x, expected.y, expected.z));
+
+    expected = u*a + v*b + w*c;
+    y = turbomath::lincomb(a, u, b, v, c, w);
+    EXPECT_VEC3_SUPERCLOSE(y, Eigen::Vector3f(expected.x, expected.y, expected.z));
+
+    // un-normalized inputs, so the product has to be renormalized
+    turbomath::Quaternion q = random_quaternions[i + 1];
+    turbomath::Quaternion step = turbomath::propagate_normalize(q, u, a, b);
+    turbomath::Quaternion step_expected = (turbomath::Quaternion(a, b*u.x, b*u.y, b*u.z)*q).normalize();
+    ASSERT_TURBOQUAT_SUPERCLOSE(step, step_expected);
+    EXPECT_GE(step.w, 0.0f);
+  }
+}